@@ -1,34 +1,41 @@
 import os
 import sys
 import re
-import glob
+import json
+import hashlib
 import fnmatch
 
 CURR_DIR = os.path.dirname(os.path.realpath(__file__))
+sys.path.insert(0, os.path.join(CURR_DIR, '..'))
+import nid_db
+
 DEF_FILE = 'definitions.dox'
 DEF_FILE_PATH = os.path.join(CURR_DIR, '..', 'docs', DEF_FILE)
-DB_FILE_PATH = os.path.join(CURR_DIR, '..', 'db', '360', '*.yml')
+DB_DIR_PATH = os.path.join(CURR_DIR, '..', 'db', '360')
 INCLUDE_DIR = os.path.join(CURR_DIR, '..', 'include')
+CACHE_FILE_PATH = os.environ.get('DEFINITION_CHECK_CACHE',
+    os.path.join(CURR_DIR, '..', '.definition_check_cache.json'))
+CACHE_VERSION = 1
 
 DEFINE_RULE = re.compile(r' \*     \\defgroup (Sce\w+) \w+')
 USER_GROUP_RULE = re.compile(r' \* \\(user|kernel)group\{(Sce\w+)\}')
 
 FUNC_RULE_PATTERN = (
     # ret
-    '^\w+\s+' +
+    r'^\w+\s+' +
     # func name
-    '(_*k?sce\w+|__\w+)' +
+    r'(_*k?sce\w+|__\w+)' +
     # args; if define with multiline, end with comma, if not end with `);`
-    '\(.*(,|\);)' +
+    r'\(.*(,|\);)' +
     # white spaces
-    '\s*$'
+    r'\s*$'
 )
 FUNCTION_RULE = re.compile(FUNC_RULE_PATTERN)
 IGNORE_FILES = [
     'vitasdk.h',
     'vitasdkkern.h',
-    'vitasdk/utils.h',
-    'vitasdk/build_utils.h',
+    # vitasdk helpers, not part of any SCE library
+    'vitasdk/*.h',
 ]
 
 # older python's glob not support `**`
@@ -37,22 +44,12 @@ def findfile(directory, filepattern):
     for root, dirnames, filenames in os.walk(directory):
         for filename in fnmatch.filter(filenames, filepattern):
             matches.append(os.path.join(root, filename))
-    return matches
-
-def readlines(f):
-    if sys.version_info.major < 3:
-        return f.xreadlines()
-    return f
-
-def dict_items(dic):
-    if sys.version_info.major < 3:
-        return dic.iteritems()
-    return dic.items()
+    return sorted(matches)
 
 def read_def_groups():
     definitions = dict()
     with open(DEF_FILE_PATH, 'r') as d:
-        for line in readlines(d):
+        for line in d:
             m = DEFINE_RULE.match(line)
             if not m:
                 continue
@@ -60,95 +57,156 @@ def read_def_groups():
     return definitions
 
 def read_nids():
-    errors = []
-    user_nids = dict()
-    kernel_nids = dict()
-    nids = None
-    for fn in glob.glob(DB_FILE_PATH):
-        with open(fn, 'r') as d:
-            SECTION = None
-            for line_no, line in enumerate(readlines(d)):
-                line = line.strip()
-                k, v = line.split(':')[:3]
-                if k[0] == "#": # It a comment
-                    continue
-                if not v.strip():
-                    SECTION = k
-                    continue
-                if k.strip() == 'kernel':
-                    if v.strip() == 'true':
-                        nids = kernel_nids
-                    else:
-                        nids = user_nids
-                if SECTION != 'functions':
-                    continue
-                # Same name is now handled by vita-nid-check
-                # if nids.get(k):
-                #     errors.append('%s: NID conflict %s' % (line_no + 1, k))
-                nids[k] = 1
-    return dict(user_nids, **kernel_nids), errors
-
-def check_header_groups(definitions):
+    nids = dict()
+    for fn, _, _, _, lib in nid_db.iter_libraries(nid_db.load_dir(DB_DIR_PATH)):
+        # Same name is now handled by vita-nid-check
+        nids.update(lib.get('functions', dict()))
+    return nids
+
+def file_sha1(path):
+    with open(path, 'rb') as h:
+        return hashlib.sha1(h.read()).hexdigest()
+
+def scan_header(header_path):
+    """Collect the group tags and the function names of a header in one pass."""
+    groups = []
+    functions = []
+    with open(header_path, 'rb') as h:
+        data = h.read()
+    for line in data.decode('utf-8', 'replace').splitlines():
+        m = USER_GROUP_RULE.match(line)
+        if m:
+            groups.append(m.group(2))
+            continue
+        m = FUNCTION_RULE.match(line)
+        if m:
+            functions.append(m.group(1))
+    return {
+        'sha1': hashlib.sha1(data).hexdigest(),
+        'groups': groups,
+        'functions': functions,
+    }
+
+def load_cache():
+    try:
+        with open(CACHE_FILE_PATH, 'r') as f:
+            cache = json.load(f)
+        if cache.get('version') == CACHE_VERSION:
+            return cache['headers']
+    except (IOError, ValueError, KeyError):
+        pass
+    return dict()
+
+def save_cache(headers):
+    try:
+        with open(CACHE_FILE_PATH + '.tmp', 'w') as f:
+            json.dump({'version': CACHE_VERSION, 'headers': headers}, f)
+        os.replace(CACHE_FILE_PATH + '.tmp', CACHE_FILE_PATH)
+    except (IOError, OSError):
+        pass
+
+def scan_headers(use_cache=True):
+    """Return {header: scan result}, only rescanning the modified headers."""
+    cache = load_cache() if use_cache else dict()
+    headers = dict()
+    stale = []
+    dirty = len(cache) == 0
+    for header_path in findfile(INCLUDE_DIR, '*.h'):
+        header_file = header_path.split('include' + os.sep)[1].replace(os.sep, '/')
+        if any(fnmatch.fnmatch(header_file, p) for p in IGNORE_FILES):
+            continue
+        st = os.stat(header_path)
+        entry = cache.get(header_file)
+        # A touched but unmodified header (e.g. after a checkout) keeps its
+        # previous results.
+        if entry and (entry['mtime'] == st.st_mtime_ns
+                      or entry['sha1'] == file_sha1(header_path)) \
+                 and entry['size'] == st.st_size:
+            dirty = dirty or entry['mtime'] != st.st_mtime_ns
+            entry['mtime'] = st.st_mtime_ns
+            headers[header_file] = entry
+        else:
+            stale.append((header_file, header_path, st))
+
+    if len(stale) > 1:
+        from concurrent.futures import ProcessPoolExecutor
+        with ProcessPoolExecutor() as pool:
+            results = list(pool.map(scan_header, [s[1] for s in stale],
+                                    chunksize=16))
+    else:
+        results = [scan_header(s[1]) for s in stale]
+
+    for (header_file, _, st), result in zip(stale, results):
+        result['mtime'] = st.st_mtime_ns
+        result['size'] = st.st_size
+        headers[header_file] = result
+
+    if use_cache and (dirty or stale or len(headers) != len(cache)):
+        save_cache(headers)
+    return headers
+
+def check_header_groups(headers, definitions):
     errors = []
     # check exists in definitions
-    for header_path in findfile(INCLUDE_DIR, '*.h'):
-        header_file = header_path.split('include/')[1]
-        if header_file in IGNORE_FILES:
+    for header_file in sorted(headers):
+        groups = headers[header_file]['groups']
+        if not groups:
+            errors.append('%s: Could not find definition' % header_file)
             continue
-        with open(header_path, 'r') as h:
-            have_group_define = False
-            for line in readlines(h):
-                m = USER_GROUP_RULE.match(line)
-                if not m:
-                    continue
-                if have_group_define:
-                    errors.append('%s: Has multiple groups' % header_file)
-                    break
-                group = m.group(2)
-                if definitions.get(group) == None:
-                    errors.append('%s: Unknown group %s' %
-                                  (header_file, m.group(2)))
-                    break
-                definitions[group] += 1
-                have_group_define = True
-            if not have_group_define:
-                errors.append('%s: Could not find definition' % header_file)
+        group = groups[0]
+        if definitions.get(group) == None:
+            errors.append('%s: Unknown group %s' % (header_file, group))
+            errors.append('%s: Could not find definition' % header_file)
+            continue
+        definitions[group] += 1
+        if len(groups) > 1:
+            errors.append('%s: Has multiple groups' % header_file)
     # reverse check if exist header
-    for k, v in dict_items(definitions):
+    for k, v in sorted(definitions.items()):
         if v == 0:
             errors.append('%s: Could not find using header: %s' %
                           (DEF_FILE, k))
     return errors
 
-def check_function_nids(nids):
+def check_function_nids(headers, nids):
     errors = []
     functions = dict()
-    for header_path in findfile(INCLUDE_DIR, '*.h'):
-        header_file = header_path.split('include/')[1]
-        if header_file in IGNORE_FILES:
-            continue
-        with open(header_path, 'r') as h:
-            have_group_define = False
-            for line in readlines(h):
-                m = FUNCTION_RULE.match(line)
-                if not m:
-                    continue
-                fn = m.group(1)
-                if functions.get(fn):
-                    errors.append('%s: Already defined %s' %
-                                  (header_file, fn))
-                    continue
-                if not nids.get(fn):
-                    errors.append('%s: Could not find NID %s' %
-                                  (header_file, fn))
-                functions[fn] = 1
+    for header_file in sorted(headers):
+        for fn in headers[header_file]['functions']:
+            if functions.get(fn):
+                errors.append('%s: Already defined %s' %
+                              (header_file, fn))
+                continue
+            if fn not in nids:
+                errors.append('%s: Could not find NID %s' %
+                              (header_file, fn))
+            functions[fn] = 1
     return errors
 
 if __name__ == '__main__':
-    nids, errors = read_nids()
-    errors += check_header_groups(read_def_groups()) \
-        + check_function_nids(nids)
-    if len(errors):
+    import argparse
+
+    parser = argparse.ArgumentParser(description='Check header groups and function NIDs.')
+    parser.add_argument('--json', action='store_true',
+                        help='print the results as JSON')
+    parser.add_argument('--no-cache', action='store_true',
+                        help='rescan every header')
+    args = parser.parse_args()
+
+    headers = scan_headers(use_cache=not args.no_cache)
+    group_errors = check_header_groups(headers, read_def_groups())
+    nid_errors = check_function_nids(headers, read_nids())
+    errors = group_errors + nid_errors
+
+    if args.json:
+        json.dump({
+            'headers': len(headers),
+            'groups': group_errors,
+            'nids': nid_errors,
+        }, sys.stdout, indent=2)
+        sys.stdout.write('\n')
+    else:
         for e in errors:
             print(e)
+    if len(errors):
         sys.exit(1)
@@ -1,8 +1,12 @@
 import os
 import glob
+import json
+import time
+import hashlib
 
 
 DEFAULT_BUILD_OUTDIR = 'build'
+BUILD_CACHE_FILE = '.build_cache.json'
 CURR_DIR = os.path.dirname(os.path.realpath(__file__))
 
 def execute(cmd, force_print=False):
@@ -12,27 +16,26 @@ def execute(cmd, force_print=False):
                 print(line)
         return r.close()
 
+def vita_libs_gen_cmd():
+    return os.environ.get('VITA_LIBS_GEN', 'vita-libs-gen')
+
 def vita_libs_gen(yml, out):
-    cmd = os.environ.get('VITA_LIBS_GEN', 'vita-libs-gen')
+    cmd = vita_libs_gen_cmd()
     if execute('{} {} {}'.format(cmd, yml, out)):
         raise SystemExit(10)
 
-def make(target):
-    curr = os.getcwd()
-    os.chdir(target)
+# make() and make_install() may run from several worker threads at once, so
+# they must not touch the process wide working directory.
+def make(target, jobs=''):
     arch = os.environ.get('ARCH', '')
     if arch:
         arch = 'ARCH={}'.format(arch)
-    if execute('make -j {}'.format(arch)):
+    if execute('cd "{}" && make -j{} {}'.format(target, jobs, arch)):
         raise SystemExit(11)
-    os.chdir(curr)
 
 def make_install(target):
-    curr = os.getcwd()
-    os.chdir(target)
-    if execute('make install'):
+    if execute('cd "{}" && make install'.format(target)):
         raise SystemExit(12)
-    os.chdir(curr)
 
 def definition_check():
     return execute('python .travis.d/definition_check.py', force_print=True)
@@ -40,9 +43,92 @@ def definition_check():
 def definition_ordering(yml):
     return execute('bash .travis.d/definition_ordering.sh {}'.format(yml))
 
+def build_jobs():
+    jobs = os.environ.get('JOBS')
+    if jobs:
+        return max(1, int(jobs))
+    return os.cpu_count() or 1
+
+def collect_targets(outdir):
+    targets = []
+    for yml in glob.glob(os.path.join(CURR_DIR, 'db', '**', '*.yml')):
+        dirs, fn = (os.path.split(yml))
+        _, ver = os.path.split(dirs)
+        targets.append((ver, fn, yml, os.path.join(outdir, ver, fn)))
+    # The stubs of a newer firmware must be installed after the older ones
+    # so that they take precedence, hence the stable (version, file) order.
+    return sorted(targets, key=lambda t: (t[0], t[1]))
+
+def file_hash(path, h=None):
+    h = h or hashlib.sha256()
+    with open(path, 'rb') as f:
+        for chunk in iter(lambda: f.read(1 << 16), b''):
+            h.update(chunk)
+    return h
+
+def generator_hash():
+    import shutil
+
+    # There is no reliable version switch on vita-libs-gen, so the binary
+    # itself stands for its version.
+    cmd = vita_libs_gen_cmd()
+    path = shutil.which(cmd)
+    if not path:
+        return hashlib.sha256(cmd.encode()).hexdigest()
+    return file_hash(path).hexdigest()
+
+def module_hash(yml, gen_hash):
+    h = hashlib.sha256(gen_hash.encode())
+    return file_hash(yml, h).hexdigest()
+
+def load_build_cache(outdir):
+    if os.environ.get('FORCE_REBUILD'):
+        return dict()
+    try:
+        with open(os.path.join(outdir, BUILD_CACHE_FILE), 'r') as f:
+            return json.load(f)
+    except (IOError, ValueError):
+        return dict()
+
+def save_build_cache(outdir, cache):
+    path = os.path.join(outdir, BUILD_CACHE_FILE)
+    with open(path + '.tmp', 'w') as f:
+        json.dump(cache, f, indent=1, sort_keys=True)
+    os.replace(path + '.tmp', path)
+
+def build_target(yml, target, make_jobs):
+    import shutil
+
+    if os.path.exists(target):
+        shutil.rmtree(target)
+    os.makedirs(target)
+
+    start = time.time()
+    vita_libs_gen(yml, target)
+    generated = time.time()
+    make(target, make_jobs)
+    return generated - start, time.time() - generated
+
+def build_all(targets, jobs):
+    from concurrent.futures import ThreadPoolExecutor
+
+    # Each module already gets one core when building several at once,
+    # keep the nested make from oversubscribing the machine.
+    make_jobs = '' if jobs == 1 else '1'
+    with ThreadPoolExecutor(max_workers=jobs) as pool:
+        futures = [(ver, fn, pool.submit(build_target, yml, target, make_jobs))
+                   for ver, fn, yml, target in targets]
+        timings = []
+        for ver, fn, future in futures:
+            gen_time, make_time = future.result()
+            timings.append((ver, fn, gen_time, make_time))
+            if os.environ.get('VERBOSE') or os.environ.get('TIMING'):
+                print('{}/{}: gen {:.2f}s, make {:.2f}s'.format(
+                    ver, fn, gen_time, make_time))
+    return timings
+
 if __name__ == '__main__':
     import sys
-    import shutil
 
 
     outdir = DEFAULT_BUILD_OUTDIR
@@ -59,14 +145,43 @@ if __name__ == '__main__':
         #         raise SystemExit(2)
 
     if not os.environ.get('BYPASS_VITA_LIBS_GEN'):
-        for yml in glob.glob(os.path.join(CURR_DIR, 'db', '**', '*.yml')):
-            dirs, fn = (os.path.split(yml))
-            _, ver = os.path.split(dirs)
-            build_target = os.path.join(outdir, ver, fn)
-            if os.path.exists(build_target):
-                shutil.rmtree(build_target)
-            os.makedirs(build_target)
-            vita_libs_gen(yml, build_target)
-            make(build_target)
-            if not os.environ.get('BYPASS_INSTALL'):
-                make_install(build_target)
+        targets = collect_targets(outdir)
+        jobs = build_jobs()
+
+        # Only the modules whose yml (or generator) changed since the last
+        # run are regenerated, rebuilt and reinstalled.
+        cache = load_build_cache(outdir)
+        gen_hash = generator_hash()
+        hashes = dict()
+        stale = []
+        for ver, fn, yml, target in targets:
+            key = '{}/{}'.format(ver, fn)
+            hashes[key] = module_hash(yml, gen_hash)
+            entry = cache.get(key, dict())
+            if entry.get('hash') != hashes[key] or not os.path.exists(target):
+                cache.pop(key, None)
+                stale.append((ver, fn, yml, target))
+
+        start = time.time()
+        timings = build_all(stale, jobs)
+        if os.environ.get('TIMING'):
+            print('built {} of {} modules with {} jobs in {:.2f}s'.format(
+                len(timings), len(targets), jobs, time.time() - start))
+
+        for ver, fn, _, _ in stale:
+            key = '{}/{}'.format(ver, fn)
+            cache[key] = {'hash': hashes[key], 'installed': False}
+
+        # Nothing is installed unless every module built successfully.
+        # Reinstalling an older firmware module overwrites the stubs of the
+        # newer ones sharing its file name, so those are reinstalled too.
+        if not os.environ.get('BYPASS_INSTALL'):
+            reinstalled = set()
+            for ver, fn, _, target in targets:
+                entry = cache['{}/{}'.format(ver, fn)]
+                if not entry['installed'] or fn in reinstalled:
+                    make_install(target)
+                    entry['installed'] = True
+                    reinstalled.add(fn)
+
+        save_build_cache(outdir, cache)
@@ -0,0 +1,200 @@
+/*
+ * Test and benchmark of the vitasdk/arena.h allocators.
+ *
+ * usage: arena_bench [frames]
+ *
+ * Checks the alignment, marks and high water of the arena, the recycling of
+ * the frame allocator, the free list of the pool and the rejection of the
+ * sizes which overflow, then times a frame of small allocations of each
+ * allocator against malloc and free, the host counterpart of a general
+ * purpose heap such as a SceClibMspace.
+ */
+
+#include <string.h>
+#include <vitasdk/arena.h>
+
+#include "host_kernel.h"
+
+#define ALLOCS     (1000)
+#define BLOCK_SIZE (24)
+
+static void *ptrs[ALLOCS];
+
+/* Keep the compiler from dropping the allocations */
+static void use(void)
+{
+	__asm__ volatile("" : : "r"(ptrs) : "memory");
+}
+
+static void check_arena(void)
+{
+	VitasdkArena arena;
+	SceSize mark;
+	char *a, *b;
+
+	HOST_CHECK(vitasdk_arena_create(&arena, "ArenaBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, 100000) == 0);
+	HOST_CHECK(arena.size == 0x19000);
+	a = vitasdk_arena_alloc(&arena, 3, 1);
+	b = vitasdk_arena_alloc(&arena, 16, 16);
+	HOST_CHECK(((uintptr_t)b & 15) == 0 && b >= a + 3);
+	mark = vitasdk_arena_mark(&arena);
+	HOST_CHECK(vitasdk_arena_alloc_default(&arena, 1000) != NULL);
+	vitasdk_arena_release(&arena, mark);
+	HOST_CHECK(arena.used == mark && arena.high_water == mark + 1000);
+	HOST_CHECK(vitasdk_arena_alloc(&arena, arena.size, 1) == NULL);
+	HOST_CHECK(vitasdk_arena_alloc(&arena, arena.size - arena.used, 1) != NULL);
+	HOST_CHECK(vitasdk_arena_alloc(&arena, 1, 1) == NULL);
+	HOST_CHECK(vitasdk_arena_delete(&arena) == 0);
+}
+
+static void check_frame_allocator(void)
+{
+	VitasdkFrameAllocator frame;
+	char *f0, *f1, *f2;
+
+	HOST_CHECK(vitasdk_frame_allocator_create(&frame, "ArenaBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_CDRAM_RW, 1000) == 0);
+	HOST_CHECK(frame.arenas[0].size == 0x20000);
+	f0 = vitasdk_frame_allocator_alloc(&frame, 64, 8);
+	vitasdk_frame_allocator_flip(&frame);
+	f1 = vitasdk_frame_allocator_alloc(&frame, 128, 8);
+	vitasdk_frame_allocator_flip(&frame);
+	f2 = vitasdk_frame_allocator_alloc(&frame, 64, 8);
+	HOST_CHECK(f0 == f2 && f1 != f0);
+	HOST_CHECK(vitasdk_frame_allocator_high_water(&frame) == 128);
+	HOST_CHECK(vitasdk_frame_allocator_delete(&frame) == 0);
+}
+
+static void check_pool(void)
+{
+	VitasdkPool pool;
+	SceUInt32 i;
+
+	HOST_CHECK(vitasdk_pool_create(&pool, "ArenaBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, BLOCK_SIZE, ALLOCS) == 0);
+	HOST_CHECK(vitasdk_pool_capacity(&pool) == 0x6000 / BLOCK_SIZE);
+	for (i = 0; i < vitasdk_pool_capacity(&pool); i++)
+		HOST_CHECK(vitasdk_pool_alloc(&pool) != NULL);
+	HOST_CHECK(vitasdk_pool_alloc(&pool) == NULL);
+	vitasdk_pool_reset(&pool);
+	for (i = 0; i < ALLOCS; i++) {
+		ptrs[i] = vitasdk_pool_alloc(&pool);
+		memset(ptrs[i], (int)i, BLOCK_SIZE);
+	}
+	for (i = 0; i < ALLOCS; i += 2)
+		vitasdk_pool_free(&pool, ptrs[i]);
+	/* Freed blocks are reused first, the others are untouched */
+	for (i = 0; i < ALLOCS; i += 2)
+		HOST_CHECK(vitasdk_pool_alloc(&pool) == ptrs[ALLOCS - 2 - i]);
+	for (i = 1; i < ALLOCS; i += 2)
+		HOST_CHECK(((unsigned char *)ptrs[i])[BLOCK_SIZE - 1] == (unsigned char)i);
+	HOST_CHECK(pool.used == ALLOCS && pool.high_water == vitasdk_pool_capacity(&pool));
+	HOST_CHECK(vitasdk_pool_delete(&pool) == 0);
+}
+
+static void report(const char *what, SceUInt32 frames, double elapsed)
+{
+	printf("%-22s %6.2f ns per allocation\n", what, elapsed / ((double)frames * ALLOCS) * 1e9);
+}
+
+static void bench(SceUInt32 frames)
+{
+	VitasdkArena arena;
+	VitasdkFrameAllocator frame;
+	VitasdkPool pool;
+	SceUInt32 f, i;
+	double start;
+
+	HOST_CHECK(vitasdk_arena_create(&arena, "ArenaBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, ALLOCS * 64) == 0);
+	HOST_CHECK(vitasdk_frame_allocator_create(&frame, "ArenaBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, ALLOCS * 64) == 0);
+	HOST_CHECK(vitasdk_pool_create(&pool, "ArenaBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, BLOCK_SIZE, ALLOCS) == 0);
+
+	/* Sizes of 8 to 64 bytes, all freed at the end of the frame */
+	start = host_seconds();
+	for (f = 0; f < frames; f++) {
+		vitasdk_arena_reset(&arena);
+		for (i = 0; i < ALLOCS; i++)
+			ptrs[i] = vitasdk_arena_alloc_default(&arena, 8 + (i & 7) * 8);
+		use();
+	}
+	report("arena", frames, host_seconds() - start);
+
+	start = host_seconds();
+	for (f = 0; f < frames; f++) {
+		vitasdk_frame_allocator_flip(&frame);
+		for (i = 0; i < ALLOCS; i++)
+			ptrs[i] = vitasdk_frame_allocator_alloc(&frame, 8 + (i & 7) * 8, 16);
+		use();
+	}
+	report("frame allocator", frames, host_seconds() - start);
+
+	start = host_seconds();
+	for (f = 0; f < frames; f++) {
+		for (i = 0; i < ALLOCS; i++)
+			ptrs[i] = malloc(8 + (i & 7) * 8);
+		use();
+		for (i = 0; i < ALLOCS; i++)
+			free(ptrs[i]);
+	}
+	report("malloc + free", frames, host_seconds() - start);
+
+	/* Fixed-size blocks freed one by one */
+	start = host_seconds();
+	for (f = 0; f < frames; f++) {
+		for (i = 0; i < ALLOCS; i++)
+			ptrs[i] = vitasdk_pool_alloc(&pool);
+		use();
+		for (i = 0; i < ALLOCS; i++)
+			vitasdk_pool_free(&pool, ptrs[i]);
+	}
+	report("pool alloc + free", frames, host_seconds() - start);
+
+	start = host_seconds();
+	for (f = 0; f < frames; f++) {
+		for (i = 0; i < ALLOCS; i++)
+			ptrs[i] = malloc(BLOCK_SIZE);
+		use();
+		for (i = 0; i < ALLOCS; i++)
+			free(ptrs[i]);
+	}
+	report("malloc + free (pool)", frames, host_seconds() - start);
+
+	printf("high water: arena %u bytes, frame %u bytes, pool %u blocks\n", (unsigned)arena.high_water,
+	       (unsigned)vitasdk_frame_allocator_high_water(&frame), pool.high_water);
+	/* 36 bytes per allocation on average, padded to 40 by the 16 bytes alignment */
+	HOST_CHECK(arena.high_water == ALLOCS * 36 && vitasdk_frame_allocator_high_water(&frame) == ALLOCS * 40);
+	HOST_CHECK(pool.used == 0 && pool.high_water == ALLOCS);
+
+	HOST_CHECK(vitasdk_pool_delete(&pool) == 0);
+	HOST_CHECK(vitasdk_frame_allocator_delete(&frame) == 0);
+	HOST_CHECK(vitasdk_arena_delete(&arena) == 0);
+}
+
+/* Sizes whose rounding or product wraps around are rejected before any allocation */
+static void check_overflow(void)
+{
+	const int illegal = (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+	unsigned long calls = host_kernel_calls();
+	VitasdkFrameAllocator frame;
+	VitasdkArena arena;
+	VitasdkPool pool;
+
+	HOST_CHECK(vitasdk_arena_create(&arena, "ArenaBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, 0xFFFFF001) == illegal);
+	HOST_CHECK(vitasdk_frame_allocator_create(&frame, "ArenaBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, 0x80000000) == illegal);
+	HOST_CHECK(vitasdk_frame_allocator_create(&frame, "ArenaBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, 0x7FFFF801) == illegal);
+	HOST_CHECK(vitasdk_pool_create(&pool, "ArenaBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, 0xFFFFFFFC, 1) == illegal);
+	HOST_CHECK(vitasdk_pool_create(&pool, "ArenaBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, 24, 0x0AAAAAAB) == illegal);
+	HOST_CHECK(host_kernel_calls() == calls);
+}
+
+int main(int argc, char *argv[])
+{
+	SceUInt32 frames = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : 10000;
+
+	HOST_CHECK(frames > 0);
+	check_arena();
+	check_frame_allocator();
+	check_pool();
+	check_overflow();
+	bench(frames);
+	printf("ok\n");
+	return 0;
+}
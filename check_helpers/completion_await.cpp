@@ -0,0 +1,129 @@
+/*
+ * Test of the vitasdk/completion.h C++20 coroutine adapter.
+ *
+ * usage: completion_await
+ *
+ * Coroutines of the main thread await completions posted by another
+ * thread, several times each, and are resumed by completion_port_dispatch.
+ * A completion dispatched before it is awaited must not suspend its
+ * coroutine. Every completion must be released once the coroutines end.
+ */
+
+#include <coroutine>
+#include <psp2/kernel/threadmgr/msgpipe.h>
+#include <psp2/kernel/threadmgr/thread.h>
+#include <vitasdk/completion.h>
+
+#include "host_kernel.h"
+
+#define CAPACITY   (64)
+#define COROUTINES (50)
+#define AWAITS     (10)
+
+struct Task {
+	struct promise_type {
+		Task get_return_object() { return {}; }
+		std::suspend_never initial_suspend() { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() {}
+	};
+};
+
+struct Post {
+	VitasdkCompletion *c;
+	SceInt32 result;
+};
+
+static struct {
+	VitasdkCompletionPort port;
+	SceUID pipe;
+	VitasdkCompletion completions[CAPACITY];
+	long total;
+	SceUInt32 done;
+	SceUInt32 suspended;
+} await;
+
+/* Post the completions sent through the pipe, until a NULL one */
+static int poster(SceSize args, void *argp)
+{
+	Post post;
+
+	(void)args;
+	(void)argp;
+	for (;;) {
+		HOST_CHECK(sceKernelReceiveMsgPipe(await.pipe, &post, sizeof(post), 0, NULL, NULL) == 0);
+		if (!post.c)
+			return 0;
+		HOST_CHECK(vitasdk_completion_post(post.c, post.result) == 0);
+	}
+}
+
+static void post_later(VitasdkCompletion *c, SceInt32 result)
+{
+	Post post = { c, result };
+
+	HOST_CHECK(sceKernelSendMsgPipe(await.pipe, &post, sizeof(post), 0, NULL, NULL) == 0);
+}
+
+static Task awaiting(SceInt32 k)
+{
+	for (SceUInt32 i = 0; i < AWAITS; i++) {
+		VitasdkCompletion *c = vitasdk_completion_port_acquire(&await.port, NULL);
+
+		HOST_CHECK(c);
+		post_later(c, k);
+		await.suspended++;
+		await.total += co_await vitasdk::await_completion(c);
+		await.suspended--;
+	}
+	await.done++;
+}
+
+static Task ready(VitasdkCompletion *c)
+{
+	await.total += co_await vitasdk::await_completion(c);
+	await.done++;
+}
+
+int main()
+{
+	VitasdkCompletion *c;
+	SceUInt32 free_completions = 0;
+	SceUID thid;
+
+	HOST_CHECK(vitasdk_completion_port_create(&await.port, "CompletionAwait", await.completions, CAPACITY) == 0);
+	await.pipe = sceKernelCreateMsgPipe("CompletionAwait", 0x40, 0, 0x1000, NULL);
+	HOST_CHECK(await.pipe >= 0);
+	thid = sceKernelCreateThread("CompletionPoster", poster, 0x10000100, 0x4000, 0, 0, NULL);
+	HOST_CHECK(thid >= 0);
+	HOST_CHECK(sceKernelStartThread(thid, 0, NULL) == 0);
+
+	/* Posted and dispatched before the coroutine awaits it */
+	c = vitasdk_completion_port_acquire(&await.port, NULL);
+	HOST_CHECK(c);
+	HOST_CHECK(vitasdk_completion_post(c, 1000) == 0);
+	HOST_CHECK(vitasdk::completion_port_dispatch(&await.port) == 1);
+	ready(c);
+	HOST_CHECK(await.done == 1 && await.total == 1000);
+
+	await.done  = 0;
+	await.total = 0;
+	for (SceInt32 k = 1; k <= COROUTINES; k++)
+		awaiting(k);
+	while (await.done < COROUTINES)
+		HOST_CHECK(vitasdk::completion_port_dispatch(&await.port) > 0);
+	HOST_CHECK(await.suspended == 0);
+	post_later(NULL, 0);
+	HOST_CHECK(sceKernelWaitThreadEnd(thid, NULL, NULL) == 0);
+	sceKernelDeleteThread(thid);
+	HOST_CHECK(sceKernelDeleteMsgPipe(await.pipe) == 0);
+	HOST_CHECK(await.total == (long)AWAITS * COROUTINES * (COROUTINES + 1) / 2);
+
+	while ((c = vitasdk_completion_port_acquire(&await.port, NULL)))
+		free_completions++;
+	HOST_CHECK(free_completions == CAPACITY);
+	HOST_CHECK(vitasdk_completion_port_delete(&await.port) == 0);
+	printf("%u coroutines resumed %u times each\nok\n", COROUTINES, AWAITS);
+	return 0;
+}
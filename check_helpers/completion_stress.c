@@ -0,0 +1,172 @@
+/*
+ * Stress test of the vitasdk/completion.h completion ports.
+ *
+ * usage: completion_stress [posts]
+ *
+ * First a wait returning fewer completions than are ready must leave the
+ * others ready for the next waits, whether their group was already
+ * collected or not reached. Then 4 threads post completions from the 32
+ * groups of a port while the main thread alternates waits and polls of 64
+ * completions at most, and checks that every post comes back once with its
+ * result. The event flag calls per completion are the syscalls of the Vita.
+ */
+
+#include <string.h>
+#include <psp2/kernel/threadmgr/thread.h>
+#include <vitasdk/completion.h>
+
+#include "host_kernel.h"
+
+#define POSTS      (200000)
+#define POSTERS    (4)
+#define CAPACITY   (1000)
+#define READY_MAX  (64)
+#define TIMEOUT_US (1000000)
+
+static struct {
+	VitasdkCompletionPort port;
+	VitasdkCompletion completions[CAPACITY];
+	SceUInt32 posts;
+	unsigned char *seen;
+	volatile SceUInt32 start;
+	volatile SceUInt32 delays;   /* Of the posters waiting for a free completion */
+} stress;
+
+/* Acquire every completion, the port must have none left */
+static void check_all_free(void)
+{
+	VitasdkCompletion *c[CAPACITY];
+	SceUInt32 i;
+
+	for (i = 0; i < CAPACITY; i++) {
+		c[i] = vitasdk_completion_port_acquire(&stress.port, NULL);
+		HOST_CHECK(c[i]);
+	}
+	HOST_CHECK(vitasdk_completion_port_acquire(&stress.port, NULL) == NULL);
+	for (i = 0; i < CAPACITY; i++)
+		vitasdk_completion_port_release(c[i]);
+}
+
+static void check_requeue(void)
+{
+	static const SceUInt32 posted[] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, /* A full group */
+		33, 40, 63,                                                     /* A second one */
+		999                                                             /* The last one */
+	};
+	const SceUInt32 n = sizeof(posted) / sizeof(posted[0]);
+	VitasdkCompletion *c[CAPACITY], *ready[4];
+	SceUInt timeout;
+	SceUInt32 i, got = 0;
+	int res, j;
+
+	for (i = 0; i < CAPACITY; i++)
+		c[i] = vitasdk_completion_port_acquire(&stress.port, NULL);
+	for (i = 0; i < n; i++)
+		HOST_CHECK(vitasdk_completion_post(c[posted[i]], posted[i]) == 0);
+
+	memset(stress.seen, 0, CAPACITY);
+	while (got < n) {
+		/* A completion left pending without its bit would time out */
+		timeout = TIMEOUT_US;
+		res = vitasdk_completion_port_wait(&stress.port, ready, 4, &timeout);
+		HOST_CHECK(res > 0 && res <= 4);
+		for (j = 0; j < res; j++) {
+			HOST_CHECK(ready[j]->result == (SceInt32)ready[j]->index);
+			HOST_CHECK(!stress.seen[ready[j]->index]);
+			stress.seen[ready[j]->index] = 1;
+		}
+		got += res;
+	}
+	for (i = 0; i < n; i++)
+		HOST_CHECK(stress.seen[posted[i]]);
+	HOST_CHECK(vitasdk_completion_port_poll(&stress.port, ready, 4) == 0);
+
+	for (i = 0; i < CAPACITY; i++)
+		vitasdk_completion_port_release(c[i]);
+	check_all_free();
+}
+
+static int poster(SceSize args, void *argp)
+{
+	SceUInt32 i;
+	VitasdkCompletion *c;
+
+	(void)args;
+	while (!vitasdk_atomic_load_acquire32(&stress.start))
+		vitasdk_cpu_relax();
+	for (i = *(SceUInt32 *)argp; i < stress.posts; i += POSTERS) {
+		while (!(c = vitasdk_completion_port_acquire(&stress.port, (void *)(uintptr_t)i))) {
+			vitasdk_atomic_add32(&stress.delays, 1);
+			sceKernelDelayThread(0);
+		}
+		HOST_CHECK(vitasdk_completion_post(c, (SceInt32)i) == 0);
+	}
+	return 0;
+}
+
+static void run_posters(void)
+{
+	VitasdkCompletion *ready[READY_MAX];
+	SceUID thids[POSTERS];
+	SceUInt32 i, got = 0, waits = 0;
+	unsigned long calls;
+	SceUInt timeout;
+	double t;
+	int res, j;
+
+	stress.seen = realloc(stress.seen, stress.posts);
+	HOST_CHECK(stress.seen);
+	memset(stress.seen, 0, stress.posts);
+	for (i = 0; i < POSTERS; i++) {
+		thids[i] = sceKernelCreateThread("CompletionPoster", poster, 0x10000100, 0x4000, 0,
+		                                 SCE_KERNEL_CPU_MASK_USER_0 << (i % 3), NULL);
+		HOST_CHECK(thids[i] >= 0);
+		HOST_CHECK(sceKernelStartThread(thids[i], sizeof(i), &i) == 0);
+	}
+	calls = host_kernel_calls();
+	t     = host_seconds();
+	vitasdk_atomic_store_release32(&stress.start, 1);
+	while (got < stress.posts) {
+		timeout = TIMEOUT_US;
+		res = waits++ % 2 ? vitasdk_completion_port_poll(&stress.port, ready, READY_MAX)
+		                  : vitasdk_completion_port_wait(&stress.port, ready, READY_MAX, &timeout);
+		HOST_CHECK(res >= 0 && res <= READY_MAX);
+		for (j = 0; j < res; j++) {
+			i = (SceUInt32)(uintptr_t)ready[j]->user;
+			HOST_CHECK(i < stress.posts && ready[j]->result == (SceInt32)i);
+			HOST_CHECK(!stress.seen[i]);
+			stress.seen[i] = 1;
+			vitasdk_completion_port_release(ready[j]);
+		}
+		got += res;
+	}
+	t     = host_seconds() - t;
+	calls = host_kernel_calls() - calls - stress.delays;
+	for (i = 0; i < POSTERS; i++) {
+		HOST_CHECK(sceKernelWaitThreadEnd(thids[i], NULL, NULL) == 0);
+		sceKernelDeleteThread(thids[i]);
+	}
+	HOST_CHECK(vitasdk_completion_port_poll(&stress.port, ready, READY_MAX) == 0);
+	check_all_free();
+	printf("%u posts from %u threads in %.1f ms, %u waits and polls, %.3f syscalls per completion\n",
+	       stress.posts, POSTERS, t * 1000, waits, (double)calls / stress.posts);
+}
+
+int main(int argc, char *argv[])
+{
+	stress.posts = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : POSTS;
+	HOST_CHECK(stress.posts > 0);
+	stress.seen = malloc(CAPACITY);
+	HOST_CHECK(stress.seen);
+	HOST_CHECK(vitasdk_completion_port_create(&stress.port, "CompletionStress", stress.completions, CAPACITY) == 0);
+
+	check_requeue();
+	run_posters();
+
+	HOST_CHECK(vitasdk_completion_port_delete(&stress.port) == 0);
+	free(stress.seen);
+	printf("ok\n");
+	return 0;
+}
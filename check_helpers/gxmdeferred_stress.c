@@ -0,0 +1,357 @@
+/*
+ * Stress test of the vitasdk/gxmdeferred.h parallel recording, over GXM
+ * mocks and a simulated GPU.
+ *
+ * usage: gxmdeferred_stress [frames]
+ *
+ * Every frame, the sub-passes of a scene are recorded on the pool workers
+ * and the calling thread, each taking a random time so that they end out of
+ * order. A mocked deferred context must only ever be used by one thread. It
+ * writes the draws of a list and their vertex data into the ring memory of
+ * its callbacks, keeping the rest of a chunk for the next lists like GXM
+ * does. The lists are then executed on the immediate context, and the
+ * simulated GPU runs a frame once the next one is recorded: it must read
+ * every draw of every sub-pass in order. Each new frame checks that the
+ * ring memory of the lists the GPU did not run, and of the chunks the
+ * contexts still write to, is not recycled. The test also checks that a
+ * failed list fails the recording, and that a thread without a context
+ * gets an error instead of recording.
+ */
+
+#include <string.h>
+#include <vitasdk/gxmdeferred.h>
+
+#include "host_kernel.h"
+
+#define FRAMES     (500)
+#define PASSES     (24)
+#define PASS_DRAWS (300)
+#define RING_SIZE  (512 * 1024)
+
+/* Ring memory left from the last callback of a ring */
+typedef struct MockRing {
+	SceUInt32 *mem;
+	SceSize left;
+} MockRing;
+
+/* A mocked deferred context */
+typedef struct MockContext {
+	SceGxmDeferredContextParams params;
+	SceUInt32 owner;               /* The only thread recording on it */
+	volatile SceUInt32 recording;
+	MockRing vdm;                  /* The draws of the lists */
+	MockRing vertex;               /* The vertex data of the draws */
+	SceUInt32 pass;                /* The sub-pass of the list being recorded */
+	SceUInt32 count;
+} MockContext;
+
+/* A mocked command list, its memory is ring memory */
+typedef struct MockList {
+	SceGxmContext *context;
+	const SceUInt32 *draws;
+	const SceUInt32 *vertex_data[PASS_DRAWS];
+	SceUInt32 count;
+} MockList;
+
+static struct {
+	MockContext contexts[VITASDK_GXM_DEFERRED_MAX_CONTEXTS];
+	SceUInt32 context_count;
+	SceGxmContext *immediate;
+	/* Of the frame being recorded and of the one before */
+	MockList lists[2][PASSES];
+	const MockList *executed[2][PASSES];
+	SceUInt32 executed_count;
+	SceUInt32 frame;
+	SceUInt32 fail_pass;           /* End the list of this sub-pass with an error */
+} gxm;
+
+/* What a draw records, its sub-pass and frame */
+static SceUInt32 draw_word(SceUInt32 f, SceUInt32 pass, SceUInt32 d)
+{
+	return pass << 16 | (f % 0x40) << 10 | d;
+}
+
+static SceUInt32 random_next(SceUInt32 *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return *seed;
+}
+
+/* Take ring memory, the rest of a chunk is kept for the next requests */
+static SceUInt32 *ring_reserve(MockContext *c, MockRing *r, void *(*callback)(void *, SceSize, SceSize *), SceSize bytes)
+{
+	SceUInt32 *mem;
+	SceSize size;
+
+	if (r->left < bytes) {
+		r->mem = callback(c->params.callbackData, bytes, &size);
+		if (!r->mem) {
+			r->left = 0;
+			return NULL;
+		}
+		HOST_CHECK(size >= bytes && ((uintptr_t)r->mem & 15) == 0);
+		r->left = size;
+	}
+	mem      = r->mem;
+	r->mem  += bytes / 4;
+	r->left -= bytes;
+	return mem;
+}
+
+int sceGxmMapMemory(void *base, SceSize size, SceGxmMemoryAttribFlags attr)
+{
+	(void)base, (void)size, (void)attr;
+	return 0;
+}
+
+int sceGxmUnmapMemory(void *base)
+{
+	(void)base;
+	return 0;
+}
+
+int sceGxmCreateDeferredContext(const SceGxmDeferredContextParams *params, SceGxmContext **context)
+{
+	MockContext *c;
+
+	HOST_CHECK(gxm.context_count < VITASDK_GXM_DEFERRED_MAX_CONTEXTS);
+	HOST_CHECK(params->hostMemSize >= SCE_GXM_MINIMUM_CONTEXT_HOST_MEM_SIZE);
+	HOST_CHECK(params->vdmCallback && params->vertexCallback && params->fragmentCallback);
+	c = &gxm.contexts[gxm.context_count++];
+	memset(c, 0, sizeof(*c));
+	c->params = *params;
+	*context  = (SceGxmContext *)c;
+	return 0;
+}
+
+int sceGxmDestroyDeferredContext(SceGxmContext *context)
+{
+	MockContext *c = (MockContext *)context;
+
+	HOST_CHECK(!c->recording);
+	c->params.hostMem = NULL;
+	return 0;
+}
+
+int sceGxmBeginCommandList(SceGxmContext *context)
+{
+	MockContext *c = (MockContext *)context;
+	SceUInt32 id = (SceUInt32)sceKernelGetThreadId();
+
+	/* A context never changes threads, and records one list at a time */
+	HOST_CHECK(context != gxm.immediate);
+	if (c->owner == 0)
+		c->owner = id;
+	HOST_CHECK(c->owner == id);
+	HOST_CHECK(vitasdk_atomic_cas32(&c->recording, 0, 1));
+	c->pass  = PASSES;
+	c->count = 0;
+	return 0;
+}
+
+/* A draw of a sub-pass, its draw_word in `indexCount` */
+int sceGxmDraw(SceGxmContext *context, SceGxmPrimitiveType primType, SceGxmIndexFormat indexType, const void *indexData, unsigned int indexCount)
+{
+	MockContext *c = (MockContext *)context;
+	SceUInt32 *vertex_data;
+	MockList *l;
+
+	(void)primType, (void)indexType, (void)indexData;
+	HOST_CHECK(c->recording && c->owner == (SceUInt32)sceKernelGetThreadId());
+	HOST_CHECK(c->count < PASS_DRAWS && indexCount >> 16 < PASSES);
+	l = &gxm.lists[gxm.frame % 2][indexCount >> 16];
+	/* The draws of a list are contiguous */
+	if (c->count == 0) {
+		c->pass    = indexCount >> 16;
+		l->context = context;
+		l->draws   = ring_reserve(c, &c->vdm, c->params.vdmCallback, PASS_DRAWS * 4);
+		if (!l->draws)
+			return (int)SCE_GXM_ERROR_RESERVE_FAILED;
+	}
+	HOST_CHECK(c->pass == indexCount >> 16);
+	vertex_data = ring_reserve(c, &c->vertex, c->params.vertexCallback, 8);
+	if (!vertex_data)
+		return (int)SCE_GXM_ERROR_RESERVE_FAILED;
+	vertex_data[0] = indexCount;
+	vertex_data[1] = ~indexCount;
+	((SceUInt32 *)l->draws)[c->count] = indexCount;
+	l->vertex_data[c->count]           = vertex_data;
+	c->count++;
+	return 0;
+}
+
+int sceGxmEndCommandList(SceGxmContext *context, SceGxmCommandList *list)
+{
+	MockContext *c = (MockContext *)context;
+	MockList *l = &gxm.lists[gxm.frame % 2][c->pass];
+
+	HOST_CHECK(c->recording && c->owner == (SceUInt32)sceKernelGetThreadId());
+	HOST_CHECK(c->pass < PASSES);
+	c->recording = 0;
+	l->count     = c->count;
+	memcpy(list->words, &l, sizeof(l));
+	if (c->pass == gxm.fail_pass)
+		return (int)SCE_GXM_ERROR_INVALID_VALUE;
+	return 0;
+}
+
+int sceGxmExecuteCommandList(SceGxmContext *context, SceGxmCommandList *list)
+{
+	HOST_CHECK(context == gxm.immediate);
+	HOST_CHECK(gxm.executed_count < PASSES);
+	memcpy(&gxm.executed[gxm.frame % 2][gxm.executed_count++], list->words, sizeof(MockList *));
+	return 0;
+}
+
+/* Run the lists of frame `f`, every draw of every sub-pass in order */
+static void gpu_run(SceUInt32 f)
+{
+	const MockList *const *l = gxm.executed[f % 2];
+	SceUInt32 pass, d, word;
+
+	for (pass = 0; pass < PASSES; pass++) {
+		HOST_CHECK(l[pass]->count == PASS_DRAWS);
+		for (d = 0; d < PASS_DRAWS; d++) {
+			word = draw_word(f, pass, d);
+			HOST_CHECK(l[pass]->draws[d] == word);
+			HOST_CHECK(l[pass]->vertex_data[d][0] == word && l[pass]->vertex_data[d][1] == ~word);
+		}
+	}
+}
+
+/* Memory of a context is in the part of its ring which is not recycled */
+static void check_kept(const VitasdkGxmDeferred *deferred, const SceGxmContext *context, const void *p, SceSize size)
+{
+	const VitasdkGxmDeferredContext *dc = NULL;
+	SceUInt32 i, offset;
+
+	for (i = 0; i < deferred->context_count; i++) {
+		if (deferred->contexts[i].context == context)
+			dc = &deferred->contexts[i];
+	}
+	HOST_CHECK(dc != NULL);
+	offset = (SceUInt32)((const char *)p - dc->base);
+	HOST_CHECK(offset < dc->size);
+	HOST_CHECK(((offset - dc->tail) & (dc->size - 1)) + size <= dc->head - dc->tail);
+}
+
+/* The lists of frame `f` - 1, which the GPU did not run, and the rest of the chunks of the contexts */
+static void check_in_use(const VitasdkGxmDeferred *deferred, SceUInt32 f)
+{
+	const MockContext *c;
+	const MockList *l;
+	SceUInt32 i, pass, d;
+
+	for (i = 0; i < gxm.context_count; i++) {
+		c = &gxm.contexts[i];
+		if (c->vdm.left > 0)
+			check_kept(deferred, (const SceGxmContext *)c, c->vdm.mem, c->vdm.left);
+		if (c->vertex.left > 0)
+			check_kept(deferred, (const SceGxmContext *)c, c->vertex.mem, c->vertex.left);
+	}
+	if (f == 0)
+		return;
+	for (pass = 0; pass < PASSES; pass++) {
+		l = &gxm.lists[(f - 1) % 2][pass];
+		check_kept(deferred, l->context, l->draws, l->count * 4);
+		for (d = 0; d < l->count; d++)
+			check_kept(deferred, l->context, l->vertex_data[d], 8);
+	}
+}
+
+static void record(void *arg, SceGxmContext *context, SceUInt32 pass)
+{
+	SceUInt32 seed = pass * 0x9E3779B1u + gxm.frame + 1, spin, d;
+	volatile SceUInt32 sink = 0;
+
+	(void)arg;
+	/* The sub-passes end out of order */
+	for (spin = random_next(&seed) % 20000; spin > 0; spin--)
+		sink += spin;
+	for (d = 0; d < PASS_DRAWS; d++)
+		HOST_CHECK(sceGxmDraw(context, SCE_GXM_PRIMITIVE_TRIANGLES, SCE_GXM_INDEX_FORMAT_U16, NULL, draw_word(gxm.frame, pass, d)) == 0);
+}
+
+static int record_frame(VitasdkGxmDeferred *deferred, SceUInt32 f)
+{
+	int res;
+
+	vitasdk_gxm_deferred_begin_frame(deferred);
+	check_in_use(deferred, f);
+	gxm.frame          = f;
+	gxm.executed_count = 0;
+	res = vitasdk_gxm_deferred_record(deferred, PASSES, record, NULL);
+	if (res < 0)
+		return res;
+	HOST_CHECK(vitasdk_gxm_deferred_execute(deferred, gxm.immediate, PASSES) == 0);
+	HOST_CHECK(gxm.executed_count == PASSES);
+	return 0;
+}
+
+static SceUInt32 count_lists(const VitasdkGxmDeferred *deferred)
+{
+	SceUInt32 i, lists = 0;
+
+	for (i = 0; i < deferred->context_count; i++)
+		lists += deferred->contexts[i].lists;
+	return lists;
+}
+
+int main(int argc, char *argv[])
+{
+	SceUInt32 frames = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : FRAMES;
+	static VitasdkGxmDeferred deferred;
+	VitasdkThreadPoolParam param;
+	VitasdkThreadPool pool;
+	MockContext immediate;
+	SceUInt32 f, i, lists;
+	double t;
+
+	HOST_CHECK(frames > 0);
+	gxm.immediate = (SceGxmContext *)&immediate;
+	gxm.fail_pass = PASSES;
+	vitasdk_thread_pool_param_init(&param);
+	param.core_mask = SCE_KERNEL_CPU_MASK_USER_ALL;
+	HOST_CHECK(vitasdk_thread_pool_create(&pool, &param) == 0);
+	HOST_CHECK(vitasdk_gxm_deferred_create(&deferred, &pool, SCE_KERNEL_MEMBLOCK_TYPE_USER_RW_UNCACHE, 0) == (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE);
+	HOST_CHECK(vitasdk_gxm_deferred_create(&deferred, &pool, SCE_KERNEL_MEMBLOCK_TYPE_USER_RW_UNCACHE, RING_SIZE) == 0);
+	HOST_CHECK(deferred.context_count == pool.worker_count + 1 && gxm.context_count == deferred.context_count);
+
+	/* The GPU runs a frame while the next one is recorded */
+	t = host_seconds();
+	for (f = 0; f < frames; f++) {
+		HOST_CHECK(record_frame(&deferred, f) == 0);
+		if (f > 0)
+			gpu_run(f - 1);
+	}
+	gpu_run(frames - 1);
+	t = host_seconds() - t;
+
+	printf("%u frames of %u sub-passes in %.1f ms, lists per context:", frames, PASSES, t * 1e3);
+	for (i = 0; i < deferred.context_count; i++) {
+		HOST_CHECK(deferred.contexts[i].out_of_memory == 0);
+		printf(" %u", deferred.contexts[i].lists);
+	}
+	printf("\n");
+	HOST_CHECK(count_lists(&deferred) == frames * PASSES);
+
+	/* A failed list fails the recording */
+	gxm.fail_pass = PASSES / 2;
+	HOST_CHECK(record_frame(&deferred, frames) == (int)SCE_GXM_ERROR_INVALID_VALUE);
+	gxm.fail_pass = PASSES;
+
+	/* A thread without a context records nothing */
+	lists = count_lists(&deferred);
+	deferred.contexts[deferred.context_count - 1].thid = -1;
+	deferred.results[0] = deferred.results[1] = 0;
+	_vitasdk_gxm_deferred_record_range(&deferred, 0, 2);
+	HOST_CHECK(deferred.results[0] == (int)SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID && deferred.results[1] == (int)SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID);
+	HOST_CHECK(count_lists(&deferred) == lists);
+
+	vitasdk_gxm_deferred_delete(&deferred);
+	HOST_CHECK(vitasdk_thread_pool_destroy(&pool) == 0);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,498 @@
+/*
+ * Test and benchmark of the vitasdk/gxmprecomputed.h cache, over GXM mocks.
+ *
+ * usage: gxmprecomputed_bench [frames]
+ *
+ * A scene of 100 materials with 10 meshes each is drawn every frame, each
+ * mesh with its own default uniform buffers from a frame allocator. The
+ * mocked GPU runs a frame once the CPU has queued the next one, and reads
+ * the default uniform buffers from the precomputed states bound for each
+ * draw, as the Vita one does: every draw must see the buffers of its object
+ * and frame, while the CPU already patches the states of the next frame.
+ * The test also checks that the states are built once and that a failed
+ * build is rolled back. It then prints the GXM calls per draw against the
+ * same scene drawn with sceGxmDraw. The mocks do no work, the host time of
+ * the calls does not stand for the Vita one.
+ */
+
+#include <string.h>
+#include <vitasdk/arena.h>
+#include <vitasdk/gxmprecomputed.h>
+
+#include "host_kernel.h"
+
+#define MATERIALS         (100)
+#define MESHES            (10)
+#define DRAWS             (MATERIALS * MESHES)
+#define FRAGMENT_TEXTURES (2)
+#define STREAMS           (2)
+#define UNIFORM_SIZE      (64)
+
+/* Sizes of the mocked precomputed states */
+#define VERTEX_STATE_SIZE   (100)
+#define FRAGMENT_STATE_SIZE (200)
+#define DRAW_SIZE           (50)
+
+/* Frames in flight, the GPU runs a frame behind the CPU */
+#define FRAME_COUNT (2)
+
+/* What the mocked GPU reads for a draw */
+typedef struct DrawRecord {
+	const SceGxmPrecomputedDraw *draw;
+	const SceGxmPrecomputedVertexState *vertex_state;
+	const SceGxmPrecomputedFragmentState *fragment_state;
+} DrawRecord;
+
+static struct {
+	unsigned long calls;
+	const SceGxmPrecomputedVertexState *vertex_state;
+	const SceGxmPrecomputedFragmentState *fragment_state;
+	SceUInt32 patches;             /* Default uniform buffers set on a precomputed state */
+	DrawRecord draws[2][DRAWS];    /* Of the frame being queued and of the one before */
+	SceUInt32 draw_count;
+	SceUInt32 frame;
+} gxm;
+
+/*
+ * The mocked precomputed states keep their memory in the first word, the
+ * memory of a state keeps its default uniform buffer in its first word.
+ */
+static void state_init(void *state, void *mem, SceSize size)
+{
+	HOST_CHECK(((uintptr_t)mem & (_VITASDK_GXM_PRECOMPUTED_ALIGN - 1)) == 0);
+	memset(mem, 0xA5, size);
+	*(void **)state = mem;
+}
+
+int sceGxmMapMemory(void *base, SceSize size, SceGxmMemoryAttribFlags attr)
+{
+	(void)base, (void)size, (void)attr;
+	return 0;
+}
+
+int sceGxmUnmapMemory(void *base)
+{
+	(void)base;
+	return 0;
+}
+
+unsigned int sceGxmGetPrecomputedVertexStateSize(const SceGxmVertexProgram *vertexProgram)
+{
+	(void)vertexProgram;
+	return VERTEX_STATE_SIZE;
+}
+
+unsigned int sceGxmGetPrecomputedFragmentStateSize(const SceGxmFragmentProgram *fragmentProgram)
+{
+	(void)fragmentProgram;
+	return FRAGMENT_STATE_SIZE;
+}
+
+unsigned int sceGxmGetPrecomputedDrawSize(const SceGxmVertexProgram *vertexProgram)
+{
+	(void)vertexProgram;
+	return DRAW_SIZE;
+}
+
+int sceGxmPrecomputedVertexStateInit(SceGxmPrecomputedVertexState *precomputedState, const SceGxmVertexProgram *vertexProgram, void *memBlock)
+{
+	(void)vertexProgram;
+	state_init(precomputedState, memBlock, VERTEX_STATE_SIZE);
+	return 0;
+}
+
+int sceGxmPrecomputedFragmentStateInit(SceGxmPrecomputedFragmentState *precomputedState, const SceGxmFragmentProgram *fragmentProgram, void *memBlock)
+{
+	(void)fragmentProgram;
+	state_init(precomputedState, memBlock, FRAGMENT_STATE_SIZE);
+	return 0;
+}
+
+int sceGxmPrecomputedDrawInit(SceGxmPrecomputedDraw *precomputedDraw, const SceGxmVertexProgram *vertexProgram, void *memBlock)
+{
+	(void)vertexProgram;
+	state_init(precomputedDraw, memBlock, DRAW_SIZE);
+	return 0;
+}
+
+int sceGxmPrecomputedVertexStateSetAllTextures(SceGxmPrecomputedVertexState *precomputedState, const SceGxmTexture *textures)
+{
+	(void)precomputedState, (void)textures;
+	return 0;
+}
+
+int sceGxmPrecomputedVertexStateSetAllUniformBuffers(SceGxmPrecomputedVertexState *precomputedState, const void *const *bufferDataArray)
+{
+	(void)precomputedState, (void)bufferDataArray;
+	return 0;
+}
+
+int sceGxmPrecomputedFragmentStateSetAllTextures(SceGxmPrecomputedFragmentState *precomputedState, const SceGxmTexture *textureArray)
+{
+	(void)precomputedState, (void)textureArray;
+	return 0;
+}
+
+int sceGxmPrecomputedFragmentStateSetAllUniformBuffers(SceGxmPrecomputedFragmentState *precomputedState, const void *const *bufferDataArray)
+{
+	(void)precomputedState, (void)bufferDataArray;
+	return 0;
+}
+
+int sceGxmPrecomputedDrawSetAllVertexStreams(SceGxmPrecomputedDraw *precomputedDraw, const void *const *streamDataArray)
+{
+	(void)precomputedDraw, (void)streamDataArray;
+	return 0;
+}
+
+void sceGxmPrecomputedDrawSetParams(SceGxmPrecomputedDraw *precomputedDraw, SceGxmPrimitiveType primType, SceGxmIndexFormat indexType,
+	const void *indexData, unsigned int indexCount)
+{
+	(void)precomputedDraw, (void)primType, (void)indexType, (void)indexData, (void)indexCount;
+}
+
+void sceGxmPrecomputedVertexStateSetDefaultUniformBuffer(SceGxmPrecomputedVertexState *precomputedState, void *defaultBuffer)
+{
+	**(void ***)precomputedState = defaultBuffer;
+	gxm.patches++;
+}
+
+void sceGxmPrecomputedFragmentStateSetDefaultUniformBuffer(SceGxmPrecomputedFragmentState *precomputedState, void *defaultBuffer)
+{
+	**(void ***)precomputedState = defaultBuffer;
+	gxm.patches++;
+}
+
+const SceGxmProgram *sceGxmVertexProgramGetProgram(const SceGxmVertexProgram *vertexProgram)
+{
+	return (const SceGxmProgram *)vertexProgram;
+}
+
+const SceGxmProgram *sceGxmFragmentProgramGetProgram(const SceGxmFragmentProgram *fragmentProgram)
+{
+	return (const SceGxmProgram *)fragmentProgram;
+}
+
+unsigned int sceGxmProgramGetDefaultUniformBufferSize(const SceGxmProgram *program)
+{
+	(void)program;
+	return UNIFORM_SIZE;
+}
+
+/* The context calls, counted */
+
+void sceGxmSetVertexProgram(SceGxmContext *context, const SceGxmVertexProgram *vertexProgram)
+{
+	(void)context, (void)vertexProgram;
+	gxm.calls++;
+}
+
+void sceGxmSetFragmentProgram(SceGxmContext *context, const SceGxmFragmentProgram *fragmentProgram)
+{
+	(void)context, (void)fragmentProgram;
+	gxm.calls++;
+}
+
+void sceGxmSetPrecomputedVertexState(SceGxmContext *context, const SceGxmPrecomputedVertexState *precomputedState)
+{
+	(void)context;
+	gxm.vertex_state = precomputedState;
+	gxm.calls++;
+}
+
+void sceGxmSetPrecomputedFragmentState(SceGxmContext *context, const SceGxmPrecomputedFragmentState *precomputedState)
+{
+	(void)context;
+	gxm.fragment_state = precomputedState;
+	gxm.calls++;
+}
+
+int sceGxmSetVertexDefaultUniformBuffer(SceGxmContext *context, const void *uniformBuffer)
+{
+	(void)context, (void)uniformBuffer;
+	gxm.calls++;
+	return 0;
+}
+
+int sceGxmSetFragmentDefaultUniformBuffer(SceGxmContext *context, const void *uniformBuffer)
+{
+	(void)context, (void)uniformBuffer;
+	gxm.calls++;
+	return 0;
+}
+
+int sceGxmSetVertexStream(SceGxmContext *context, unsigned int streamIndex, const void *streamData)
+{
+	(void)context, (void)streamIndex, (void)streamData;
+	gxm.calls++;
+	return 0;
+}
+
+int sceGxmSetFragmentTexture(SceGxmContext *context, unsigned int textureIndex, const SceGxmTexture *texture)
+{
+	(void)context, (void)textureIndex, (void)texture;
+	gxm.calls++;
+	return 0;
+}
+
+int sceGxmSetVertexUniformBuffer(SceGxmContext *context, unsigned int bufferIndex, const void *bufferData)
+{
+	(void)context, (void)bufferIndex, (void)bufferData;
+	gxm.calls++;
+	return 0;
+}
+
+int sceGxmSetFragmentUniformBuffer(SceGxmContext *context, unsigned int bufferIndex, const void *bufferData)
+{
+	(void)context, (void)bufferIndex, (void)bufferData;
+	gxm.calls++;
+	return 0;
+}
+
+int sceGxmDraw(SceGxmContext *context, SceGxmPrimitiveType primType, SceGxmIndexFormat indexType, const void *indexData, unsigned int indexCount)
+{
+	(void)context, (void)primType, (void)indexType, (void)indexData, (void)indexCount;
+	gxm.calls++;
+	return 0;
+}
+
+int sceGxmDrawPrecomputed(SceGxmContext *context, const SceGxmPrecomputedDraw *precomputedDraw)
+{
+	DrawRecord *r = &gxm.draws[gxm.frame % 2][gxm.draw_count++ % DRAWS];
+
+	(void)context;
+	HOST_CHECK(gxm.vertex_state != NULL && gxm.fragment_state != NULL);
+	r->draw           = precomputedDraw;
+	r->vertex_state   = gxm.vertex_state;
+	r->fragment_state = gxm.fragment_state;
+	gxm.calls++;
+	return 0;
+}
+
+/* The tag of the default uniform buffers of a draw */
+static SceUInt32 uniform_tag(SceUInt32 f, SceUInt32 d, SceUInt32 fragment)
+{
+	return (f << 11 | d) << 1 | fragment;
+}
+
+/* Run the draws of frame `f`, reading the buffers from their states */
+static void gpu_run(VitasdkGxmMesh **draws, SceUInt32 f)
+{
+	const DrawRecord *r = gxm.draws[f % 2];
+	const SceUInt32 *v, *fr;
+	SceUInt32 d;
+
+	for (d = 0; d < DRAWS; d++) {
+		v  = **(const SceUInt32 *const *const *)r[d].vertex_state;
+		fr = **(const SceUInt32 *const *const *)r[d].fragment_state;
+		HOST_CHECK(r[d].draw == &draws[d]->draw);
+		HOST_CHECK(*v == uniform_tag(f, d, 0) && *fr == uniform_tag(f, d, 1));
+	}
+}
+
+/* The scene */
+
+static VitasdkGxmMaterial materials[256];
+static VitasdkGxmMesh meshes[2048];
+static SceGxmTexture textures[MATERIALS][FRAGMENT_TEXTURES];
+static const void *uniform_buffers[MATERIALS][1];
+static const void *streams[DRAWS][STREAMS];
+static char vertex_data[DRAWS * STREAMS][16];
+
+static void describe(SceUInt32 m, SceUInt32 k, VitasdkGxmMaterialDesc *mat_desc, VitasdkGxmMeshDesc *mesh_desc)
+{
+	SceUInt32 d = m * MESHES + k, i;
+
+	memset(mat_desc, 0, sizeof(*mat_desc));
+	mat_desc->vertex_program           = (const SceGxmVertexProgram *)(uintptr_t)(0x1000 + m);
+	mat_desc->fragment_program         = (const SceGxmFragmentProgram *)(uintptr_t)(0x2000 + m);
+	mat_desc->fragment_textures        = textures[m];
+	mat_desc->vertex_uniform_buffers   = uniform_buffers[m];
+	mat_desc->fragment_uniform_buffers = uniform_buffers[m];
+	for (i = 0; i < STREAMS; i++)
+		streams[d][i] = vertex_data[d * STREAMS + i];
+	mesh_desc->streams      = streams[d];
+	mesh_desc->primitive    = SCE_GXM_PRIMITIVE_TRIANGLES;
+	mesh_desc->index_format = SCE_GXM_INDEX_FORMAT_U16;
+	mesh_desc->indices      = vertex_data[d * STREAMS];
+	mesh_desc->index_count  = 36;
+}
+
+static void lookup(VitasdkGxmPrecomputedCache *cache, VitasdkGxmMaterial **mats, VitasdkGxmMesh **draws)
+{
+	VitasdkGxmMaterialDesc mat_desc;
+	VitasdkGxmMeshDesc mesh_desc;
+	SceUInt32 m, k;
+
+	for (m = 0; m < MATERIALS; m++) {
+		for (k = 0; k < MESHES; k++) {
+			describe(m, k, &mat_desc, &mesh_desc);
+			HOST_CHECK(vitasdk_gxm_precomputed_material(cache, m + 1, &mat_desc, &mats[m]) == 0);
+			HOST_CHECK(vitasdk_gxm_precomputed_mesh(cache, (m + 1) << 8 | k, &mesh_desc, mats[m], &draws[m * MESHES + k]) == 0);
+		}
+	}
+}
+
+/* Default uniform buffer of a draw, filled by the CPU */
+static void *uniforms(VitasdkFrameAllocator *frame, SceUInt32 tag)
+{
+	SceUInt32 *buffer = vitasdk_frame_allocator_alloc(frame, UNIFORM_SIZE, 16);
+
+	HOST_CHECK(buffer != NULL);
+	memset(buffer, 0, UNIFORM_SIZE);
+	*buffer = tag;
+	return buffer;
+}
+
+static double draw_precomputed(VitasdkGxmPrecomputedCache *cache, VitasdkFrameAllocator *frame, VitasdkGxmMaterial **mats, VitasdkGxmMesh **draws,
+	SceUInt32 frames)
+{
+	SceUInt32 f, m, k, d;
+	double start = host_seconds();
+	void *v, *fr;
+
+	for (f = 0; f < frames; f++) {
+		/*
+		 * The frame allocator keeps the buffers of the frame the GPU runs,
+		 * they move from a frame to the next one using the same states
+		 */
+		vitasdk_frame_allocator_flip(frame);
+		HOST_CHECK(vitasdk_frame_allocator_alloc(frame, 16 * (1 + f % 3), 16) != NULL);
+		vitasdk_gxm_precomputed_flip(cache);
+		gxm.frame      = f;
+		gxm.draw_count = 0;
+		for (m = 0; m < MATERIALS; m++) {
+			vitasdk_gxm_material_bind(NULL, mats[m]);
+			for (k = 0; k < MESHES; k++) {
+				d  = m * MESHES + k;
+				v  = uniforms(frame, uniform_tag(f, d, 0));
+				fr = uniforms(frame, uniform_tag(f, d, 1));
+				HOST_CHECK(vitasdk_gxm_mesh_draw(NULL, cache, draws[d], v, fr) == 0);
+			}
+		}
+		HOST_CHECK(gxm.draw_count == DRAWS);
+		/* The GPU runs the frame before, while this one is queued */
+		if (f > 0)
+			gpu_run(draws, f - 1);
+	}
+	gpu_run(draws, frames - 1);
+	return host_seconds() - start;
+}
+
+static double draw_plain(VitasdkFrameAllocator *frame, SceUInt32 frames)
+{
+	VitasdkGxmMaterialDesc mat_desc;
+	VitasdkGxmMeshDesc mesh_desc;
+	SceUInt32 f, m, k, d, i;
+	double start = host_seconds();
+
+	for (f = 0; f < frames; f++) {
+		vitasdk_frame_allocator_flip(frame);
+		for (m = 0; m < MATERIALS; m++) {
+			describe(m, 0, &mat_desc, &mesh_desc);
+			sceGxmSetVertexProgram(NULL, mat_desc.vertex_program);
+			sceGxmSetFragmentProgram(NULL, mat_desc.fragment_program);
+			for (i = 0; i < FRAGMENT_TEXTURES; i++)
+				sceGxmSetFragmentTexture(NULL, i, &mat_desc.fragment_textures[i]);
+			sceGxmSetVertexUniformBuffer(NULL, 0, mat_desc.vertex_uniform_buffers[0]);
+			sceGxmSetFragmentUniformBuffer(NULL, 0, mat_desc.fragment_uniform_buffers[0]);
+			for (k = 0; k < MESHES; k++) {
+				d = m * MESHES + k;
+				describe(m, k, &mat_desc, &mesh_desc);
+				sceGxmSetVertexDefaultUniformBuffer(NULL, uniforms(frame, uniform_tag(f, d, 0)));
+				sceGxmSetFragmentDefaultUniformBuffer(NULL, uniforms(frame, uniform_tag(f, d, 1)));
+				for (i = 0; i < STREAMS; i++)
+					sceGxmSetVertexStream(NULL, i, mesh_desc.streams[i]);
+				sceGxmDraw(NULL, mesh_desc.primitive, mesh_desc.index_format, mesh_desc.indices, mesh_desc.index_count);
+			}
+		}
+	}
+	return host_seconds() - start;
+}
+
+/* A mesh drawn with the same buffers is patched once per frame in flight */
+static void check_unchanged(VitasdkGxmPrecomputedCache *cache, VitasdkGxmMesh *mesh)
+{
+	static SceUInt32 v[UNIFORM_SIZE / 4], fr[UNIFORM_SIZE / 4];
+	SceUInt32 patches = gxm.patches, f;
+
+	for (f = 0; f < 4 * FRAME_COUNT; f++) {
+		vitasdk_gxm_precomputed_flip(cache);
+		HOST_CHECK(vitasdk_gxm_mesh_draw(NULL, cache, mesh, v, fr) == 0);
+		HOST_CHECK(**(void ***)gxm.vertex_state == v && **(void ***)gxm.fragment_state == fr);
+	}
+	HOST_CHECK(gxm.patches - patches == 2 * FRAME_COUNT);
+	/* Or with no default uniform buffers */
+	HOST_CHECK(vitasdk_gxm_mesh_draw(NULL, cache, mesh, NULL, NULL) == 0);
+	HOST_CHECK(gxm.patches - patches == 2 * FRAME_COUNT);
+}
+
+int main(int argc, char *argv[])
+{
+	SceUInt32 frames = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : 1000;
+	static VitasdkGxmMaterial *mats[MATERIALS];
+	static VitasdkGxmMesh *draws[DRAWS];
+	VitasdkGxmPrecomputedCache cache;
+	VitasdkFrameAllocator frame;
+	VitasdkGxmMaterial *extra;
+	VitasdkGxmMesh *extra_mesh;
+	VitasdkGxmMaterialDesc mat_desc;
+	VitasdkGxmMeshDesc mesh_desc;
+	unsigned long calls;
+	double elapsed;
+	SceSize used;
+	SceUInt32 id;
+	int res;
+
+	HOST_CHECK(frames > 0);
+	HOST_CHECK(vitasdk_gxm_precomputed_cache_create(&cache, "GxmPrecomputedBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW_UNCACHE, 800000,
+		0, materials, 256, meshes, 2048) == (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT);
+	HOST_CHECK(vitasdk_gxm_precomputed_cache_create(&cache, "GxmPrecomputedBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW_UNCACHE, 800000,
+		VITASDK_GXM_PRECOMPUTED_MAX_FRAMES + 1, materials, 256, meshes, 2048) == (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT);
+	HOST_CHECK(vitasdk_gxm_precomputed_cache_create(&cache, "GxmPrecomputedBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW_UNCACHE, 800000,
+		FRAME_COUNT, materials, 256, meshes, 2048) == 0);
+	HOST_CHECK(vitasdk_frame_allocator_create(&frame, "GxmPrecomputedBench", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, DRAWS * UNIFORM_SIZE * 2 + 64) == 0);
+	HOST_CHECK(vitasdk_gxm_precomputed_material(&cache, 0, &mat_desc, &extra) == (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT);
+
+	/* Built on the first lookup only */
+	lookup(&cache, mats, draws);
+	HOST_CHECK(cache.misses == MATERIALS + DRAWS && cache.hits == DRAWS - MATERIALS);
+	used = cache.arena.used;
+	lookup(&cache, mats, draws);
+	HOST_CHECK(cache.misses == MATERIALS + DRAWS && cache.hits == 3 * DRAWS - MATERIALS && cache.arena.used == used);
+	HOST_CHECK(mats[7]->vertex_uniform_size == UNIFORM_SIZE && draws[73]->material == mats[7]);
+	printf("%u materials and %u meshes built in %u bytes, %u hits\n", MATERIALS, DRAWS, (unsigned)used, cache.hits);
+
+	/* Every draw reads the buffers of its frame from its states */
+	gxm.calls   = 0;
+	gxm.patches = 0;
+	elapsed     = draw_precomputed(&cache, &frame, mats, draws, frames);
+	calls       = gxm.calls;
+	HOST_CHECK(calls == (unsigned long)frames * (MATERIALS * 2 + DRAWS * 3));
+	HOST_CHECK(gxm.patches == frames * DRAWS * 2);
+	printf("precomputed: %5.2f GXM calls and %4.2f state patches per draw, %6.2f ns per draw on the mocks\n",
+	       (double)calls / ((double)frames * DRAWS), (double)gxm.patches / ((double)frames * DRAWS), elapsed / ((double)frames * DRAWS) * 1e9);
+	check_unchanged(&cache, draws[0]);
+
+	gxm.calls = 0;
+	elapsed   = draw_plain(&frame, frames);
+	calls     = gxm.calls;
+	printf("sceGxmDraw:  %5.2f GXM calls per draw, %6.2f ns per draw on the mocks\n", (double)calls / ((double)frames * DRAWS),
+	       elapsed / ((double)frames * DRAWS) * 1e9);
+
+	/* A full arena, not table, rolls the failed build back */
+	describe(0, 0, &mat_desc, &mesh_desc);
+	for (id = 1; ; id++) {
+		used = cache.arena.used;
+		res  = vitasdk_gxm_precomputed_mesh(&cache, id, &mesh_desc, mats[0], &extra_mesh);
+		if (res < 0)
+			break;
+	}
+	HOST_CHECK(res == (int)SCE_KERNEL_ERROR_NO_MEMORY && cache.arena.used == used);
+	HOST_CHECK(cache.misses + 1 < 2048 + MATERIALS);
+
+	HOST_CHECK(vitasdk_frame_allocator_delete(&frame) == 0);
+	HOST_CHECK(vitasdk_gxm_precomputed_cache_delete(&cache) == 0);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * Stress test of the vitasdk/gxmring.h transient ring, over a simulated GPU.
+ *
+ * usage: gxmring_stress [frames]
+ *
+ * The CPU fills allocations of random sizes and alignments with the number
+ * of their frame. The simulated GPU runs the ended frames in order, a few
+ * frames behind the CPU, and checks that the data of each frame is still
+ * intact when it writes its notification: the ring must never hand out the
+ * space of a frame the GPU is not done with, across many laps. Waits on a
+ * notification run the GPU up to the waited frame, they must match the
+ * stalls statistic. The test first checks the rejected sizes and
+ * alignments, and that a new frame waits for the frame using its slot.
+ */
+
+#include <string.h>
+#include <vitasdk/gxmring.h>
+
+#include "host_kernel.h"
+
+#define RING_SIZE   (64 * 1024)
+#define FRAMES      (20000)
+#define FRAME_ALLOC (32)
+
+typedef struct Alloc {
+	unsigned char *p;
+	SceSize size;
+} Alloc;
+
+/* A frame ended by the CPU, not run by the GPU yet */
+typedef struct GpuFrame {
+	SceGxmNotification notification;
+	SceUInt32 number;
+	SceUInt32 alloc_count;
+	Alloc allocs[FRAME_ALLOC];
+} GpuFrame;
+
+static struct {
+	VitasdkGxmRing ring;
+	volatile unsigned int notifications[VITASDK_GXM_RING_MAX_FRAMES];
+	GpuFrame queue[VITASDK_GXM_RING_MAX_FRAMES + 1];
+	SceUInt32 queued;
+	SceUInt32 done;         /* Frames run by the GPU */
+	SceUInt32 waits;        /* sceGxmNotificationWait on a notification not written yet */
+	SceUInt32 space_waits;  /* The ones of vitasdk_gxm_ring_alloc, for space */
+	SceUInt32 seed;
+} gpu;
+
+static SceUInt32 random_next(void)
+{
+	gpu.seed ^= gpu.seed << 13;
+	gpu.seed ^= gpu.seed >> 17;
+	gpu.seed ^= gpu.seed << 5;
+	return gpu.seed;
+}
+
+int sceGxmMapMemory(void *base, SceSize size, SceGxmMemoryAttribFlags attr)
+{
+	(void)base, (void)size, (void)attr;
+	return 0;
+}
+
+int sceGxmUnmapMemory(void *base)
+{
+	(void)base;
+	return 0;
+}
+
+/* Run the oldest frame: check its data and write its notification */
+static void gpu_run(void)
+{
+	GpuFrame *f = &gpu.queue[gpu.done % (VITASDK_GXM_RING_MAX_FRAMES + 1)];
+	SceUInt32 i;
+	SceSize j;
+
+	HOST_CHECK(gpu.done < gpu.queued);
+	for (i = 0; i < f->alloc_count; i++) {
+		for (j = 0; j < f->allocs[i].size; j++)
+			HOST_CHECK(f->allocs[i].p[j] == (unsigned char)f->number);
+	}
+	*f->notification.address = f->notification.value;
+	gpu.done++;
+}
+
+int sceGxmNotificationWait(const SceGxmNotification *notification)
+{
+	if (*notification->address != notification->value)
+		gpu.waits++;
+	while (*notification->address != notification->value)
+		gpu_run();
+	return 0;
+}
+
+static void *alloc(GpuFrame *f, SceSize size, SceSize align)
+{
+	VitasdkGxmRing *ring = &gpu.ring;
+	SceUInt32 waits = gpu.waits;
+	unsigned char *p = vitasdk_gxm_ring_alloc(ring, size, align);
+
+	gpu.space_waits += gpu.waits - waits;
+	HOST_CHECK(p != NULL);
+	HOST_CHECK(((uintptr_t)p & (align - 1)) == 0);
+	HOST_CHECK(p >= (unsigned char *)ring->base && p + size <= (unsigned char *)ring->base + ring->size);
+	memset(p, (int)(unsigned char)f->number, size);
+	f->allocs[f->alloc_count].p    = p;
+	f->allocs[f->alloc_count].size = size;
+	f->alloc_count++;
+	return p;
+}
+
+static void end_frame(GpuFrame *f)
+{
+	VitasdkGxmRing *ring = &gpu.ring;
+
+	f->notification = *vitasdk_gxm_ring_end_frame(ring);
+	HOST_CHECK(ring->frame - ring->oldest <= ring->frame_count);
+	HOST_CHECK(gpu.queued - gpu.done < VITASDK_GXM_RING_MAX_FRAMES + 1);
+	gpu.queued++;
+}
+
+static GpuFrame *begin_frame(void)
+{
+	GpuFrame *f = &gpu.queue[gpu.queued % (VITASDK_GXM_RING_MAX_FRAMES + 1)];
+
+	f->number      = gpu.queued;
+	f->alloc_count = 0;
+	return f;
+}
+
+static void ring_create(SceUInt32 frame_count)
+{
+	memset(&gpu, 0, sizeof(gpu));
+	gpu.seed = 0x12345678;
+	HOST_CHECK(vitasdk_gxm_ring_create(&gpu.ring, "GxmRingStress", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, RING_SIZE, frame_count, gpu.notifications) == 0);
+	HOST_CHECK(gpu.ring.size == RING_SIZE);
+}
+
+static void ring_delete(void)
+{
+	HOST_CHECK(vitasdk_gxm_ring_delete(&gpu.ring) == 0);
+	HOST_CHECK(gpu.done == gpu.queued);
+}
+
+static void check_rejected(void)
+{
+	VitasdkGxmRing *ring = &gpu.ring;
+	SceSize align;
+	GpuFrame *f;
+
+	ring_create(2);
+	HOST_CHECK(vitasdk_gxm_ring_alloc(ring, 16, 0) == NULL);
+	HOST_CHECK(vitasdk_gxm_ring_alloc(ring, 16, 3) == NULL);
+	HOST_CHECK(vitasdk_gxm_ring_alloc(ring, 16, 24) == NULL);
+	HOST_CHECK(vitasdk_gxm_ring_alloc(ring, 16, RING_SIZE * 2) == NULL);
+	HOST_CHECK(vitasdk_gxm_ring_alloc(ring, RING_SIZE + 1, 4) == NULL);
+	/* Above the alignment of the base */
+	align = ((uintptr_t)ring->base & -(uintptr_t)ring->base) * 2;
+	if (align <= RING_SIZE)
+		HOST_CHECK(vitasdk_gxm_ring_alloc(ring, 16, align) == NULL);
+	HOST_CHECK(ring->head == 0);
+
+	/* The current frame alone fills the ring, nothing to wait for */
+	f = begin_frame();
+	alloc(f, RING_SIZE / 2, 0x1000);
+	alloc(f, RING_SIZE / 2, 4);
+	HOST_CHECK(vitasdk_gxm_ring_alloc(ring, 1, 1) == NULL);
+	HOST_CHECK(gpu.waits == 0 && ring->stalls == 0);
+	end_frame(f);
+
+	/* The GPU is done, the next frame gets the whole ring */
+	gpu_run();
+	f = begin_frame();
+	alloc(f, RING_SIZE, 0x1000);
+	end_frame(f);
+	HOST_CHECK(gpu.waits == 0 && ring->stalls == 0);
+	ring_delete();
+	HOST_CHECK(vitasdk_gxm_ring_create(&gpu.ring, "GxmRingStress", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, RING_SIZE, 0, gpu.notifications) < 0);
+	HOST_CHECK(vitasdk_gxm_ring_create(&gpu.ring, "GxmRingStress", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, RING_SIZE, VITASDK_GXM_RING_MAX_FRAMES + 1, gpu.notifications) < 0);
+}
+
+static void check_slot_reuse(void)
+{
+	VitasdkGxmRing *ring = &gpu.ring;
+	GpuFrame *f;
+	SceUInt32 i;
+
+	/* The GPU runs nothing on its own */
+	ring_create(2);
+	for (i = 0; i < 2; i++) {
+		f = begin_frame();
+		alloc(f, 16, 16);
+		end_frame(f);
+	}
+	HOST_CHECK(gpu.waits == 0);
+
+	/* Both slots are in flight, the third frame waits for the first */
+	f = begin_frame();
+	alloc(f, 16, 16);
+	end_frame(f);
+	HOST_CHECK(gpu.waits == 1 && ring->stalls == 1 && gpu.done == 1);
+	HOST_CHECK(f->notification.address == gpu.queue[0].notification.address);
+	HOST_CHECK(f->notification.value == 3);
+	ring_delete();
+}
+
+/* Returns the stalls, `space_stalls` the ones for ring space */
+static SceUInt32 run_frames(SceUInt32 frame_count, SceUInt32 frames, SceUInt32 lag, SceSize max_size, SceUInt32 *space_stalls)
+{
+	VitasdkGxmRing *ring = &gpu.ring;
+	SceUInt32 n, i, count, stalls;
+	GpuFrame *f;
+
+	ring_create(frame_count);
+	for (n = 0; n < frames; n++) {
+		f = begin_frame();
+		count = 1 + random_next() % FRAME_ALLOC;
+		for (i = 0; i < count; i++)
+			alloc(f, 1 + random_next() % max_size, 1u << (random_next() % 9));
+		end_frame(f);
+		/* The GPU keeps `lag` frames behind, give or take one */
+		while (gpu.queued - gpu.done > lag + random_next() % 2)
+			gpu_run();
+	}
+	HOST_CHECK(ring->stalls == gpu.waits);
+	HOST_CHECK(ring->high_water <= ring->size);
+	HOST_CHECK(ring->head / ring->size > frames / 64);
+	printf("%u frames in flight, GPU %u behind, %4u bytes at most: %5u laps, %5u stalls, %5u for space, high water %u bytes\n",
+	       frame_count, lag, max_size, ring->head / ring->size, ring->stalls, gpu.space_waits, ring->high_water);
+	stalls        = ring->stalls;
+	*space_stalls = gpu.space_waits;
+	ring_delete();
+	return stalls;
+}
+
+int main(int argc, char *argv[])
+{
+	SceUInt32 frames = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : FRAMES;
+	SceUInt32 space_stalls;
+
+	HOST_CHECK(frames > 0);
+	check_rejected();
+	check_slot_reuse();
+
+	/* The ring holds the frames in flight, the CPU never waits */
+	HOST_CHECK(run_frames(3, frames, 1, 256, &space_stalls) == 0);
+	/* The GPU further behind, the frame slots run out */
+	HOST_CHECK(run_frames(2, frames, 4, 256, &space_stalls) > 0 && space_stalls == 0);
+	/* And the ring space */
+	HOST_CHECK(run_frames(4, frames, 8, 1024, &space_stalls) > 0 && space_stalls > 0);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,376 @@
+/*
+ * Stress test of the vitasdk/gxmshadercache.h shader cache, over a mocked
+ * shader patcher.
+ *
+ * usage: gxmshadercache_stress [file]
+ *
+ * The mocked patcher takes a while to patch a program, checks that it is
+ * never used by two threads at once, and records the combination of each
+ * program so that every lookup can be checked to return the right one. A
+ * cold start without a file patches each combination on its first lookup and
+ * saves them. A warm start preloads them, while the frames look them up
+ * concurrently: each combination must be patched once, by the frames or by
+ * the preload thread. The lookups of patched programs must not wait while
+ * the preload thread patches. A file of another version is ignored, a
+ * truncated one gives the keys before its end, and a preload into a small
+ * table stops with one free entry left for the frames. The file, by default
+ * gxmshadercache_stress.bin in the current directory, is removed at the end.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <vitasdk/gxmshadercache.h>
+
+#include "host_kernel.h"
+
+#define CAPACITY         (256)
+#define SMALL_CAPACITY   (16)
+#define VERSION          (7)
+#define VERTEX_COMBOS    (12)
+#define FRAGMENT_COMBOS  (20)
+#define COMBOS           (VERTEX_COMBOS + FRAGMENT_COMBOS)
+#define FRAME_LOOKUPS    (60)
+#define PATCH_US         (300)
+#define FRAGMENT_ID      (10)
+#define PRELOAD_PRIORITY (0x10000100 + 32)
+
+/* A program of the mocked patcher, with the combination it was patched for */
+typedef struct MockProgram {
+	SceUInt32 type;                /* One of VitasdkGxmShaderType */
+	SceGxmShaderPatcherId id;
+	SceUInt32 detail;              /* Component count of the second attribute, or blend factors + 1 */
+	const SceGxmProgram *vertex;   /* Fragment, the linked vertex program */
+} MockProgram;
+
+static struct {
+	VitasdkGxmShaderCache cache;
+	VitasdkGxmShaderEntry entries[CAPACITY];
+	const char *path;
+	volatile SceUInt32 patching;   /* 1 while a thread is in the patcher */
+	SceUInt32 patched;
+	SceUInt32 released;
+	SceUInt32 hits_while_patching;
+} mock;
+
+static SceGxmShaderPatcherId patcher_id(SceUInt32 id)
+{
+	return (SceGxmShaderPatcherId)(uintptr_t)(0x1000 * id);
+}
+
+static void patcher_enter(void)
+{
+	HOST_CHECK(__atomic_exchange_n(&mock.patching, 1, __ATOMIC_ACQUIRE) == 0);
+	sceKernelDelayThread(PATCH_US);
+}
+
+static void patcher_leave(void)
+{
+	__atomic_add_fetch(&mock.patched, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&mock.patching, 0, __ATOMIC_RELEASE);
+}
+
+static MockProgram *program_new(SceUInt32 type, SceGxmShaderPatcherId id, SceUInt32 detail, const SceGxmProgram *vertex)
+{
+	MockProgram *p = malloc(sizeof(*p));
+
+	HOST_CHECK(p);
+	p->type   = type;
+	p->id     = id;
+	p->detail = detail;
+	p->vertex = vertex;
+	return p;
+}
+
+int sceGxmShaderPatcherCreateVertexProgram(SceGxmShaderPatcher *shaderPatcher, SceGxmShaderPatcherId programId, const SceGxmVertexAttribute *attributes,
+	unsigned int attributeCount, const SceGxmVertexStream *streams, unsigned int streamCount, SceGxmVertexProgram **vertexProgram)
+{
+	(void)shaderPatcher;
+	(void)streams;
+	patcher_enter();
+	HOST_CHECK(attributeCount == 2 && streamCount == 1);
+	*vertexProgram = (SceGxmVertexProgram *)program_new(VITASDK_GXM_SHADER_VERTEX, programId, attributes[1].componentCount, NULL);
+	patcher_leave();
+	return 0;
+}
+
+int sceGxmShaderPatcherCreateFragmentProgram(SceGxmShaderPatcher *shaderPatcher, SceGxmShaderPatcherId programId, SceGxmOutputRegisterFormat outputFormat,
+	SceGxmMultisampleMode multisampleMode, const SceGxmBlendInfo *blendInfo, const SceGxmProgram *vertexProgram, SceGxmFragmentProgram **fragmentProgram)
+{
+	(void)shaderPatcher;
+	patcher_enter();
+	HOST_CHECK(outputFormat == SCE_GXM_OUTPUT_REGISTER_FORMAT_UCHAR4 && multisampleMode == SCE_GXM_MULTISAMPLE_NONE);
+	*fragmentProgram = (SceGxmFragmentProgram *)program_new(VITASDK_GXM_SHADER_FRAGMENT, programId,
+	                                                        blendInfo ? 1 + (blendInfo->colorSrc | blendInfo->colorDst << 4) : 0,
+	                                                        vertexProgram);
+	patcher_leave();
+	return 0;
+}
+
+const SceGxmProgram *sceGxmShaderPatcherGetProgramFromId(SceGxmShaderPatcherId programId)
+{
+	return (const SceGxmProgram *)programId;
+}
+
+int sceGxmShaderPatcherReleaseVertexProgram(SceGxmShaderPatcher *shaderPatcher, SceGxmVertexProgram *vertexProgram)
+{
+	(void)shaderPatcher;
+	HOST_CHECK(((MockProgram *)vertexProgram)->type == VITASDK_GXM_SHADER_VERTEX);
+	free(vertexProgram);
+	mock.released++;
+	return 0;
+}
+
+int sceGxmShaderPatcherReleaseFragmentProgram(SceGxmShaderPatcher *shaderPatcher, SceGxmFragmentProgram *fragmentProgram)
+{
+	(void)shaderPatcher;
+	HOST_CHECK(((MockProgram *)fragmentProgram)->type == VITASDK_GXM_SHADER_FRAGMENT);
+	free(fragmentProgram);
+	mock.released++;
+	return 0;
+}
+
+/* Vertex combination k: one of 3 programs, with 1 to 4 components in the second attribute */
+static int lookup_vertex(SceUInt32 k, SceGxmVertexProgram **vp)
+{
+	SceGxmVertexAttribute attributes[2] = {
+		{ 0, 0, SCE_GXM_ATTRIBUTE_FORMAT_F32, 3, 0 },
+		{ 0, 12, SCE_GXM_ATTRIBUTE_FORMAT_F32, 1 + k % 4, 1 },
+	};
+	SceGxmVertexStream stream = { 28, SCE_GXM_INDEX_SOURCE_INDEX_16BIT };
+
+	return vitasdk_gxm_shader_cache_vertex_program(&mock.cache, 1 + k % 3, attributes, 2, &stream, 1, vp);
+}
+
+static void check_vertex(SceUInt32 k, const SceGxmVertexProgram *vp)
+{
+	const MockProgram *p = (const MockProgram *)vp;
+
+	HOST_CHECK(p->type == VITASDK_GXM_SHADER_VERTEX && p->id == patcher_id(1 + k % 3) && p->detail == 1 + k % 4);
+}
+
+/* Fragment combination k: linked with one of the 3 vertex programs, not blended for 0, else by its blend factors */
+static int lookup_fragment(SceUInt32 k, SceGxmFragmentProgram **fp)
+{
+	SceGxmBlendInfo blend;
+
+	memset(&blend, 0, sizeof(blend));
+	blend.colorMask = SCE_GXM_COLOR_MASK_ALL;
+	blend.colorSrc  = (k - 1) % 11;
+	blend.colorDst  = (k - 1) / 11;
+	return vitasdk_gxm_shader_cache_fragment_program(&mock.cache, FRAGMENT_ID, SCE_GXM_OUTPUT_REGISTER_FORMAT_UCHAR4, SCE_GXM_MULTISAMPLE_NONE,
+	                                                 k ? &blend : NULL, 1 + k % 3, fp);
+}
+
+static void check_fragment(SceUInt32 k, const SceGxmFragmentProgram *fp)
+{
+	const MockProgram *p = (const MockProgram *)fp;
+
+	HOST_CHECK(p->type == VITASDK_GXM_SHADER_FRAGMENT && p->id == patcher_id(FRAGMENT_ID));
+	HOST_CHECK(p->detail == (k ? 1 + ((k - 1) % 11 | (k - 1) / 11 << 4) : 0));
+	HOST_CHECK(p->vertex == (const SceGxmProgram *)patcher_id(1 + k % 3));
+}
+
+/* Look up the combinations of lookups [first, first + count) */
+static void frame(SceUInt32 first, SceUInt32 count)
+{
+	SceGxmVertexProgram *vp;
+	SceGxmFragmentProgram *fp;
+	SceUInt32 k, hits;
+
+	for (k = first; k < first + count; k++) {
+		hits = mock.cache.hits;
+		HOST_CHECK(lookup_vertex(k % VERTEX_COMBOS, &vp) == 0);
+		check_vertex(k % VERTEX_COMBOS, vp);
+		HOST_CHECK(lookup_fragment(k % FRAGMENT_COMBOS, &fp) == 0);
+		check_fragment(k % FRAGMENT_COMBOS, fp);
+		/* The hits of this thread, the preload thread does not count any */
+		if (mock.cache.hits != hits && vitasdk_atomic_load_acquire32(&mock.patching))
+			mock.hits_while_patching++;
+	}
+}
+
+static void cache_create(SceUInt32 capacity)
+{
+	SceUInt32 id;
+
+	mock.patched             = 0;
+	mock.released            = 0;
+	mock.hits_while_patching = 0;
+	HOST_CHECK(vitasdk_gxm_shader_cache_create(&mock.cache, NULL, mock.entries, capacity) == 0);
+	for (id = 1; id <= 3; id++)
+		HOST_CHECK(vitasdk_gxm_shader_cache_register(&mock.cache, id, patcher_id(id)) == 0);
+	HOST_CHECK(vitasdk_gxm_shader_cache_register(&mock.cache, FRAGMENT_ID, patcher_id(FRAGMENT_ID)) == 0);
+}
+
+static void cache_delete(void)
+{
+	HOST_CHECK(vitasdk_gxm_shader_cache_delete(&mock.cache) == 0);
+	HOST_CHECK(mock.released == mock.patched);
+}
+
+static void preload(SceUInt32 version)
+{
+	HOST_CHECK(vitasdk_gxm_shader_cache_preload(&mock.cache, mock.path, version, PRELOAD_PRIORITY, 0x4000, SCE_KERNEL_CPU_MASK_USER_2) == 0);
+}
+
+static void check_cold(void)
+{
+	VitasdkGxmShaderCache *cache = &mock.cache;
+
+	remove(mock.path);
+	cache_create(CAPACITY);
+	preload(VERSION);
+	HOST_CHECK(vitasdk_gxm_shader_cache_wait_preload(cache) < 0);
+	HOST_CHECK(cache->preloaded == 0 && cache->count == 0);
+
+	frame(0, FRAME_LOOKUPS);
+	HOST_CHECK(cache->misses == COMBOS && cache->count == COMBOS && mock.patched == COMBOS);
+	HOST_CHECK(cache->hits == 2 * FRAME_LOOKUPS - COMBOS);
+	frame(0, FRAME_LOOKUPS);
+	HOST_CHECK(cache->misses == COMBOS && cache->hits == 4 * FRAME_LOOKUPS - COMBOS);
+	HOST_CHECK(vitasdk_gxm_shader_cache_save(cache, mock.path, VERSION) == 0);
+	printf("cold: %u misses, %u hits, saved\n", cache->misses, cache->hits);
+	cache_delete();
+}
+
+static void check_warm(void)
+{
+	VitasdkGxmShaderCache *cache = &mock.cache;
+
+	cache_create(CAPACITY);
+	preload(VERSION);
+	HOST_CHECK(vitasdk_gxm_shader_cache_wait_preload(cache) == 0);
+	HOST_CHECK(cache->preloaded == COMBOS && cache->count == COMBOS && mock.patched == COMBOS);
+	frame(0, FRAME_LOOKUPS);
+	HOST_CHECK(cache->misses == 0 && cache->hits == 2 * FRAME_LOOKUPS);
+	printf("warm: %u preloaded, %u misses\n", cache->preloaded, cache->misses);
+	cache_delete();
+}
+
+/* The frames start with the preload, and miss the combinations it has not reached */
+static void check_concurrent_misses(void)
+{
+	VitasdkGxmShaderCache *cache = &mock.cache;
+	SceUInt32 frames = 0;
+
+	cache_create(CAPACITY);
+	preload(VERSION);
+	while (__atomic_load_n(&mock.patched, __ATOMIC_RELAXED) < COMBOS) {
+		frame(frames * 7, FRAME_LOOKUPS);
+		frames++;
+	}
+	HOST_CHECK(vitasdk_gxm_shader_cache_wait_preload(cache) == 0);
+	/* Each combination patched once, by either thread */
+	HOST_CHECK(cache->count == COMBOS && mock.patched == COMBOS);
+	HOST_CHECK(cache->preloaded + cache->misses == COMBOS);
+	frame(0, FRAME_LOOKUPS);
+	printf("frames during preload: %u frames, %u preloaded, %u misses\n", frames, cache->preloaded, cache->misses);
+	cache_delete();
+}
+
+/* The frames hit patched combinations while the preload thread patches the others */
+static void check_hits_during_preload(void)
+{
+	VitasdkGxmShaderCache *cache = &mock.cache;
+	SceUInt32 frames = 0, misses;
+	double worst = 0, t;
+
+	cache_create(CAPACITY);
+	frame(0, 6);
+	misses = cache->misses;
+	HOST_CHECK(misses == 12);
+	preload(VERSION);
+	while (__atomic_load_n(&mock.patched, __ATOMIC_RELAXED) < COMBOS) {
+		t = host_seconds();
+		frame(0, 6);
+		t = host_seconds() - t;
+		if (t > worst)
+			worst = t;
+		frames++;
+	}
+	HOST_CHECK(vitasdk_gxm_shader_cache_wait_preload(cache) == 0);
+	HOST_CHECK(cache->misses == misses && cache->preloaded == COMBOS - misses && mock.patched == COMBOS);
+	HOST_CHECK(mock.hits_while_patching > 0);
+	printf("hits during preload: %u frames, %u hits while patching, worst frame %.0f us, %u us per patch\n",
+	       frames, mock.hits_while_patching, worst * 1e6, PATCH_US);
+	cache_delete();
+}
+
+static void check_other_version(void)
+{
+	VitasdkGxmShaderCache *cache = &mock.cache;
+
+	cache_create(CAPACITY);
+	preload(VERSION + 1);
+	HOST_CHECK(vitasdk_gxm_shader_cache_wait_preload(cache) == 0);
+	HOST_CHECK(cache->preloaded == 0 && cache->count == 0 && mock.patched == 0);
+	cache_delete();
+}
+
+/* The preload keeps one free entry, which the frames get, then lookups of new combinations fail */
+static void check_full_table(void)
+{
+	VitasdkGxmShaderCache *cache = &mock.cache;
+	SceGxmVertexProgram *vp;
+	SceGxmFragmentProgram *fp;
+	SceUInt32 k, found = 0, full = 0;
+	int res;
+
+	cache_create(SMALL_CAPACITY);
+	preload(VERSION);
+	HOST_CHECK(vitasdk_gxm_shader_cache_wait_preload(cache) == (int)SCE_KERNEL_ERROR_NO_MEMORY);
+	HOST_CHECK(cache->preloaded == SMALL_CAPACITY - 1 && cache->count == SMALL_CAPACITY - 1);
+
+	for (k = 0; k < COMBOS; k++) {
+		if (k < VERTEX_COMBOS) {
+			res = lookup_vertex(k, &vp);
+			if (res == 0)
+				check_vertex(k, vp);
+		} else {
+			res = lookup_fragment(k - VERTEX_COMBOS, &fp);
+			if (res == 0)
+				check_fragment(k - VERTEX_COMBOS, fp);
+		}
+		if (res == 0)
+			found++;
+		else if (res == (int)SCE_KERNEL_ERROR_NO_MEMORY)
+			full++;
+	}
+	HOST_CHECK(found == SMALL_CAPACITY && full == COMBOS - SMALL_CAPACITY);
+	HOST_CHECK(cache->misses == 1 && cache->count == SMALL_CAPACITY && mock.patched == SMALL_CAPACITY);
+	HOST_CHECK(cache->hits == SMALL_CAPACITY - 1);
+	printf("full table: %u preloaded, %u found, %u out of entries\n", cache->preloaded, found, full);
+	cache_delete();
+}
+
+/* The keys written before the end of a truncated file are preloaded */
+static void check_truncated(void)
+{
+	VitasdkGxmShaderCache *cache = &mock.cache;
+
+	HOST_CHECK(truncate(mock.path, sizeof(VitasdkGxmShaderFileHeader) + 10 * sizeof(VitasdkGxmShaderKey) + sizeof(VitasdkGxmShaderKey) / 2) == 0);
+	cache_create(CAPACITY);
+	preload(VERSION);
+	HOST_CHECK(vitasdk_gxm_shader_cache_wait_preload(cache) == 0);
+	HOST_CHECK(cache->preloaded == 10 && mock.patched == 10);
+	frame(0, FRAME_LOOKUPS);
+	HOST_CHECK(cache->misses == COMBOS - 10);
+	cache_delete();
+}
+
+int main(int argc, char *argv[])
+{
+	mock.path = argc > 1 ? argv[1] : "gxmshadercache_stress.bin";
+
+	HOST_CHECK(vitasdk_gxm_shader_cache_create(&mock.cache, NULL, mock.entries, 24) < 0);
+	check_cold();
+	check_warm();
+	check_concurrent_misses();
+	check_hits_during_preload();
+	check_other_version();
+	check_full_table();
+	check_truncated();
+	HOST_CHECK(remove(mock.path) == 0);
+	printf("ok\n");
+	return 0;
+}
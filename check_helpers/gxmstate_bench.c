@@ -0,0 +1,333 @@
+/*
+ * Test and benchmark of the vitasdk/gxmstate.h state filter and recorder,
+ * over GXM mocks.
+ *
+ * usage: gxmstate_bench [draws]
+ *
+ * The mocks keep the state of the context, and every draw checks that the
+ * context holds the state of the recorded draw: the filter must only drop
+ * the changes to the value already set. A scene of draws over 6 programs
+ * and 8 textures is recorded, then flushed in recording order and sorted
+ * by VITASDK_GXM_SORT_KEY, and the test prints the sceGxmSet* calls of
+ * both. The sort must keep the recording order of the draws sharing a key.
+ * The test also checks that vitasdk_gxm_state_invalidate lets the next
+ * change of every state through, even to the value shadowed before.
+ */
+
+#include <string.h>
+#include <vitasdk/gxmstate.h>
+
+#include "host_kernel.h"
+
+#define DRAWS    (4000)
+#define PROGRAMS (6)
+#define TEXTURES (8)
+
+/* The state of the mocked context */
+static struct {
+	const SceGxmVertexProgram *vertex_program;
+	const SceGxmFragmentProgram *fragment_program;
+	const void *vertex_uniforms;
+	const void *fragment_uniforms;
+	SceGxmTexture fragment_textures[SCE_GXM_MAX_TEXTURE_UNITS];
+	SceGxmTexture vertex_textures[SCE_GXM_MAX_TEXTURE_UNITS];
+	const void *streams[SCE_GXM_MAX_VERTEX_STREAMS];
+	uintptr_t scalars[_VITASDK_GXM_STATE_COUNT];
+	SceUInt32 calls;               /* sceGxmSet* calls */
+	SceUInt32 draws;
+	const VitasdkGxmDraw *last;    /* The draw submitted before */
+	SceUInt32 order_errors;        /* Draws out of key or recording order */
+	SceBool sorted;
+} gxm;
+
+void sceGxmSetVertexProgram(SceGxmContext *context, const SceGxmVertexProgram *vertexProgram)
+{
+	(void)context;
+	gxm.vertex_program = vertexProgram;
+	gxm.calls++;
+}
+
+void sceGxmSetFragmentProgram(SceGxmContext *context, const SceGxmFragmentProgram *fragmentProgram)
+{
+	(void)context;
+	gxm.fragment_program = fragmentProgram;
+	gxm.calls++;
+}
+
+int sceGxmSetVertexDefaultUniformBuffer(SceGxmContext *context, const void *uniformBuffer)
+{
+	(void)context;
+	gxm.vertex_uniforms = uniformBuffer;
+	gxm.calls++;
+	return 0;
+}
+
+int sceGxmSetFragmentDefaultUniformBuffer(SceGxmContext *context, const void *uniformBuffer)
+{
+	(void)context;
+	gxm.fragment_uniforms = uniformBuffer;
+	gxm.calls++;
+	return 0;
+}
+
+int sceGxmSetFragmentTexture(SceGxmContext *context, unsigned int textureIndex, const SceGxmTexture *texture)
+{
+	(void)context;
+	gxm.fragment_textures[textureIndex] = *texture;
+	gxm.calls++;
+	return 0;
+}
+
+int sceGxmSetVertexTexture(SceGxmContext *context, unsigned int textureIndex, const SceGxmTexture *texture)
+{
+	(void)context;
+	gxm.vertex_textures[textureIndex] = *texture;
+	gxm.calls++;
+	return 0;
+}
+
+int sceGxmSetVertexStream(SceGxmContext *context, unsigned int streamIndex, const void *streamData)
+{
+	(void)context;
+	gxm.streams[streamIndex] = streamData;
+	gxm.calls++;
+	return 0;
+}
+
+static void set_scalar(SceUInt32 index, uintptr_t value)
+{
+	gxm.scalars[index] = value;
+	gxm.calls++;
+}
+
+void sceGxmSetFrontDepthFunc(SceGxmContext *context, SceGxmDepthFunc depthFunc)
+{
+	(void)context;
+	set_scalar(_VITASDK_GXM_STATE_FRONT_DEPTH_FUNC, depthFunc);
+}
+
+void sceGxmSetBackDepthFunc(SceGxmContext *context, SceGxmDepthFunc depthFunc)
+{
+	(void)context;
+	set_scalar(_VITASDK_GXM_STATE_BACK_DEPTH_FUNC, depthFunc);
+}
+
+void sceGxmSetFrontDepthWriteEnable(SceGxmContext *context, SceGxmDepthWriteMode enable)
+{
+	(void)context;
+	set_scalar(_VITASDK_GXM_STATE_FRONT_DEPTH_WRITE, enable);
+}
+
+void sceGxmSetBackDepthWriteEnable(SceGxmContext *context, SceGxmDepthWriteMode enable)
+{
+	(void)context;
+	set_scalar(_VITASDK_GXM_STATE_BACK_DEPTH_WRITE, enable);
+}
+
+void sceGxmSetFrontPolygonMode(SceGxmContext *context, SceGxmPolygonMode mode)
+{
+	(void)context;
+	set_scalar(_VITASDK_GXM_STATE_FRONT_POLYGON_MODE, mode);
+}
+
+void sceGxmSetBackPolygonMode(SceGxmContext *context, SceGxmPolygonMode mode)
+{
+	(void)context;
+	set_scalar(_VITASDK_GXM_STATE_BACK_POLYGON_MODE, mode);
+}
+
+void sceGxmSetFrontStencilRef(SceGxmContext *context, unsigned int sref)
+{
+	(void)context;
+	set_scalar(_VITASDK_GXM_STATE_FRONT_STENCIL_REF, sref);
+}
+
+void sceGxmSetBackStencilRef(SceGxmContext *context, unsigned int sref)
+{
+	(void)context;
+	set_scalar(_VITASDK_GXM_STATE_BACK_STENCIL_REF, sref);
+}
+
+void sceGxmSetCullMode(SceGxmContext *context, SceGxmCullMode mode)
+{
+	(void)context;
+	set_scalar(_VITASDK_GXM_STATE_CULL_MODE, mode);
+}
+
+void sceGxmSetTwoSidedEnable(SceGxmContext *context, SceGxmTwoSidedMode mode)
+{
+	(void)context;
+	set_scalar(_VITASDK_GXM_STATE_TWO_SIDED, mode);
+}
+
+/* The indices of the recorded draws are the draws themselves */
+int sceGxmDraw(SceGxmContext *context, SceGxmPrimitiveType primType, SceGxmIndexFormat indexType, const void *indexData, unsigned int indexCount)
+{
+	const VitasdkGxmDraw *d = indexData;
+	SceUInt32 i;
+
+	(void)context, (void)primType, (void)indexType, (void)indexCount;
+	HOST_CHECK(gxm.vertex_program == d->vertex_program && gxm.fragment_program == d->fragment_program);
+	HOST_CHECK(gxm.vertex_uniforms == d->vertex_uniforms && gxm.fragment_uniforms == d->fragment_uniforms);
+	for (i = 0; i < VITASDK_GXM_DRAW_TEXTURES; i++)
+		HOST_CHECK(memcmp(&gxm.fragment_textures[i], d->textures[i], sizeof(SceGxmTexture)) == 0);
+	for (i = 0; i < VITASDK_GXM_DRAW_STREAMS; i++)
+		HOST_CHECK(gxm.streams[i] == d->streams[i]);
+	HOST_CHECK(gxm.scalars[_VITASDK_GXM_STATE_FRONT_DEPTH_FUNC] == d->depth_func);
+	HOST_CHECK(gxm.scalars[_VITASDK_GXM_STATE_FRONT_DEPTH_WRITE] == d->depth_write);
+	HOST_CHECK(gxm.scalars[_VITASDK_GXM_STATE_CULL_MODE] == d->cull_mode);
+
+	if (gxm.last && (gxm.sorted ? gxm.last->sort_key > d->sort_key ||
+	                              (gxm.last->sort_key == d->sort_key && gxm.last > d)
+	                            : gxm.last > d))
+		gxm.order_errors++;
+	gxm.last = d;
+	gxm.draws++;
+	return 0;
+}
+
+static VitasdkGxmDraw draws[DRAWS];
+static SceUInt32 order[2 * DRAWS];
+static SceGxmTexture textures[TEXTURES];
+static char uniforms[DRAWS][16];
+static char vertices[DRAWS][16];
+
+static void record_scene(VitasdkGxmRecorder *rec, SceUInt32 n, SceUInt32 seed)
+{
+	VitasdkGxmDraw *d;
+	SceUInt32 i, p, t;
+
+	for (i = 0; i < n; i++) {
+		seed = seed * 1103515245 + 12345;
+		p = (seed >> 16) % PROGRAMS;
+		t = (seed >> 8) % TEXTURES;
+		d = vitasdk_gxm_recorder_add(rec);
+		HOST_CHECK(d);
+		d->vertex_program    = (const SceGxmVertexProgram *)(uintptr_t)(0x1000 + p * 16);
+		d->fragment_program  = (const SceGxmFragmentProgram *)(uintptr_t)(0x2000 + p * 16);
+		d->textures[0]       = &textures[t];
+		d->textures[1]       = &textures[(t + 1) % TEXTURES];
+		d->textures[2]       = &textures[0];
+		d->textures[3]       = &textures[1];
+		d->streams[0]        = vertices[i];
+		d->streams[1]        = vertices[p];
+		d->vertex_uniforms   = uniforms[i];
+		d->fragment_uniforms = uniforms[p];
+		d->cull_mode         = p & 1 ? SCE_GXM_CULL_CW : SCE_GXM_CULL_NONE;
+		d->primitive         = SCE_GXM_PRIMITIVE_TRIANGLES;
+		d->index_format      = SCE_GXM_INDEX_FORMAT_U16;
+		d->indices           = d;
+		d->index_count       = 3;
+		/* The layer of a few draws sets the high byte */
+		d->sort_key          = VITASDK_GXM_SORT_KEY(i % 16 == 0, p, t, 0);
+	}
+	if (n == DRAWS)
+		HOST_CHECK(vitasdk_gxm_recorder_add(rec) == NULL);
+}
+
+static SceUInt32 flush_scene(SceUInt32 n, SceBool sorted)
+{
+	VitasdkGxmState state;
+	VitasdkGxmRecorder rec;
+
+	memset(&gxm, 0, sizeof(gxm));
+	gxm.sorted = sorted;
+	vitasdk_gxm_state_init(&state, NULL);
+	vitasdk_gxm_recorder_init(&rec, &state, draws, order, DRAWS);
+	record_scene(&rec, n, 2);
+	HOST_CHECK(vitasdk_gxm_recorder_flush(&rec, sorted) == 0);
+	HOST_CHECK(rec.count == 0);
+	HOST_CHECK(gxm.draws == n && state.stats.draws == n);
+	HOST_CHECK(gxm.order_errors == 0);
+	HOST_CHECK(state.stats.submitted == gxm.calls);
+	return gxm.calls;
+}
+
+/* Keys of a few values in every byte: most passes move the draws */
+static void check_sort(SceUInt32 n)
+{
+	VitasdkGxmRecorder rec;
+	VitasdkGxmState state;
+	SceUInt32 *sorted, i, seed = 7;
+
+	vitasdk_gxm_state_init(&state, NULL);
+	vitasdk_gxm_recorder_init(&rec, &state, draws, order, DRAWS);
+	for (i = 0; i < n; i++) {
+		seed = seed * 1103515245 + 12345;
+		HOST_CHECK(vitasdk_gxm_recorder_add(&rec));
+		draws[i].sort_key = (seed >> 4) & 0x03030303;
+	}
+	sorted = _vitasdk_gxm_recorder_sort(&rec);
+	for (i = 1; i < n; i++) {
+		HOST_CHECK(draws[sorted[i - 1]].sort_key <= draws[sorted[i]].sort_key);
+		if (draws[sorted[i - 1]].sort_key == draws[sorted[i]].sort_key)
+			HOST_CHECK(sorted[i - 1] < sorted[i]);
+	}
+
+	/* All keys equal: the recording order */
+	for (i = 0; i < n; i++)
+		draws[i].sort_key = 0x12345678;
+	sorted = _vitasdk_gxm_recorder_sort(&rec);
+	for (i = 0; i < n; i++)
+		HOST_CHECK(sorted[i] == i);
+}
+
+static void check_invalidate(void)
+{
+	VitasdkGxmState state;
+	SceUInt32 i, calls;
+	const void *vertex = vertices[0];
+
+	memset(&gxm, 0, sizeof(gxm));
+	vitasdk_gxm_state_init(&state, NULL);
+	for (i = 0; i < 3; i++) {
+		calls = gxm.calls;
+		vitasdk_gxm_set_vertex_program(&state, (const SceGxmVertexProgram *)(uintptr_t)0x1000);
+		vitasdk_gxm_set_fragment_program(&state, (const SceGxmFragmentProgram *)(uintptr_t)0x2000);
+		HOST_CHECK(vitasdk_gxm_set_vertex_default_uniform_buffer(&state, uniforms[0]) == 0);
+		HOST_CHECK(vitasdk_gxm_set_fragment_default_uniform_buffer(&state, uniforms[1]) == 0);
+		HOST_CHECK(vitasdk_gxm_set_fragment_texture(&state, 0, &textures[0]) == 0);
+		HOST_CHECK(vitasdk_gxm_set_vertex_texture(&state, 0, &textures[1]) == 0);
+		HOST_CHECK(vitasdk_gxm_set_vertex_stream(&state, 0, vertex) == 0);
+		vitasdk_gxm_set_front_depth_func(&state, SCE_GXM_DEPTH_FUNC_LESS);
+		vitasdk_gxm_set_back_depth_func(&state, SCE_GXM_DEPTH_FUNC_LESS);
+		vitasdk_gxm_set_front_depth_write_enable(&state, SCE_GXM_DEPTH_WRITE_DISABLED);
+		vitasdk_gxm_set_back_depth_write_enable(&state, SCE_GXM_DEPTH_WRITE_DISABLED);
+		vitasdk_gxm_set_front_polygon_mode(&state, SCE_GXM_POLYGON_MODE_LINE);
+		vitasdk_gxm_set_back_polygon_mode(&state, SCE_GXM_POLYGON_MODE_LINE);
+		vitasdk_gxm_set_front_stencil_ref(&state, 1);
+		vitasdk_gxm_set_back_stencil_ref(&state, 1);
+		vitasdk_gxm_set_cull_mode(&state, SCE_GXM_CULL_CW);
+		vitasdk_gxm_set_two_sided_enable(&state, SCE_GXM_TWO_SIDED_ENABLED);
+		/* Everything once, then nothing but after an invalidate */
+		HOST_CHECK(gxm.calls - calls == (i == 1 ? 0 : 17));
+		if (i == 1)
+			vitasdk_gxm_state_invalidate(&state);
+	}
+	HOST_CHECK(state.stats.submitted == 2 * 17 && state.stats.elided == 17);
+	HOST_CHECK(vitasdk_gxm_set_fragment_texture(&state, SCE_GXM_MAX_TEXTURE_UNITS, &textures[0]) == (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT);
+	HOST_CHECK(vitasdk_gxm_set_vertex_stream(&state, SCE_GXM_MAX_VERTEX_STREAMS, vertex) == (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT);
+}
+
+int main(int argc, char *argv[])
+{
+	SceUInt32 n = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : DRAWS;
+	SceUInt32 i, unsorted_calls, sorted_calls;
+
+	HOST_CHECK(n > 0 && n <= DRAWS);
+	for (i = 0; i < TEXTURES; i++)
+		memset(&textures[i], (int)i + 1, sizeof(textures[i]));
+
+	check_invalidate();
+	check_sort(n);
+
+	unsorted_calls = flush_scene(n, SCE_FALSE);
+	sorted_calls   = flush_scene(n, SCE_TRUE);
+	HOST_CHECK(sorted_calls < unsorted_calls);
+	printf("%u draws, %u programs, %u textures\n", n, PROGRAMS, TEXTURES);
+	printf("%-10s %12s %14s\n", "", "state calls", "calls per draw");
+	printf("%-10s %12u %14.2f\n", "recorded", unsorted_calls, (double)unsorted_calls / n);
+	printf("%-10s %12u %14.2f\n", "sorted", sorted_calls, (double)sorted_calls / n);
+	printf("ok\n");
+	return 0;
+}
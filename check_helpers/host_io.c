@@ -0,0 +1,70 @@
+/*
+ * SceIo over the host files, the errors are SCE_ERROR_ERRNO_* like on the
+ * Vita. The psp2 headers come first: the st_atime of SceIoStat is a macro
+ * of the host <sys/stat.h>.
+ */
+
+#include <psp2/io/fcntl.h>
+#include <psp2/kernel/error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "host_kernel.h"
+
+static int host_io_error(void)
+{
+	return (int)(0x80010000 | errno);
+}
+
+SceUID sceIoOpen(const char *file, int flags, SceMode mode)
+{
+	int host_flags = 0, fd;
+
+	host_kernel_count_call();
+	switch (flags & SCE_O_RDWR) {
+	case SCE_O_RDONLY:
+		host_flags = O_RDONLY;
+		break;
+	case SCE_O_WRONLY:
+		host_flags = O_WRONLY;
+		break;
+	default:
+		host_flags = O_RDWR;
+		break;
+	}
+	if (flags & SCE_O_APPEND)
+		host_flags |= O_APPEND;
+	if (flags & SCE_O_CREAT)
+		host_flags |= O_CREAT;
+	if (flags & SCE_O_TRUNC)
+		host_flags |= O_TRUNC;
+	if (flags & SCE_O_EXCL)
+		host_flags |= O_EXCL;
+	fd = open(file, host_flags, mode);
+	return fd < 0 ? host_io_error() : fd;
+}
+
+int sceIoClose(SceUID fd)
+{
+	host_kernel_count_call();
+	return close(fd) < 0 ? host_io_error() : 0;
+}
+
+SceSSize sceIoRead(SceUID fd, void *buf, SceSize nbyte)
+{
+	ssize_t n;
+
+	host_kernel_count_call();
+	n = read(fd, buf, nbyte);
+	return n < 0 ? host_io_error() : (SceSSize)n;
+}
+
+SceSSize sceIoWrite(SceUID fd, const void *buf, SceSize nbyte)
+{
+	ssize_t n;
+
+	host_kernel_count_call();
+	n = write(fd, buf, nbyte);
+	return n < 0 ? host_io_error() : (SceSSize)n;
+}
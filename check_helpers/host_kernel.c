@@ -0,0 +1,1056 @@
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <psp2/fiber.h>
+#include <psp2/perf.h>
+#include <psp2/kernel/clib.h>
+#include <psp2/kernel/cpu.h>
+#include <psp2/kernel/error.h>
+#include <psp2/kernel/processmgr.h>
+#include <psp2/kernel/sysmem.h>
+#include <psp2/kernel/threadmgr/thread.h>
+#include <psp2/kernel/threadmgr/eventflag.h>
+#include <psp2/kernel/threadmgr/msgpipe.h>
+#include <psp2/kernel/threadmgr/semaphore.h>
+
+#include "host_kernel.h"
+
+double host_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* SceCpu atomics, sequentially consistent like the ldrex/strex loops plus dmb */
+
+SceInt32 sceKernelAtomicCompareAndSet32(SceInt32 *store, SceInt32 value, SceInt32 new_value)
+{
+	__atomic_compare_exchange_n(store, &value, new_value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return value;
+}
+
+SceInt32 sceKernelAtomicAddAndGet32(SceInt32 *store, SceInt32 value)
+{
+	return __atomic_add_fetch(store, value, __ATOMIC_SEQ_CST);
+}
+
+SceInt32 sceKernelAtomicGetAndSet32(SceInt32 *store, SceInt32 value)
+{
+	return __atomic_exchange_n(store, value, __ATOMIC_SEQ_CST);
+}
+
+SceInt32 sceKernelAtomicGetAndOr32(SceInt32 *store, SceInt32 value)
+{
+	return __atomic_fetch_or(store, value, __ATOMIC_SEQ_CST);
+}
+
+SceInt32 sceKernelAtomicGetAndAnd32(SceInt32 *store, SceInt32 value)
+{
+	return __atomic_fetch_and(store, value, __ATOMIC_SEQ_CST);
+}
+
+/* Semaphores, a counter behind a mutex and a condition variable each */
+
+#define HOST_SEMAS (256)
+
+typedef struct HostSema {
+	int used;
+	int count;
+	int max;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} HostSema;
+
+static HostSema host_semas[HOST_SEMAS];
+static pthread_mutex_t host_semas_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long host_calls;
+
+unsigned long host_kernel_calls(void)
+{
+	return __atomic_load_n(&host_calls, __ATOMIC_RELAXED);
+}
+
+void host_kernel_count_call(void)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+}
+
+/* The CLOCK_MONOTONIC time `timeout` us from now */
+static void host_deadline(struct timespec *deadline, SceUInt timeout)
+{
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec  += timeout / 1000000;
+	deadline->tv_nsec += (timeout % 1000000) * 1000;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+/* Every call counts as a syscall */
+static HostSema *host_sema(SceUID semaid)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (semaid <= 0 || semaid > HOST_SEMAS || !host_semas[semaid - 1].used)
+		return NULL;
+	return &host_semas[semaid - 1];
+}
+
+SceUID sceKernelCreateSema(const char *name, SceUInt attr, int initVal, int maxVal, SceKernelSemaOptParam *option)
+{
+	pthread_condattr_t cond_attr;
+	SceUID id;
+
+	(void)name;
+	(void)attr;
+	(void)option;
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (initVal < 0 || maxVal <= 0 || initVal > maxVal)
+		return SCE_KERNEL_ERROR_ILLEGAL_COUNT;
+	pthread_mutex_lock(&host_semas_lock);
+	for (id = 0; id < HOST_SEMAS && host_semas[id].used; id++)
+		;
+	if (id == HOST_SEMAS) {
+		pthread_mutex_unlock(&host_semas_lock);
+		return SCE_KERNEL_ERROR_NO_MEMORY;
+	}
+	host_semas[id].used  = 1;
+	host_semas[id].count = initVal;
+	host_semas[id].max   = maxVal;
+	pthread_mutex_init(&host_semas[id].lock, NULL);
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&host_semas[id].cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+	pthread_mutex_unlock(&host_semas_lock);
+	return id + 1;
+}
+
+/* Only deleted once no thread waits on it */
+int sceKernelDeleteSema(SceUID semaid)
+{
+	HostSema *sema = host_sema(semaid);
+
+	if (!sema)
+		return SCE_KERNEL_ERROR_UNKNOWN_SEMA_ID;
+	pthread_mutex_lock(&host_semas_lock);
+	pthread_mutex_destroy(&sema->lock);
+	pthread_cond_destroy(&sema->cond);
+	sema->used = 0;
+	pthread_mutex_unlock(&host_semas_lock);
+	return 0;
+}
+
+int sceKernelSignalSema(SceUID semaid, int signal)
+{
+	HostSema *sema = host_sema(semaid);
+
+	if (!sema)
+		return SCE_KERNEL_ERROR_UNKNOWN_SEMA_ID;
+	pthread_mutex_lock(&sema->lock);
+	if (signal < 0 || sema->count + signal > sema->max) {
+		pthread_mutex_unlock(&sema->lock);
+		return SCE_KERNEL_ERROR_SEMA_OVF;
+	}
+	sema->count += signal;
+	pthread_cond_broadcast(&sema->cond);
+	pthread_mutex_unlock(&sema->lock);
+	return 0;
+}
+
+int sceKernelWaitSema(SceUID semaid, int signal, SceUInt *timeout)
+{
+	HostSema *sema = host_sema(semaid);
+	struct timespec deadline;
+	int res = 0;
+
+	if (!sema)
+		return SCE_KERNEL_ERROR_UNKNOWN_SEMA_ID;
+	if (timeout)
+		host_deadline(&deadline, *timeout);
+	pthread_mutex_lock(&sema->lock);
+	while (sema->count < signal && res == 0) {
+		if (timeout)
+			res = pthread_cond_timedwait(&sema->cond, &sema->lock, &deadline);
+		else
+			pthread_cond_wait(&sema->cond, &sema->lock);
+	}
+	if (sema->count >= signal) {
+		sema->count -= signal;
+		res = 0;
+	}
+	pthread_mutex_unlock(&sema->lock);
+	if (res != 0) {
+		*timeout = 0;
+		return SCE_KERNEL_ERROR_WAIT_TIMEOUT;
+	}
+	return 0;
+}
+
+int sceKernelPollSema(SceUID semaid, int signal)
+{
+	HostSema *sema = host_sema(semaid);
+	int res = SCE_KERNEL_ERROR_SEMA_ZERO;
+
+	if (!sema)
+		return SCE_KERNEL_ERROR_UNKNOWN_SEMA_ID;
+	pthread_mutex_lock(&sema->lock);
+	if (sema->count >= signal) {
+		sema->count -= signal;
+		res = 0;
+	}
+	pthread_mutex_unlock(&sema->lock);
+	return res;
+}
+
+/*
+ * Memblocks, anonymous mappings which must respect the granularity of their
+ * type. They are mapped below 4 GiB where the host allows it, as the helpers
+ * pass their addresses through SceUInt32 arguments like on the Vita.
+ */
+
+#ifdef MAP_32BIT
+#define HOST_MAP_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT)
+#else
+#define HOST_MAP_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS)
+#endif
+
+#define HOST_MEMBLOCKS (256)
+
+static struct {
+	void *base;
+	SceSize size;
+} host_memblocks[HOST_MEMBLOCKS];
+static pthread_mutex_t host_memblocks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+SceUID sceKernelAllocMemBlock(const char *name, SceKernelMemBlockType type, SceSize size, SceKernelAllocMemBlockOpt *opt)
+{
+	SceSize align = (type & 0xFF000000) == 0x09000000 ? 0x40000 : 0x1000;
+	void *base;
+	SceUID id;
+
+	(void)name;
+	(void)opt;
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (size == 0 || (size & (align - 1)) != 0)
+		return SCE_KERNEL_ERROR_ILLEGAL_MEMBLOCK_SIZE;
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE, HOST_MAP_FLAGS, -1, 0);
+	if (base == MAP_FAILED)
+		return SCE_KERNEL_ERROR_NO_MEMORY;
+	pthread_mutex_lock(&host_memblocks_lock);
+	for (id = 0; id < HOST_MEMBLOCKS && host_memblocks[id].base; id++)
+		;
+	if (id == HOST_MEMBLOCKS) {
+		pthread_mutex_unlock(&host_memblocks_lock);
+		munmap(base, size);
+		return SCE_KERNEL_ERROR_NO_MEMORY;
+	}
+	host_memblocks[id].base = base;
+	host_memblocks[id].size = size;
+	pthread_mutex_unlock(&host_memblocks_lock);
+	return id + 1;
+}
+
+int sceKernelGetMemBlockBase(SceUID uid, void **base)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (uid <= 0 || uid > HOST_MEMBLOCKS || !host_memblocks[uid - 1].base)
+		return SCE_KERNEL_ERROR_ILLEGAL_MEMBLOCK_CODE;
+	*base = host_memblocks[uid - 1].base;
+	return 0;
+}
+
+int sceKernelFreeMemBlock(SceUID uid)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (uid <= 0 || uid > HOST_MEMBLOCKS || !host_memblocks[uid - 1].base)
+		return SCE_KERNEL_ERROR_ILLEGAL_MEMBLOCK_CODE;
+	pthread_mutex_lock(&host_memblocks_lock);
+	munmap(host_memblocks[uid - 1].base, host_memblocks[uid - 1].size);
+	host_memblocks[uid - 1].base = NULL;
+	pthread_mutex_unlock(&host_memblocks_lock);
+	return 0;
+}
+
+/*
+ * Message pipes, a byte stream over a ring buffer. A transfer larger than
+ * the free space goes through in pieces, and a vector is transferred one
+ * buffer after the other: nothing keeps the messages of two senders from
+ * interleaving. The timeouts are not supported, the calls wait forever.
+ */
+
+#define HOST_MSGPIPES (64)
+
+typedef struct HostMsgPipe {
+	unsigned char *buf;
+	SceSize size;
+	SceSize head;
+	SceSize used;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} HostMsgPipe;
+
+static HostMsgPipe host_msgpipes[HOST_MSGPIPES];
+static pthread_mutex_t host_msgpipes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static HostMsgPipe *host_msgpipe(SceUID uid)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (uid <= 0 || uid > HOST_MSGPIPES || !host_msgpipes[uid - 1].buf)
+		return NULL;
+	return &host_msgpipes[uid - 1];
+}
+
+SceUID sceKernelCreateMsgPipe(const char *name, int type, int attr, unsigned int bufSize, void *opt)
+{
+	SceUID id;
+
+	(void)name;
+	(void)type;
+	(void)attr;
+	(void)opt;
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (bufSize == 0)
+		return SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+	pthread_mutex_lock(&host_msgpipes_lock);
+	for (id = 0; id < HOST_MSGPIPES && host_msgpipes[id].buf; id++)
+		;
+	if (id == HOST_MSGPIPES || !(host_msgpipes[id].buf = malloc(bufSize))) {
+		pthread_mutex_unlock(&host_msgpipes_lock);
+		return SCE_KERNEL_ERROR_NO_MEMORY;
+	}
+	host_msgpipes[id].size = bufSize;
+	host_msgpipes[id].head = 0;
+	host_msgpipes[id].used = 0;
+	pthread_mutex_init(&host_msgpipes[id].lock, NULL);
+	pthread_cond_init(&host_msgpipes[id].cond, NULL);
+	pthread_mutex_unlock(&host_msgpipes_lock);
+	return id + 1;
+}
+
+/* Only deleted once no thread waits on it */
+int sceKernelDeleteMsgPipe(SceUID uid)
+{
+	HostMsgPipe *pipe = host_msgpipe(uid);
+
+	if (!pipe)
+		return SCE_KERNEL_ERROR_UNKNOWN_MSG_PIPE_ID;
+	pthread_mutex_lock(&host_msgpipes_lock);
+	pthread_mutex_destroy(&pipe->lock);
+	pthread_cond_destroy(&pipe->cond);
+	free(pipe->buf);
+	pipe->buf = NULL;
+	pthread_mutex_unlock(&host_msgpipes_lock);
+	return 0;
+}
+
+/* Write a buffer, waiting for free space, with the pipe locked */
+static void host_msgpipe_write(HostMsgPipe *pipe, const unsigned char *message, SceSize size)
+{
+	SceSize n, tail;
+
+	while (size != 0) {
+		while (pipe->used == pipe->size)
+			pthread_cond_wait(&pipe->cond, &pipe->lock);
+		tail = (pipe->head + pipe->used) % pipe->size;
+		n = pipe->size - pipe->used;
+		if (n > pipe->size - tail)
+			n = pipe->size - tail;
+		if (n > size)
+			n = size;
+		memcpy(pipe->buf + tail, message, n);
+		pipe->used += n;
+		message    += n;
+		size       -= n;
+		pthread_cond_broadcast(&pipe->cond);
+	}
+}
+
+/* Read a buffer, waiting for data, with the pipe locked */
+static void host_msgpipe_read(HostMsgPipe *pipe, unsigned char *message, SceSize size)
+{
+	SceSize n;
+
+	while (size != 0) {
+		while (pipe->used == 0)
+			pthread_cond_wait(&pipe->cond, &pipe->lock);
+		n = pipe->used;
+		if (n > pipe->size - pipe->head)
+			n = pipe->size - pipe->head;
+		if (n > size)
+			n = size;
+		memcpy(message, pipe->buf + pipe->head, n);
+		pipe->head  = (pipe->head + n) % pipe->size;
+		pipe->used -= n;
+		message    += n;
+		size       -= n;
+		pthread_cond_broadcast(&pipe->cond);
+	}
+}
+
+int sceKernelSendMsgPipeVector(SceUID uid, const SceKernelMsgPipeVector *v, unsigned int n, int unk1, void *unk2, unsigned int *timeout)
+{
+	HostMsgPipe *pipe = host_msgpipe(uid);
+	unsigned int i;
+
+	(void)unk1;
+	(void)unk2;
+	(void)timeout;
+	if (!pipe)
+		return SCE_KERNEL_ERROR_UNKNOWN_MSG_PIPE_ID;
+	pthread_mutex_lock(&pipe->lock);
+	for (i = 0; i < n; i++)
+		host_msgpipe_write(pipe, v[i].message, v[i].size);
+	pthread_mutex_unlock(&pipe->lock);
+	return 0;
+}
+
+int sceKernelReceiveMsgPipeVector(SceUID uid, const SceKernelMsgPipeVector *v, unsigned int n, int unk1, void *unk2, unsigned int *timeout)
+{
+	HostMsgPipe *pipe = host_msgpipe(uid);
+	unsigned int i;
+
+	(void)unk1;
+	(void)unk2;
+	(void)timeout;
+	if (!pipe)
+		return SCE_KERNEL_ERROR_UNKNOWN_MSG_PIPE_ID;
+	pthread_mutex_lock(&pipe->lock);
+	for (i = 0; i < n; i++)
+		host_msgpipe_read(pipe, v[i].message, v[i].size);
+	pthread_mutex_unlock(&pipe->lock);
+	return 0;
+}
+
+int sceKernelSendMsgPipe(SceUID uid, void *message, unsigned int size, int unk1, void *unk2, unsigned int *timeout)
+{
+	SceKernelMsgPipeVector v = { message, size };
+
+	return sceKernelSendMsgPipeVector(uid, &v, 1, unk1, unk2, timeout);
+}
+
+int sceKernelReceiveMsgPipe(SceUID uid, void *message, SceSize size, int unk1, void *unk2, unsigned int *timeout)
+{
+	SceKernelMsgPipeVector v = { message, size };
+
+	return sceKernelReceiveMsgPipeVector(uid, &v, 1, unk1, unk2, timeout);
+}
+
+int sceKernelTryReceiveMsgPipe(SceUID uid, void *message, SceSize size, int unk1, void *unk2)
+{
+	HostMsgPipe *pipe = host_msgpipe(uid);
+	int res = SCE_KERNEL_ERROR_MSG_PIPE_EMPTY;
+
+	(void)unk1;
+	(void)unk2;
+	if (!pipe)
+		return SCE_KERNEL_ERROR_UNKNOWN_MSG_PIPE_ID;
+	pthread_mutex_lock(&pipe->lock);
+	if (pipe->used >= size) {
+		host_msgpipe_read(pipe, message, size);
+		res = 0;
+	}
+	pthread_mutex_unlock(&pipe->lock);
+	return res;
+}
+
+/*
+ * Event flags, a pattern behind a mutex and a condition variable each. A
+ * flag created with SCE_EVENT_WAITSINGLE refuses a second waiter.
+ */
+
+#define HOST_EVENT_FLAGS (64)
+
+typedef struct HostEventFlag {
+	int used;
+	int attr;
+	unsigned int bits;
+	int waiters;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} HostEventFlag;
+
+static HostEventFlag host_event_flags[HOST_EVENT_FLAGS];
+static pthread_mutex_t host_event_flags_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static HostEventFlag *host_event_flag(SceUID evid)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (evid <= 0 || evid > HOST_EVENT_FLAGS || !host_event_flags[evid - 1].used)
+		return NULL;
+	return &host_event_flags[evid - 1];
+}
+
+SceUID sceKernelCreateEventFlag(const char *name, int attr, int bits, SceKernelEventFlagOptParam *opt)
+{
+	pthread_condattr_t cond_attr;
+	SceUID id;
+
+	(void)name;
+	(void)opt;
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&host_event_flags_lock);
+	for (id = 0; id < HOST_EVENT_FLAGS && host_event_flags[id].used; id++)
+		;
+	if (id == HOST_EVENT_FLAGS) {
+		pthread_mutex_unlock(&host_event_flags_lock);
+		return SCE_KERNEL_ERROR_NO_MEMORY;
+	}
+	host_event_flags[id].used    = 1;
+	host_event_flags[id].attr    = attr;
+	host_event_flags[id].bits    = bits;
+	host_event_flags[id].waiters = 0;
+	pthread_mutex_init(&host_event_flags[id].lock, NULL);
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&host_event_flags[id].cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+	pthread_mutex_unlock(&host_event_flags_lock);
+	return id + 1;
+}
+
+/* Only deleted once no thread waits on it */
+int sceKernelDeleteEventFlag(int evid)
+{
+	HostEventFlag *evf = host_event_flag(evid);
+
+	if (!evf)
+		return SCE_KERNEL_ERROR_UNKNOWN_EVF_ID;
+	pthread_mutex_lock(&host_event_flags_lock);
+	pthread_mutex_destroy(&evf->lock);
+	pthread_cond_destroy(&evf->cond);
+	evf->used = 0;
+	pthread_mutex_unlock(&host_event_flags_lock);
+	return 0;
+}
+
+int sceKernelSetEventFlag(SceUID evid, unsigned int bits)
+{
+	HostEventFlag *evf = host_event_flag(evid);
+
+	if (!evf)
+		return SCE_KERNEL_ERROR_UNKNOWN_EVF_ID;
+	pthread_mutex_lock(&evf->lock);
+	evf->bits |= bits;
+	pthread_cond_broadcast(&evf->cond);
+	pthread_mutex_unlock(&evf->lock);
+	return 0;
+}
+
+/* Keeps the bits set in `bits` */
+int sceKernelClearEventFlag(SceUID evid, unsigned int bits)
+{
+	HostEventFlag *evf = host_event_flag(evid);
+
+	if (!evf)
+		return SCE_KERNEL_ERROR_UNKNOWN_EVF_ID;
+	pthread_mutex_lock(&evf->lock);
+	evf->bits &= bits;
+	pthread_mutex_unlock(&evf->lock);
+	return 0;
+}
+
+/* Match the pattern of a locked flag, and clear it as `wait` asks */
+static int host_event_flag_match(HostEventFlag *evf, unsigned int bits, unsigned int wait, unsigned int *outBits)
+{
+	unsigned int set = evf->bits & bits;
+
+	if ((wait & SCE_EVENT_WAITOR) ? set == 0 : set != bits)
+		return 0;
+	if (outBits)
+		*outBits = evf->bits;
+	if (wait & SCE_EVENT_WAITCLEAR)
+		evf->bits = 0;
+	else if (wait & SCE_EVENT_WAITCLEAR_PAT)
+		evf->bits &= ~bits;
+	return 1;
+}
+
+int sceKernelPollEventFlag(int evid, unsigned int bits, unsigned int wait, unsigned int *outBits)
+{
+	HostEventFlag *evf = host_event_flag(evid);
+	int res = SCE_KERNEL_ERROR_EVF_COND;
+
+	if (!evf)
+		return SCE_KERNEL_ERROR_UNKNOWN_EVF_ID;
+	if (bits == 0)
+		return SCE_KERNEL_ERROR_ILLEGAL_MODE;
+	pthread_mutex_lock(&evf->lock);
+	if (host_event_flag_match(evf, bits, wait, outBits))
+		res = 0;
+	pthread_mutex_unlock(&evf->lock);
+	return res;
+}
+
+int sceKernelWaitEventFlag(int evid, unsigned int bits, unsigned int wait, unsigned int *outBits, SceUInt *timeout)
+{
+	HostEventFlag *evf = host_event_flag(evid);
+	struct timespec deadline;
+	int matched, res = 0;
+
+	if (!evf)
+		return SCE_KERNEL_ERROR_UNKNOWN_EVF_ID;
+	if (bits == 0)
+		return SCE_KERNEL_ERROR_ILLEGAL_MODE;
+	if (timeout)
+		host_deadline(&deadline, *timeout);
+	pthread_mutex_lock(&evf->lock);
+	if (!(evf->attr & SCE_EVENT_WAITMULTIPLE) && evf->waiters != 0) {
+		pthread_mutex_unlock(&evf->lock);
+		return SCE_KERNEL_ERROR_EVF_MULTI;
+	}
+	evf->waiters++;
+	while (!(matched = host_event_flag_match(evf, bits, wait, outBits)) && res == 0) {
+		if (timeout)
+			res = pthread_cond_timedwait(&evf->cond, &evf->lock, &deadline);
+		else
+			pthread_cond_wait(&evf->cond, &evf->lock);
+	}
+	evf->waiters--;
+	pthread_mutex_unlock(&evf->lock);
+	if (!matched) {
+		*timeout = 0;
+		return SCE_KERNEL_ERROR_WAIT_TIMEOUT;
+	}
+	return 0;
+}
+
+/*
+ * Threads. The user cores 0-2 are pinned to the host CPUs of the same
+ * index modulo their count, the system core is refused like in a process
+ * which was not granted it. Priorities are ignored.
+ */
+
+#define HOST_THREADS (64)
+/* Id of the threads not created by sceKernelCreateThread, like main */
+#define HOST_THREAD_OTHER (HOST_THREADS + 1)
+
+typedef struct HostThread {
+	int used;
+	pthread_t thread;
+	SceKernelThreadEntry entry;
+	int affinity;
+	SceSize args;
+	void *argp;
+	int status;
+} HostThread;
+
+static HostThread host_threads[HOST_THREADS];
+static pthread_mutex_t host_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread SceUID host_thread_id;
+
+static void *host_thread_entry(void *arg)
+{
+	HostThread *t = arg;
+
+	host_thread_id = (SceUID)(t - host_threads) + 1;
+	t->status = t->entry(t->args, t->argp);
+	return NULL;
+}
+
+static HostThread *host_thread(SceUID thid)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (thid <= 0 || thid > HOST_THREADS || !host_threads[thid - 1].used)
+		return NULL;
+	return &host_threads[thid - 1];
+}
+
+SceUID sceKernelCreateThread(const char *name, SceKernelThreadEntry entry, int initPriority,
+                             SceSize stackSize, SceUInt attr, int cpuAffinityMask,
+                             const SceKernelThreadOptParam *option)
+{
+	SceUID id;
+
+	(void)name;
+	(void)initPriority;
+	(void)stackSize;
+	(void)attr;
+	(void)option;
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if ((cpuAffinityMask & ~SCE_KERNEL_CPU_MASK_USER_ALL) != 0)
+		return SCE_KERNEL_ERROR_ILLEGAL_CPU_AFFINITY_MASK;
+	pthread_mutex_lock(&host_threads_lock);
+	for (id = 0; id < HOST_THREADS && host_threads[id].used; id++)
+		;
+	if (id == HOST_THREADS) {
+		pthread_mutex_unlock(&host_threads_lock);
+		return SCE_KERNEL_ERROR_NO_MEMORY;
+	}
+	host_threads[id].used     = 1;
+	host_threads[id].entry    = entry;
+	host_threads[id].affinity = cpuAffinityMask;
+	host_threads[id].argp     = NULL;
+	pthread_mutex_unlock(&host_threads_lock);
+	return id + 1;
+}
+
+int sceKernelStartThread(SceUID thid, SceSize arglen, void *argp)
+{
+	HostThread *t = host_thread(thid);
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	int core, res;
+
+	if (!t)
+		return SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID;
+	/* The arguments are copied, like to the stack of a Vita thread */
+	t->args = arglen;
+	t->argp = malloc(arglen ? arglen : 1);
+	if (!t->argp)
+		return SCE_KERNEL_ERROR_NO_MEMORY;
+	memcpy(t->argp, argp, arglen);
+	pthread_attr_init(&attr);
+	if (t->affinity != 0 && count > 0) {
+		CPU_ZERO(&cpus);
+		for (core = 0; core < 3; core++) {
+			if (t->affinity & (SCE_KERNEL_CPU_MASK_USER_0 << core))
+				CPU_SET(core % count, &cpus);
+		}
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	}
+	res = pthread_create(&t->thread, &attr, host_thread_entry, t);
+	pthread_attr_destroy(&attr);
+	return res == 0 ? 0 : SCE_KERNEL_ERROR_NO_MEMORY;
+}
+
+int sceKernelWaitThreadEnd(SceUID thid, int *stat, SceUInt *timeout)
+{
+	HostThread *t = host_thread(thid);
+
+	(void)timeout;
+	if (!t)
+		return SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID;
+	pthread_join(t->thread, NULL);
+	if (stat)
+		*stat = t->status;
+	return 0;
+}
+
+int sceKernelDeleteThread(SceUID thid)
+{
+	HostThread *t = host_thread(thid);
+
+	if (!t)
+		return SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID;
+	pthread_mutex_lock(&host_threads_lock);
+	free(t->argp);
+	t->used = 0;
+	pthread_mutex_unlock(&host_threads_lock);
+	return 0;
+}
+
+int sceKernelGetThreadId(void)
+{
+	return host_thread_id ? host_thread_id : HOST_THREAD_OTHER;
+}
+
+#define HOST_TLS_KEYS (0x100)
+
+static __thread void *host_tls[HOST_TLS_KEYS];
+
+void *sceKernelGetTLSAddr(int key)
+{
+	if (key < 0 || key >= HOST_TLS_KEYS)
+		return NULL;
+	return &host_tls[key];
+}
+
+int sceKernelChangeThreadPriority(SceUID thid, int priority)
+{
+	(void)priority;
+	/* 0 is the calling thread */
+	if (!host_thread(thid) && thid != 0)
+		return SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID;
+	return 0;
+}
+
+int sceKernelDelayThread(SceUInt delay)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	usleep(delay);
+	return 0;
+}
+
+SceUInt64 sceKernelGetProcessTimeWide(void)
+{
+	return (SceUInt64)(host_seconds() * 1e6);
+}
+
+/*
+ * SceClib mspaces, the host malloc behind one lock like the mspace lock of
+ * the Vita. The sizes are the chunk sizes of a 32-bit dlmalloc, so that
+ * sceClibMspaceMallocUsableSize returns what it would on the Vita.
+ */
+
+typedef struct HostMspace {
+	pthread_mutex_t lock;
+	SceSize capacity;
+	SceSize peak_in_use;
+	SceSize current_in_use;
+} HostMspace;
+
+/* Kept in front of each allocation, 16 bytes to keep the host alignment */
+typedef struct HostMspaceHeader {
+	SceSize chunk;
+	char pad[12];
+} HostMspaceHeader;
+
+/* 4 bytes of header, 8 bytes alignment, 16 bytes at least */
+static SceSize host_mspace_chunk(SceSize size)
+{
+	SceSize chunk = (size + 4 + 7) & ~7;
+
+	return chunk < 16 ? 16 : chunk;
+}
+
+SceClibMspace sceClibMspaceCreate(void *memblock, SceSize size)
+{
+	HostMspace *ms = calloc(1, sizeof(*ms));
+
+	(void)memblock;
+	if (!ms)
+		return NULL;
+	pthread_mutex_init(&ms->lock, NULL);
+	ms->capacity = size;
+	return ms;
+}
+
+void sceClibMspaceDestroy(SceClibMspace mspace)
+{
+	HostMspace *ms = mspace;
+
+	pthread_mutex_destroy(&ms->lock);
+	free(ms);
+}
+
+void *sceClibMspaceMalloc(SceClibMspace mspace, SceSize size)
+{
+	HostMspace *ms = mspace;
+	SceSize chunk = host_mspace_chunk(size);
+	HostMspaceHeader *h = NULL;
+
+	pthread_mutex_lock(&ms->lock);
+	if (size < 0x7FFFFFF0 && ms->current_in_use + chunk <= ms->capacity)
+		h = malloc(sizeof(*h) + chunk - 4);
+	if (h) {
+		h->chunk = chunk;
+		ms->current_in_use += chunk;
+		if (ms->current_in_use > ms->peak_in_use)
+			ms->peak_in_use = ms->current_in_use;
+	}
+	pthread_mutex_unlock(&ms->lock);
+	return h ? h + 1 : NULL;
+}
+
+void sceClibMspaceFree(SceClibMspace mspace, void *ptr)
+{
+	HostMspace *ms = mspace;
+	HostMspaceHeader *h;
+
+	if (!ptr)
+		return;
+	h = (HostMspaceHeader *)ptr - 1;
+	pthread_mutex_lock(&ms->lock);
+	ms->current_in_use -= h->chunk;
+	free(h);
+	pthread_mutex_unlock(&ms->lock);
+}
+
+SceSize sceClibMspaceMallocUsableSize(void *ptr)
+{
+	return ptr ? ((HostMspaceHeader *)ptr - 1)->chunk - 4 : 0;
+}
+
+void sceClibMspaceMallocStatsFast(SceClibMspace mspace, SceClibMspaceStats *stats)
+{
+	HostMspace *ms = mspace;
+
+	pthread_mutex_lock(&ms->lock);
+	stats->capacity       = ms->capacity;
+	stats->unk            = ms->capacity;
+	stats->peak_in_use    = ms->peak_in_use;
+	stats->current_in_use = ms->current_in_use;
+	pthread_mutex_unlock(&ms->lock);
+}
+
+/*
+ * Fibers of SceFiber over ucontext. A fiber returns to the thread which ran
+ * it last, so it may be resumed by another thread than the one it left.
+ */
+
+typedef struct HostFiber {
+	ucontext_t context;
+	ucontext_t *thread_context;   /* Of the thread running the fiber */
+	SceFiberEntry *entry;
+	SceUInt32 arg_on_initialize;
+	SceUInt32 arg_to_fiber;
+	SceUInt32 arg_to_thread;
+	int running;
+} HostFiber;
+
+static __thread HostFiber *host_fiber_current;
+
+static HostFiber *host_fiber(SceFiber *fiber)
+{
+	return *(HostFiber **)fiber->reserved;
+}
+
+static void host_fiber_entry(void)
+{
+	HostFiber *f = host_fiber_current;
+
+	f->entry(f->arg_on_initialize, f->arg_to_fiber);
+	/* Returning from the entry ends the fiber */
+	f->arg_to_thread = 0;
+	setcontext(f->thread_context);
+}
+
+SceInt32 _sceFiberInitializeImpl(SceFiber *fiber, char *name, SceFiberEntry *entry, SceUInt32 argOnInitialize,
+                                 void *addrContext, SceSize sizeContext, SceFiberOptParam *params)
+{
+	HostFiber *f;
+
+	(void)name;
+	(void)params;
+	if (!fiber || !entry || !addrContext)
+		return SCE_FIBER_ERROR_NULL;
+	if (((uintptr_t)fiber & 7) != 0 || ((uintptr_t)addrContext & 7) != 0)
+		return SCE_FIBER_ERROR_ALIGNMENT;
+	f = calloc(1, sizeof(*f));
+	if (!f)
+		return SCE_FIBER_ERROR_AGAIN;
+	getcontext(&f->context);
+	f->context.uc_stack.ss_sp   = addrContext;
+	f->context.uc_stack.ss_size = sizeContext;
+	f->context.uc_link          = NULL;
+	makecontext(&f->context, host_fiber_entry, 0);
+	f->entry             = entry;
+	f->arg_on_initialize = argOnInitialize;
+	*(HostFiber **)fiber->reserved = f;
+	return 0;
+}
+
+SceInt32 sceFiberFinalize(SceFiber *fiber)
+{
+	HostFiber *f = host_fiber(fiber);
+
+	if (f->running)
+		return SCE_FIBER_ERROR_STATE;
+	free(f);
+	*(HostFiber **)fiber->reserved = NULL;
+	return 0;
+}
+
+SceInt32 sceFiberRun(SceFiber *fiber, SceUInt32 argOnRunTo, SceUInt32 *argOnRun)
+{
+	HostFiber *f = host_fiber(fiber);
+	ucontext_t thread_context;
+
+	if (host_fiber_current)
+		return SCE_FIBER_ERROR_PERMISSION;
+	if (__atomic_exchange_n(&f->running, 1, __ATOMIC_ACQUIRE))
+		return SCE_FIBER_ERROR_STATE;
+	f->thread_context  = &thread_context;
+	f->arg_to_fiber    = argOnRunTo;
+	host_fiber_current = f;
+	swapcontext(&thread_context, &f->context);
+	host_fiber_current = NULL;
+	if (argOnRun)
+		*argOnRun = f->arg_to_thread;
+	/* Another thread may run the fiber from here */
+	__atomic_store_n(&f->running, 0, __ATOMIC_RELEASE);
+	return 0;
+}
+
+SceInt32 sceFiberReturnToThread(SceUInt32 argOnReturn, SceUInt32 *argOnRun)
+{
+	HostFiber *f = host_fiber_current;
+
+	if (!f)
+		return SCE_FIBER_ERROR_PERMISSION;
+	f->arg_to_thread = argOnReturn;
+	swapcontext(&f->context, f->thread_context);
+	if (argOnRun)
+		*argOnRun = f->arg_to_fiber;
+	return 0;
+}
+
+/*
+ * ScePerf. The timebase counts nanoseconds. The PMU counters of a thread
+ * all count its counter reads, so that the scopes of a test have known
+ * counts, and every PMU call is a kernel call.
+ */
+
+static __thread SceUInt32 host_pmon_reads;
+static __thread int host_pmon_started;
+
+SceUInt64 scePerfGetTimebaseValue(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (SceUInt64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+SceUInt32 scePerfGetTimebaseFrequency(void)
+{
+	return 1000000000;
+}
+
+int scePerfArmPmonReset(SceUID thid)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (thid != SCE_PERF_ARM_PMON_THREAD_ID_SELF)
+		return SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID;
+	host_pmon_reads   = 0;
+	host_pmon_started = 0;
+	return 0;
+}
+
+int scePerfArmPmonSelectEvent(SceUID thid, SceUInt32 counter, SceUInt8 event_code)
+{
+	(void)event_code;
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (thid != SCE_PERF_ARM_PMON_THREAD_ID_SELF)
+		return SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID;
+	if (counter >= 6)
+		return SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	return 0;
+}
+
+int scePerfArmPmonStart(SceUID thid)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (thid != SCE_PERF_ARM_PMON_THREAD_ID_SELF)
+		return SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID;
+	host_pmon_started = 1;
+	return 0;
+}
+
+int scePerfArmPmonStop(SceUID thid)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (thid != SCE_PERF_ARM_PMON_THREAD_ID_SELF)
+		return SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID;
+	host_pmon_started = 0;
+	return 0;
+}
+
+int scePerfArmPmonGetCounterValue(SceUID thid, SceUInt32 counter, SceUInt32 *value)
+{
+	__atomic_add_fetch(&host_calls, 1, __ATOMIC_RELAXED);
+	if (thid != SCE_PERF_ARM_PMON_THREAD_ID_SELF)
+		return SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID;
+	if (counter >= 6)
+		return SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	*value = host_pmon_started ? ++host_pmon_reads : host_pmon_reads;
+	return 0;
+}
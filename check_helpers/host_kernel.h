@@ -0,0 +1,43 @@
+#ifndef _HOST_KERNEL_H_
+#define _HOST_KERNEL_H_
+
+/*
+ * Host implementations of the SceLibKernel, mspace, SceFiber, ScePerf and
+ * SceIo calls used by the vitasdk helpers, so that their stress tests and
+ * benchmarks run on Linux. The SceIo calls are in host_io.c.
+ *
+ * They follow the documented behaviour of the Vita calls, not their cost:
+ * the numbers of the benchmarks compare the helpers with each other and with
+ * the host primitives, not with the Vita kernel.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Monotonic time in seconds */
+double host_seconds(void);
+
+/** Number of the kernel object calls above the atomics so far, syscalls on the Vita */
+unsigned long host_kernel_calls(void);
+
+/** Count a kernel call, for the calls implemented out of host_kernel.c */
+void host_kernel_count_call(void);
+
+/** Print a failure and exit with status 1 */
+#define HOST_CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		exit(1); \
+	} \
+} while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HOST_KERNEL_H_ */
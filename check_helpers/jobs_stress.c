@@ -0,0 +1,218 @@
+/*
+ * Stress test of the vitasdk/jobs.h job system.
+ *
+ * usage: jobs_stress [flat jobs]
+ *
+ * Flat jobs submitted from the main thread must each run exactly once. Then
+ * trees of jobs submitting their children and waiting on them from within
+ * the jobs check the nested vitasdk_jobs_wait, first with a fiber for every
+ * waiting job, then with two fibers so that most jobs wait on the worker
+ * threads. The hooks check that they get the worker running the job, which
+ * changes when a waiting fiber is resumed by another worker.
+ */
+
+#include <string.h>
+#include <vitasdk/jobs.h>
+
+#include "host_kernel.h"
+
+#define FLAT_JOBS   (100000)
+#define BATCH       (256)
+#define FANOUT      (6)
+#define DEPTH       (4)
+#define TREE_NODES  (1 + 6 + 36 + 216 + 1296)
+#define TREE_ROUNDS (20)
+
+typedef struct Node {
+	SceUInt32 depth;
+	SceUInt32 begin_worker;       /* Passed to on_job_begin */
+	volatile SceUInt32 runs;
+	VitasdkJobCounter counter;
+	VitasdkJob children[FANOUT];
+} Node;
+
+static struct {
+	VitasdkJobSystem js;
+	volatile SceUInt32 *flat_runs;
+	Node nodes[TREE_NODES];
+	volatile SceUInt32 begins;
+	volatile SceUInt32 ends;
+	volatile SceUInt32 hook_errors;
+	volatile SceUInt32 wait_errors;
+	volatile SceUInt32 thread_jobs; /* Run by a worker without a fiber */
+	volatile SceUInt32 moved;       /* Ended on another worker than they began */
+} jobs;
+
+static void tree_job(void *arg);
+
+/* The worker run by the calling thread, VITASDK_JOBS_NO_WORKER for another thread */
+static SceUInt32 current_worker(void)
+{
+	SceUID thid = sceKernelGetThreadId();
+	SceUInt32 i;
+
+	for (i = 0; i < jobs.js.param.workers; i++) {
+		if (jobs.js.workers[i].thid == thid)
+			return i;
+	}
+	return VITASDK_JOBS_NO_WORKER;
+}
+
+static void on_job_begin(const VitasdkJob *job, SceUInt32 worker, void *user)
+{
+	(void)user;
+	if (worker != current_worker())
+		vitasdk_atomic_add32(&jobs.hook_errors, 1);
+	if (worker != VITASDK_JOBS_NO_WORKER && !jobs.js.workers[worker].current)
+		vitasdk_atomic_add32(&jobs.thread_jobs, 1);
+	if (job->func == tree_job)
+		((Node *)job->arg)->begin_worker = worker;
+	vitasdk_atomic_add32(&jobs.begins, 1);
+}
+
+static void on_job_end(const VitasdkJob *job, SceUInt32 worker, void *user)
+{
+	(void)user;
+	if (worker != current_worker())
+		vitasdk_atomic_add32(&jobs.hook_errors, 1);
+	if (job->func == tree_job && ((Node *)job->arg)->begin_worker != worker)
+		vitasdk_atomic_add32(&jobs.moved, 1);
+	vitasdk_atomic_add32(&jobs.ends, 1);
+}
+
+static void flat_job(void *arg)
+{
+	vitasdk_atomic_add32(&jobs.flat_runs[(uintptr_t)arg], 1);
+}
+
+/* Run a node of the tree: submit its children and wait for them */
+static void tree_job(void *arg)
+{
+	Node *node = arg;
+	SceUInt32 index = node - jobs.nodes, runs, i;
+
+	runs = vitasdk_atomic_add32(&node->runs, 1);
+	if (node->depth == DEPTH)
+		return;
+	for (i = 0; i < FANOUT; i++) {
+		node->children[i].func = tree_job;
+		node->children[i].arg  = &jobs.nodes[index * FANOUT + 1 + i];
+	}
+	vitasdk_jobs_submit(&jobs.js, node->children, FANOUT, &node->counter);
+	vitasdk_jobs_wait(&jobs.js, &node->counter);
+	/* Each child, and so its whole subtree, ran as many times as the node */
+	for (i = 0; i < FANOUT; i++) {
+		if (vitasdk_atomic_load_acquire32(&jobs.nodes[index * FANOUT + 1 + i].runs) != runs)
+			vitasdk_atomic_add32(&jobs.wait_errors, 1);
+	}
+}
+
+static void hooks_check(SceUInt32 expected)
+{
+	HOST_CHECK(jobs.begins == expected);
+	HOST_CHECK(jobs.ends == expected);
+	HOST_CHECK(jobs.hook_errors == 0);
+	jobs.begins = 0;
+	jobs.ends   = 0;
+}
+
+static void jobs_start(SceUInt32 fibers)
+{
+	VitasdkJobSystemParam param;
+
+	vitasdk_jobs_param_init(&param);
+	param.fibers            = fibers;
+	/* The host needs larger stacks than the Vita */
+	param.thread_stack_size = 0x40000;
+	param.fiber_stack_size  = 0x10000;
+	param.on_job_begin      = on_job_begin;
+	param.on_job_end        = on_job_end;
+	HOST_CHECK(vitasdk_jobs_create(&jobs.js, &param) == 0);
+}
+
+static void run_flat(SceUInt32 n)
+{
+	VitasdkJob *batch = calloc(n, sizeof(*batch));
+	VitasdkJobCounter counter = { 0 };
+	SceUInt32 i, stolen = 0;
+	double t;
+
+	HOST_CHECK(batch);
+	jobs.flat_runs = calloc(n, sizeof(*jobs.flat_runs));
+	HOST_CHECK(jobs.flat_runs);
+	for (i = 0; i < n; i++) {
+		batch[i].func = flat_job;
+		batch[i].arg  = (void *)(uintptr_t)i;
+	}
+
+	jobs_start(32);
+	t = host_seconds();
+	for (i = 0; i < n; i += BATCH)
+		vitasdk_jobs_submit(&jobs.js, &batch[i], n - i < BATCH ? n - i : BATCH, &counter);
+	vitasdk_jobs_wait(&jobs.js, &counter);
+	t = host_seconds() - t;
+	for (i = 0; i < jobs.js.param.workers; i++)
+		stolen += jobs.js.workers[i].jobs_stolen;
+	HOST_CHECK(vitasdk_jobs_destroy(&jobs.js) == 0);
+
+	HOST_CHECK(counter.value == 0);
+	for (i = 0; i < n; i++)
+		HOST_CHECK(jobs.flat_runs[i] == 1);
+	hooks_check(n);
+	printf("flat: %u jobs run once in %.1f ms, %u stolen\n", n, t * 1000, stolen);
+	free((void *)jobs.flat_runs);
+	free(batch);
+}
+
+static void run_tree(SceUInt32 fibers)
+{
+	VitasdkJob root;
+	VitasdkJobCounter counter = { 0 };
+	SceUInt32 round, i;
+	double t;
+
+	memset(jobs.nodes, 0, sizeof(jobs.nodes));
+	jobs.nodes[0].depth = 0;
+	for (i = 1; i < TREE_NODES; i++)
+		jobs.nodes[i].depth = jobs.nodes[(i - 1) / FANOUT].depth + 1;
+	jobs.thread_jobs = 0;
+	jobs.moved       = 0;
+
+	jobs_start(fibers);
+	t = host_seconds();
+	for (round = 0; round < TREE_ROUNDS; round++) {
+		root.func = tree_job;
+		root.arg  = &jobs.nodes[0];
+		vitasdk_jobs_submit(&jobs.js, &root, 1, &counter);
+		/* Leave the whole tree to the workers */
+		while (vitasdk_atomic_load_acquire32(&counter.value) != 0)
+			sceKernelDelayThread(100);
+	}
+	t = host_seconds() - t;
+	HOST_CHECK(vitasdk_jobs_destroy(&jobs.js) == 0);
+
+	for (i = 0; i < TREE_NODES; i++) {
+		HOST_CHECK(jobs.nodes[i].runs == TREE_ROUNDS);
+		HOST_CHECK(jobs.nodes[i].counter.value == 0);
+	}
+	HOST_CHECK(jobs.wait_errors == 0);
+	hooks_check(TREE_NODES * TREE_ROUNDS);
+	/* A leaf and its waiting ancestors need DEPTH + 1 fibers */
+	if (fibers < DEPTH + 1)
+		HOST_CHECK(jobs.thread_jobs > 0);
+	printf("tree with %4u fibers: %u rounds of %u nested jobs in %.1f ms, %u without a fiber, %u resumed on another worker\n",
+	       fibers, TREE_ROUNDS, TREE_NODES, t * 1000, jobs.thread_jobs, jobs.moved);
+}
+
+int main(int argc, char *argv[])
+{
+	SceUInt32 n = argc > 1 ? strtoul(argv[1], NULL, 0) : FLAT_JOBS;
+
+	run_flat(n);
+	/* Enough fibers for every waiting job */
+	run_tree(1024);
+	/* All fibers busy: most jobs run and wait on the worker threads */
+	run_tree(2);
+	printf("ok\n");
+	return 0;
+}
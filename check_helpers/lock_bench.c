@@ -0,0 +1,282 @@
+/*
+ * Stress test and contention benchmark of the vitasdk/lock.h locks.
+ *
+ * usage: lock_bench [iterations per thread]
+ *
+ * The mutex and the reader/writer lock guard counters updated by 1 to 4
+ * threads, the condition variable hands items from two producers to two
+ * consumers, one of them waiting with a timeout. The test checks that no
+ * update is lost and that readers never see a half-written pair. Each run
+ * is compared with the pthread primitive of the same kind, and prints the
+ * semaphore calls per lock, which stay at zero without contention.
+ */
+
+#include <pthread.h>
+#include <psp2/kernel/error.h>
+#include <vitasdk/lock.h>
+
+#include "host_kernel.h"
+
+#define THREADS (4)
+/* One write lock every WRITE_EVERY locks of the reader/writer runs */
+#define WRITE_EVERY (8)
+
+typedef enum LockKind {
+	LOCK_VITASDK,
+	LOCK_PTHREAD
+} LockKind;
+
+static const char *const lock_names[] = { "vitasdk", "pthread" };
+
+static struct {
+	LockKind kind;
+	SceUInt32 iterations;         /* Per thread */
+	VitasdkMutex mutex;
+	VitasdkRWLock rwlock;
+	VitasdkCond cond;
+	pthread_mutex_t pmutex;
+	pthread_rwlock_t prwlock;
+	pthread_cond_t pcond;
+	unsigned long counter;
+	unsigned long pair[2];
+	SceUInt32 torn_reads;
+	/* Condition variable runs */
+	SceUInt32 queued;
+	SceUInt32 produced;
+	SceUInt32 consumed;
+} lock;
+
+static void mutex_lock(void)
+{
+	if (lock.kind == LOCK_VITASDK)
+		HOST_CHECK(vitasdk_mutex_lock(&lock.mutex) == 0);
+	else
+		pthread_mutex_lock(&lock.pmutex);
+}
+
+static void mutex_unlock(void)
+{
+	if (lock.kind == LOCK_VITASDK)
+		HOST_CHECK(vitasdk_mutex_unlock(&lock.mutex) == 0);
+	else
+		pthread_mutex_unlock(&lock.pmutex);
+}
+
+static void *mutex_entry(void *arg)
+{
+	SceUInt32 i;
+
+	(void)arg;
+	for (i = 0; i < lock.iterations; i++) {
+		mutex_lock();
+		lock.counter++;
+		mutex_unlock();
+	}
+	return NULL;
+}
+
+static void *rwlock_entry(void *arg)
+{
+	SceUInt32 i;
+
+	(void)arg;
+	for (i = 0; i < lock.iterations; i++) {
+		if (i % WRITE_EVERY == 0) {
+			if (lock.kind == LOCK_VITASDK)
+				HOST_CHECK(vitasdk_rwlock_lock_write(&lock.rwlock) == 0);
+			else
+				pthread_rwlock_wrlock(&lock.prwlock);
+			lock.pair[0]++;
+			lock.pair[1]++;
+			if (lock.kind == LOCK_VITASDK)
+				HOST_CHECK(vitasdk_rwlock_unlock_write(&lock.rwlock) == 0);
+			else
+				pthread_rwlock_unlock(&lock.prwlock);
+		} else {
+			if (lock.kind == LOCK_VITASDK)
+				HOST_CHECK(vitasdk_rwlock_lock_read(&lock.rwlock) == 0);
+			else
+				pthread_rwlock_rdlock(&lock.prwlock);
+			if (lock.pair[0] != lock.pair[1])
+				__atomic_add_fetch(&lock.torn_reads, 1, __ATOMIC_RELAXED);
+			if (lock.kind == LOCK_VITASDK)
+				HOST_CHECK(vitasdk_rwlock_unlock_read(&lock.rwlock) == 0);
+			else
+				pthread_rwlock_unlock(&lock.prwlock);
+		}
+	}
+	return NULL;
+}
+
+static void cond_signal(void)
+{
+	if (lock.kind == LOCK_VITASDK)
+		HOST_CHECK(vitasdk_cond_signal(&lock.cond) == 0);
+	else
+		pthread_cond_signal(&lock.pcond);
+}
+
+static void *producer_entry(void *arg)
+{
+	SceUInt32 i;
+
+	(void)arg;
+	for (i = 0; i < lock.iterations; i++) {
+		mutex_lock();
+		lock.queued++;
+		lock.produced++;
+		cond_signal();
+		mutex_unlock();
+	}
+	return NULL;
+}
+
+/* The timed consumer goes through the timeout path of vitasdk_cond_wait */
+static void *consumer_entry(void *arg)
+{
+	SceUInt32 total = lock.iterations * 2;
+	int res;
+
+	mutex_lock();
+	for (;;) {
+		while (lock.queued == 0 && lock.produced < total) {
+			if (lock.kind == LOCK_PTHREAD) {
+				pthread_cond_wait(&lock.pcond, &lock.pmutex);
+			} else if (arg) {
+				SceUInt timeout = 100;
+				res = vitasdk_cond_wait(&lock.cond, &lock.mutex, &timeout);
+				HOST_CHECK(res == 0 || res == (int)SCE_KERNEL_ERROR_WAIT_TIMEOUT);
+			} else {
+				HOST_CHECK(vitasdk_cond_wait(&lock.cond, &lock.mutex, NULL) == 0);
+			}
+		}
+		if (lock.queued == 0)
+			break;
+		lock.queued--;
+		lock.consumed++;
+	}
+	/* Wake the other consumer up once everything is consumed */
+	if (lock.kind == LOCK_VITASDK)
+		vitasdk_cond_broadcast(&lock.cond);
+	else
+		pthread_cond_broadcast(&lock.pcond);
+	mutex_unlock();
+	return NULL;
+}
+
+static void report(const char *what, LockKind kind, SceUInt32 threads, SceUInt32 locks,
+                   unsigned long calls, double elapsed)
+{
+	printf("%-7s %-6s %u threads: %7.2f M locks/s", lock_names[kind], what, threads, locks / elapsed / 1e6);
+	if (kind == LOCK_VITASDK)
+		printf(", %.4f semaphore calls per lock", (double)calls / locks);
+	printf("\n");
+}
+
+static void run_threads(void *(*entry)(void *), SceUInt32 threads)
+{
+	pthread_t thread[THREADS];
+	SceUInt32 i;
+
+	for (i = 0; i < threads; i++)
+		pthread_create(&thread[i], NULL, entry, NULL);
+	for (i = 0; i < threads; i++)
+		pthread_join(thread[i], NULL);
+}
+
+static void run_mutex(LockKind kind, SceUInt32 threads)
+{
+	unsigned long calls;
+	double start;
+
+	lock.kind    = kind;
+	lock.counter = 0;
+	calls = host_kernel_calls();
+	start = host_seconds();
+	run_threads(mutex_entry, threads);
+	report("mutex", kind, threads, lock.iterations * threads, host_kernel_calls() - calls,
+	       host_seconds() - start);
+	HOST_CHECK(lock.counter == (unsigned long)lock.iterations * threads);
+}
+
+static void run_rwlock(LockKind kind, SceUInt32 threads)
+{
+	unsigned long calls;
+	double start;
+
+	lock.kind       = kind;
+	lock.pair[0]    = 0;
+	lock.pair[1]    = 0;
+	lock.torn_reads = 0;
+	calls = host_kernel_calls();
+	start = host_seconds();
+	run_threads(rwlock_entry, threads);
+	report("rwlock", kind, threads, lock.iterations * threads, host_kernel_calls() - calls,
+	       host_seconds() - start);
+	HOST_CHECK(lock.torn_reads == 0);
+	HOST_CHECK(lock.pair[0] == (unsigned long)threads * ((lock.iterations + WRITE_EVERY - 1) / WRITE_EVERY));
+	HOST_CHECK(lock.kind == LOCK_PTHREAD || lock.rwlock.status == 0);
+}
+
+static void run_cond(LockKind kind)
+{
+	pthread_t thread[4];
+	unsigned long calls;
+	double start;
+	SceUInt32 i;
+
+	lock.kind     = kind;
+	lock.queued   = 0;
+	lock.produced = 0;
+	lock.consumed = 0;
+	calls = host_kernel_calls();
+	start = host_seconds();
+	pthread_create(&thread[0], NULL, consumer_entry, NULL);
+	pthread_create(&thread[1], NULL, consumer_entry, (void *)1);
+	pthread_create(&thread[2], NULL, producer_entry, NULL);
+	pthread_create(&thread[3], NULL, producer_entry, NULL);
+	for (i = 0; i < 4; i++)
+		pthread_join(thread[i], NULL);
+	report("cond", kind, 4, lock.iterations * 2, host_kernel_calls() - calls, host_seconds() - start);
+	HOST_CHECK(lock.consumed == lock.iterations * 2 && lock.queued == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	SceUInt32 threads;
+	LockKind kind;
+
+	lock.iterations = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : 200000;
+	HOST_CHECK(lock.iterations > 0);
+	HOST_CHECK(vitasdk_mutex_create(&lock.mutex, "LockBench", VITASDK_MUTEX_DEFAULT_SPIN) == 0);
+	HOST_CHECK(vitasdk_rwlock_create(&lock.rwlock, "LockBench") == 0);
+	HOST_CHECK(vitasdk_cond_create(&lock.cond, "LockBench") == 0);
+	pthread_mutex_init(&lock.pmutex, NULL);
+	pthread_rwlock_init(&lock.prwlock, NULL);
+	pthread_cond_init(&lock.pcond, NULL);
+
+	/* Uncontended pairs never reach the semaphores */
+	lock.kind = LOCK_VITASDK;
+	HOST_CHECK(vitasdk_mutex_trylock(&lock.mutex));
+	HOST_CHECK(!vitasdk_mutex_trylock(&lock.mutex));
+	mutex_unlock();
+	run_mutex(LOCK_VITASDK, 1);
+	HOST_CHECK(host_kernel_calls() == 4);
+
+	for (threads = 1; threads <= THREADS; threads *= 2) {
+		for (kind = LOCK_VITASDK; kind <= LOCK_PTHREAD; kind++)
+			run_mutex(kind, threads);
+	}
+	for (threads = 1; threads <= THREADS; threads *= 2) {
+		for (kind = LOCK_VITASDK; kind <= LOCK_PTHREAD; kind++)
+			run_rwlock(kind, threads);
+	}
+	for (kind = LOCK_VITASDK; kind <= LOCK_PTHREAD; kind++)
+		run_cond(kind);
+
+	HOST_CHECK(vitasdk_cond_delete(&lock.cond) == 0);
+	HOST_CHECK(vitasdk_rwlock_delete(&lock.rwlock) == 0);
+	HOST_CHECK(vitasdk_mutex_delete(&lock.mutex) == 0);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * Test and benchmark of the vitasdk/msgpipe.h batched transfers.
+ *
+ * usage: msgpipe_bench [messages]
+ *
+ * One thread sends numbered messages through a pipe to another, one
+ * message per call, in batches, or as buffer handles. The test checks that
+ * every message arrives once and in order, and prints the message pipe
+ * calls per message, the syscalls of the Vita. Then several threads send
+ * batches of varying sizes through the same pipe, and the test checks that
+ * the batches of different senders never interleave.
+ */
+
+#include <pthread.h>
+#include <psp2/kernel/error.h>
+#include <vitasdk/msgpipe.h>
+
+#include "host_kernel.h"
+
+#define PIPE_SIZE (4096)
+#define BATCH     (64)
+#define SENDERS   (4)
+
+typedef struct Message {
+	SceUInt32 seq;
+	SceUInt32 check;
+	SceUInt32 payload[2];
+} Message;
+
+typedef enum TransferKind {
+	TRANSFER_SINGLE,
+	TRANSFER_BATCH,
+	TRANSFER_HANDLES,
+	TRANSFER_SENDERS
+} TransferKind;
+
+static const char *const transfer_names[] = { "per message", "batch", "handles", "4 senders" };
+
+static struct {
+	TransferKind kind;
+	SceUInt32 messages;
+	VitasdkMsgPipe pipe;
+	Message *sent;                /* Backing store of the handles */
+} bench;
+
+static void message_make(Message *m, SceUInt32 seq)
+{
+	m->seq        = seq;
+	m->check      = seq * 2654435761u;
+	m->payload[0] = ~seq;
+	m->payload[1] = seq ^ 0x5A5A5A5A;
+}
+
+static void message_check(const Message *m, SceUInt32 seq)
+{
+	HOST_CHECK(m->seq == seq && m->check == seq * 2654435761u);
+	HOST_CHECK(m->payload[0] == ~seq && m->payload[1] == (seq ^ 0x5A5A5A5A));
+}
+
+/* Messages of the senders: their sequence, then the sender and the position in the batch */
+static void message_make_batch(Message *m, SceUInt32 seq, SceUInt32 sender, SceUInt32 index, SceUInt32 n)
+{
+	m->seq        = seq;
+	m->check      = seq * 2654435761u;
+	m->payload[0] = (sender << 16) | index;
+	m->payload[1] = n;
+}
+
+static void *senders_entry(void *arg)
+{
+	Message batch[BATCH];
+	void *pointers[BATCH];
+	SceUInt32 sender = (SceUInt32)(uintptr_t)arg, messages = bench.messages / SENDERS, seq = 0, n, i;
+
+	while (seq < messages) {
+		/* 1 to BATCH messages, often more than a syscall carries */
+		n = 1 + (seq * 7 + sender) % BATCH;
+		if (n > messages - seq)
+			n = messages - seq;
+		for (i = 0; i < n; i++) {
+			message_make_batch(&batch[i], seq + i, sender, i, n);
+			pointers[i] = &batch[i];
+		}
+		HOST_CHECK(vitasdk_msgpipe_send_batch(&bench.pipe, pointers, sizeof(Message), n, NULL) == 0);
+		seq += n;
+	}
+	return NULL;
+}
+
+/* The messages of each sender in order, each batch in one piece */
+static void receive_senders(void)
+{
+	Message batch[BATCH];
+	void *pointers[BATCH];
+	SceUInt32 next[SENDERS] = { 0 }, total = bench.messages / SENDERS * SENDERS;
+	SceUInt32 received = 0, sender = 0, index = 0, left = 0, n, i;
+
+	while (received < total) {
+		/* Receive boundaries unrelated to the batch boundaries */
+		n = total - received < 37 ? total - received : 37;
+		for (i = 0; i < n; i++)
+			pointers[i] = &batch[i];
+		HOST_CHECK(vitasdk_msgpipe_receive_batch(&bench.pipe, pointers, sizeof(Message), n, NULL) == 0);
+		for (i = 0; i < n; i++) {
+			Message *m = &batch[i];
+			SceUInt32 from = m->payload[0] >> 16;
+
+			HOST_CHECK(from < SENDERS && m->check == m->seq * 2654435761u);
+			if (left == 0) {
+				/* A new batch starts */
+				sender = from;
+				index  = 0;
+				left   = m->payload[1];
+			}
+			HOST_CHECK(from == sender && (m->payload[0] & 0xFFFF) == index);
+			HOST_CHECK(m->seq == next[sender]);
+			next[sender]++;
+			index++;
+			left--;
+		}
+		received += n;
+	}
+	HOST_CHECK(left == 0);
+	for (i = 0; i < SENDERS; i++)
+		HOST_CHECK(next[i] == bench.messages / SENDERS);
+}
+
+static void *sender_entry(void *arg)
+{
+	Message batch[BATCH];
+	void *pointers[BATCH];
+	SceUInt32 seq = 0, n, i;
+
+	(void)arg;
+	while (seq < bench.messages) {
+		n = bench.messages - seq < BATCH ? bench.messages - seq : BATCH;
+		switch (bench.kind) {
+		case TRANSFER_SINGLE:
+			for (i = 0; i < n; i++) {
+				message_make(&batch[0], seq + i);
+				HOST_CHECK(sceKernelSendMsgPipe(bench.pipe.uid, &batch[0], sizeof(Message), 0, NULL, NULL) == 0);
+			}
+			break;
+		case TRANSFER_BATCH:
+			for (i = 0; i < n; i++) {
+				message_make(&batch[i], seq + i);
+				pointers[i] = &batch[i];
+			}
+			HOST_CHECK(vitasdk_msgpipe_send_batch(&bench.pipe, pointers, sizeof(Message), n, NULL) == 0);
+			break;
+		default:
+			for (i = 0; i < n; i++) {
+				message_make(&bench.sent[seq + i], seq + i);
+				pointers[i] = &bench.sent[seq + i];
+			}
+			HOST_CHECK(vitasdk_msgpipe_send_handles(&bench.pipe, pointers, n, NULL) == 0);
+			break;
+		}
+		seq += n;
+	}
+	return NULL;
+}
+
+static void receive(void)
+{
+	Message batch[BATCH];
+	void *pointers[BATCH];
+	SceUInt32 seq = 0, n, i;
+
+	while (seq < bench.messages) {
+		n = bench.messages - seq < BATCH ? bench.messages - seq : BATCH;
+		switch (bench.kind) {
+		case TRANSFER_SINGLE:
+			for (i = 0; i < n; i++) {
+				HOST_CHECK(sceKernelReceiveMsgPipe(bench.pipe.uid, &batch[i], sizeof(Message), 0, NULL, NULL) == 0);
+				message_check(&batch[i], seq + i);
+			}
+			break;
+		case TRANSFER_BATCH:
+			for (i = 0; i < n; i++)
+				pointers[i] = &batch[i];
+			HOST_CHECK(vitasdk_msgpipe_receive_batch(&bench.pipe, pointers, sizeof(Message), n, NULL) == 0);
+			for (i = 0; i < n; i++)
+				message_check(&batch[i], seq + i);
+			break;
+		default:
+			HOST_CHECK(vitasdk_msgpipe_receive_handles(&bench.pipe, pointers, n, NULL) == 0);
+			for (i = 0; i < n; i++) {
+				HOST_CHECK(pointers[i] == &bench.sent[seq + i]);
+				message_check((const Message *)pointers[i], seq + i);
+			}
+			break;
+		}
+		seq += n;
+	}
+}
+
+static void run(TransferKind kind)
+{
+	pthread_t senders[SENDERS];
+	unsigned long calls;
+	double start, elapsed;
+	Message none;
+	SceUInt32 i;
+
+	bench.kind = kind;
+	calls = host_kernel_calls();
+	start = host_seconds();
+	if (kind == TRANSFER_SENDERS) {
+		for (i = 0; i < SENDERS; i++)
+			pthread_create(&senders[i], NULL, senders_entry, (void *)(uintptr_t)i);
+		receive_senders();
+		for (i = 0; i < SENDERS; i++)
+			pthread_join(senders[i], NULL);
+	} else {
+		pthread_create(&senders[0], NULL, sender_entry, NULL);
+		receive();
+		pthread_join(senders[0], NULL);
+	}
+	elapsed = host_seconds() - start;
+	calls   = host_kernel_calls() - calls;
+	printf("%-12s %8u messages: %6.2f M messages/s, %.3f calls per message\n", transfer_names[kind],
+	       bench.messages, bench.messages / elapsed / 1e6, (double)calls / bench.messages);
+	HOST_CHECK(sceKernelTryReceiveMsgPipe(bench.pipe.uid, &none, sizeof(none), 0, NULL) == (int)SCE_KERNEL_ERROR_MSG_PIPE_EMPTY);
+}
+
+int main(int argc, char *argv[])
+{
+	bench.messages = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : 200000;
+	HOST_CHECK(bench.messages > 0);
+	bench.sent = malloc(sizeof(Message) * bench.messages);
+	HOST_CHECK(bench.sent != NULL);
+	HOST_CHECK(vitasdk_msgpipe_create(&bench.pipe, "MsgPipeBench", 0x40, 12, PIPE_SIZE) == 0);
+
+	run(TRANSFER_SINGLE);
+	run(TRANSFER_BATCH);
+	run(TRANSFER_HANDLES);
+	run(TRANSFER_SENDERS);
+
+	HOST_CHECK(vitasdk_msgpipe_delete(&bench.pipe) == 0);
+	free(bench.sent);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * Benchmark of the vitasdk/profile.h scopes, and dump writer of the
+ * profile_trace.py round trip check.
+ *
+ * usage: profile_bench [scopes]
+ *        profile_bench --dump <file>
+ *
+ * Times VITASDK_PROFILE_SCOPE without PMU counters, then
+ * VITASDK_PROFILE_SCOPE_IN with two counters, and prints the kernel calls of
+ * each scope, the syscalls of the Vita. The two timebase reads of a scope
+ * are also timed alone, the rest is the cost of the scope itself. The
+ * scopes are drained by vitasdk_profile_dump into /dev/null, which is not
+ * timed.
+ *
+ * With --dump, two threads record nested scopes of known PMU counts into
+ * <file>, see profile_trace_check.py.
+ */
+
+#define ENABLE_VITASDK_PROFILE
+#include <string.h>
+#include <vitasdk/profile.h>
+
+#include "host_kernel.h"
+
+#define CAPACITY    (4096)
+#define CHUNK       (2048)
+#define PMU_TLS_KEY (VITASDK_PROFILE_TLS_KEY + 1)
+
+static const ScePerfArmPmonEventCode pmu_events[] = {
+	SCE_PERF_ARM_PMON_DCACHE_MISS,
+	SCE_PERF_ARM_PMON_BRANCH_MISPREDICT
+};
+
+static struct {
+	VitasdkProfiler prof;
+	VitasdkProfiler pmu_prof;
+	VitasdkProfileThread main_thread;
+	VitasdkProfileThread pmu_thread;
+	VitasdkProfileThread worker_thread;
+	VitasdkProfileEvent main_events[CAPACITY];
+	VitasdkProfileEvent pmu_events[CAPACITY];
+	VitasdkProfileEvent worker_events[CAPACITY];
+	volatile SceUInt32 sink;
+} bench;
+
+static void __attribute__((noinline)) scope_default(SceUInt32 i)
+{
+	VITASDK_PROFILE_SCOPE("scope");
+	bench.sink = i;
+}
+
+static void __attribute__((noinline)) scope_pmu(SceUInt32 i)
+{
+	VITASDK_PROFILE_SCOPE_IN(&bench.pmu_prof, "scope");
+	bench.sink = i;
+}
+
+static void __attribute__((noinline)) scope_none(SceUInt32 i)
+{
+	bench.sink = i;
+}
+
+/* The timebase reads of a scope alone, the host clock being slower than the Vita one */
+static void __attribute__((noinline)) scope_reads(SceUInt32 i)
+{
+	bench.sink = (SceUInt32)scePerfGetTimebaseValue();
+	bench.sink = (SceUInt32)scePerfGetTimebaseValue() + i;
+}
+
+/* ns per call of `scope`, its dumps excluded */
+static double time_scopes(void (*scope)(SceUInt32), VitasdkProfiler *prof, SceUID fd, SceUInt32 n,
+                          double *calls)
+{
+	unsigned long kernel_calls = 0, c;
+	double elapsed = 0, start;
+	SceUInt32 done, i;
+
+	for (done = 0; done < n; done += CHUNK) {
+		c     = host_kernel_calls();
+		start = host_seconds();
+		for (i = 0; i < CHUNK; i++)
+			scope(done + i);
+		elapsed      += host_seconds() - start;
+		kernel_calls += host_kernel_calls() - c;
+		if (prof)
+			HOST_CHECK(vitasdk_profile_dump(prof, fd) == 0);
+	}
+	*calls = (double)kernel_calls / done;
+	return elapsed / done * 1e9;
+}
+
+static void bench_scopes(SceUInt32 n)
+{
+	double none, reads, timebase, pmu, calls_none, calls_reads, calls_timebase, calls_pmu;
+	SceUID fd;
+
+	HOST_CHECK(vitasdk_profile_init(&bench.prof, VITASDK_PROFILE_TLS_KEY, NULL, 0) == 0);
+	HOST_CHECK(vitasdk_profile_init(&bench.pmu_prof, PMU_TLS_KEY, pmu_events, 2) == 0);
+	HOST_CHECK(vitasdk_profile_thread_init(&bench.prof, &bench.main_thread, bench.main_events, CAPACITY, "main") == 0);
+	HOST_CHECK(vitasdk_profile_thread_init(&bench.pmu_prof, &bench.pmu_thread, bench.pmu_events, CAPACITY, "main") == 0);
+	fd = vitasdk_profile_open(&bench.prof, "/dev/null");
+	HOST_CHECK(fd >= 0);
+
+	none     = time_scopes(scope_none, NULL, fd, n, &calls_none);
+	reads    = time_scopes(scope_reads, NULL, fd, n, &calls_reads);
+	timebase = time_scopes(scope_default, &bench.prof, fd, n, &calls_timebase);
+	pmu      = time_scopes(scope_pmu, &bench.pmu_prof, fd, n, &calls_pmu);
+	HOST_CHECK(bench.main_thread.dropped == 0 && bench.pmu_thread.dropped == 0);
+	/* Each PMU counter is read at both ends of a scope */
+	HOST_CHECK(calls_timebase == 0 && calls_pmu == 2 * 2);
+
+	printf("%-24s %10s %14s\n", "", "ns/scope", "syscalls/scope");
+	printf("%-24s %10.1f %14.1f\n", "empty function", none, calls_none);
+	printf("%-24s %10.1f %14.1f\n", "2 timebase reads", reads - none, calls_reads);
+	printf("%-24s %10.1f %14.1f\n", "timebase only", timebase - none, calls_timebase);
+	printf("%-24s %10.1f %14.1f\n", "timebase + 2 PMU", pmu - none, calls_pmu);
+	HOST_CHECK(sceIoClose(fd) == 0);
+}
+
+/* Scopes of known PMU counts: each counter read counts 1, a scope reads each counter twice */
+static void frame(void)
+{
+	SceUInt32 i;
+
+	VITASDK_PROFILE_SCOPE("frame");
+	for (i = 0; i < 2; i++) {
+		VITASDK_PROFILE_SCOPE("update");
+		bench.sink = i;
+	}
+}
+
+static int worker_entry(SceSize args, void *argp)
+{
+	SceUInt32 i;
+
+	(void)args;
+	(void)argp;
+	HOST_CHECK(vitasdk_profile_thread_init(&bench.prof, &bench.worker_thread, bench.worker_events, CAPACITY, "worker") == 0);
+	for (i = 0; i < 5; i++) {
+		VITASDK_PROFILE_SCOPE_IN(&bench.prof, "job");
+		bench.sink = i;
+	}
+	vitasdk_profile_thread_exit(&bench.prof);
+	return 0;
+}
+
+static void write_dump(const char *path)
+{
+	SceUID fd, thid;
+	SceUInt32 i;
+
+	HOST_CHECK(vitasdk_profile_init(&bench.prof, VITASDK_PROFILE_TLS_KEY, pmu_events, 2) == 0);
+	HOST_CHECK(vitasdk_profile_thread_init(&bench.prof, &bench.main_thread, bench.main_events, CAPACITY, "main") == 0);
+	fd = vitasdk_profile_open(&bench.prof, path);
+	HOST_CHECK(fd >= 0);
+
+	/* Two dumps, each names the threads again */
+	frame();
+	HOST_CHECK(vitasdk_profile_dump(&bench.prof, fd) == 0);
+	thid = sceKernelCreateThread("ProfileWorker", worker_entry, 0x10000100, 0x4000, 0, 0, NULL);
+	HOST_CHECK(thid >= 0);
+	HOST_CHECK(sceKernelStartThread(thid, 0, NULL) == 0);
+	HOST_CHECK(sceKernelWaitThreadEnd(thid, NULL, NULL) == 0);
+	sceKernelDeleteThread(thid);
+	for (i = 0; i < 2; i++)
+		frame();
+	HOST_CHECK(vitasdk_profile_dump(&bench.prof, fd) == 0);
+	HOST_CHECK(sceIoClose(fd) == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	SceUInt32 n;
+
+	if (argc == 3 && strcmp(argv[1], "--dump") == 0) {
+		write_dump(argv[2]);
+		return 0;
+	}
+	n = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : 1000000;
+	HOST_CHECK(n > 0);
+	bench_scopes(n);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Round trip of a vitasdk/profile.h dump through profile_trace.py.
+
+usage: profile_trace_check.py <profile_bench>
+
+profile_bench --dump writes the scopes of two threads, with the PMU
+counters of the host, which count their own reads. The check reads the
+dump with the layouts of profile_trace.py, which must match
+VitasdkProfileFileHeader and VitasdkProfileRecord, then converts it.
+"""
+import os
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.realpath(__file__)), '..'))
+import profile_trace
+
+def check(cond, what):
+    if not cond:
+        sys.exit('check failed: %s' % what)
+
+def main(bench):
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'profile.bin')
+        subprocess.run([bench, '--dump', path], check=True)
+        with open(path, 'rb') as f:
+            data = f.read()
+
+    header, records = profile_trace.read_dump(data)
+    check((len(data) - profile_trace.HEADER.size) % profile_trace.RECORD.size == 0, 'whole records')
+    check(header['frequency'] == 1000000000, 'timebase frequency')
+    # SCE_PERF_ARM_PMON_DCACHE_MISS, SCE_PERF_ARM_PMON_BRANCH_MISPREDICT
+    check(header['pmu_events'] == [0x03, 0x10], 'pmu events')
+
+    threads = dict()
+    for r in records:
+        if r['type'] == profile_trace.RECORD_THREAD:
+            check(threads.setdefault(r['thid'], r['name']) == r['name'], 'thread name')
+    check(sorted(threads.values()) == ['main', 'worker'], 'thread records')
+    # Two dumps name main twice, the worker once
+    check(sum(r['type'] == profile_trace.RECORD_THREAD for r in records) == 3, 'thread records per dump')
+
+    scopes = [r for r in records if r['type'] == profile_trace.RECORD_SCOPE]
+    names = sorted((threads[r['thid']], r['name']) for r in scopes)
+    check(names == [('main', 'frame')] * 3 + [('main', 'update')] * 6 + [('worker', 'job')] * 5, 'scopes')
+    for r in scopes:
+        check(r['end'] >= r['begin'], 'scope duration')
+        # Two reads of each counter per scope, and four per nested scope
+        expected = 2 + 4 * 2 if r['name'] == 'frame' else 2
+        check(list(r['counters']) == [expected, expected], 'counters of %s' % r['name'])
+    frames = [r for r in scopes if r['name'] == 'frame']
+    for r in scopes:
+        if r['name'] == 'update':
+            check(any(f['begin'] <= r['begin'] and r['end'] <= f['end'] for f in frames), 'nested scope')
+
+    trace = profile_trace.to_trace(header, records, profile_trace.pmu_event_names(profile_trace.INCLUDE_DIR))
+    events = trace['traceEvents']
+    check(sorted(e['args']['name'] for e in events if e['ph'] == 'M') == ['main', 'worker'], 'thread names')
+    complete = [e for e in events if e['ph'] == 'X']
+    check(len(complete) == len(scopes), 'complete events')
+    check(all(set(e['args']) == {'dcache_miss', 'branch_mispredict'} for e in complete), 'counter names')
+    check(min(e['ts'] for e in complete) == 0, 'trace origin')
+    print('ok')
+
+if __name__ == '__main__':
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    main(sys.argv[1])
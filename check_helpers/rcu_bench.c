@@ -0,0 +1,210 @@
+/*
+ * Stress test and reader scaling benchmark of vitasdk/seqlock.h and
+ * vitasdk/rcu.h.
+ *
+ * usage: rcu_bench [milliseconds per run]
+ *
+ * 1 to 4 readers copy a snapshot of 16 words while a writer replaces it
+ * every millisecond. Each reader checks that no copy mixes two snapshots.
+ * The throughput of the reads is compared with a VitasdkRWLock and a
+ * pthread rwlock guarding the same snapshot. On a host with fewer CPUs than
+ * threads, the readers share the CPUs and only the cost per read compares.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <vitasdk/lock.h>
+#include <vitasdk/rcu.h>
+#include <vitasdk/seqlock.h>
+
+#include "host_kernel.h"
+
+#define READERS (4)
+#define WORDS   (16)
+
+typedef struct Snapshot {
+	SceUInt32 v[WORDS];
+} Snapshot;
+
+typedef enum ShareKind {
+	SHARE_SEQLOCK,
+	SHARE_RCU,
+	SHARE_RWLOCK,
+	SHARE_PTHREAD
+} ShareKind;
+
+static const char *const share_names[] = { "seqlock", "rcu", "vitasdk rwlock", "pthread rwlock" };
+
+static struct {
+	ShareKind kind;
+	volatile SceUInt32 stop;
+	VitasdkSeqlock seqlock;
+	VitasdkRcu rcu;
+	VitasdkRWLock rwlock;
+	pthread_rwlock_t prwlock;
+	Snapshot snapshot;                /* Seqlock and rwlocks */
+	Snapshot *volatile current;       /* RCU */
+	unsigned long reads[READERS];
+	SceUInt32 torn;
+	SceUInt32 writes;
+} share;
+
+static void snapshot_make(Snapshot *s, SceUInt32 generation)
+{
+	SceUInt32 i;
+
+	for (i = 0; i < WORDS; i++)
+		s->v[i] = generation + i;
+}
+
+static SceBool snapshot_consistent(const Snapshot *s)
+{
+	SceUInt32 i;
+
+	for (i = 1; i < WORDS; i++) {
+		if (s->v[i] != s->v[0] + i)
+			return SCE_FALSE;
+	}
+	return SCE_TRUE;
+}
+
+static void read_snapshot(VitasdkRcuReader *reader, Snapshot *copy)
+{
+	switch (share.kind) {
+	case SHARE_SEQLOCK:
+		vitasdk_seqlock_read(&share.seqlock, copy, &share.snapshot, sizeof(*copy));
+		break;
+	case SHARE_RCU:
+		vitasdk_rcu_read_lock(&share.rcu, reader);
+		*copy = *(const Snapshot *)vitasdk_rcu_dereference((void *const volatile *)&share.current);
+		vitasdk_rcu_read_unlock(reader);
+		break;
+	case SHARE_RWLOCK:
+		HOST_CHECK(vitasdk_rwlock_lock_read(&share.rwlock) == 0);
+		*copy = share.snapshot;
+		HOST_CHECK(vitasdk_rwlock_unlock_read(&share.rwlock) == 0);
+		break;
+	default:
+		pthread_rwlock_rdlock(&share.prwlock);
+		*copy = share.snapshot;
+		pthread_rwlock_unlock(&share.prwlock);
+		break;
+	}
+}
+
+static void write_snapshot(SceUInt32 generation)
+{
+	Snapshot next, *copy;
+
+	snapshot_make(&next, generation);
+	switch (share.kind) {
+	case SHARE_SEQLOCK:
+		vitasdk_seqlock_write(&share.seqlock, &share.snapshot, &next, sizeof(next));
+		break;
+	case SHARE_RCU:
+		copy = malloc(sizeof(*copy));
+		HOST_CHECK(copy != NULL);
+		*copy = next;
+		free(vitasdk_rcu_replace(&share.rcu, (void *volatile *)&share.current, copy));
+		break;
+	case SHARE_RWLOCK:
+		HOST_CHECK(vitasdk_rwlock_lock_write(&share.rwlock) == 0);
+		share.snapshot = next;
+		HOST_CHECK(vitasdk_rwlock_unlock_write(&share.rwlock) == 0);
+		break;
+	default:
+		pthread_rwlock_wrlock(&share.prwlock);
+		share.snapshot = next;
+		pthread_rwlock_unlock(&share.prwlock);
+		break;
+	}
+}
+
+static void *reader_entry(void *arg)
+{
+	SceUInt32 index = (SceUInt32)(uintptr_t)arg, i;
+	VitasdkRcuReader *reader = vitasdk_rcu_register(&share.rcu);
+	unsigned long reads = 0;
+	Snapshot copy;
+
+	HOST_CHECK(reader != NULL);
+	while (!vitasdk_atomic_load_acquire32(&share.stop)) {
+		for (i = 0; i < 1000; i++) {
+			read_snapshot(reader, &copy);
+			if (!snapshot_consistent(&copy))
+				__atomic_add_fetch(&share.torn, 1, __ATOMIC_RELAXED);
+		}
+		reads += 1000;
+	}
+	vitasdk_rcu_unregister(&share.rcu, reader);
+	share.reads[index] = reads;
+	return NULL;
+}
+
+static void *writer_entry(void *arg)
+{
+	(void)arg;
+	while (!vitasdk_atomic_load_acquire32(&share.stop)) {
+		write_snapshot(++share.writes);
+		usleep(1000);
+	}
+	return NULL;
+}
+
+static void run(ShareKind kind, SceUInt32 readers, SceUInt32 ms)
+{
+	pthread_t threads[READERS], writer;
+	unsigned long reads = 0;
+	double start, elapsed;
+	SceUInt32 i;
+
+	share.kind   = kind;
+	share.stop   = 0;
+	share.torn   = 0;
+	share.writes = 0;
+	write_snapshot(0);
+
+	start = host_seconds();
+	for (i = 0; i < readers; i++)
+		pthread_create(&threads[i], NULL, reader_entry, (void *)(uintptr_t)i);
+	pthread_create(&writer, NULL, writer_entry, NULL);
+	usleep(ms * 1000);
+	vitasdk_atomic_store_release32(&share.stop, 1);
+	for (i = 0; i < readers; i++) {
+		pthread_join(threads[i], NULL);
+		reads += share.reads[i];
+	}
+	pthread_join(writer, NULL);
+	elapsed = host_seconds() - start;
+
+	printf("%-15s %u readers: %8.2f M reads/s, %5u writes\n", share_names[kind], readers, reads / elapsed / 1e6,
+	       share.writes);
+	HOST_CHECK(share.torn == 0);
+	HOST_CHECK(kind != SHARE_RWLOCK || share.rwlock.status == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	SceUInt32 ms = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : 100;
+	SceUInt32 readers;
+	ShareKind kind;
+
+	HOST_CHECK(ms > 0);
+	vitasdk_seqlock_init(&share.seqlock);
+	vitasdk_rcu_init(&share.rcu);
+	HOST_CHECK(vitasdk_rwlock_create(&share.rwlock, "RcuBench") == 0);
+	pthread_rwlock_init(&share.prwlock, NULL);
+	share.current = calloc(1, sizeof(Snapshot));
+	HOST_CHECK(share.current != NULL);
+
+	for (readers = 1; readers <= READERS; readers *= 2) {
+		for (kind = SHARE_SEQLOCK; kind <= SHARE_PTHREAD; kind++)
+			run(kind, readers, ms);
+	}
+
+	free(share.current);
+	HOST_CHECK(share.rcu.registered == 0);
+	HOST_CHECK(vitasdk_rwlock_delete(&share.rwlock) == 0);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * Stress test and throughput benchmark of the vitasdk/ring.h rings.
+ *
+ * usage: ring_stress [items per producer]
+ *
+ * Each ring moves numbered items from its producers to its consumers with
+ * batches of varying sizes. The test checks that every item arrives exactly
+ * once, and in the order of its producer when there is a single consumer.
+ * The throughput is compared with a queue behind a pthread mutex taken once
+ * per item, the host counterpart of a message pipe call per item.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <vitasdk/ring.h>
+
+#include "host_kernel.h"
+
+#define PRODUCERS (4)
+#define CONSUMERS (4)
+#define CAPACITY  (1024)
+#define MAX_BATCH (8)
+
+typedef enum RingKind {
+	RING_SPSC,
+	RING_MPSC,
+	RING_MPMC,
+	RING_MUTEX
+} RingKind;
+
+static const char *const ring_names[] = { "spsc", "mpsc", "mpmc", "mutex queue" };
+
+static struct {
+	RingKind kind;
+	SceUInt32 items;              /* Per producer */
+	SceUInt32 producers;
+	SceUInt32 consumers;
+	VitasdkSpscRing spsc VITASDK_CACHE_ALIGNED;
+	VitasdkMpscRing mpsc VITASDK_CACHE_ALIGNED;
+	VitasdkMpmcRing mpmc VITASDK_CACHE_ALIGNED;
+	void *slots[CAPACITY];
+	VitasdkRingCell cells[CAPACITY];
+	pthread_mutex_t lock;
+	SceUInt32 lock_head, lock_tail;
+	volatile SceUInt32 received;
+	unsigned char *seen;          /* Arrivals of each item */
+	SceUInt32 order_errors;
+} ring;
+
+/* Items are never NULL: the producer in the top bits, its sequence from 1 */
+static void *item_make(SceUInt32 producer, SceUInt32 seq)
+{
+	return (void *)(uintptr_t)(((uintptr_t)producer << 24) | (seq + 1));
+}
+
+static SceUInt32 item_index(void *item, SceUInt32 *producer, SceUInt32 *seq)
+{
+	uintptr_t v = (uintptr_t)item;
+
+	*producer = (SceUInt32)(v >> 24);
+	*seq      = (SceUInt32)(v & 0xFFFFFF) - 1;
+	return *producer * ring.items + *seq;
+}
+
+static SceUInt32 ring_push(void *const *items, SceUInt32 n)
+{
+	SceUInt32 i;
+
+	switch (ring.kind) {
+	case RING_SPSC:
+		return vitasdk_spsc_ring_push_n(&ring.spsc, items, n);
+	case RING_MPSC:
+		return vitasdk_mpsc_ring_push_n(&ring.mpsc, items, n);
+	case RING_MPMC:
+		return vitasdk_mpmc_ring_push_n(&ring.mpmc, items, n);
+	default:
+		for (i = 0; i < n; i++) {
+			pthread_mutex_lock(&ring.lock);
+			if (ring.lock_tail - ring.lock_head == CAPACITY) {
+				pthread_mutex_unlock(&ring.lock);
+				break;
+			}
+			ring.slots[ring.lock_tail++ % CAPACITY] = items[i];
+			pthread_mutex_unlock(&ring.lock);
+		}
+		return i;
+	}
+}
+
+static SceUInt32 ring_pop(void **items, SceUInt32 n)
+{
+	SceUInt32 i;
+
+	switch (ring.kind) {
+	case RING_SPSC:
+		return vitasdk_spsc_ring_pop_n(&ring.spsc, items, n);
+	case RING_MPSC:
+		return vitasdk_mpsc_ring_pop_n(&ring.mpsc, items, n);
+	case RING_MPMC:
+		return vitasdk_mpmc_ring_pop_n(&ring.mpmc, items, n);
+	default:
+		for (i = 0; i < n; i++) {
+			pthread_mutex_lock(&ring.lock);
+			if (ring.lock_tail == ring.lock_head) {
+				pthread_mutex_unlock(&ring.lock);
+				break;
+			}
+			items[i] = ring.slots[ring.lock_head++ % CAPACITY];
+			pthread_mutex_unlock(&ring.lock);
+		}
+		return i;
+	}
+}
+
+static void *producer_entry(void *arg)
+{
+	SceUInt32 producer = (SceUInt32)(uintptr_t)arg, seq = 0, n, i;
+	void *batch[MAX_BATCH];
+
+	while (seq < ring.items) {
+		n = 1 + (seq % MAX_BATCH);
+		if (n > ring.items - seq)
+			n = ring.items - seq;
+		for (i = 0; i < n; i++)
+			batch[i] = item_make(producer, seq + i);
+		for (i = 0; i < n;) {
+			SceUInt32 pushed = ring_push(batch + i, n - i);
+			if (pushed == 0)
+				sched_yield();
+			i += pushed;
+		}
+		seq += n;
+	}
+	return NULL;
+}
+
+static void *consumer_entry(void *arg)
+{
+	SceUInt32 total = ring.items * ring.producers, last[PRODUCERS] = { 0 };
+	SceUInt32 n, i, producer, seq, batch_size = 1;
+	void *batch[MAX_BATCH];
+
+	(void)arg;
+	while (vitasdk_atomic_load32(&ring.received) < total) {
+		n = ring_pop(batch, batch_size);
+		batch_size = batch_size % MAX_BATCH + 1;
+		if (n == 0) {
+			sched_yield();
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			SceUInt32 index = item_index(batch[i], &producer, &seq);
+
+			HOST_CHECK(producer < ring.producers && seq < ring.items);
+			__atomic_add_fetch(&ring.seen[index], 1, __ATOMIC_RELAXED);
+			/* A single consumer sees the items of a producer in order */
+			if (ring.consumers == 1) {
+				if (seq + 1 <= last[producer])
+					ring.order_errors++;
+				last[producer] = seq + 1;
+			}
+		}
+		vitasdk_atomic_add32(&ring.received, n);
+	}
+	return NULL;
+}
+
+static void run(RingKind kind, SceUInt32 producers, SceUInt32 consumers, SceUInt32 items)
+{
+	pthread_t threads[PRODUCERS + CONSUMERS];
+	SceUInt32 total = items * producers, i;
+	double start, elapsed;
+
+	ring.kind         = kind;
+	ring.items        = items;
+	ring.producers    = producers;
+	ring.consumers    = consumers;
+	ring.received     = 0;
+	ring.order_errors = 0;
+	ring.lock_head    = 0;
+	ring.lock_tail    = 0;
+	memset(ring.seen, 0, total);
+	HOST_CHECK(vitasdk_spsc_ring_init(&ring.spsc, ring.slots, CAPACITY) == 0);
+	HOST_CHECK(vitasdk_mpsc_ring_init(&ring.mpsc, ring.cells, CAPACITY) == 0);
+	HOST_CHECK(vitasdk_mpmc_ring_init(&ring.mpmc, ring.cells, CAPACITY) == 0);
+
+	start = host_seconds();
+	for (i = 0; i < consumers; i++)
+		pthread_create(&threads[producers + i], NULL, consumer_entry, NULL);
+	for (i = 0; i < producers; i++)
+		pthread_create(&threads[i], NULL, producer_entry, (void *)(uintptr_t)i);
+	for (i = 0; i < producers + consumers; i++)
+		pthread_join(threads[i], NULL);
+	elapsed = host_seconds() - start;
+
+	for (i = 0; i < total; i++)
+		HOST_CHECK(ring.seen[i] == 1);
+	HOST_CHECK(ring.order_errors == 0);
+	printf("%-12s %u -> %u: %9u items, %7.2f M items/s\n", ring_names[kind], producers, consumers,
+	       total, total / elapsed / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	SceUInt32 items = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : 200000;
+	VitasdkRingCell small[4];
+
+	HOST_CHECK(items > 0 && items < 0xFFFFFF);
+	ring.seen = malloc(items * PRODUCERS);
+	HOST_CHECK(ring.seen != NULL);
+	pthread_mutex_init(&ring.lock, NULL);
+
+	/* Capacity checks */
+	HOST_CHECK(vitasdk_mpmc_ring_init(&ring.mpmc, small, 3) == (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE);
+	HOST_CHECK(vitasdk_mpmc_ring_init(&ring.mpmc, small, 1) == (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE);
+
+	run(RING_SPSC, 1, 1, items);
+	run(RING_MUTEX, 1, 1, items);
+	run(RING_MPSC, PRODUCERS, 1, items);
+	run(RING_MUTEX, PRODUCERS, 1, items);
+	run(RING_MPMC, PRODUCERS, CONSUMERS, items);
+	run(RING_MUTEX, PRODUCERS, CONSUMERS, items);
+
+	free(ring.seen);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * Test and benchmark of the vitasdk/tcache.h thread-cached allocator.
+ *
+ * usage: tcache_bench [rounds]
+ *
+ * Checks that vitasdk_tcache_free caches the objects of every size, from the
+ * allocator or straight from the mspace, in the class matching their usable
+ * size, and that every object is back in the mspace once the threads exited
+ * and the central rings are trimmed. Then 1 to 4 threads allocate and free
+ * objects of 16 to 256 bytes through the allocator and straight through the
+ * mspace, whose single lock is the contended path the caches avoid. The
+ * times are the wall time divided by the allocations of all the threads.
+ */
+
+#include <string.h>
+#include <vitasdk/tcache.h>
+
+#include "host_kernel.h"
+
+#define MSPACE_SIZE (16 * 1024 * 1024)
+#define TLS_KEY     (0x10)
+#define MAX_THREADS (4)
+#define OBJECTS     (256)
+
+static struct {
+	VitasdkTcache tc;
+	SceClibMspace mspace;
+	SceUInt32 rounds;
+	int cached;                  /* Through the allocator, else the mspace */
+	volatile SceUInt32 start;
+	volatile SceUInt32 errors;
+} bench;
+
+static SceSize mspace_in_use(void)
+{
+	SceClibMspaceStats stats;
+
+	sceClibMspaceMallocStatsFast(bench.mspace, &stats);
+	return stats.current_in_use;
+}
+
+static void check_classes(void)
+{
+	VitasdkTcache *tc = &bench.tc;
+	VitasdkTcacheStats stats;
+	SceSize size, usable, in_use;
+	SceUInt32 cls;
+	void *p;
+
+	for (size = 1; size <= VITASDK_TCACHE_MAX_SIZE; size++) {
+		cls = (size - 1) / VITASDK_TCACHE_CLASS_SIZE;
+
+		/* Back to its own class, the next allocation of the class reuses it */
+		p = vitasdk_tcache_malloc(tc, size);
+		HOST_CHECK(p);
+		vitasdk_tcache_free(tc, p);
+		HOST_CHECK(vitasdk_tcache_malloc(tc, (cls + 1) * VITASDK_TCACHE_CLASS_SIZE) == p);
+		vitasdk_tcache_free_sized(tc, p, size);
+		HOST_CHECK(vitasdk_tcache_malloc(tc, size) == p);
+		vitasdk_tcache_free(tc, p);
+
+		/* From the mspace, to the largest class its usable size holds */
+		p = sceClibMspaceMalloc(bench.mspace, size);
+		HOST_CHECK(p);
+		usable = sceClibMspaceMallocUsableSize(p);
+		cls    = usable / VITASDK_TCACHE_CLASS_SIZE;
+		in_use = mspace_in_use();
+		vitasdk_tcache_free(tc, p);
+		if (cls == 0) {
+			/* Too small for any class, back to the mspace */
+			HOST_CHECK(mspace_in_use() < in_use);
+			continue;
+		}
+		HOST_CHECK(mspace_in_use() == in_use);
+		HOST_CHECK(vitasdk_tcache_malloc(tc, cls * VITASDK_TCACHE_CLASS_SIZE) == p);
+		vitasdk_tcache_free(tc, p);
+	}
+
+	/* Larger objects go back to the mspace */
+	in_use = mspace_in_use();
+	p = vitasdk_tcache_malloc(tc, VITASDK_TCACHE_MAX_SIZE * 2);
+	HOST_CHECK(p && mspace_in_use() > in_use);
+	vitasdk_tcache_free(tc, p);
+	HOST_CHECK(mspace_in_use() == in_use);
+
+	/* Nothing is left but the cache of the thread, kept for the next one */
+	vitasdk_tcache_thread_exit(tc);
+	vitasdk_tcache_trim(tc);
+	vitasdk_tcache_get_stats(tc, &stats);
+	HOST_CHECK(stats.thread_cached == 0 && stats.central_cached == 0);
+	HOST_CHECK(stats.mspace.current_in_use == sceClibMspaceMallocUsableSize(tc->threads[0]) + 4);
+}
+
+static int bench_thread(SceSize args, void *argp)
+{
+	void *objects[OBJECTS];
+	SceUInt32 seed = *(SceUInt32 *)argp, round, i;
+	SceSize size;
+
+	(void)args;
+	while (!vitasdk_atomic_load_acquire32(&bench.start))
+		vitasdk_cpu_relax();
+	for (round = 0; round < bench.rounds; round++) {
+		for (i = 0; i < OBJECTS; i++) {
+			size = 16 + (seed + i * 37) % 241;
+			objects[i] = bench.cached ? vitasdk_tcache_malloc(&bench.tc, size)
+			                          : sceClibMspaceMalloc(bench.mspace, size);
+			if (!objects[i])
+				vitasdk_atomic_add32(&bench.errors, 1);
+			else
+				*(SceUInt32 *)objects[i] = i;
+		}
+		/* Freed in another order than allocated */
+		for (i = 0; i < OBJECTS; i++) {
+			void *p = objects[(i * 7) % OBJECTS];
+			if (p && *(SceUInt32 *)p != (i * 7) % OBJECTS)
+				vitasdk_atomic_add32(&bench.errors, 1);
+			if (bench.cached)
+				vitasdk_tcache_free(&bench.tc, p);
+			else
+				sceClibMspaceFree(bench.mspace, p);
+		}
+	}
+	if (bench.cached)
+		vitasdk_tcache_thread_exit(&bench.tc);
+	return 0;
+}
+
+static double run(SceUInt32 threads, int cached)
+{
+	SceUID thids[MAX_THREADS];
+	SceUInt32 i;
+	double start;
+
+	bench.cached = cached;
+	bench.start  = 0;
+	for (i = 0; i < threads; i++) {
+		thids[i] = sceKernelCreateThread("TcacheBench", bench_thread, 0x10000100, 0x4000, 0,
+		                                 SCE_KERNEL_CPU_MASK_USER_0 << (i % 3), NULL);
+		HOST_CHECK(thids[i] >= 0);
+		HOST_CHECK(sceKernelStartThread(thids[i], sizeof(i), &i) == 0);
+	}
+	start = host_seconds();
+	vitasdk_atomic_store_release32(&bench.start, 1);
+	for (i = 0; i < threads; i++) {
+		HOST_CHECK(sceKernelWaitThreadEnd(thids[i], NULL, NULL) == 0);
+		sceKernelDeleteThread(thids[i]);
+	}
+	HOST_CHECK(bench.errors == 0);
+	return (host_seconds() - start) / ((double)threads * bench.rounds * OBJECTS) * 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	VitasdkTcacheStats stats;
+	SceUInt32 threads;
+	double cached, locked;
+
+	bench.rounds = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : 2000;
+	HOST_CHECK(bench.rounds > 0);
+	bench.mspace = sceClibMspaceCreate(NULL, MSPACE_SIZE);
+	HOST_CHECK(bench.mspace);
+	vitasdk_tcache_init(&bench.tc, bench.mspace, TLS_KEY);
+
+	check_classes();
+
+	printf("%-8s %18s %18s\n", "threads", "tcache (ns/pair)", "mspace (ns/pair)");
+	for (threads = 1; threads <= MAX_THREADS; threads++) {
+		cached = run(threads, 1);
+		locked = run(threads, 0);
+		printf("%-8u %18.1f %18.1f\n", threads, cached, locked);
+	}
+
+	/* The exited threads left nothing in their caches */
+	vitasdk_tcache_trim(&bench.tc);
+	vitasdk_tcache_get_stats(&bench.tc, &stats);
+	HOST_CHECK(stats.thread_cached == 0 && stats.central_cached == 0);
+	for (threads = 0; threads < VITASDK_TCACHE_MAX_THREADS; threads++) {
+		if (bench.tc.threads[threads])
+			stats.mspace.current_in_use -= sceClibMspaceMallocUsableSize(bench.tc.threads[threads]) + 4;
+	}
+	HOST_CHECK(stats.mspace.current_in_use == 0);
+	sceClibMspaceDestroy(bench.mspace);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * Test and core scaling sweep of the vitasdk/threadpool.h pool.
+ *
+ * usage: threadpool_bench [items]
+ *
+ * A parallel-for hashes every item of an array with pools on 1, 2 and 3
+ * user cores, the calling thread taking part in each. The test checks that
+ * every item is run exactly once and that the statistics add up, then
+ * prints the speedup over the calling thread alone. The host CPUs stand in
+ * for the Vita cores: with fewer than 4 of them the sweep cannot scale.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <psp2/kernel/error.h>
+#include <vitasdk/threadpool.h>
+
+#include "host_kernel.h"
+
+/* Hash rounds per item, the work of a chunk */
+#define ROUNDS (200)
+
+static struct {
+	SceUInt32 items;
+	SceUInt32 *out;
+	unsigned char *runs;
+} bench;
+
+static SceUInt32 hash(SceUInt32 x)
+{
+	SceUInt32 i;
+
+	for (i = 0; i < ROUNDS; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+	}
+	return x;
+}
+
+static void hash_range(void *arg, SceUInt32 begin, SceUInt32 end)
+{
+	(void)arg;
+	for (; begin < end; begin++) {
+		bench.out[begin] = hash(begin + 1);
+		__atomic_add_fetch(&bench.runs[begin], 1, __ATOMIC_RELAXED);
+	}
+}
+
+static double run_serial(void)
+{
+	double start = host_seconds();
+
+	hash_range(NULL, 0, bench.items);
+	return host_seconds() - start;
+}
+
+static double run_pool(int core_mask, SceUInt32 chunk, double serial)
+{
+	VitasdkThreadPoolParam param;
+	VitasdkThreadPool pool;
+	SceUInt32 chunks = 0, i;
+	double start, elapsed;
+
+	vitasdk_thread_pool_param_init(&param);
+	param.core_mask = core_mask;
+	HOST_CHECK(vitasdk_thread_pool_create(&pool, &param) == 0);
+	HOST_CHECK(pool.core_mask == (core_mask & SCE_KERNEL_CPU_MASK_USER_ALL));
+	memset(bench.runs, 0, bench.items);
+
+	start = host_seconds();
+	HOST_CHECK(vitasdk_thread_pool_parallel_for(&pool, 0, bench.items, chunk, hash_range, NULL) == 0);
+	elapsed = host_seconds() - start;
+
+	for (i = 0; i < bench.items; i++)
+		HOST_CHECK(bench.runs[i] == 1 && bench.out[i] == hash(i + 1));
+	for (i = 0; i < pool.worker_count; i++)
+		chunks += vitasdk_atomic_load32(&pool.workers[i].chunks);
+	/* The caller runs the other chunks */
+	HOST_CHECK(chunks <= (bench.items + pool.chunk - 1) / pool.chunk);
+	printf("%u workers + caller: %7.2f ms, %4.2fx the caller alone, %u chunks on the workers, utilization",
+	       pool.worker_count, elapsed * 1e3, serial / elapsed, chunks);
+	for (i = 0; i < pool.worker_count; i++)
+		printf(" %u", vitasdk_thread_pool_utilization(&pool, i));
+	printf("\n");
+
+	vitasdk_thread_pool_reset_stats(&pool);
+	for (i = 0; i < pool.worker_count; i++)
+		HOST_CHECK(pool.workers[i].chunks == 0 && vitasdk_thread_pool_utilization(&pool, i) == 0);
+	HOST_CHECK(vitasdk_thread_pool_destroy(&pool) == 0);
+	return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int masks[] = {
+		SCE_KERNEL_CPU_MASK_USER_0,
+		SCE_KERNEL_CPU_MASK_USER_0 | SCE_KERNEL_CPU_MASK_USER_1,
+		SCE_KERNEL_CPU_MASK_USER_ALL
+	};
+	VitasdkThreadPoolParam param;
+	VitasdkThreadPool pool;
+	double serial;
+	SceUInt32 i;
+
+	bench.items = argc > 1 ? (SceUInt32)strtoul(argv[1], NULL, 0) : 200000;
+	HOST_CHECK(bench.items > 0);
+	bench.out  = malloc(sizeof(*bench.out) * bench.items);
+	bench.runs = malloc(bench.items);
+	HOST_CHECK(bench.out && bench.runs);
+
+	/* The system core is skipped when the process may not use it */
+	vitasdk_thread_pool_param_init(&param);
+	param.core_mask = SCE_KERNEL_CPU_MASK_SYSTEM;
+	HOST_CHECK(vitasdk_thread_pool_create(&pool, &param) == (int)SCE_KERNEL_ERROR_ILLEGAL_CPU_AFFINITY_MASK);
+
+	printf("%ld host CPUs\n", sysconf(_SC_NPROCESSORS_ONLN));
+	serial = run_serial();
+	printf("caller alone:       %7.2f ms\n", serial * 1e3);
+	for (i = 0; i < sizeof(masks) / sizeof(masks[0]); i++)
+		run_pool(masks[i], 0, serial);
+	run_pool(SCE_KERNEL_CPU_MASK_USER_ALL | SCE_KERNEL_CPU_MASK_SYSTEM, 64, serial);
+
+	free(bench.runs);
+	free(bench.out);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef _CHECK_NID_COMPAT_H_
+#define _CHECK_NID_COMPAT_H_
+
+// Check the import of ksceKernelDomainTextMemcpy on the firmwares exporting it
+#ifndef __USE_SCE_KERNEL_DOMAIN_TEXT_MEMCPY_IMPORT
+#define __USE_SCE_KERNEL_DOMAIN_TEXT_MEMCPY_IMPORT
+#endif
+
+#include <stddef.h>
+#include <psp2common/defs.h>
+
+typedef struct {
+	const char *function_name;
+	void *function;
+} function_entry;
+
+#define _x(__name__) {.function_name = #__name__, .function = __name__}
+
+#endif /* _CHECK_NID_COMPAT_H_ */
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Generate the NID compat check sources from the db and the headers.
+
+Every library of a `db/<fw>` directory gets one translation unit holding a
+`function_entry` table with the functions of the library declared by the
+headers. Linking the tables against the stubs of the same firmware checks
+that every declared function is exported under the name used by the headers.
+"""
+import os
+import sys
+
+CURR_DIR = os.path.dirname(os.path.realpath(__file__))
+sys.path.insert(0, os.path.join(CURR_DIR, '..'))
+import nid_db
+import header_scan
+
+DEFAULT_FIRMWARES = ['360', '363']
+# The stubs of the other firmwares are suffixed with the firmware, e.g. SceSysmemForKernel_363_stub
+BASE_FIRMWARE = '360'
+
+# The function used by module_start and its stub
+PRINT_FUNCTIONS = {
+    'kernel': ('psp2kern/kernel/debug.h', 'ksceKernelPrintf', 'SceDebugForDriver'),
+    'user': ('psp2/kernel/clib.h', 'sceClibPrintf', 'SceLibKernel'),
+}
+
+def library_table(kind, lib, declared):
+    """Return (headers, [(function, condition)]) for the declared functions of a library."""
+    headers = set()
+    entries = []
+    for name in sorted(lib.get('functions', dict())):
+        decls = [d for d in declared.get(name, []) if d[0].startswith(header_scan.HEADER_DIRS[kind])]
+        if not decls:
+            continue
+        headers.update(d[0] for d in decls)
+        conds = [d[1] for d in decls]
+        cond = None if None in conds else header_scan.join_conditions(' || ', conds)
+        entries.append((name, cond))
+    return sorted(headers), entries
+
+def render_table(source, lib_name, headers, entries):
+    out = ['/* Generated by gen_tables.py from %s, do not edit */' % source, '',
+           '#include "check_nid_compat.h"']
+    out += ['#include <%s>' % h for h in headers]
+    out += ['', 'const function_entry %s_functions[] = {' % lib_name]
+    for name, cond in entries:
+        if cond:
+            out.append('#if %s' % cond)
+        out.append('\t_x(%s),' % name)
+        if cond:
+            out.append('#endif')
+    out += ['\t{', '\t\t.function_name = NULL,', '\t\t.function = NULL', '\t}', '};', '']
+    return '\n'.join(out)
+
+def render_main(kind, tables):
+    header, printf, _ = PRINT_FUNCTIONS[kind]
+    modulemgr = 'psp2kern/kernel/modulemgr.h' if kind == 'kernel' else 'psp2/kernel/modulemgr.h'
+    out = ['/* Generated by gen_tables.py, do not edit */', '',
+           '#include "check_nid_compat.h"',
+           '#include <%s>' % header,
+           '#include <%s>' % modulemgr, '',
+           'const SceUInt32 module_sdk_version = PSP2_SDK_VERSION;', '']
+    out += ['extern const function_entry %s_functions[];' % t for t, _ in tables]
+    out += ['',
+            'void _start() __attribute__ ((weak, alias("module_start")));',
+            'int module_start(SceSize args, void *argp){', '',
+            '#define _print(__lib__, __n__) %s("%%s %%p %%d\\n", #__lib__, __lib__##_functions, __n__)' % printf, '']
+    out += ['\t_print(%s, %d);' % (t, n) for t, n in tables]
+    out += ['', '\treturn SCE_KERNEL_START_SUCCESS;', '}', '']
+    return '\n'.join(out)
+
+def write_if_changed(path, data):
+    try:
+        with open(path, 'r') as f:
+            if f.read() == data:
+                return
+    except IOError:
+        pass
+    with open(path, 'w') as f:
+        f.write(data)
+
+def cmake_list(values):
+    return '\n'.join('  %s' % v for v in values)
+
+def generate(out_dir, ver, files, declared):
+    suffix = '' if ver == BASE_FIRMWARE else '_' + ver
+    fw_dir = os.path.join(out_dir, ver)
+    sources = {'kernel': [], 'user': []}
+    stubs = {'kernel': set(), 'user': set()}
+    tables = {'kernel': [], 'user': []}
+    count = 0
+
+    for fn, _, _, lib_name, lib in nid_db.iter_libraries(files):
+        kind = 'kernel' if lib.get('kernel') else 'user'
+        headers, entries = library_table(kind, lib, declared)
+        if not entries:
+            continue
+        kind_dir = os.path.join(fw_dir, kind)
+        os.makedirs(kind_dir, exist_ok=True)
+        source = os.path.join(kind_dir, lib_name + '.c')
+        write_if_changed(source, render_table('db/%s/%s' % (ver, fn), lib_name, headers, entries))
+        sources[kind].append(source)
+        stubs[kind].add('%s%s_stub' % (lib.get('stubname', lib_name), suffix))
+        tables[kind].append((lib_name, len(entries) + 1))
+        count += len(entries)
+
+    cmake = ['# Generated by gen_tables.py, do not edit', '']
+    for kind in ('kernel', 'user'):
+        kind_dir = os.path.join(fw_dir, kind)
+        if sources[kind]:
+            main = os.path.join(kind_dir, 'main.c')
+            write_if_changed(main, render_main(kind, tables[kind]))
+            sources[kind].append(main)
+            # The stub of the print function is always the one of the base firmware
+            stubs[kind].add(PRINT_FUNCTIONS[kind][2] + '_stub')
+        # Drop the tables of the libraries removed from the db
+        for path in header_scan.findfile(kind_dir, '.c') if os.path.isdir(kind_dir) else []:
+            if path not in sources[kind]:
+                os.remove(path)
+        name = 'CHECK_NID_COMPAT_%s' % kind.upper()
+        cmake += ['set(%s_SOURCES\n%s\n)' % (name, cmake_list(sources[kind])),
+                  'set(%s_STUBS\n%s\n)' % (name, cmake_list(sorted(stubs[kind]))), '']
+    write_if_changed(os.path.join(fw_dir, 'tables.cmake'), '\n'.join(cmake))
+
+    return sum(len(t) for t in tables.values()), count
+
+if __name__ == '__main__':
+    import argparse
+
+    parser = argparse.ArgumentParser(description='Generate the NID compat check tables.')
+    parser.add_argument('out_dir')
+    parser.add_argument('firmwares', nargs='*', default=DEFAULT_FIRMWARES,
+                        help='db/<fw> directories to generate, %s by default' % ' '.join(DEFAULT_FIRMWARES))
+    parser.add_argument('--db', default=nid_db.DB_DIR)
+    parser.add_argument('--include', default=header_scan.INCLUDE_DIR)
+    args = parser.parse_args()
+
+    declared = header_scan.scan_headers(args.include)
+    for ver in args.firmwares:
+        files = nid_db.load_dir(os.path.join(args.db, ver))
+        if not files:
+            sys.exit('%s: no such firmware in %s' % (ver, args.db))
+        libraries, functions = generate(args.out_dir, ver, files, declared)
+        print('%s: %d libraries, %d functions' % (ver, libraries, functions))
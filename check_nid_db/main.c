@@ -0,0 +1,526 @@
+/*
+ * Consistency checker for the NID database.
+ *
+ * usage: check_nid_db [-v] [-s] [-j jobs] [db dir]
+ *
+ * Errors (exit status 1):
+ *  - a yml file that can not be parsed
+ *  - the same name listed twice in a library
+ *  - a `Name_XXXXXXXX` entry whose NID is not XXXXXXXX
+ *  - two libraries of a firmware sharing a library NID
+ *  - an entry renamed between the 3.60 database and a later one
+ *
+ * Warnings (errors with -s):
+ *  - one NID with several names in a library (aliases)
+ *  - one NID with unrelated names in different libraries of a firmware
+ *
+ * With -v, the NIDs changed between 3.60 and the later firmwares are listed.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define BASE_FIRMWARE "360"
+
+typedef struct Library {
+	const char *file;
+	const char *fw;
+	const char *module;
+	const char *name;
+	unsigned int nid;
+	int line;
+} Library;
+
+typedef struct Entry {
+	const Library *lib;
+	const char *name;
+	unsigned int nid;
+	int line;
+} Entry;
+
+typedef struct DbFile {
+	char *path;
+	const char *fw;
+	char *data;
+	Library *libs;
+	int n_libs;
+	Entry *entries;
+	int n_entries;
+	char *error;
+} DbFile;
+
+static int verbose, strict;
+static int n_errors, n_warnings;
+
+static void *xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size);
+	if (p == NULL) {
+		perror("realloc");
+		exit(2);
+	}
+	return p;
+}
+
+static char *xstrdup(const char *s)
+{
+	char *d = strdup(s);
+	if (d == NULL) {
+		perror("strdup");
+		exit(2);
+	}
+	return d;
+}
+
+__attribute__((format(printf, 2, 3)))
+static void report(int warning, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (warning && !strict) {
+		printf("warning: ");
+		n_warnings++;
+	} else {
+		printf("error: ");
+		n_errors++;
+	}
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	putchar('\n');
+}
+
+static void parse_error(DbFile *f, int line, const char *what)
+{
+	char buf[512];
+
+	if (f->error != NULL)
+		return;
+	snprintf(buf, sizeof(buf), "%s:%d: %s", f->path, line, what);
+	f->error = xstrdup(buf);
+}
+
+/*
+ * The db files only use block mappings of scalars, the key path is tracked
+ * through the indentation:
+ *   modules: / <module>: / libraries: / <library>: / functions|variables: / <name>: <nid>
+ */
+static void parse_file(DbFile *f)
+{
+	FILE *fp;
+	long size;
+	char *line, *next;
+	int line_no = 0, depth = 0;
+	int indents[8];
+	const char *keys[8];
+	Library *lib = NULL;
+
+	fp = fopen(f->path, "rb");
+	if (fp == NULL) {
+		parse_error(f, 0, "can not open");
+		return;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	f->data = xrealloc(NULL, size + 1);
+	if (fread(f->data, 1, size, fp) != (size_t)size) {
+		fclose(fp);
+		parse_error(f, 0, "can not read");
+		return;
+	}
+	f->data[size] = '\0';
+	fclose(fp);
+
+	for (line = f->data; line != NULL && *line != '\0'; line = next) {
+		char *key, *value, *colon, *end;
+		int indent = 0;
+
+		line_no++;
+		next = strchr(line, '\n');
+		if (next != NULL)
+			*next++ = '\0';
+
+		while (line[indent] == ' ')
+			indent++;
+		key = line + indent;
+		if (*key == '\0' || *key == '#' || *key == '\r')
+			continue;
+
+		colon = strchr(key, ':');
+		if (colon == NULL) {
+			parse_error(f, line_no, "expected `key: value`");
+			return;
+		}
+		*colon = '\0';
+		value = colon + 1;
+		while (*value == ' ')
+			value++;
+		end = value + strcspn(value, "#\r");
+		while (end > value && end[-1] == ' ')
+			end--;
+		*end = '\0';
+
+		while (depth > 0 && indent <= indents[depth - 1])
+			depth--;
+		if (depth >= 6) {
+			parse_error(f, line_no, "too deeply nested");
+			return;
+		}
+
+		if (*value == '\0') {
+			indents[depth] = indent;
+			keys[depth++] = key;
+			if (depth == 4 && strcmp(keys[0], "modules") == 0 && strcmp(keys[2], "libraries") == 0) {
+				f->libs = xrealloc(f->libs, (f->n_libs + 1) * sizeof(Library));
+				lib = &f->libs[f->n_libs++];
+				memset(lib, 0, sizeof(*lib));
+				lib->file = f->path;
+				lib->fw = f->fw;
+				lib->module = keys[1];
+				lib->name = key;
+				lib->line = line_no;
+			}
+			continue;
+		}
+
+		if (depth == 4 && strcmp(key, "nid") == 0 && lib != NULL) {
+			lib->nid = strtoul(value, NULL, 0);
+		} else if (depth == 5 && lib != NULL
+		        && (strcmp(keys[4], "functions") == 0 || strcmp(keys[4], "variables") == 0)) {
+			Entry *e;
+			char *nid_end;
+			unsigned long nid = strtoul(value, &nid_end, 0);
+
+			if (*nid_end != '\0') {
+				parse_error(f, line_no, "invalid NID");
+				return;
+			}
+			f->entries = xrealloc(f->entries, (f->n_entries + 1) * sizeof(Entry));
+			e = &f->entries[f->n_entries++];
+			/* the library pointer is fixed up once f->libs stops moving */
+			e->lib = (const Library *)(size_t)(f->n_libs - 1);
+			e->name = key;
+			e->nid = nid;
+			e->line = line_no;
+		}
+	}
+
+	for (int i = 0; i < f->n_entries; i++)
+		f->entries[i].lib = &f->libs[(size_t)f->entries[i].lib];
+}
+
+typedef struct Work {
+	DbFile *files;
+	int n_files;
+	int next;
+	pthread_mutex_t lock;
+} Work;
+
+static void *worker(void *arg)
+{
+	Work *w = arg;
+
+	for (;;) {
+		int i;
+
+		pthread_mutex_lock(&w->lock);
+		i = w->next++;
+		pthread_mutex_unlock(&w->lock);
+		if (i >= w->n_files)
+			return NULL;
+		parse_file(&w->files[i]);
+	}
+}
+
+static int has_suffix(const char *s, const char *suffix)
+{
+	size_t n = strlen(s), m = strlen(suffix);
+	return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static DbFile *collect_files(const char *db_dir, int *n_files)
+{
+	DbFile *files = NULL;
+	DIR *db, *fw;
+	struct dirent *d, *e;
+	char path[4096];
+	int n = 0;
+
+	db = opendir(db_dir);
+	if (db == NULL) {
+		perror(db_dir);
+		exit(2);
+	}
+	while ((d = readdir(db)) != NULL) {
+		char *fw_name;
+
+		if (d->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", db_dir, d->d_name);
+		fw = opendir(path);
+		if (fw == NULL)
+			continue;
+		fw_name = xstrdup(d->d_name);
+		while ((e = readdir(fw)) != NULL) {
+			if (!has_suffix(e->d_name, ".yml"))
+				continue;
+			files = xrealloc(files, (n + 1) * sizeof(DbFile));
+			memset(&files[n], 0, sizeof(DbFile));
+			snprintf(path, sizeof(path), "%s/%s/%s", db_dir, d->d_name, e->d_name);
+			files[n].path = xstrdup(path);
+			files[n].fw = fw_name;
+			n++;
+		}
+		closedir(fw);
+	}
+	closedir(db);
+
+	*n_files = n;
+	return files;
+}
+
+/* ksceFoo and sceFoo are the kernel and user exports of the same function */
+static const char *base_name(const char *name)
+{
+	if (name[0] == 'k' && strncmp(name + 1, "sce", 3) == 0)
+		return name + 1;
+	return name;
+}
+
+static int cmp_lib_nid(const void *a, const void *b)
+{
+	const Entry *x = a, *y = b;
+	if (x->lib != y->lib)
+		return x->lib < y->lib ? -1 : 1;
+	if (x->nid != y->nid)
+		return x->nid < y->nid ? -1 : 1;
+	return strcmp(x->name, y->name);
+}
+
+static int cmp_lib_name(const void *a, const void *b)
+{
+	const Entry *x = a, *y = b;
+	if (x->lib != y->lib)
+		return x->lib < y->lib ? -1 : 1;
+	return strcmp(x->name, y->name);
+}
+
+static int cmp_fw_nid(const void *a, const void *b)
+{
+	const Entry *x = a, *y = b;
+	int r = strcmp(x->lib->fw, y->lib->fw);
+	if (r != 0)
+		return r;
+	if (x->nid != y->nid)
+		return x->nid < y->nid ? -1 : 1;
+	return strcmp(base_name(x->name), base_name(y->name));
+}
+
+static int cmp_libname_nid(const void *a, const void *b)
+{
+	const Entry *x = a, *y = b;
+	int r = strcmp(x->lib->name, y->lib->name);
+	if (r != 0)
+		return r;
+	if (x->nid != y->nid)
+		return x->nid < y->nid ? -1 : 1;
+	return strcmp(x->lib->fw, y->lib->fw);
+}
+
+static int cmp_libname_name(const void *a, const void *b)
+{
+	const Entry *x = a, *y = b;
+	int r = strcmp(x->lib->name, y->lib->name);
+	if (r != 0)
+		return r;
+	r = strcmp(x->name, y->name);
+	if (r != 0)
+		return r;
+	return strcmp(x->lib->fw, y->lib->fw);
+}
+
+static int cmp_lib_fw_nid(const void *a, const void *b)
+{
+	const Library *x = *(const Library * const *)a, *y = *(const Library * const *)b;
+	int r = strcmp(x->fw, y->fw);
+	if (r != 0)
+		return r;
+	if (x->nid != y->nid)
+		return x->nid < y->nid ? -1 : 1;
+	return strcmp(x->name, y->name);
+}
+
+static void check_suffixes(const Entry *entries, int n)
+{
+	for (int i = 0; i < n; i++) {
+		const char *name = entries[i].name;
+		size_t len = strlen(name);
+		int j;
+
+		if (len < 10 || name[len - 9] != '_')
+			continue;
+		for (j = 0; j < 8; j++) {
+			if (!isxdigit((unsigned char)name[len - 8 + j]))
+				break;
+		}
+		if (j != 8)
+			continue;
+		if (strtoul(name + len - 8, NULL, 16) != entries[i].nid)
+			report(0, "%s: %s: %s is not 0x%08X",
+				entries[i].lib->file, entries[i].lib->name, name, entries[i].nid);
+	}
+}
+
+static void check_libraries(Entry *entries, int n)
+{
+	/* names and NIDs inside a library */
+	qsort(entries, n, sizeof(Entry), cmp_lib_name);
+	for (int i = 1; i < n; i++) {
+		if (entries[i].lib == entries[i - 1].lib && strcmp(entries[i].name, entries[i - 1].name) == 0)
+			report(0, "%s: %s: %s is listed twice",
+				entries[i].lib->file, entries[i].lib->name, entries[i].name);
+	}
+
+	qsort(entries, n, sizeof(Entry), cmp_lib_nid);
+	for (int i = 1; i < n; i++) {
+		if (entries[i].lib == entries[i - 1].lib && entries[i].nid == entries[i - 1].nid)
+			report(1, "%s: %s: %s and %s share NID 0x%08X",
+				entries[i].lib->file, entries[i].lib->name, entries[i - 1].name, entries[i].name, entries[i].nid);
+	}
+
+	/* NIDs across the libraries of a firmware */
+	qsort(entries, n, sizeof(Entry), cmp_fw_nid);
+	for (int i = 1; i < n; i++) {
+		const Entry *a = &entries[i - 1], *b = &entries[i];
+
+		if (a->lib->fw != b->lib->fw && strcmp(a->lib->fw, b->lib->fw) != 0)
+			continue;
+		if (a->nid != b->nid || a->lib == b->lib)
+			continue;
+		if (strcmp(base_name(a->name), base_name(b->name)) != 0)
+			report(1, "%s: NID 0x%08X is both %s (%s) and %s (%s)",
+				a->lib->fw, a->nid, a->name, a->lib->name, b->name, b->lib->name);
+	}
+}
+
+static void check_library_nids(DbFile *files, int n_files)
+{
+	const Library **libs = NULL;
+	int n = 0;
+
+	for (int i = 0; i < n_files; i++) {
+		libs = xrealloc(libs, (n + files[i].n_libs) * sizeof(*libs));
+		for (int j = 0; j < files[i].n_libs; j++)
+			libs[n++] = &files[i].libs[j];
+	}
+	qsort(libs, n, sizeof(*libs), cmp_lib_fw_nid);
+	for (int i = 1; i < n; i++) {
+		if (strcmp(libs[i]->fw, libs[i - 1]->fw) == 0 && libs[i]->nid == libs[i - 1]->nid
+		 && strcmp(libs[i]->name, libs[i - 1]->name) != 0)
+			report(0, "%s: libraries %s and %s share NID 0x%08X",
+				libs[i]->fw, libs[i - 1]->name, libs[i]->name, libs[i]->nid);
+	}
+	free(libs);
+}
+
+/* Compare every later firmware against the 3.60 database, library by library */
+static void check_firmwares(Entry *entries, int n)
+{
+	qsort(entries, n, sizeof(Entry), cmp_libname_nid);
+	for (int i = 0; i < n; i++) {
+		const Entry *base = &entries[i];
+
+		if (strcmp(base->lib->fw, BASE_FIRMWARE) != 0)
+			continue;
+		for (int j = i + 1; j < n; j++) {
+			const Entry *e = &entries[j];
+			if (e->nid != base->nid || strcmp(e->lib->name, base->lib->name) != 0)
+				break;
+			if (strcmp(e->name, base->name) != 0 && strcmp(e->lib->fw, BASE_FIRMWARE) > 0)
+				report(0, "%s: %s: NID 0x%08X is %s but " BASE_FIRMWARE " has %s",
+					e->lib->file, e->lib->name, e->nid, e->name, base->name);
+		}
+	}
+
+	if (!verbose)
+		return;
+	qsort(entries, n, sizeof(Entry), cmp_libname_name);
+	for (int i = 1; i < n; i++) {
+		const Entry *a = &entries[i - 1], *b = &entries[i];
+		if (strcmp(a->lib->name, b->lib->name) == 0 && strcmp(a->name, b->name) == 0
+		 && strcmp(a->lib->fw, BASE_FIRMWARE) == 0 && a->nid != b->nid)
+			printf("info: %s: %s: %s changed from 0x%08X to 0x%08X\n",
+				b->lib->fw, b->lib->name, b->name, a->nid, b->nid);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *db_dir = "db";
+	DbFile *files;
+	Entry *entries = NULL;
+	Work work;
+	pthread_t *threads;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt, n_files, n_entries = 0, n_threads;
+
+	while ((opt = getopt(argc, argv, "vsj:")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 's':
+			strict = 1;
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v] [-s] [-j jobs] [db dir]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (optind < argc)
+		db_dir = argv[optind];
+
+	files = collect_files(db_dir, &n_files);
+
+	work.files = files;
+	work.n_files = n_files;
+	work.next = 0;
+	pthread_mutex_init(&work.lock, NULL);
+	n_threads = jobs < 1 ? 1 : (jobs > n_files ? n_files : (int)jobs);
+	threads = xrealloc(NULL, n_threads * sizeof(pthread_t));
+	for (int i = 0; i < n_threads; i++)
+		pthread_create(&threads[i], NULL, worker, &work);
+	for (int i = 0; i < n_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	for (int i = 0; i < n_files; i++) {
+		if (files[i].error != NULL) {
+			printf("error: %s\n", files[i].error);
+			n_errors++;
+			continue;
+		}
+		entries = xrealloc(entries, (n_entries + files[i].n_entries) * sizeof(Entry));
+		memcpy(&entries[n_entries], files[i].entries, files[i].n_entries * sizeof(Entry));
+		n_entries += files[i].n_entries;
+	}
+
+	check_suffixes(entries, n_entries);
+	check_library_nids(files, n_files);
+	check_libraries(entries, n_entries);
+	check_firmwares(entries, n_entries);
+
+	if (verbose || n_errors || n_warnings)
+		printf("%d files, %d entries: %d errors, %d warnings\n", n_files, n_entries, n_errors, n_warnings);
+	return n_errors ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+#!/usr/bin/env bash
+# Run check_nid_db when db/ files are committed.
+# Install with: ln -s ../../check_nid_db/pre-commit.sh .git/hooks/pre-commit
+set -e
+ROOT="$(git rev-parse --show-toplevel)"
+BUILD="$ROOT/check_nid_db/build"
+
+git diff --cached --name-only | grep -q '^db/' || exit 0
+
+if [ ! -x "$BUILD/check_nid_db" ] || [ "$ROOT/check_nid_db/main.c" -nt "$BUILD/check_nid_db" ]; then
+  cmake -S "$ROOT/check_nid_db" -B "$BUILD" > /dev/null
+  cmake --build "$BUILD" > /dev/null
+fi
+
+# Check the staged db/, not the working tree, so that unstaged changes
+# neither hide nor cause errors in the commit
+STAGED="$(mktemp -d)"
+trap 'rm -rf "$STAGED"' EXIT
+cd "$ROOT"
+git ls-files -z -- db | xargs -0 git checkout-index --prefix="$STAGED/" --
+
+"$BUILD/check_nid_db" "$STAGED/db"
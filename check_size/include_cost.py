@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+import argparse
+import glob
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+from includes_all import header_reach
+
+token_rule = re.compile(r'[A-Za-z_]\w*|0[xX][0-9a-fA-F]+|\d+|"(?:\\.|[^"\\])*"|\S')
+umbrella_headers = ["vitasdk.h", "vitasdkkern.h"]
+
+def default_compiler(lang):
+    env = os.environ.get("CC" if lang == "c" else "CXX")
+    if env:
+        return env
+    vita = "arm-vita-eabi-gcc" if lang == "c" else "arm-vita-eabi-g++"
+    if shutil.which(vita):
+        return vita
+    return "cc" if lang == "c" else "c++"
+
+def run(cmd):
+    start = time.perf_counter()
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    return time.perf_counter() - start, proc
+
+def measure(compiler, lang, header, include_dir, flags, repeat):
+    path = os.path.join(include_dir, header)
+    base = [compiler, "-x", "c" if lang == "c" else "c++", "-I" + include_dir] + flags
+    preprocess = parse = None
+    output = b""
+    for _ in range(repeat):
+        t, proc = run(base + ["-E", "-P", path])
+        if proc.returncode != 0:
+            return {"error": proc.stderr.decode(errors="replace").strip()}
+        preprocess = t if preprocess is None else min(preprocess, t)
+        output = proc.stdout
+
+        t, proc = run(base + ["-fsyntax-only", path])
+        if proc.returncode != 0:
+            return {"error": proc.stderr.decode(errors="replace").strip()}
+        parse = t if parse is None else min(parse, t)
+
+    text = output.decode(errors="replace")
+    return {
+        "preprocess": preprocess,
+        "parse": parse,
+        "lines": text.count("\n"),
+        "tokens": sum(1 for _ in token_rule.finditer(text)),
+    }
+
+def measure_pch(compiler, lang, header, include_dir, flags, repeat):
+    """Build a precompiled `header`, then parse a source which only includes it."""
+    with tempfile.TemporaryDirectory() as tmp:
+        gch = os.path.join(tmp, header + ".gch")
+        os.makedirs(os.path.dirname(gch), exist_ok=True)
+        source = os.path.join(tmp, "pch_user.c")
+        open(source, "w").close()
+        build = [compiler, "-x", "c-header" if lang == "c" else "c++-header", "-I" + include_dir] + flags
+        use = [compiler, "-x", "c" if lang == "c" else "c++", "-I" + tmp, "-I" + include_dir] + flags
+        pch_build = pch_parse = None
+        for _ in range(repeat):
+            t, proc = run(build + [os.path.join(include_dir, header), "-o", gch])
+            if proc.returncode != 0:
+                return {"error": proc.stderr.decode(errors="replace").strip()}
+            pch_build = t if pch_build is None else min(pch_build, t)
+
+            # -H prints "! <gch>" when the precompiled header is used
+            t, proc = run(use + ["-H", "-Winvalid-pch", "-include", header, "-fsyntax-only", source])
+            if proc.returncode != 0 or not proc.stderr.decode(errors="replace").startswith("! "):
+                return {"error": "the precompiled header was not used\n" + proc.stderr.decode(errors="replace").strip()}
+            pch_parse = t if pch_parse is None else min(pch_parse, t)
+    return {"pch_build": pch_build, "pch_parse": pch_parse}
+
+def compare(results, baseline, threshold, floor):
+    regressions = []
+    for key, r in results.items():
+        old = baseline.get(key)
+        if not old or "error" in r or "error" in old:
+            continue
+        for metric in ("parse", "tokens"):
+            limit = old[metric] * (1 + threshold / 100.0)
+            if metric == "parse":
+                limit = max(limit, old[metric] + floor)
+            if r[metric] > limit:
+                regressions.append((key, metric, old[metric], r[metric]))
+    return regressions
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Measure the compile cost of each header.")
+    parser.add_argument("include_dir")
+    parser.add_argument("headers", nargs="*", help="headers to measure, all of them by default")
+    parser.add_argument("--lang", choices=["c", "c++", "both"], default="both")
+    parser.add_argument("--cflags", default="", help="extra compiler flags")
+    parser.add_argument("--repeat", type=int, default=3, help="keep the best of N runs")
+    parser.add_argument("--sort", choices=["parse", "preprocess", "tokens", "lines"], default="parse")
+    parser.add_argument("--top", type=int, default=0, help="only print the N most expensive")
+    parser.add_argument("--pch", action="store_true",
+                        help="also time a source using the header precompiled, gcc only")
+    parser.add_argument("--output", help="write the results as JSON")
+    parser.add_argument("--baseline", help="JSON results to compare against")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed regression against the baseline, in percent")
+    parser.add_argument("--floor", type=float, default=0.01,
+                        help="parse time differences below this many seconds are noise")
+    args = parser.parse_args()
+
+    include_dir = args.include_dir
+    headers = args.headers or umbrella_headers + sorted(
+        h for h in glob.glob("**/*.h", recursive=True, root_dir=include_dir)
+        if h not in umbrella_headers)
+    langs = ["c", "c++"] if args.lang == "both" else [args.lang]
+    flags = args.cflags.split()
+
+    results = dict()
+    for lang in langs:
+        compiler = default_compiler(lang)
+        for header in headers:
+            r = measure(compiler, lang, header, include_dir, flags, args.repeat)
+            if "error" not in r and args.pch:
+                r.update(measure_pch(compiler, lang, header, include_dir, flags, args.repeat))
+            if "error" not in r:
+                r["reach"] = len(header_reach(header, include_dir))
+            results["%s:%s" % (lang, header)] = r
+
+    ok = sorted((k for k in results if "error" not in results[k]),
+                key=lambda k: results[k][args.sort], reverse=True)
+    if args.top:
+        ok = ok[:args.top]
+    pch_columns = " %10s %10s" % ("pch (ms)", "w/ pch (ms)") if args.pch else ""
+    print("%-56s %10s %10s %8s %9s %6s%s" % ("header", "cpp (ms)", "parse (ms)", "lines", "tokens", "reach", pch_columns))
+    for k in ok:
+        r = results[k]
+        pch_columns = " %10.2f %10.2f" % (r["pch_build"] * 1000, r["pch_parse"] * 1000) if args.pch else ""
+        print("%-56s %10.2f %10.2f %8d %9d %6d%s" % (k, r["preprocess"] * 1000, r["parse"] * 1000,
+                                                    r["lines"], r["tokens"], r["reach"], pch_columns))
+    for k in sorted(k for k in results if "error" in results[k]):
+        print("%s: failed to compile\n%s" % (k, results[k]["error"]), file=sys.stderr)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=1, sort_keys=True)
+
+    status = 1 if any("error" in r for r in results.values()) else 0
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        regressions = compare(results, baseline, args.threshold, args.floor)
+        for key, metric, old, new in regressions:
+            print("%s: %s regressed from %g to %g" % (key, metric, old, new), file=sys.stderr)
+        if regressions:
+            status = 2
+    sys.exit(status)
@@ -5,10 +5,31 @@ import glob
 import os
 
 include_directive = re.compile(r"#include <([\w/]+\.h)>")
+comment_rule = re.compile(r"/\*.*?\*/|//[^\n]*", re.S)
+preprocessor_rule = re.compile(r"#[^\n]*")
+identifier_rule = re.compile(r"\b[A-Za-z_]\w*\b")
+symbol_rules = [
+    re.compile(r"#\s*define\s+(\w+)"),
+    # typedef names, variables and struct members
+    re.compile(r"\b(\w+)\s*;"),
+    # function pointer typedefs
+    re.compile(r"\(\s*\*\s*(\w+)\s*\)"),
+    re.compile(r"\b(?:struct|union|enum)\s+(\w+)"),
+    # functions and function-like macros
+    re.compile(r"\b(\w+)\s*\("),
+    # enumerators
+    re.compile(r"\b(\w+)\s*(?:=[^,;{}]*)?[,}]"),
+]
+subsystem_umbrellas = ["vitasdk/audio.h", "vitasdk/graphics.h", "vitasdk/input.h",
+                       "vitasdk/io.h", "vitasdk/net.h", "vitasdk/threading.h"]
 common_external_headers = frozenset(["stddef.h", "stdint.h", "stdarg.h"])
 user_external_headers = common_external_headers.union(["time.h"])
 kernel_external_headers = common_external_headers
 all_external_headers = user_external_headers.union(kernel_external_headers)
+# Unused includes which users may rely on, until the removal announced in vita.header_warn.cmake
+kept_includes = {
+    "psp2kern/jpegenc.h": ["vitasdk/build_utils.h", "psp2kern/types.h"],
+}
 
 def header_reach(root, include_dir = ""):
     if root in all_external_headers:
@@ -26,6 +47,93 @@ def header_reach(root, include_dir = ""):
 
     return reach
 
+def read_header(header, include_dir):
+    with open(os.path.join(include_dir, header)) as f:
+        return f.read()
+
+def direct_includes(header, include_dir):
+    return [m.group(1) for m in include_directive.finditer(read_header(header, include_dir))
+            if m.group(1) not in all_external_headers]
+
+def header_code(header, include_dir):
+    """The header without its comments."""
+    return comment_rule.sub(" ", read_header(header, include_dir))
+
+def is_umbrella(header, include_dir):
+    """Whether a header only includes others and declares nothing itself."""
+    return not preprocessor_rule.sub("", header_code(header, include_dir)).strip()
+
+def header_symbols(header, include_dir):
+    """An over-approximation of the identifiers a header declares."""
+    code = header_code(header, include_dir)
+    symbols = set()
+    for rule in symbol_rules:
+        symbols.update(rule.findall(code))
+    return symbols
+
+def header_uses(header, include_dir):
+    code = header_code(header, include_dir)
+    code = re.sub(r"#\s*(ifndef|define\s+_\w+_H_|endif|include)[^\n]*", "", code)
+    return set(identifier_rule.findall(code))
+
+def unused_includes(header, include_dir, reach=header_reach, symbols=header_symbols):
+    """Direct includes none of whose declarations are used by `header`.
+
+    An include provides its own declarations, plus the ones it alone brings in
+    (headers also reached through another direct include do not count). Pure
+    forwarding headers such as psp2/types.h provide everything they reach.
+    """
+    if is_umbrella(header, include_dir):
+        return []
+    includes = direct_includes(header, include_dir)
+    uses = header_uses(header, include_dir)
+    unused = []
+    for include in includes:
+        if include in kept_includes.get(header, []):
+            continue
+        others = set()
+        for other in includes:
+            if other != include:
+                others.update(reach(other, include_dir))
+        if is_umbrella(include, include_dir):
+            provided = reach(include, include_dir)
+        else:
+            provided = reach(include, include_dir).difference(others).union([include])
+        if not any(uses.intersection(symbols(h, include_dir))
+                   for h in provided if h not in all_external_headers):
+            unused.append(include)
+    return unused
+
+def reach_without(root, include_dir, removed):
+    """header_reach of `root` once the `removed` direct includes are dropped."""
+    reach = {root}
+    for include in direct_includes(root, include_dir):
+        if include not in removed:
+            reach.update(header_reach(include, include_dir))
+    return reach
+
+def check_unused_includes(include_dir, report=False):
+    import functools
+
+    reach = functools.lru_cache(maxsize=None)(lambda h, d: frozenset(header_reach(h, d)))
+    symbols = functools.lru_cache(maxsize=None)(header_symbols)
+    errors = []
+    for header in sorted(glob.glob("**/*.h", recursive=True, root_dir=include_dir)):
+        unused = unused_includes(header, include_dir, reach, symbols)
+        if not unused:
+            continue
+        before = len(reach(header, include_dir))
+        after = len(reach_without(header, include_dir, unused))
+        errors.append(f"{header}: unused includes {unused}, reach {before} -> {after}")
+
+    if report:
+        total = len(reach("vitasdk.h", include_dir))
+        print(f"vitasdk.h reaches {total} headers")
+        for umbrella in subsystem_umbrellas:
+            n = len(reach(umbrella, include_dir))
+            print(f"  {umbrella:24} reaches {n:3} headers ({100 * (total - n) // total}% fewer)")
+    return errors
+
 def globs(gs, *, recursive=False, root_dir=None):
     return set().union(*(glob.glob(g, recursive=recursive, root_dir=root_dir) for g in gs))
 
@@ -40,16 +148,26 @@ def assert_reach(root_name, got, expected, possible=set()):
 
 if __name__ == "__main__":
     include_dir = sys.argv[1]
+    report = "--report" in sys.argv[2:]
 
     vitasdk_got = header_reach("vitasdk.h", include_dir)
-    vitasdk = globs(["vitasdk.h", "vitasdk/build_utils.h", "vitasdk/utils.h", "psp2/**/*.h"], recursive=True, root_dir=include_dir).union(user_external_headers)
+    vitasdk = globs(["vitasdk.h", "vitasdk/build_utils.h", "vitasdk/utils.h", "psp2/**/*.h"] + subsystem_umbrellas, recursive=True, root_dir=include_dir).union(user_external_headers)
     psp2_common = glob.glob("psp2common/**/*.h", recursive=True, root_dir=include_dir)
     assert_reach("`vitasdk.h`", vitasdk_got, vitasdk, psp2_common)
 
+    # The header-only helpers are opt-in, only the user headers are reachable from them
+    helpers = globs(["vitasdk/*.h"], root_dir=include_dir).difference(vitasdk)
+    for helper in sorted(helpers):
+        assert_reach(f"`{helper}`", header_reach(helper, include_dir), {helper}, vitasdk.union(helpers, psp2_common))
+
     vitasdkkern_got = header_reach("vitasdkkern.h", include_dir)
     vitasdkkern = globs(["vitasdkkern.h", "vitasdk/build_utils.h", "psp2kern/**/*.h"], recursive=True, root_dir=include_dir).union(kernel_external_headers)
     assert_reach("`vitasdkkern.h`", vitasdkkern_got, vitasdkkern, psp2_common)
 
     vitasdkall_got = vitasdk_got.union(vitasdkkern_got)
-    vitasdkall = set(glob.glob("**/*.h", recursive=True, root_dir=include_dir)).union(all_external_headers)
+    vitasdkall = set(glob.glob("**/*.h", recursive=True, root_dir=include_dir)).union(all_external_headers).difference(helpers)
     assert_reach("`vitasdk.h` or `vitasdkkern.h`", vitasdkall_got, vitasdkall)
+
+    unused = check_unused_includes(include_dir, report)
+    if len(unused) != 0:
+        raise RuntimeError("headers include files they do not use:\n" + "\n".join(unused))
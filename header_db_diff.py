@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+"""Cross-reference the prototypes of the headers with the NIDs of each firmware.
+
+For every `db/<fw>` directory this reports the declared functions without a
+NID and the NIDs without a declaration. The directories other than db/360
+only hold the libraries changed by their firmware, the other libraries are
+taken from db/360, and their changes against db/360 are reported as well.
+"""
+import sys
+import json
+
+import nid_db
+import header_scan
+
+BASE_FIRMWARE = '360'
+KINDS = ('kernel', 'user')
+# Changes listed by the summary without -v
+SUMMARY_LIMIT = 10
+
+def firmware_libraries(base, files):
+    """Return {library name: (file, library dict)} of a firmware, over the base ones."""
+    libraries = dict(base)
+    for fn, _, _, lib_name, lib in nid_db.iter_libraries(files):
+        libraries[lib_name] = (fn, lib)
+    return libraries
+
+def library_kind(lib):
+    return 'kernel' if lib.get('kernel') else 'user'
+
+def declared_by_kind(declared):
+    """Return {kind: {function name: [(header, condition)]}}."""
+    by_kind = dict((kind, dict()) for kind in KINDS)
+    for name, decls in declared.items():
+        for kind in KINDS:
+            d = [x for x in decls if x[0].startswith(header_scan.HEADER_DIRS[kind])]
+            if d:
+                by_kind[kind][name] = d
+    return by_kind
+
+def diff_firmware(libraries, by_kind):
+    exported = dict((kind, dict()) for kind in KINDS)
+    undeclared = []
+    for lib_name, (fn, lib) in sorted(libraries.items()):
+        kind = library_kind(lib)
+        for name, nid in sorted(lib.get('functions', dict()).items()):
+            exported[kind].setdefault(name, nid)
+            if name not in by_kind[kind]:
+                undeclared.append({'name': name, 'nid': '0x%08X' % nid,
+                                   'library': lib_name, 'file': fn})
+
+    missing = []
+    for kind in KINDS:
+        for name, decls in sorted(by_kind[kind].items()):
+            if name in exported[kind]:
+                continue
+            # psp2common declarations are only missing if no kind exports them
+            if all(d[0].startswith('psp2common/') for d in decls) and \
+                    any(name in exported[k] for k in KINDS):
+                continue
+            conds = [d[1] for d in decls]
+            missing.append({'name': name, 'kind': kind,
+                            'header': decls[0][0],
+                            'condition': None if None in conds else
+                                header_scan.join_conditions(' || ', conds)})
+    # psp2common declarations missing from both kinds are listed once
+    seen = set()
+    missing = [m for m in missing if not (m['name'] in seen or seen.add(m['name']))]
+    return {
+        'libraries': len(libraries),
+        'nids': sum(len(e) for e in exported.values()),
+        'missing_nids': missing,
+        'undeclared_nids': undeclared,
+    }
+
+def diff_changes(base, files):
+    """Compare the libraries of a firmware with the same libraries of the base firmware."""
+    renamed, nid_changed, removed, added = [], [], [], []
+    for fn, _, _, lib_name, lib in nid_db.iter_libraries(files):
+        if lib_name not in base:
+            continue
+        old = base[lib_name][1].get('functions', dict())
+        new = lib.get('functions', dict())
+        old_by_nid = dict((nid, name) for name, nid in old.items())
+        for name, nid in sorted(new.items()):
+            if name in old:
+                if old[name] != nid:
+                    nid_changed.append({'library': lib_name, 'name': name,
+                                        'from': '0x%08X' % old[name], 'to': '0x%08X' % nid})
+            elif nid in old_by_nid:
+                renamed.append({'library': lib_name, 'nid': '0x%08X' % nid,
+                                'from': old_by_nid[nid], 'to': name})
+            else:
+                added.append({'library': lib_name, 'name': name, 'nid': '0x%08X' % nid})
+        new_nids = set(new.values())
+        for name, nid in sorted(old.items()):
+            if name not in new and nid not in new_nids:
+                removed.append({'library': lib_name, 'name': name, 'nid': '0x%08X' % nid})
+    return {
+        'renamed': renamed,
+        'nid_changed': nid_changed,
+        'removed': removed,
+        'added': added,
+    }
+
+def print_entries(out, what, entries, limit, fmt):
+    for c in entries[:limit]:
+        out.write('  %-8s %s\n' % (what, fmt(c)))
+    if limit is not None and len(entries) > limit:
+        out.write('  ... %d more %s (-v to list them)\n' % (len(entries) - limit, what))
+
+def print_summary(report, verbose, out=sys.stdout):
+    out.write('%d headers, %d declared functions\n\n' % (report['headers'], report['declared']))
+    out.write('%-8s %10s %6s %8s %10s %12s\n' %
+              ('firmware', 'libraries', 'nids', 'no nid', '(guarded)', 'undeclared'))
+    firmwares = sorted(report['firmwares'].values(), key=lambda fw: nid_db.firmware_version(fw['firmware']))
+    for fw in firmwares:
+        guarded = sum(1 for m in fw['missing_nids'] if m['condition'])
+        out.write('%-8s %10d %6d %8d %10d %12d\n' %
+                  (fw['firmware'], fw['libraries'], fw['nids'], len(fw['missing_nids']),
+                   guarded, len(fw['undeclared_nids'])))
+
+    for fw in firmwares:
+        changes = fw.get('changes')
+        if not changes:
+            continue
+        out.write('\n%s against %s: %d renamed, %d NIDs changed, %d removed, %d added\n' %
+                  (fw['firmware'], report['base'],
+                   len(changes['renamed']), len(changes['nid_changed']),
+                   len(changes['removed']), len(changes['added'])))
+        limit = None if verbose else SUMMARY_LIMIT
+        print_entries(out, 'renamed', changes['renamed'], limit,
+                      lambda c: '%s: %s -> %s (%s)' % (c['library'], c['from'], c['to'], c['nid']))
+        print_entries(out, 'removed', changes['removed'], limit,
+                      lambda c: '%s: %s (%s)' % (c['library'], c['name'], c['nid']))
+        if verbose:
+            print_entries(out, 'nid', changes['nid_changed'], None,
+                          lambda c: '%s: %s %s -> %s' % (c['library'], c['name'], c['from'], c['to']))
+            print_entries(out, 'added', changes['added'], None,
+                          lambda c: '%s: %s (%s)' % (c['library'], c['name'], c['nid']))
+
+    if verbose:
+        for fw in firmwares:
+            out.write('\n%s: declared without NID\n' % fw['firmware'])
+            for m in fw['missing_nids']:
+                out.write('  %s: %s%s\n' % (m['header'], m['name'],
+                                           ' (#if %s)' % m['condition'] if m['condition'] else ''))
+
+if __name__ == '__main__':
+    import argparse
+
+    parser = argparse.ArgumentParser(description='Cross-reference the header prototypes with the NID db.')
+    parser.add_argument('firmwares', nargs='*', help='db/<fw> directories to report, all of them by default')
+    parser.add_argument('--db', default=nid_db.DB_DIR)
+    parser.add_argument('--include', default=header_scan.INCLUDE_DIR)
+    parser.add_argument('--json', metavar='FILE', help='write the full report as JSON, - for stdout')
+    parser.add_argument('-v', '--verbose', action='store_true', help='list every entry in the summary')
+    args = parser.parse_args()
+
+    declared = header_scan.scan_headers(args.include)
+    by_kind = declared_by_kind(declared)
+    headers = set(d[0] for decls in declared.values() for d in decls)
+
+    versions = args.firmwares or nid_db.db_versions(args.db)
+    db = nid_db.load_db(args.db, sorted(set(versions) | set([BASE_FIRMWARE])))
+    base = firmware_libraries(dict(), db[BASE_FIRMWARE])
+
+    report = {'headers': len(headers), 'declared': len(declared),
+              'base': nid_db.dir_firmware(db[BASE_FIRMWARE]), 'firmwares': dict()}
+    for ver in versions:
+        files = db[ver]
+        fw = diff_firmware(firmware_libraries(base, files), by_kind)
+        fw['firmware'] = nid_db.dir_firmware(files)
+        if ver != BASE_FIRMWARE:
+            fw['changes'] = diff_changes(base, files)
+        report['firmwares'][ver] = fw
+
+    if args.json == '-':
+        json.dump(report, sys.stdout, indent=1, sort_keys=True)
+        sys.stdout.write('\n')
+    else:
+        if args.json:
+            with open(args.json, 'w') as f:
+                json.dump(report, f, indent=1, sort_keys=True)
+        print_summary(report, args.verbose)
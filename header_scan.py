@@ -0,0 +1,105 @@
+import os
+import re
+
+
+CURR_DIR = os.path.dirname(os.path.realpath(__file__))
+INCLUDE_DIR = os.path.join(CURR_DIR, 'include')
+
+# Header directories declaring the functions of each kind of library, the
+# user and kernel headers can not be included together.
+HEADER_DIRS = {
+    'kernel': ('psp2kern/', 'psp2common/'),
+    'user': ('psp2/', 'psp2common/'),
+}
+
+# Prototypes of exported functions, inline functions are not imported
+DECL_RULE = re.compile(r'^(?!static\b|typedef\b|return\b)[A-Za-z_][\w \t\*]*?\b(_*k?sce\w+)\s*\(')
+DIRECTIVE_RULE = re.compile(r'^\s*#\s*(\w+)\s*(.*)$')
+COMMENT_RULE = re.compile(r'/\*.*?\*/|//.*$')
+# `static inline` on the line before the prototype
+INLINE_RULE = re.compile(r'^\s*(static|inline|__inline__)\b[^;{}()]*$')
+
+def findfile(directory, ext):
+    matches = []
+    for root, dirnames, filenames in os.walk(directory):
+        for filename in filenames:
+            if filename.endswith(ext):
+                matches.append(os.path.join(root, filename))
+    return sorted(matches)
+
+def _ignored_condition(directive, expr):
+    return '__cplusplus' in expr
+
+def join_conditions(op, conds):
+    if len(conds) < 2:
+        return conds[0] if conds else None
+    return op.join('(%s)' % c for c in conds)
+
+def scan_header(path):
+    """Return {function name: condition} for the functions declared by a header.
+
+    The condition is the preprocessor expression guarding the declaration,
+    None when it is always declared.
+    """
+    with open(path, 'r', errors='replace') as f:
+        lines = f.read().replace('\\\n', '').splitlines()
+
+    functions = dict()
+    # Each frame is [previous branch expressions, current expression or None]
+    stack = []
+    guard = None
+    for i, line in enumerate(lines):
+        prev = lines[i - 1] if i else ''
+        m = DIRECTIVE_RULE.match(line)
+        if m:
+            directive, expr = m.group(1), COMMENT_RULE.sub('', m.group(2)).strip()
+            if directive in ('if', 'ifdef', 'ifndef'):
+                if directive == 'ifdef':
+                    expr = 'defined(%s)' % expr
+                elif directive == 'ifndef':
+                    # The include guard does not guard anything
+                    if guard is None and i + 1 < len(lines) and \
+                            lines[i + 1].split() == ['#define', expr]:
+                        guard = expr
+                        stack.append(None)
+                        continue
+                    expr = '!defined(%s)' % expr
+                stack.append(None if _ignored_condition(directive, expr) else [[], expr])
+            elif directive in ('elif', 'else') and stack and stack[-1] is not None:
+                frame = stack[-1]
+                frame[0].append(frame[1])
+                frame[1] = expr if directive == 'elif' else None
+            elif directive == 'endif' and stack:
+                stack.pop()
+            continue
+
+        m = DECL_RULE.match(line)
+        if not m or INLINE_RULE.match(prev):
+            continue
+        conds = []
+        for frame in stack:
+            if frame is None:
+                continue
+            conds += ['!(%s)' % e for e in frame[0]]
+            if frame[1] is not None:
+                conds.append(frame[1])
+        if '0' in conds:
+            continue
+        cond = join_conditions(' && ', conds)
+        name = m.group(1)
+        if name in functions and (functions[name] is None or cond is None):
+            functions[name] = None
+        elif name in functions:
+            functions[name] = join_conditions(' || ', [functions[name], cond])
+        else:
+            functions[name] = cond
+    return functions
+
+def scan_headers(include_dir=INCLUDE_DIR):
+    """Return {function name: [(header, condition)]}."""
+    declared = dict()
+    for path in findfile(include_dir, '.h'):
+        header = os.path.relpath(path, include_dir).replace(os.sep, '/')
+        for name, cond in scan_header(path).items():
+            declared.setdefault(name, []).append((header, cond))
+    return declared
@@ -118,6 +118,95 @@ int sceKernelReceiveMsgPipeCB(SceUID uid, void *message, SceSize size, int unk1,
  */
 int sceKernelTryReceiveMsgPipe(SceUID uid, void *message, SceSize size, int unk1, void *unk2);
 
+/** A buffer of a vectored send or receive */
+typedef struct SceKernelMsgPipeVector {
+	void    *message;
+	SceSize size;
+} SceKernelMsgPipeVector;
+VITASDK_BUILD_ASSERT_EQ(0x8, SceKernelMsgPipeVector);
+
+/**
+ * Send the buffers of a vector to a pipe in one call
+ *
+ * @param uid - The UID of the pipe
+ * @param v - The buffers to send, in order
+ * @param n - The number of buffers
+ * @param unk1 - Unknown - async vs sync? use 0 for sync
+ * @param unk2 - Unknown - use NULL
+ * @param timeout - Timeout for send in us. use NULL to wait indefinitely
+ *
+ * @return 0 on success, < 0 on error
+ */
+int sceKernelSendMsgPipeVector(SceUID uid, const SceKernelMsgPipeVector *v, unsigned int n, int unk1, void *unk2, unsigned int *timeout);
+
+/**
+ * Send the buffers of a vector to a pipe in one call (with callback)
+ *
+ * @param uid - The UID of the pipe
+ * @param v - The buffers to send, in order
+ * @param n - The number of buffers
+ * @param unk1 - Unknown - async vs sync? use 0 for sync
+ * @param unk2 - Unknown - use NULL
+ * @param timeout - Timeout for send in us. use NULL to wait indefinitely
+ *
+ * @return 0 on success, < 0 on error
+ */
+int sceKernelSendMsgPipeVectorCB(SceUID uid, const SceKernelMsgPipeVector *v, unsigned int n, int unk1, void *unk2, unsigned int *timeout);
+
+/**
+ * Try to send the buffers of a vector to a pipe in one call
+ *
+ * @param uid - The UID of the pipe
+ * @param v - The buffers to send, in order
+ * @param n - The number of buffers
+ * @param unk1 - Unknown - use 0
+ * @param unk2 - Unknown - use NULL
+ *
+ * @return 0 on success, < 0 on error
+ */
+int sceKernelTrySendMsgPipeVector(SceUID uid, const SceKernelMsgPipeVector *v, unsigned int n, int unk1, void *unk2);
+
+/**
+ * Receive from a pipe into the buffers of a vector in one call
+ *
+ * @param uid - The UID of the pipe
+ * @param v - The buffers to fill, in order
+ * @param n - The number of buffers
+ * @param unk1 - Unknown - async vs sync? use 0 for sync
+ * @param unk2 - Unknown - use NULL
+ * @param timeout - Timeout for receive in us. use NULL to wait indefinitely
+ *
+ * @return 0 on success, < 0 on error
+ */
+int sceKernelReceiveMsgPipeVector(SceUID uid, const SceKernelMsgPipeVector *v, unsigned int n, int unk1, void *unk2, unsigned int *timeout);
+
+/**
+ * Receive from a pipe into the buffers of a vector in one call (with callback)
+ *
+ * @param uid - The UID of the pipe
+ * @param v - The buffers to fill, in order
+ * @param n - The number of buffers
+ * @param unk1 - Unknown - async vs sync? use 0 for sync
+ * @param unk2 - Unknown - use NULL
+ * @param timeout - Timeout for receive in us. use NULL to wait indefinitely
+ *
+ * @return 0 on success, < 0 on error
+ */
+int sceKernelReceiveMsgPipeVectorCB(SceUID uid, const SceKernelMsgPipeVector *v, unsigned int n, int unk1, void *unk2, unsigned int *timeout);
+
+/**
+ * Try to receive from a pipe into the buffers of a vector in one call
+ *
+ * @param uid - The UID of the pipe
+ * @param v - The buffers to fill, in order
+ * @param n - The number of buffers
+ * @param unk1 - Unknown - use 0
+ * @param unk2 - Unknown - use NULL
+ *
+ * @return 0 on success, < 0 on error
+ */
+int sceKernelTryReceiveMsgPipeVector(SceUID uid, const SceKernelMsgPipeVector *v, unsigned int n, int unk1, void *unk2);
+
 /**
  * Cancel a message pipe
  *
@@ -0,0 +1,322 @@
+#ifndef _VITASDK_ARENA_H_
+#define _VITASDK_ARENA_H_
+
+/*
+ * Bump and slab allocators over memblocks, for data which is freed in bulk.
+ *
+ *   VitasdkArena          - bump allocator, freed at once or back to a mark
+ *   VitasdkFrameAllocator - two arenas, the one of the frame before last is
+ *                           reset when flipping, so the GPU may still read
+ *                           the data of the previous frame
+ *   VitasdkPool           - fixed-size blocks with an O(1) free list
+ *
+ * Each allocator reserves one memblock of the requested type, its size is
+ * rounded up to the granularity of the type. They are not thread-safe, use
+ * one per thread or lock around them.
+ */
+
+#include <psp2/types.h>
+#include <psp2/kernel/error.h>
+#include <psp2/kernel/sysmem.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** Alignment of vitasdk_arena_alloc_default */
+#define VITASDK_ARENA_DEFAULT_ALIGN (8)
+
+typedef struct VitasdkArena {
+	char *base;
+	SceSize size;
+	SceSize used;
+	SceSize high_water; //!< Highest `used` since the creation
+	SceUID memblock;    //!< -1 for an arena over caller memory
+} VitasdkArena;
+
+typedef struct VitasdkFrameAllocator {
+	VitasdkArena arenas[2];
+	SceUInt32 current;
+	SceUID memblock;
+} VitasdkFrameAllocator;
+
+typedef struct VitasdkPool {
+	void *free_list;
+	char *next;         //!< First block never allocated
+	char *end;
+	char *base;
+	SceSize block_size;
+	SceUInt32 used;
+	SceUInt32 high_water; //!< Highest `used` since the creation
+	SceUID memblock;
+} VitasdkPool;
+
+/* Round a size up to the memblock granularity of a type */
+static inline SceSize _vitasdk_memblock_size(SceKernelMemBlockType type, SceSize size)
+{
+	SceSize align = 0x1000;
+
+	if ((type & 0xFF000000) == 0x09000000)
+		align = 0x40000;
+	else if (type == SCE_KERNEL_MEMBLOCK_TYPE_USER_MAIN_PHYCONT_RW || type == SCE_KERNEL_MEMBLOCK_TYPE_USER_MAIN_PHYCONT_NC_RW)
+		align = 0x100000;
+	return (size + align - 1) & ~(align - 1);
+}
+
+/* Allocate a memblock, its size is updated to the rounded one */
+static inline SceUID _vitasdk_memblock_alloc(const char *name, SceKernelMemBlockType type, SceSize *size, void **base)
+{
+	SceUID memblock;
+	int res;
+
+	SceSize rounded = _vitasdk_memblock_size(type, *size);
+
+	/* The rounding wrapped around */
+	if (rounded < *size)
+		return (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+	*size = rounded;
+	memblock = sceKernelAllocMemBlock(name, type, *size, NULL);
+	if (memblock < 0)
+		return memblock;
+	res = sceKernelGetMemBlockBase(memblock, base);
+	if (res < 0) {
+		sceKernelFreeMemBlock(memblock);
+		return res;
+	}
+	return memblock;
+}
+
+/**
+ * @brief vitasdk_arena_init - Initialize an arena over caller memory
+ * @param arena - The arena
+ * @param base - The memory
+ * @param size - The size of the memory
+ */
+static inline void vitasdk_arena_init(VitasdkArena *arena, void *base, SceSize size)
+{
+	arena->base       = (char *)base;
+	arena->size       = size;
+	arena->used       = 0;
+	arena->high_water = 0;
+	arena->memblock   = -1;
+}
+
+/**
+ * @brief vitasdk_arena_create - Create an arena over a new memblock
+ * @param arena - The arena
+ * @param name - The name of the memblock
+ * @param type - The memblock type, e.g. SCE_KERNEL_MEMBLOCK_TYPE_USER_RW
+ * @param size - The minimum size of the arena
+ * @return 0 on success, SCE_KERNEL_ERROR_ILLEGAL_SIZE if the rounded size overflows, < 0 on error.
+ */
+static inline int vitasdk_arena_create(VitasdkArena *arena, const char *name, SceKernelMemBlockType type, SceSize size)
+{
+	void *base;
+	SceUID memblock = _vitasdk_memblock_alloc(name, type, &size, &base);
+	if (memblock < 0)
+		return memblock;
+	vitasdk_arena_init(arena, base, size);
+	arena->memblock = memblock;
+	return 0;
+}
+
+static inline int vitasdk_arena_delete(VitasdkArena *arena)
+{
+	int res = 0;
+
+	if (arena->memblock >= 0)
+		res = sceKernelFreeMemBlock(arena->memblock);
+	arena->memblock = -1;
+	return res;
+}
+
+/**
+ * @brief vitasdk_arena_alloc - Allocate from an arena
+ * @param arena - The arena
+ * @param size - The size to allocate
+ * @param align - The alignment, a power of two
+ * @return The allocated memory, NULL if the arena is full
+ */
+static inline void *vitasdk_arena_alloc(VitasdkArena *arena, SceSize size, SceSize align)
+{
+	uintptr_t addr = ((uintptr_t)(arena->base + arena->used) + align - 1) & ~(uintptr_t)(align - 1);
+	SceSize offset = (SceSize)(addr - (uintptr_t)arena->base);
+
+	if (offset > arena->size || size > arena->size - offset)
+		return NULL;
+	arena->used = offset + size;
+	if (arena->used > arena->high_water)
+		arena->high_water = arena->used;
+	return arena->base + offset;
+}
+
+static inline void *vitasdk_arena_alloc_default(VitasdkArena *arena, SceSize size)
+{
+	return vitasdk_arena_alloc(arena, size, VITASDK_ARENA_DEFAULT_ALIGN);
+}
+
+/** The current position, to free everything allocated after it with vitasdk_arena_release */
+static inline SceSize vitasdk_arena_mark(const VitasdkArena *arena)
+{
+	return arena->used;
+}
+
+static inline void vitasdk_arena_release(VitasdkArena *arena, SceSize mark)
+{
+	if (mark < arena->used)
+		arena->used = mark;
+}
+
+static inline void vitasdk_arena_reset(VitasdkArena *arena)
+{
+	arena->used = 0;
+}
+
+/**
+ * @brief vitasdk_frame_allocator_create - Create a double-buffered frame allocator
+ * @param frame - The frame allocator
+ * @param name - The name of the memblock
+ * @param type - The memblock type, e.g. SCE_KERNEL_MEMBLOCK_TYPE_USER_CDRAM_RW for GPU data
+ * @param size - The minimum size available to each frame
+ * @return 0 on success, SCE_KERNEL_ERROR_ILLEGAL_SIZE if twice the size overflows, < 0 on error.
+ */
+static inline int vitasdk_frame_allocator_create(VitasdkFrameAllocator *frame, const char *name, SceKernelMemBlockType type, SceSize size)
+{
+	SceSize total = size * 2;
+	void *base;
+	SceUID memblock;
+
+	if (size > (SceSize)-1 / 2)
+		return (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+	memblock = _vitasdk_memblock_alloc(name, type, &total, &base);
+	if (memblock < 0)
+		return memblock;
+	vitasdk_arena_init(&frame->arenas[0], base, total / 2);
+	vitasdk_arena_init(&frame->arenas[1], (char *)base + total / 2, total / 2);
+	frame->current  = 0;
+	frame->memblock = memblock;
+	return 0;
+}
+
+static inline int vitasdk_frame_allocator_delete(VitasdkFrameAllocator *frame)
+{
+	int res = sceKernelFreeMemBlock(frame->memblock);
+	frame->memblock = -1;
+	return res;
+}
+
+/** Allocate for the current frame, see vitasdk_arena_alloc */
+static inline void *vitasdk_frame_allocator_alloc(VitasdkFrameAllocator *frame, SceSize size, SceSize align)
+{
+	return vitasdk_arena_alloc(&frame->arenas[frame->current], size, align);
+}
+
+/**
+ * @brief vitasdk_frame_allocator_flip - Start a new frame
+ *
+ * The allocations of the frame before last are freed, the ones of the frame
+ * which just ended stay valid until the next flip.
+ *
+ * @param frame - The frame allocator
+ */
+static inline void vitasdk_frame_allocator_flip(VitasdkFrameAllocator *frame)
+{
+	frame->current ^= 1;
+	vitasdk_arena_reset(&frame->arenas[frame->current]);
+}
+
+/** Highest usage of a single frame */
+static inline SceSize vitasdk_frame_allocator_high_water(const VitasdkFrameAllocator *frame)
+{
+	SceSize a = frame->arenas[0].high_water, b = frame->arenas[1].high_water;
+	return a > b ? a : b;
+}
+
+/**
+ * @brief vitasdk_pool_create - Create a pool of fixed-size blocks
+ * @param pool - The pool
+ * @param name - The name of the memblock
+ * @param type - The memblock type, e.g. SCE_KERNEL_MEMBLOCK_TYPE_USER_RW
+ * @param block_size - The size of each block, rounded up to a multiple of 8
+ * @param count - The minimum number of blocks
+ * @return 0 on success, SCE_KERNEL_ERROR_ILLEGAL_SIZE if the total size overflows, < 0 on error.
+ */
+static inline int vitasdk_pool_create(VitasdkPool *pool, const char *name, SceKernelMemBlockType type, SceSize block_size, SceUInt32 count)
+{
+	SceSize size;
+	void *base;
+	SceUID memblock;
+
+	if (block_size > (SceSize)-1 - 7)
+		return (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+	block_size = (block_size + 7) & ~7;
+	if (block_size == 0)
+		block_size = 8;
+	if (count > (SceSize)-1 / block_size)
+		return (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+	size     = block_size * count;
+	memblock = _vitasdk_memblock_alloc(name, type, &size, &base);
+	if (memblock < 0)
+		return memblock;
+	pool->base       = (char *)base;
+	pool->end        = pool->base + size / block_size * block_size;
+	pool->block_size = block_size;
+	pool->memblock   = memblock;
+	pool->high_water = 0;
+	pool->free_list  = NULL;
+	pool->next       = pool->base;
+	pool->used       = 0;
+	return 0;
+}
+
+static inline int vitasdk_pool_delete(VitasdkPool *pool)
+{
+	int res = sceKernelFreeMemBlock(pool->memblock);
+	pool->memblock = -1;
+	return res;
+}
+
+/** Allocate a block, NULL if the pool is empty */
+static inline void *vitasdk_pool_alloc(VitasdkPool *pool)
+{
+	void *block = pool->free_list;
+
+	if (block) {
+		pool->free_list = *(void **)block;
+	} else if (pool->next != pool->end) {
+		/* The blocks are only threaded on the free list once freed */
+		block = pool->next;
+		pool->next += pool->block_size;
+	} else {
+		return NULL;
+	}
+	if (++pool->used > pool->high_water)
+		pool->high_water = pool->used;
+	return block;
+}
+
+static inline void vitasdk_pool_free(VitasdkPool *pool, void *block)
+{
+	*(void **)block = pool->free_list;
+	pool->free_list = block;
+	pool->used--;
+}
+
+/** Free every block at once */
+static inline void vitasdk_pool_reset(VitasdkPool *pool)
+{
+	pool->free_list = NULL;
+	pool->next      = pool->base;
+	pool->used      = 0;
+}
+
+/** The number of blocks of the pool */
+static inline SceUInt32 vitasdk_pool_capacity(const VitasdkPool *pool)
+{
+	return (SceUInt32)((pool->end - pool->base) / pool->block_size);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_ARENA_H_ */
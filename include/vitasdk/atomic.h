@@ -0,0 +1,142 @@
+#ifndef _VITASDK_ATOMIC_H_
+#define _VITASDK_ATOMIC_H_
+
+/* Atomic helpers shared by the vitasdk containers and locks */
+
+#include <psp2/types.h>
+#include <psp2/kernel/cpu.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** L1 cache line size of the Cortex-A9 */
+#define VITASDK_CACHE_LINE_SIZE (32)
+
+/** Put a member or a variable on its own cache line */
+#define VITASDK_CACHE_ALIGNED __attribute__((aligned(VITASDK_CACHE_LINE_SIZE)))
+
+/*
+ * Loads and stores are plain ldr/str plus a barrier where needed, the
+ * read-modify-write operations go through the SceLibKernel atomics and do
+ * not order the surrounding accesses on their own.
+ */
+
+static inline SceUInt32 vitasdk_atomic_load32(const volatile SceUInt32 *p)
+{
+	return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static inline SceUInt32 vitasdk_atomic_load_acquire32(const volatile SceUInt32 *p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void vitasdk_atomic_store32(volatile SceUInt32 *p, SceUInt32 value)
+{
+	__atomic_store_n(p, value, __ATOMIC_RELAXED);
+}
+
+static inline void vitasdk_atomic_store_release32(volatile SceUInt32 *p, SceUInt32 value)
+{
+	__atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+static inline void *vitasdk_atomic_load_acquire_ptr(void *const volatile *p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void vitasdk_atomic_store_release_ptr(void *volatile *p, void *value)
+{
+	__atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+static inline void vitasdk_atomic_fence_acquire(void)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline void vitasdk_atomic_fence_release(void)
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/** Order every earlier access before every later one, including store-load */
+static inline void vitasdk_atomic_fence(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief vitasdk_atomic_cas32 - Replace a value if it is still the expected one
+ * @param p - The value to update
+ * @param expected - The value `p` must hold
+ * @param desired - The new value
+ * @return SCE_TRUE if `p` was updated
+ */
+static inline SceBool vitasdk_atomic_cas32(volatile SceUInt32 *p, SceUInt32 expected, SceUInt32 desired)
+{
+	return (SceUInt32)sceKernelAtomicCompareAndSet32((SceInt32 *)p, (SceInt32)expected, (SceInt32)desired) == expected;
+}
+
+/**
+ * @brief vitasdk_atomic_add32 - Add to a value
+ * @param p - The value to update
+ * @param value - The value to add
+ * @return The updated value
+ */
+static inline SceUInt32 vitasdk_atomic_add32(volatile SceUInt32 *p, SceUInt32 value)
+{
+	return (SceUInt32)sceKernelAtomicAddAndGet32((SceInt32 *)p, (SceInt32)value);
+}
+
+/**
+ * @brief vitasdk_atomic_exchange32 - Replace a value
+ * @param p - The value to update
+ * @param value - The new value
+ * @return The previous value
+ */
+static inline SceUInt32 vitasdk_atomic_exchange32(volatile SceUInt32 *p, SceUInt32 value)
+{
+	return (SceUInt32)sceKernelAtomicGetAndSet32((SceInt32 *)p, (SceInt32)value);
+}
+
+/**
+ * @brief vitasdk_atomic_or32 - Set bits of a value
+ * @param p - The value to update
+ * @param bits - The bits to set
+ * @return The previous value
+ */
+static inline SceUInt32 vitasdk_atomic_or32(volatile SceUInt32 *p, SceUInt32 bits)
+{
+	return (SceUInt32)sceKernelAtomicGetAndOr32((SceInt32 *)p, (SceInt32)bits);
+}
+
+/**
+ * @brief vitasdk_atomic_clear32 - Clear bits of a value
+ * @param p - The value to update
+ * @param bits - The bits to clear
+ * @return The previous value
+ */
+static inline SceUInt32 vitasdk_atomic_clear32(volatile SceUInt32 *p, SceUInt32 bits)
+{
+	return (SceUInt32)sceKernelAtomicGetAndAnd32((SceInt32 *)p, (SceInt32)~bits);
+}
+
+/** Hint the core that it is spinning */
+static inline void vitasdk_cpu_relax(void)
+{
+#if defined(__arm__)
+	__asm__ volatile("yield" ::: "memory");
+#elif defined(__i386__) || defined(__x86_64__)
+	__asm__ volatile("pause" ::: "memory");
+#else
+	__asm__ volatile("" ::: "memory");
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_ATOMIC_H_ */
@@ -0,0 +1,16 @@
+#ifndef _VITASDK_AUDIO_H_
+#define _VITASDK_AUDIO_H_
+
+/* Audio output, input and codecs, a lighter alternative to vitasdk.h */
+
+#include <psp2/types.h>
+#include <psp2/atrac.h>
+#include <psp2/audiodec.h>
+#include <psp2/audioenc.h>
+#include <psp2/audioin.h>
+#include <psp2/audioout.h>
+#include <psp2/ngs_internal.h>
+#include <psp2/shutter_sound.h>
+#include <psp2/usbaudioin.h>
+
+#endif /* _VITASDK_AUDIO_H_ */
@@ -0,0 +1,322 @@
+#ifndef _VITASDK_COMPLETION_H_
+#define _VITASDK_COMPLETION_H_
+
+/*
+ * Completion ports over an event flag.
+ *
+ * A port multiplexes up to VITASDK_COMPLETION_PORT_MAX_SOURCES async
+ * operations onto one event flag so a single thread can wait on I/O, GPU
+ * and audio work at once. Each operation owns a completion of the port,
+ * whoever finishes the operation posts its result from any thread:
+ *
+ *   VitasdkCompletion *c = vitasdk_completion_port_acquire(&port, request);
+ *   start_request(request, c);   // calls vitasdk_completion_post(c, res)
+ *
+ *   VitasdkCompletion *ready[16];
+ *   int i, n = vitasdk_completion_port_wait(&port, ready, 16, NULL);
+ *   for (i = 0; i < n; i++) {
+ *       finish_request(ready[i]->user, ready[i]->result);
+ *       vitasdk_completion_port_release(ready[i]);
+ *   }
+ *
+ * The completions are grouped by 32 and every group is chained to one bit
+ * of the event flag, so a wait returns all the completions that are ready
+ * with one syscall, and a post only signals the flag when its group had
+ * nothing pending yet. One thread at a time waits on a port.
+ *
+ * With C++20 coroutines, vitasdk::await_completion suspends a coroutine
+ * until its completion is posted and vitasdk::completion_port_dispatch,
+ * run by the thread that services the port, resumes it.
+ */
+
+#include <psp2/types.h>
+#include <psp2/kernel/error.h>
+#include <psp2/kernel/threadmgr/eventflag.h>
+#include <vitasdk/atomic.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** Completions of a port, one group of 32 per event flag bit */
+#define VITASDK_COMPLETION_PORT_MAX_SOURCES (32 * 32)
+
+#define _VITASDK_COMPLETION_PORT_GROUPS (VITASDK_COMPLETION_PORT_MAX_SOURCES / 32)
+
+struct VitasdkCompletionPort;
+
+typedef struct VitasdkCompletion {
+	void *user;                           //!< Set by vitasdk_completion_port_acquire
+	volatile SceInt32 result;             //!< Set by vitasdk_completion_post
+	SceUInt32 index;
+	struct VitasdkCompletionPort *port;
+} VitasdkCompletion;
+
+typedef struct VitasdkCompletionPort {
+	SceUID evfid;
+	VitasdkCompletion *completions;
+	SceUInt32 capacity;
+	SceUInt32 group_bits;   //!< Event flag bits of the groups in use
+	SceUInt32 next_group;   //!< First group the next wait collects from
+	volatile SceUInt32 allocated[_VITASDK_COMPLETION_PORT_GROUPS];
+	volatile SceUInt32 pending[_VITASDK_COMPLETION_PORT_GROUPS];
+} VitasdkCompletionPort;
+
+/**
+ * @brief vitasdk_completion_port_create - Create a completion port
+ * @param port - The port to create
+ * @param name - The name of the event flag
+ * @param completions - The completions of the port
+ * @param capacity - The number of completions, at most VITASDK_COMPLETION_PORT_MAX_SOURCES
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_completion_port_create(VitasdkCompletionPort *port, const char *name, VitasdkCompletion *completions, SceUInt32 capacity)
+{
+	SceUInt32 i, groups;
+	SceUID evfid;
+
+	if (capacity == 0 || capacity > VITASDK_COMPLETION_PORT_MAX_SOURCES)
+		return (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+
+	evfid = sceKernelCreateEventFlag(name, SCE_EVENT_WAITSINGLE, 0, NULL);
+	if (evfid < 0)
+		return evfid;
+
+	groups = (capacity + 31) / 32;
+	port->evfid       = evfid;
+	port->completions = completions;
+	port->capacity    = capacity;
+	port->group_bits  = groups == 32 ? 0xFFFFFFFF : (1u << groups) - 1;
+	port->next_group  = 0;
+	for (i = 0; i < _VITASDK_COMPLETION_PORT_GROUPS; i++) {
+		port->allocated[i] = 0;
+		port->pending[i]   = 0;
+	}
+	/* The tail of the last group is never handed out */
+	if (capacity % 32 != 0)
+		port->allocated[groups - 1] = 0xFFFFFFFF << (capacity % 32);
+
+	for (i = 0; i < capacity; i++) {
+		completions[i].user   = NULL;
+		completions[i].result = 0;
+		completions[i].index  = i;
+		completions[i].port   = port;
+	}
+	return 0;
+}
+
+/**
+ * @brief vitasdk_completion_port_delete - Delete a completion port
+ * @param port - The port, no thread may wait on it
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_completion_port_delete(VitasdkCompletionPort *port)
+{
+	return sceKernelDeleteEventFlag(port->evfid);
+}
+
+/**
+ * @brief vitasdk_completion_port_acquire - Get a completion for a new operation
+ * @param port - The port
+ * @param user - The user data of the completion
+ * @return The completion, NULL if all of them are in use.
+ */
+static inline VitasdkCompletion *vitasdk_completion_port_acquire(VitasdkCompletionPort *port, void *user)
+{
+	SceUInt32 group, allocated, bit;
+	VitasdkCompletion *c;
+
+	for (group = 0; group * 32 < port->capacity; group++) {
+		allocated = vitasdk_atomic_load32(&port->allocated[group]);
+		while (allocated != 0xFFFFFFFF) {
+			bit = 1u << __builtin_ctz(~allocated);
+			if (vitasdk_atomic_cas32(&port->allocated[group], allocated, allocated | bit)) {
+				c = &port->completions[group * 32 + __builtin_ctz(bit)];
+				c->user   = user;
+				c->result = 0;
+				return c;
+			}
+			allocated = vitasdk_atomic_load32(&port->allocated[group]);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief vitasdk_completion_port_release - Give back a completion
+ * @param c - The completion, returned by a wait or never posted
+ */
+static inline void vitasdk_completion_port_release(VitasdkCompletion *c)
+{
+	vitasdk_atomic_clear32(&c->port->allocated[c->index / 32], 1u << (c->index % 32));
+}
+
+/**
+ * @brief vitasdk_completion_post - Complete an operation, from any thread
+ * @param c - The completion of the operation
+ * @param result - The result of the operation
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_completion_post(VitasdkCompletion *c, SceInt32 result)
+{
+	VitasdkCompletionPort *port = c->port;
+	SceUInt32 group = c->index / 32;
+
+	c->result = result;
+	vitasdk_atomic_fence_release();
+	/* The earlier poster of a pending group signals the flag */
+	if (vitasdk_atomic_or32(&port->pending[group], 1u << (c->index % 32)) != 0)
+		return 0;
+	return sceKernelSetEventFlag(port->evfid, 1u << group);
+}
+
+static inline int _vitasdk_completion_port_collect(VitasdkCompletionPort *port, SceUInt32 bits, VitasdkCompletion **ready, SceUInt32 max)
+{
+	SceUInt32 i, group, pending, requeue = 0, n = 0;
+
+	/* Rotate the first group so busy groups do not starve the others */
+	for (i = 0; i < 32; i++) {
+		group = (port->next_group + i) % 32;
+		if ((bits & (1u << group)) == 0)
+			continue;
+		if (n == max) {
+			requeue |= 1u << group;
+			continue;
+		}
+		pending = vitasdk_atomic_exchange32(&port->pending[group], 0);
+		for (; pending != 0 && n < max; pending &= pending - 1)
+			ready[n++] = &port->completions[group * 32 + __builtin_ctz(pending)];
+		if (pending != 0) {
+			vitasdk_atomic_or32(&port->pending[group], pending);
+			requeue |= 1u << group;
+		}
+	}
+	vitasdk_atomic_fence_acquire();
+
+	port->next_group = (port->next_group + 1) % 32;
+	if (requeue != 0)
+		sceKernelSetEventFlag(port->evfid, requeue);
+	return n;
+}
+
+/**
+ * @brief vitasdk_completion_port_wait - Wait for completions
+ * @param port - The port
+ * @param ready - Receives the completions
+ * @param max - The size of `ready`, the others stay ready for the next wait
+ * @param timeout - Timeout in us, NULL to wait indefinitely
+ * @return The number of completions, < 0 on error.
+ */
+static inline int vitasdk_completion_port_wait(VitasdkCompletionPort *port, VitasdkCompletion **ready, SceUInt32 max, SceUInt *timeout)
+{
+	unsigned int bits;
+	int res, n;
+
+	if (max == 0)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+
+	/* A post racing with the previous wait can leave its bit set with nothing pending */
+	do {
+		res = sceKernelWaitEventFlag(port->evfid, port->group_bits, SCE_EVENT_WAITOR | SCE_EVENT_WAITCLEAR_PAT, &bits, timeout);
+		if (res < 0)
+			return res;
+		n = _vitasdk_completion_port_collect(port, bits, ready, max);
+	} while (n == 0);
+	return n;
+}
+
+/**
+ * @brief vitasdk_completion_port_poll - Get the completions ready without waiting
+ * @param port - The port
+ * @param ready - Receives the completions
+ * @param max - The size of `ready`, the others stay ready for the next wait
+ * @return The number of completions, < 0 on error.
+ */
+static inline int vitasdk_completion_port_poll(VitasdkCompletionPort *port, VitasdkCompletion **ready, SceUInt32 max)
+{
+	unsigned int bits;
+	int res;
+
+	if (max == 0)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+
+	res = sceKernelPollEventFlag(port->evfid, port->group_bits, SCE_EVENT_WAITOR | SCE_EVENT_WAITCLEAR_PAT, &bits);
+	if (res == (int)SCE_KERNEL_ERROR_EVF_COND)
+		return 0;
+	if (res < 0)
+		return res;
+	return _vitasdk_completion_port_collect(port, bits, ready, max);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(__cplusplus) && defined(__cpp_impl_coroutine)
+#include <coroutine>
+
+namespace vitasdk {
+
+/**
+ * Awaiter of a completion acquired with a NULL user data, the completion
+ * is released when the coroutine resumes:
+ *
+ *   VitasdkCompletion *c = vitasdk_completion_port_acquire(&port, NULL);
+ *   start_request(request, c);
+ *   SceInt32 res = co_await vitasdk::await_completion(c);
+ */
+struct CompletionAwaiter {
+	VitasdkCompletion *completion;
+	std::coroutine_handle<> handle;
+
+	/* A completion dispatched before it was awaited points to itself */
+	bool await_ready() const noexcept
+	{
+		return completion->user == completion;
+	}
+
+	void await_suspend(std::coroutine_handle<> h) noexcept
+	{
+		handle = h;
+		completion->user = this;
+	}
+
+	SceInt32 await_resume() const noexcept
+	{
+		SceInt32 result = completion->result;
+
+		vitasdk_completion_port_release(completion);
+		return result;
+	}
+};
+
+inline CompletionAwaiter await_completion(VitasdkCompletion *c) noexcept
+{
+	return CompletionAwaiter{c, std::coroutine_handle<>()};
+}
+
+/**
+ * @brief completion_port_dispatch - Wait for completions and resume their coroutines
+ * @param port - The port, all its completions are awaited by coroutines of this thread
+ * @param timeout - Timeout in us, NULL to wait indefinitely
+ * @return The number of completions, < 0 on error.
+ */
+inline int completion_port_dispatch(VitasdkCompletionPort *port, SceUInt *timeout = nullptr)
+{
+	VitasdkCompletion *ready[32];
+	int i, n;
+
+	n = vitasdk_completion_port_wait(port, ready, 32, timeout);
+	for (i = 0; i < n; i++) {
+		if (ready[i]->user == nullptr)
+			ready[i]->user = ready[i];
+		else
+			static_cast<CompletionAwaiter *>(ready[i]->user)->handle.resume();
+	}
+	return n;
+}
+
+} // namespace vitasdk
+#endif
+
+#endif /* _VITASDK_COMPLETION_H_ */
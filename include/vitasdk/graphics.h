@@ -0,0 +1,21 @@
+#ifndef _VITASDK_GRAPHICS_H_
+#define _VITASDK_GRAPHICS_H_
+
+/* Display, GPU, fonts and image/video codecs, a lighter alternative to vitasdk.h */
+
+#include <psp2/types.h>
+#include <psp2/avplayer.h>
+#include <psp2/display.h>
+#include <psp2/gxm.h>
+#include <psp2/gxt.h>
+#include <psp2/jpeg.h>
+#include <psp2/jpegarm.h>
+#include <psp2/jpegenc.h>
+#include <psp2/jpegencarm.h>
+#include <psp2/pgf.h>
+#include <psp2/pvf.h>
+#include <psp2/shacccg.h>
+#include <psp2/sharedfb.h>
+#include <psp2/videodec.h>
+
+#endif /* _VITASDK_GRAPHICS_H_ */
@@ -0,0 +1,354 @@
+#ifndef _VITASDK_GXMDEFERRED_H_
+#define _VITASDK_GXMDEFERRED_H_
+
+/*
+ * Parallel command list recording with GXM deferred contexts.
+ *
+ * Every thread of a vitasdk/threadpool.h pool, and the thread which starts
+ * the recording, owns a deferred context. The sub-passes of a scene are
+ * recorded into command lists on all of them at once, then executed in
+ * order on the immediate context:
+ *
+ *   static void record(void *arg, SceGxmContext *ctx, SceUInt32 pass)
+ *   {
+ *       draw_sub_pass(arg, ctx, pass);
+ *   }
+ *
+ *   vitasdk_gxm_deferred_begin_frame(&deferred);
+ *   sceGxmBeginScene(ctx, ...);
+ *   vitasdk_gxm_deferred_record(&deferred, pass_count, record, scene);
+ *   vitasdk_gxm_deferred_execute(&deferred, ctx, pass_count);
+ *   sceGxmEndScene(ctx, ...);
+ *
+ * A command list starts without any state, each sub-pass sets everything
+ * it draws with. The VDM, vertex and fragment ring memory of a deferred
+ * context comes in chunks from its own ring mapped for the GPU. A context
+ * keeps writing the rest of its last chunks in the next lists, frames
+ * later, so a chunk is only recycled once the GPU is done with the frames
+ * which began while it was in use. vitasdk_gxm_deferred_begin_frame may
+ * only be called once the GPU is done with the frame before last.
+ */
+
+#include <psp2/types.h>
+#include <psp2/gxm.h>
+#include <psp2/kernel/error.h>
+#include <psp2/kernel/sysmem.h>
+#include <psp2/kernel/threadmgr/thread.h>
+#include <vitasdk/arena.h>
+#include <vitasdk/threadpool.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** The workers of a pool and the recording thread */
+#define VITASDK_GXM_DEFERRED_MAX_CONTEXTS (VITASDK_THREAD_POOL_MAX_WORKERS + 1)
+/** Sub-passes of a recording */
+#define VITASDK_GXM_DEFERRED_MAX_LISTS (64)
+
+/* Smallest ring memory handed to a deferred context at once */
+#define _VITASDK_GXM_DEFERRED_CHUNK (16 * 1024)
+#define _VITASDK_GXM_DEFERRED_ALIGN (16)
+
+/* The rings of a deferred context, each with a chunk in use */
+#define _VITASDK_GXM_DEFERRED_VDM      (0)
+#define _VITASDK_GXM_DEFERRED_VERTEX   (1)
+#define _VITASDK_GXM_DEFERRED_FRAGMENT (2)
+#define _VITASDK_GXM_DEFERRED_RINGS    (3)
+
+typedef void (*VitasdkGxmRecordFunc)(void *arg, SceGxmContext *context, SceUInt32 pass);
+
+typedef struct VitasdkGxmDeferredContext {
+	SceUID thid;                       //!< The thread recording with this context
+	SceGxmContext *context;
+	char *base;                        //!< Ring memory of the VDM, vertex and fragment chunks
+	SceSize size;                      //!< A power of two
+	SceUInt32 head;                    //!< Position of the next chunk
+	SceUInt32 tail;                    //!< Position of the oldest chunk the GPU may read
+	SceUInt32 chunks[_VITASDK_GXM_DEFERRED_RINGS]; //!< Position of the chunk in use of each ring
+	SceUInt32 chunk_mask;              //!< The rings with a chunk in use
+	SceUInt32 frame_starts[2];         //!< Oldest chunk in use when each of the last two frames began
+	SceUID memblock;
+	SceUInt32 lists;                   //!< Command lists recorded since the creation
+	SceUInt32 out_of_memory;           //!< Ring memory requests which failed
+	SceUInt32 host_mem[SCE_GXM_MINIMUM_CONTEXT_HOST_MEM_SIZE / 4];
+} VitasdkGxmDeferredContext;
+
+typedef struct VitasdkGxmDeferred {
+	VitasdkThreadPool *pool;
+	VitasdkGxmDeferredContext contexts[VITASDK_GXM_DEFERRED_MAX_CONTEXTS];
+	SceUInt32 context_count;
+	SceUInt32 frame;                   //!< Frames begun
+	/* The running recording */
+	VitasdkGxmRecordFunc func;
+	void *arg;
+	SceGxmCommandList lists[VITASDK_GXM_DEFERRED_MAX_LISTS];
+	int results[VITASDK_GXM_DEFERRED_MAX_LISTS];
+} VitasdkGxmDeferred;
+
+/* Hand a new chunk to a ring of a deferred context, its last chunk is done with */
+static inline void *_vitasdk_gxm_deferred_ring(VitasdkGxmDeferredContext *dc, SceUInt32 ring, SceSize requested, SceSize *size)
+{
+	SceSize chunk = requested > _VITASDK_GXM_DEFERRED_CHUNK ? requested : _VITASDK_GXM_DEFERRED_CHUNK;
+	SceUInt32 offset, start, needed;
+
+	chunk = (chunk + _VITASDK_GXM_DEFERRED_ALIGN - 1) & ~(_VITASDK_GXM_DEFERRED_ALIGN - 1);
+	for (;;) {
+		offset = dc->head & (dc->size - 1);
+		start  = (offset + _VITASDK_GXM_DEFERRED_ALIGN - 1) & ~(_VITASDK_GXM_DEFERRED_ALIGN - 1);
+		/* The chunk is contiguous, the end of the lap is skipped */
+		if (start + chunk > dc->size)
+			start = dc->size;
+		needed = start - offset + chunk;
+		if (chunk <= dc->size && dc->head + needed - dc->tail <= dc->size)
+			break;
+		/* Fall back to the exact request */
+		if (chunk == requested) {
+			dc->out_of_memory++;
+			return NULL;
+		}
+		chunk = requested;
+	}
+	dc->chunks[ring] = dc->head + (start - offset);
+	dc->chunk_mask  |= 1u << ring;
+	dc->head        += needed;
+	*size = chunk;
+	return dc->base + (start & (dc->size - 1));
+}
+
+static inline void *_vitasdk_gxm_deferred_vdm(void *args, SceSize requested, SceSize *size)
+{
+	return _vitasdk_gxm_deferred_ring((VitasdkGxmDeferredContext *)args, _VITASDK_GXM_DEFERRED_VDM, requested, size);
+}
+
+static inline void *_vitasdk_gxm_deferred_vertex(void *args, SceSize requested, SceSize *size)
+{
+	return _vitasdk_gxm_deferred_ring((VitasdkGxmDeferredContext *)args, _VITASDK_GXM_DEFERRED_VERTEX, requested, size);
+}
+
+static inline void *_vitasdk_gxm_deferred_fragment(void *args, SceSize requested, SceSize *size)
+{
+	return _vitasdk_gxm_deferred_ring((VitasdkGxmDeferredContext *)args, _VITASDK_GXM_DEFERRED_FRAGMENT, requested, size);
+}
+
+static inline void _vitasdk_gxm_deferred_context_delete(VitasdkGxmDeferredContext *dc)
+{
+	if (dc->context)
+		sceGxmDestroyDeferredContext(dc->context);
+	if (dc->memblock >= 0) {
+		sceGxmUnmapMemory(dc->base);
+		sceKernelFreeMemBlock(dc->memblock);
+	}
+	dc->context  = NULL;
+	dc->memblock = -1;
+}
+
+static inline int _vitasdk_gxm_deferred_context_create(VitasdkGxmDeferredContext *dc, SceUID thid, SceKernelMemBlockType type, SceSize size)
+{
+	SceGxmDeferredContextParams params;
+	SceSize ring_size = 1;
+	void *base;
+	int res;
+
+	dc->thid            = thid;
+	dc->context         = NULL;
+	dc->memblock        = -1;
+	dc->head            = 0;
+	dc->tail            = 0;
+	dc->chunk_mask      = 0;
+	dc->frame_starts[0] = 0;
+	dc->frame_starts[1] = 0;
+	dc->lists           = 0;
+	dc->out_of_memory   = 0;
+	/* A power of two is also a multiple of every memblock granularity above it */
+	while (ring_size < size)
+		ring_size <<= 1;
+	dc->memblock = _vitasdk_memblock_alloc("VitasdkGxmDeferred", type, &ring_size, &base);
+	if (dc->memblock < 0) {
+		res = dc->memblock;
+		dc->memblock = -1;
+		return res;
+	}
+	dc->base = (char *)base;
+	dc->size = ring_size;
+	res = sceGxmMapMemory(dc->base, dc->size, SCE_GXM_MEMORY_ATTRIB_READ);
+	if (res < 0) {
+		sceKernelFreeMemBlock(dc->memblock);
+		dc->memblock = -1;
+		return res;
+	}
+
+	/* All the ring memory comes from the callbacks */
+	params.hostMem                   = dc->host_mem;
+	params.hostMemSize               = sizeof(dc->host_mem);
+	params.vdmCallback               = _vitasdk_gxm_deferred_vdm;
+	params.vertexCallback            = _vitasdk_gxm_deferred_vertex;
+	params.fragmentCallback          = _vitasdk_gxm_deferred_fragment;
+	params.callbackData              = dc;
+	params.vdmRingBufferMem          = NULL;
+	params.vdmRingBufferMemSize      = 0;
+	params.vertexRingBufferMem       = NULL;
+	params.vertexRingBufferMemSize   = 0;
+	params.fragmentRingBufferMem     = NULL;
+	params.fragmentRingBufferMemSize = 0;
+	res = sceGxmCreateDeferredContext(&params, &dc->context);
+	if (res < 0) {
+		dc->context = NULL;
+		_vitasdk_gxm_deferred_context_delete(dc);
+	}
+	return res;
+}
+
+/**
+ * @brief vitasdk_gxm_deferred_delete - Delete the deferred contexts
+ * @param deferred - The recorder, whose command lists the GPU is done with
+ */
+static inline void vitasdk_gxm_deferred_delete(VitasdkGxmDeferred *deferred)
+{
+	SceUInt32 i;
+
+	for (i = 0; i < deferred->context_count; i++)
+		_vitasdk_gxm_deferred_context_delete(&deferred->contexts[i]);
+	deferred->context_count = 0;
+}
+
+/**
+ * @brief vitasdk_gxm_deferred_create - Create a deferred context per recording thread
+ * @param deferred - The recorder
+ * @param pool - The pool whose workers record
+ * @param type - The memblock type of the ring memory, e.g. SCE_KERNEL_MEMBLOCK_TYPE_USER_RW_UNCACHE
+ * @param size - The minimum ring memory of a context, for two frames and the chunks it still writes to
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_deferred_create(VitasdkGxmDeferred *deferred, VitasdkThreadPool *pool, SceKernelMemBlockType type, SceSize size)
+{
+	SceUInt32 i;
+	int res;
+
+	if (size == 0 || size > 0x40000000)
+		return (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+	deferred->pool          = pool;
+	deferred->context_count = 0;
+	deferred->frame         = 0;
+	/* The last context belongs to whichever thread records */
+	for (i = 0; i <= pool->worker_count; i++) {
+		res = _vitasdk_gxm_deferred_context_create(&deferred->contexts[i], i < pool->worker_count ? pool->workers[i].thid : -1, type, size);
+		if (res < 0) {
+			vitasdk_gxm_deferred_delete(deferred);
+			return res;
+		}
+		deferred->context_count++;
+	}
+	return 0;
+}
+
+/**
+ * @brief vitasdk_gxm_deferred_begin_frame - Recycle the ring memory the GPU is done with
+ *
+ * The GPU must be done with the frame before last: the chunks up to the
+ * ones still in use when the last frame began are recycled.
+ *
+ * @param deferred - The recorder
+ */
+static inline void vitasdk_gxm_deferred_begin_frame(VitasdkGxmDeferred *deferred)
+{
+	VitasdkGxmDeferredContext *dc;
+	SceUInt32 i, ring, oldest;
+
+	for (i = 0; i < deferred->context_count; i++) {
+		dc       = &deferred->contexts[i];
+		dc->tail = dc->frame_starts[(deferred->frame + 1) % 2];
+		/* The lists of the new frame may write to the chunks in use */
+		oldest = dc->head;
+		for (ring = 0; ring < _VITASDK_GXM_DEFERRED_RINGS; ring++) {
+			if ((dc->chunk_mask & (1u << ring)) && dc->head - dc->chunks[ring] > dc->head - oldest)
+				oldest = dc->chunks[ring];
+		}
+		dc->frame_starts[deferred->frame % 2] = oldest;
+	}
+	deferred->frame++;
+}
+
+static inline void _vitasdk_gxm_deferred_record_range(void *arg, SceUInt32 begin, SceUInt32 end)
+{
+	VitasdkGxmDeferred *deferred = (VitasdkGxmDeferred *)arg;
+	VitasdkGxmDeferredContext *dc = NULL;
+	SceUID thid = sceKernelGetThreadId();
+	SceUInt32 i;
+	int res;
+
+	for (i = 0; i < deferred->context_count; i++) {
+		if (deferred->contexts[i].thid == thid)
+			dc = &deferred->contexts[i];
+	}
+	/* Neither a worker nor the recording thread, e.g. a pool shared with another recorder */
+	if (!dc) {
+		for (; begin < end; begin++)
+			deferred->results[begin] = (int)SCE_KERNEL_ERROR_UNKNOWN_THREAD_ID;
+		return;
+	}
+
+	for (; begin < end; begin++) {
+		res = sceGxmBeginCommandList(dc->context);
+		if (res >= 0) {
+			deferred->func(deferred->arg, dc->context, begin);
+			res = sceGxmEndCommandList(dc->context, &deferred->lists[begin]);
+		}
+		deferred->results[begin] = res;
+		dc->lists++;
+	}
+}
+
+/**
+ * @brief vitasdk_gxm_deferred_record - Record sub-passes on all the threads
+ * @param deferred - The recorder
+ * @param pass_count - The number of sub-passes, at most VITASDK_GXM_DEFERRED_MAX_LISTS
+ * @param func - Records a sub-pass, called once per sub-pass
+ * @param arg - Passed to `func`
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_deferred_record(VitasdkGxmDeferred *deferred, SceUInt32 pass_count, VitasdkGxmRecordFunc func, void *arg)
+{
+	SceUInt32 i;
+	int res;
+
+	if (pass_count > VITASDK_GXM_DEFERRED_MAX_LISTS)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+
+	deferred->contexts[deferred->context_count - 1].thid = sceKernelGetThreadId();
+	deferred->func = func;
+	deferred->arg  = arg;
+	res = vitasdk_thread_pool_parallel_for(deferred->pool, 0, pass_count, 1, _vitasdk_gxm_deferred_record_range, deferred);
+	if (res < 0)
+		return res;
+	for (i = 0; i < pass_count; i++) {
+		if (deferred->results[i] < 0)
+			return deferred->results[i];
+	}
+	return 0;
+}
+
+/**
+ * @brief vitasdk_gxm_deferred_execute - Execute the recorded sub-passes in order
+ * @param deferred - The recorder
+ * @param context - The immediate context, in a scene
+ * @param pass_count - The number of sub-passes of the last recording
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_deferred_execute(VitasdkGxmDeferred *deferred, SceGxmContext *context, SceUInt32 pass_count)
+{
+	SceUInt32 i;
+	int res;
+
+	for (i = 0; i < pass_count; i++) {
+		res = sceGxmExecuteCommandList(context, &deferred->lists[i]);
+		if (res < 0)
+			return res;
+	}
+	return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_GXMDEFERRED_H_ */
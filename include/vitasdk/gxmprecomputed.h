@@ -0,0 +1,357 @@
+#ifndef _VITASDK_GXMPRECOMPUTED_H_
+#define _VITASDK_GXMPRECOMPUTED_H_
+
+/*
+ * Cache of GXM precomputed states for static materials and meshes.
+ *
+ * A material holds a pair of programs with their textures and uniform
+ * buffers, a mesh is an object drawn with a material: the precomputed draw
+ * of its vertex streams and indices, and the precomputed vertex and
+ * fragment states of the material for each frame in flight. Both are built
+ * once, on their first lookup, and the states live in one memblock mapped
+ * for the GPU:
+ *
+ *   VitasdkGxmMaterial *mat;
+ *   VitasdkGxmMesh *mesh;
+ *
+ *   vitasdk_gxm_precomputed_material(&cache, MATERIAL_ROCK, &mat_desc, &mat);
+ *   vitasdk_gxm_precomputed_mesh(&cache, MESH_ROCK_1, &mesh_desc, mat, &mesh);
+ *
+ *   vitasdk_gxm_precomputed_flip(&cache);
+ *   vitasdk_gxm_material_bind(ctx, mat);
+ *   vitasdk_gxm_mesh_draw(ctx, &cache, mesh, vertex_uniforms, fragment_uniforms);
+ *
+ * A draw then costs the two precomputed states and a sceGxmDrawPrecomputed
+ * instead of setting the streams, textures and uniform buffers of each
+ * sceGxmDraw. The ids are chosen by the caller and are never 0.
+ *
+ * The GPU reads the precomputed states when it runs the draws, frames after
+ * they were queued, and a bound precomputed state brings its own default
+ * uniform buffers. A draw therefore sets its buffers on the states of its
+ * mesh for the current frame, which the GPU is done with since the frame
+ * `frame_count` frames ago. A mesh is drawn once per frame, objects sharing
+ * their geometry each have a mesh id.
+ */
+
+#include <psp2/types.h>
+#include <psp2/gxm.h>
+#include <psp2/kernel/error.h>
+#include <psp2/kernel/sysmem.h>
+#include <vitasdk/arena.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** Frames which can be in flight at the same time */
+#define VITASDK_GXM_PRECOMPUTED_MAX_FRAMES (4)
+
+/* Alignment of the memory of the precomputed states */
+#define _VITASDK_GXM_PRECOMPUTED_ALIGN (16)
+
+typedef struct VitasdkGxmMaterialDesc {
+	const SceGxmVertexProgram *vertex_program;
+	const SceGxmFragmentProgram *fragment_program;
+	const SceGxmTexture *vertex_textures;             //!< All the textures of the vertex program, or NULL
+	const SceGxmTexture *fragment_textures;           //!< All the textures of the fragment program, or NULL
+	const void *const *vertex_uniform_buffers;        //!< All the uniform buffers of the vertex program, or NULL
+	const void *const *fragment_uniform_buffers;      //!< All the uniform buffers of the fragment program, or NULL
+} VitasdkGxmMaterialDesc;
+
+typedef struct VitasdkGxmMeshDesc {
+	const void *const *streams;                       //!< All the vertex streams of the vertex program
+	SceGxmPrimitiveType primitive;
+	SceGxmIndexFormat index_format;
+	const void *indices;
+	unsigned int index_count;
+} VitasdkGxmMeshDesc;
+
+typedef struct VitasdkGxmMaterial {
+	SceUInt32 id;
+	VitasdkGxmMaterialDesc desc;                      //!< Its arrays are read again by the builds of the meshes
+	unsigned int vertex_uniform_size;                 //!< Size of the default vertex uniform buffer
+	unsigned int fragment_uniform_size;               //!< Size of the default fragment uniform buffer
+} VitasdkGxmMaterial;
+
+typedef struct VitasdkGxmMesh {
+	SceUInt32 id;
+	const VitasdkGxmMaterial *material;
+	SceGxmPrecomputedDraw draw;
+	SceGxmPrecomputedVertexState vertex_states[VITASDK_GXM_PRECOMPUTED_MAX_FRAMES];     //!< One per frame in flight
+	SceGxmPrecomputedFragmentState fragment_states[VITASDK_GXM_PRECOMPUTED_MAX_FRAMES]; //!< One per frame in flight
+	void *vertex_uniforms[VITASDK_GXM_PRECOMPUTED_MAX_FRAMES];                           //!< Default buffer set on each state
+	void *fragment_uniforms[VITASDK_GXM_PRECOMPUTED_MAX_FRAMES];                         //!< Default buffer set on each state
+} VitasdkGxmMesh;
+
+typedef struct VitasdkGxmPrecomputedCache {
+	VitasdkArena arena;                               //!< Memory of the precomputed states
+	VitasdkGxmMaterial *materials;                    //!< Open addressed by id
+	SceUInt32 material_mask;
+	VitasdkGxmMesh *meshes;                           //!< Open addressed by id
+	SceUInt32 mesh_mask;
+	SceUInt32 frame_count;
+	SceUInt32 frame;                                  //!< States of the current frame
+	SceUInt32 hits;                                   //!< Lookups of built entries
+	SceUInt32 misses;                                 //!< Lookups which built an entry
+} VitasdkGxmPrecomputedCache;
+
+/**
+ * @brief vitasdk_gxm_precomputed_cache_create - Create a cache over a new memblock mapped for the GPU
+ * @param cache - The cache
+ * @param name - The name of the memblock
+ * @param type - The memblock type, e.g. SCE_KERNEL_MEMBLOCK_TYPE_USER_RW_UNCACHE
+ * @param size - The memory of all the precomputed states, a draw and `frame_count` pairs of states per mesh
+ * @param frame_count - The number of frames in flight, at most VITASDK_GXM_PRECOMPUTED_MAX_FRAMES
+ * @param materials - Storage for `material_capacity` materials
+ * @param material_capacity - A power of two, larger than the number of materials
+ * @param meshes - Storage for `mesh_capacity` meshes
+ * @param mesh_capacity - A power of two, larger than the number of meshes
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_precomputed_cache_create(VitasdkGxmPrecomputedCache *cache, const char *name, SceKernelMemBlockType type, SceSize size,
+	SceUInt32 frame_count, VitasdkGxmMaterial *materials, SceUInt32 material_capacity, VitasdkGxmMesh *meshes, SceUInt32 mesh_capacity)
+{
+	SceUInt32 i;
+	int res;
+
+	if (frame_count == 0 || frame_count > VITASDK_GXM_PRECOMPUTED_MAX_FRAMES)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	if (material_capacity == 0 || (material_capacity & (material_capacity - 1)) != 0 ||
+	    mesh_capacity == 0 || (mesh_capacity & (mesh_capacity - 1)) != 0)
+		return (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+
+	res = vitasdk_arena_create(&cache->arena, name, type, size);
+	if (res < 0)
+		return res;
+	res = sceGxmMapMemory(cache->arena.base, cache->arena.size, SCE_GXM_MEMORY_ATTRIB_READ);
+	if (res < 0) {
+		vitasdk_arena_delete(&cache->arena);
+		return res;
+	}
+
+	for (i = 0; i < material_capacity; i++)
+		materials[i].id = 0;
+	for (i = 0; i < mesh_capacity; i++)
+		meshes[i].id = 0;
+	cache->materials     = materials;
+	cache->material_mask = material_capacity - 1;
+	cache->meshes        = meshes;
+	cache->mesh_mask     = mesh_capacity - 1;
+	cache->frame_count   = frame_count;
+	cache->frame         = 0;
+	cache->hits          = 0;
+	cache->misses        = 0;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_gxm_precomputed_cache_delete - Delete a cache
+ * @param cache - The cache, which the GPU is done with
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_precomputed_cache_delete(VitasdkGxmPrecomputedCache *cache)
+{
+	int res = sceGxmUnmapMemory(cache->arena.base);
+
+	if (res < 0)
+		return res;
+	return vitasdk_arena_delete(&cache->arena);
+}
+
+/* Home slot of an id in a table, ids are often sequential */
+static inline SceUInt32 _vitasdk_gxm_precomputed_slot(SceUInt32 id, SceUInt32 mask)
+{
+	return ((id * 0x9E3779B1u) >> 7) & mask;
+}
+
+/* The states of a mesh for one frame */
+static inline int _vitasdk_gxm_mesh_build_states(VitasdkGxmPrecomputedCache *cache, VitasdkGxmMesh *m, const VitasdkGxmMaterialDesc *desc, SceUInt32 frame)
+{
+	void *vertex_mem, *fragment_mem;
+	int res;
+
+	vertex_mem   = vitasdk_arena_alloc(&cache->arena, sceGxmGetPrecomputedVertexStateSize(desc->vertex_program), _VITASDK_GXM_PRECOMPUTED_ALIGN);
+	fragment_mem = vitasdk_arena_alloc(&cache->arena, sceGxmGetPrecomputedFragmentStateSize(desc->fragment_program), _VITASDK_GXM_PRECOMPUTED_ALIGN);
+	if (!vertex_mem || !fragment_mem)
+		return (int)SCE_KERNEL_ERROR_NO_MEMORY;
+
+	res = sceGxmPrecomputedVertexStateInit(&m->vertex_states[frame], desc->vertex_program, vertex_mem);
+	if (res >= 0 && desc->vertex_textures)
+		res = sceGxmPrecomputedVertexStateSetAllTextures(&m->vertex_states[frame], desc->vertex_textures);
+	if (res >= 0 && desc->vertex_uniform_buffers)
+		res = sceGxmPrecomputedVertexStateSetAllUniformBuffers(&m->vertex_states[frame], desc->vertex_uniform_buffers);
+	if (res >= 0)
+		res = sceGxmPrecomputedFragmentStateInit(&m->fragment_states[frame], desc->fragment_program, fragment_mem);
+	if (res >= 0 && desc->fragment_textures)
+		res = sceGxmPrecomputedFragmentStateSetAllTextures(&m->fragment_states[frame], desc->fragment_textures);
+	if (res >= 0 && desc->fragment_uniform_buffers)
+		res = sceGxmPrecomputedFragmentStateSetAllUniformBuffers(&m->fragment_states[frame], desc->fragment_uniform_buffers);
+	m->vertex_uniforms[frame]   = NULL;
+	m->fragment_uniforms[frame] = NULL;
+	return res;
+}
+
+static inline int _vitasdk_gxm_mesh_build(VitasdkGxmPrecomputedCache *cache, VitasdkGxmMesh *m, const VitasdkGxmMeshDesc *desc, const VitasdkGxmMaterial *material)
+{
+	SceSize mark = vitasdk_arena_mark(&cache->arena);
+	SceUInt32 i;
+	void *mem;
+	int res;
+
+	mem = vitasdk_arena_alloc(&cache->arena, sceGxmGetPrecomputedDrawSize(material->desc.vertex_program), _VITASDK_GXM_PRECOMPUTED_ALIGN);
+	if (!mem) {
+		res = (int)SCE_KERNEL_ERROR_NO_MEMORY;
+		goto err;
+	}
+	res = sceGxmPrecomputedDrawInit(&m->draw, material->desc.vertex_program, mem);
+	if (res >= 0)
+		res = sceGxmPrecomputedDrawSetAllVertexStreams(&m->draw, desc->streams);
+	for (i = 0; i < cache->frame_count && res >= 0; i++)
+		res = _vitasdk_gxm_mesh_build_states(cache, m, &material->desc, i);
+	if (res < 0)
+		goto err;
+
+	sceGxmPrecomputedDrawSetParams(&m->draw, desc->primitive, desc->index_format, desc->indices, desc->index_count);
+	m->material = material;
+	return 0;
+
+err:
+	vitasdk_arena_release(&cache->arena, mark);
+	return res;
+}
+
+/**
+ * @brief vitasdk_gxm_precomputed_material - Get a material, built on the first lookup of its id
+ * @param cache - The cache
+ * @param id - The id of the material, not 0
+ * @param desc - The material, only read to build it, its arrays are read again to build its meshes
+ * @param material - Receives the material
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_precomputed_material(VitasdkGxmPrecomputedCache *cache, SceUInt32 id, const VitasdkGxmMaterialDesc *desc, VitasdkGxmMaterial **material)
+{
+	SceUInt32 i, slot = _vitasdk_gxm_precomputed_slot(id, cache->material_mask);
+	VitasdkGxmMaterial *mat;
+
+	if (id == 0)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+
+	for (i = 0; i <= cache->material_mask; i++) {
+		mat = &cache->materials[(slot + i) & cache->material_mask];
+		if (mat->id == id) {
+			cache->hits++;
+			*material = mat;
+			return 0;
+		}
+		if (mat->id == 0) {
+			mat->desc                  = *desc;
+			mat->vertex_uniform_size   = sceGxmProgramGetDefaultUniformBufferSize(sceGxmVertexProgramGetProgram(desc->vertex_program));
+			mat->fragment_uniform_size = sceGxmProgramGetDefaultUniformBufferSize(sceGxmFragmentProgramGetProgram(desc->fragment_program));
+			mat->id                    = id;
+			cache->misses++;
+			*material = mat;
+			return 0;
+		}
+	}
+	return (int)SCE_KERNEL_ERROR_NO_MEMORY;
+}
+
+/**
+ * @brief vitasdk_gxm_precomputed_mesh - Get a mesh, built on the first lookup of its id
+ * @param cache - The cache
+ * @param id - The id of the object, not 0
+ * @param desc - The mesh, only read to build it
+ * @param material - The material the mesh is drawn with
+ * @param mesh - Receives the mesh
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_precomputed_mesh(VitasdkGxmPrecomputedCache *cache, SceUInt32 id, const VitasdkGxmMeshDesc *desc, const VitasdkGxmMaterial *material, VitasdkGxmMesh **mesh)
+{
+	SceUInt32 i, slot = _vitasdk_gxm_precomputed_slot(id, cache->mesh_mask);
+	VitasdkGxmMesh *m;
+	int res;
+
+	if (id == 0)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+
+	for (i = 0; i <= cache->mesh_mask; i++) {
+		m = &cache->meshes[(slot + i) & cache->mesh_mask];
+		if (m->id == id) {
+			cache->hits++;
+			*mesh = m;
+			return 0;
+		}
+		if (m->id != 0)
+			continue;
+
+		res = _vitasdk_gxm_mesh_build(cache, m, desc, material);
+		if (res < 0)
+			return res;
+		m->id = id;
+		cache->misses++;
+		*mesh = m;
+		return 0;
+	}
+	return (int)SCE_KERNEL_ERROR_NO_MEMORY;
+}
+
+/**
+ * @brief vitasdk_gxm_precomputed_flip - Start a new frame
+ *
+ * The meshes of the new frame use the states of the frame `frame_count`
+ * frames ago, which the GPU must be done with.
+ *
+ * @param cache - The cache
+ */
+static inline void vitasdk_gxm_precomputed_flip(VitasdkGxmPrecomputedCache *cache)
+{
+	cache->frame = (cache->frame + 1) % cache->frame_count;
+}
+
+/**
+ * @brief vitasdk_gxm_material_bind - Set the programs of a material
+ * @param context - The context
+ * @param material - The material
+ */
+static inline void vitasdk_gxm_material_bind(SceGxmContext *context, const VitasdkGxmMaterial *material)
+{
+	sceGxmSetVertexProgram(context, material->desc.vertex_program);
+	sceGxmSetFragmentProgram(context, material->desc.fragment_program);
+}
+
+/**
+ * @brief vitasdk_gxm_mesh_draw - Draw a mesh, its material bound
+ *
+ * The default uniform buffers are set on the states of the mesh for the
+ * current frame, the buffer of a state is only set again when it changes.
+ * They must stay valid until the GPU is done with the draw, which is the
+ * case of the memory of a frame or ring allocator.
+ *
+ * @param context - The context
+ * @param cache - The cache of the mesh
+ * @param mesh - The mesh
+ * @param vertex_uniforms - The default vertex uniform buffer, or NULL if the program has none
+ * @param fragment_uniforms - The default fragment uniform buffer, or NULL if the program has none
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_mesh_draw(SceGxmContext *context, const VitasdkGxmPrecomputedCache *cache, VitasdkGxmMesh *mesh, void *vertex_uniforms, void *fragment_uniforms)
+{
+	SceUInt32 frame = cache->frame;
+
+	if (vertex_uniforms && mesh->vertex_uniforms[frame] != vertex_uniforms) {
+		sceGxmPrecomputedVertexStateSetDefaultUniformBuffer(&mesh->vertex_states[frame], vertex_uniforms);
+		mesh->vertex_uniforms[frame] = vertex_uniforms;
+	}
+	if (fragment_uniforms && mesh->fragment_uniforms[frame] != fragment_uniforms) {
+		sceGxmPrecomputedFragmentStateSetDefaultUniformBuffer(&mesh->fragment_states[frame], fragment_uniforms);
+		mesh->fragment_uniforms[frame] = fragment_uniforms;
+	}
+	sceGxmSetPrecomputedVertexState(context, &mesh->vertex_states[frame]);
+	sceGxmSetPrecomputedFragmentState(context, &mesh->fragment_states[frame]);
+	return sceGxmDrawPrecomputed(context, &mesh->draw);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_GXMPRECOMPUTED_H_ */
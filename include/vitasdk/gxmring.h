@@ -0,0 +1,225 @@
+#ifndef _VITASDK_GXMRING_H_
+#define _VITASDK_GXMRING_H_
+
+/*
+ * Transient ring allocator for per-draw GPU data.
+ *
+ * One memblock mapped for the GPU holds the uniform, vertex and index data
+ * written by the CPU for the frames in flight. Allocations are a pointer
+ * bump, each frame ends with a notification which the GPU writes once it
+ * is done with the scene, the space of a frame is recycled as soon as its
+ * notification was written:
+ *
+ *   void *u = vitasdk_gxm_ring_push(&ring, &matrices, sizeof(matrices), 4);
+ *   sceGxmSetVertexUniformBuffer(ctx, 0, u);
+ *   ...
+ *   sceGxmEndScene(ctx, NULL, vitasdk_gxm_ring_end_frame(&ring));
+ *
+ * With a ring larger than the data of all the frames in flight the CPU
+ * never waits for the GPU, the stalls statistic counts the times it did.
+ */
+
+#include <psp2/types.h>
+#include <psp2/gxm.h>
+#include <psp2/kernel/error.h>
+#include <psp2/kernel/sysmem.h>
+#include <vitasdk/arena.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** Frames which can be in flight at the same time */
+#define VITASDK_GXM_RING_MAX_FRAMES (4)
+
+typedef struct VitasdkGxmRingFrame {
+	SceGxmNotification notification;
+	SceUInt32 end;         //!< Ring position after the last allocation of the frame
+} VitasdkGxmRingFrame;
+
+typedef struct VitasdkGxmRing {
+	char *base;
+	SceSize size;          //!< A power of two
+	SceUInt32 head;        //!< Position of the next allocation
+	SceUInt32 tail;        //!< Position of the oldest allocation the GPU may read
+	SceUInt32 frame_count;
+	SceUInt32 frame;       //!< Frames ended
+	SceUInt32 oldest;      //!< Oldest frame the GPU may not be done with
+	VitasdkGxmRingFrame frames[VITASDK_GXM_RING_MAX_FRAMES];
+	SceUInt32 stalls;      //!< Waits for the GPU since the creation
+	SceSize high_water;    //!< Highest number of bytes in use since the creation
+	SceUID memblock;
+} VitasdkGxmRing;
+
+/* Recycle the space of the oldest frame once the GPU is done with it */
+static inline SceBool _vitasdk_gxm_ring_retire(VitasdkGxmRing *ring, SceBool wait)
+{
+	VitasdkGxmRingFrame *f;
+
+	if (ring->oldest == ring->frame)
+		return SCE_FALSE;
+
+	f = &ring->frames[ring->oldest % ring->frame_count];
+	if (*f->notification.address != f->notification.value) {
+		if (!wait)
+			return SCE_FALSE;
+		ring->stalls++;
+		sceGxmNotificationWait(&f->notification);
+	}
+	ring->tail = f->end;
+	ring->oldest++;
+	return SCE_TRUE;
+}
+
+/**
+ * @brief vitasdk_gxm_ring_create - Create a ring over a new memblock mapped for the GPU
+ * @param ring - The ring
+ * @param name - The name of the memblock
+ * @param type - The memblock type, e.g. SCE_KERNEL_MEMBLOCK_TYPE_USER_CDRAM_RW
+ * @param size - The minimum size of the ring
+ * @param frame_count - The number of frames in flight, at most VITASDK_GXM_RING_MAX_FRAMES
+ * @param notifications - `frame_count` words of the sceGxmGetNotificationRegion region
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_ring_create(VitasdkGxmRing *ring, const char *name, SceKernelMemBlockType type, SceSize size, SceUInt32 frame_count, volatile unsigned int *notifications)
+{
+	SceSize ring_size = 1;
+	SceUInt32 i;
+	SceUID memblock;
+	void *base;
+	int res;
+
+	if (frame_count == 0 || frame_count > VITASDK_GXM_RING_MAX_FRAMES)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	if (size == 0 || size > 0x40000000)
+		return (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+
+	/* A power of two is also a multiple of every memblock granularity above it */
+	while (ring_size < size)
+		ring_size <<= 1;
+	memblock = _vitasdk_memblock_alloc(name, type, &ring_size, &base);
+	if (memblock < 0)
+		return memblock;
+	res = sceGxmMapMemory(base, ring_size, SCE_GXM_MEMORY_ATTRIB_READ);
+	if (res < 0) {
+		sceKernelFreeMemBlock(memblock);
+		return res;
+	}
+
+	ring->base        = (char *)base;
+	ring->size        = ring_size;
+	ring->head        = 0;
+	ring->tail        = 0;
+	ring->frame_count = frame_count;
+	ring->frame       = 0;
+	ring->oldest      = 0;
+	for (i = 0; i < frame_count; i++) {
+		notifications[i] = 0;
+		ring->frames[i].notification.address = &notifications[i];
+		ring->frames[i].notification.value   = 0;
+		ring->frames[i].end                  = 0;
+	}
+	ring->stalls     = 0;
+	ring->high_water = 0;
+	ring->memblock   = memblock;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_gxm_ring_delete - Wait for the GPU and delete a ring
+ * @param ring - The ring
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_ring_delete(VitasdkGxmRing *ring)
+{
+	int res;
+
+	while (_vitasdk_gxm_ring_retire(ring, SCE_TRUE))
+		;
+	res = sceGxmUnmapMemory(ring->base);
+	if (res < 0)
+		return res;
+	return sceKernelFreeMemBlock(ring->memblock);
+}
+
+/**
+ * @brief vitasdk_gxm_ring_alloc - Allocate GPU data for the current frame
+ * @param ring - The ring
+ * @param size - The size of the data
+ * @param align - The alignment of the data, a power of two the base of the ring is aligned to,
+ *                the memblock granularity at least
+ * @return The data, NULL if the current frame alone fills the ring or `align` is invalid.
+ */
+static inline void *vitasdk_gxm_ring_alloc(VitasdkGxmRing *ring, SceSize size, SceSize align)
+{
+	SceUInt32 offset, start, needed;
+
+	if (size > ring->size)
+		return NULL;
+	/* The offsets are aligned, the base must be as well */
+	if (align == 0 || (align & (align - 1)) != 0 || align > ring->size || ((uintptr_t)ring->base & (align - 1)) != 0)
+		return NULL;
+
+	for (;;) {
+		offset = ring->head & (ring->size - 1);
+		start  = (offset + align - 1) & ~(align - 1);
+		/* The data is contiguous, the end of the lap is skipped */
+		if (start + size > ring->size)
+			start = ring->size;
+		needed = start - offset + size;
+		if (ring->head + needed - ring->tail <= ring->size)
+			break;
+		if (!_vitasdk_gxm_ring_retire(ring, SCE_TRUE))
+			return NULL;
+	}
+
+	ring->head += needed;
+	if (ring->head - ring->tail > ring->high_water)
+		ring->high_water = ring->head - ring->tail;
+	return ring->base + (start & (ring->size - 1));
+}
+
+/**
+ * @brief vitasdk_gxm_ring_push - Copy data for the GPU
+ * @param ring - The ring
+ * @param data - The data
+ * @param size - The size of the data
+ * @param align - The alignment of the copy, see vitasdk_gxm_ring_alloc
+ * @return The copy, NULL if the current frame alone fills the ring or `align` is invalid.
+ */
+static inline void *vitasdk_gxm_ring_push(VitasdkGxmRing *ring, const void *data, SceSize size, SceSize align)
+{
+	void *p = vitasdk_gxm_ring_alloc(ring, size, align);
+
+	if (p)
+		__builtin_memcpy(p, data, size);
+	return p;
+}
+
+/**
+ * @brief vitasdk_gxm_ring_end_frame - End the allocations of the current frame
+ * @param ring - The ring
+ * @return The notification to pass as fragment notification of the last
+ *         sceGxmEndScene of the frame.
+ */
+static inline const SceGxmNotification *vitasdk_gxm_ring_end_frame(VitasdkGxmRing *ring)
+{
+	VitasdkGxmRingFrame *f;
+
+	while (_vitasdk_gxm_ring_retire(ring, SCE_FALSE))
+		;
+	/* The slot of the new frame is the one of the oldest frame */
+	if (ring->frame - ring->oldest == ring->frame_count)
+		_vitasdk_gxm_ring_retire(ring, SCE_TRUE);
+
+	f = &ring->frames[ring->frame % ring->frame_count];
+	f->end = ring->head;
+	ring->frame++;
+	f->notification.value = ring->frame;
+	return &f->notification;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_GXMRING_H_ */
@@ -0,0 +1,506 @@
+#ifndef _VITASDK_GXMSHADERCACHE_H_
+#define _VITASDK_GXMSHADERCACHE_H_
+
+/*
+ * Cache of the programs created by a GXM shader patcher.
+ *
+ * Patching a program for a new attribute layout, output format, blend or
+ * multisample mode takes long enough to drop a frame. The cache patches each
+ * combination once, and saves the combinations it has seen to a file. On the
+ * next start a background thread patches them again from that file, before
+ * the frames which need them:
+ *
+ *   vitasdk_gxm_shader_cache_create(&cache, patcher, entries, 256);
+ *   vitasdk_gxm_shader_cache_register(&cache, SHADER_BASIC_V, basic_v_id);
+ *   vitasdk_gxm_shader_cache_register(&cache, SHADER_BASIC_F, basic_f_id);
+ *   vitasdk_gxm_shader_cache_preload(&cache, "ux0:data/game/shaders.bin", BUILD_ID, 0x10000100 + 32, 0x4000,
+ *                                    SCE_KERNEL_CPU_MASK_USER_2);
+ *   ...
+ *   vitasdk_gxm_shader_cache_fragment_program(&cache, SHADER_BASIC_F, SCE_GXM_OUTPUT_REGISTER_FORMAT_UCHAR4,
+ *                                             SCE_GXM_MULTISAMPLE_NONE, &blend, SHADER_BASIC_V, &fp);
+ *   ...
+ *   vitasdk_gxm_shader_cache_save(&cache, "ux0:data/game/shaders.bin", BUILD_ID);
+ *
+ * Programs are named by ids chosen by the caller, which stay the same across
+ * starts, and are never 0. The version passed to save and preload changes
+ * with the shaders, a file of another version is ignored.
+ *
+ * The shader patcher is not thread safe, every use of it while the cache is
+ * alive goes through the cache. Only the patching is serialized: a lookup of
+ * a patched program takes no lock, so the frames never wait behind the
+ * preload thread, and a miss waits for at most the one program it patches.
+ */
+
+#include <psp2/types.h>
+#include <psp2/gxm.h>
+#include <psp2/io/fcntl.h>
+#include <psp2/kernel/error.h>
+#include <psp2/kernel/threadmgr/thread.h>
+#include <vitasdk/atomic.h>
+#include <vitasdk/lock.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** Programs which can be registered */
+#define VITASDK_GXM_SHADER_MAX_PROGRAMS (64)
+/** Vertex attributes of a vertex program */
+#define VITASDK_GXM_SHADER_MAX_ATTRIBUTES (16)
+/** Vertex streams of a vertex program */
+#define VITASDK_GXM_SHADER_MAX_STREAMS (4)
+
+/* 'VXSC' */
+#define _VITASDK_GXM_SHADER_MAGIC (0x43535856)
+/* Keys read from the file at once */
+#define _VITASDK_GXM_SHADER_BATCH (16)
+#define _VITASDK_GXM_SHADER_PATH_MAX (256)
+
+typedef enum VitasdkGxmShaderType {
+	VITASDK_GXM_SHADER_VERTEX   = 1,
+	VITASDK_GXM_SHADER_FRAGMENT = 2
+} VitasdkGxmShaderType;
+
+/* The combination a program was patched for, also the record of the file */
+typedef struct VitasdkGxmShaderKey {
+	SceUInt32 type;                                   //!< One of ::VitasdkGxmShaderType
+	SceUInt32 program;                                //!< Id of the program
+	SceUInt32 vertex_program;                         //!< Fragment, id of the linked vertex program or 0
+	SceUInt32 output_format;                          //!< Fragment, one of ::SceGxmOutputRegisterFormat
+	SceUInt32 multisample;                            //!< Fragment, one of ::SceGxmMultisampleMode
+	SceUInt32 blended;                                //!< Fragment, whether `blend` is used
+	SceUInt32 attribute_count;                        //!< Vertex
+	SceUInt32 stream_count;                           //!< Vertex
+	SceGxmBlendInfo blend;
+	SceGxmVertexAttribute attributes[VITASDK_GXM_SHADER_MAX_ATTRIBUTES];
+	SceGxmVertexStream streams[VITASDK_GXM_SHADER_MAX_STREAMS];
+} VitasdkGxmShaderKey;
+
+typedef struct VitasdkGxmShaderEntry {
+	VitasdkGxmShaderKey key;
+	volatile SceUInt32 hash;                          //!< 0 for a free entry, stored last
+	void *program;                                    //!< SceGxmVertexProgram or SceGxmFragmentProgram
+} VitasdkGxmShaderEntry;
+
+typedef struct VitasdkGxmShaderFileHeader {
+	SceUInt32 magic;
+	SceUInt32 version;
+	SceUInt32 key_size;
+	SceUInt32 count;
+} VitasdkGxmShaderFileHeader;
+
+typedef struct VitasdkGxmShaderCache {
+	SceGxmShaderPatcher *patcher;
+	VitasdkMutex patch_lock;                          //!< Held for the uses of the patcher and the insertions
+	VitasdkGxmShaderEntry *entries;                   //!< Open addressed by hash
+	SceUInt32 mask;
+	SceUInt32 count;
+	struct {
+		SceUInt32 id;
+		SceGxmShaderPatcherId patcher_id;
+	} programs[VITASDK_GXM_SHADER_MAX_PROGRAMS];
+	SceUInt32 program_count;
+	volatile SceUInt32 hits;                          //!< Lookups of patched programs
+	SceUInt32 misses;                                 //!< Lookups which patched a program
+	SceUInt32 preloaded;                              //!< Programs patched by the preload thread
+	/* Preload thread */
+	SceUID preload_thid;
+	SceUInt32 preload_version;
+	int preload_result;
+	char preload_path[_VITASDK_GXM_SHADER_PATH_MAX];
+} VitasdkGxmShaderCache;
+
+/**
+ * @brief vitasdk_gxm_shader_cache_create - Create a cache over a shader patcher
+ * @param cache - The cache
+ * @param patcher - The shader patcher
+ * @param entries - Storage for `capacity` programs
+ * @param capacity - A power of two, larger than the number of combinations
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_shader_cache_create(VitasdkGxmShaderCache *cache, SceGxmShaderPatcher *patcher, VitasdkGxmShaderEntry *entries, SceUInt32 capacity)
+{
+	SceUInt32 i;
+	int res;
+
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+		return (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+
+	res = vitasdk_mutex_create(&cache->patch_lock, "VitasdkGxmShaderCache", VITASDK_MUTEX_DEFAULT_SPIN);
+	if (res < 0)
+		return res;
+	for (i = 0; i < capacity; i++)
+		entries[i].hash = 0;
+	cache->patcher        = patcher;
+	cache->entries        = entries;
+	cache->mask           = capacity - 1;
+	cache->count          = 0;
+	cache->program_count  = 0;
+	cache->hits           = 0;
+	cache->misses         = 0;
+	cache->preloaded      = 0;
+	cache->preload_thid   = -1;
+	cache->preload_result = 0;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_gxm_shader_cache_wait_preload - Wait for the end of the preload thread
+ * @param cache - The cache
+ * @return 0 on success or without preload, < 0 on error, such as no file on a first start.
+ */
+static inline int vitasdk_gxm_shader_cache_wait_preload(VitasdkGxmShaderCache *cache)
+{
+	if (cache->preload_thid >= 0) {
+		sceKernelWaitThreadEnd(cache->preload_thid, NULL, NULL);
+		sceKernelDeleteThread(cache->preload_thid);
+		cache->preload_thid = -1;
+	}
+	return cache->preload_result;
+}
+
+/**
+ * @brief vitasdk_gxm_shader_cache_delete - Release the programs and delete a cache
+ * @param cache - The cache, whose programs the GPU is done with
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_shader_cache_delete(VitasdkGxmShaderCache *cache)
+{
+	VitasdkGxmShaderEntry *e;
+	SceUInt32 i;
+
+	vitasdk_gxm_shader_cache_wait_preload(cache);
+	for (i = 0; i <= cache->mask; i++) {
+		e = &cache->entries[i];
+		if (e->hash == 0)
+			continue;
+		if (e->key.type == VITASDK_GXM_SHADER_VERTEX)
+			sceGxmShaderPatcherReleaseVertexProgram(cache->patcher, (SceGxmVertexProgram *)e->program);
+		else
+			sceGxmShaderPatcherReleaseFragmentProgram(cache->patcher, (SceGxmFragmentProgram *)e->program);
+		e->hash = 0;
+	}
+	return vitasdk_mutex_delete(&cache->patch_lock);
+}
+
+/**
+ * @brief vitasdk_gxm_shader_cache_register - Name a program registered with the shader patcher
+ * @param cache - The cache, before vitasdk_gxm_shader_cache_preload
+ * @param id - The id of the program, the same on every start, not 0
+ * @param patcher_id - The program from sceGxmShaderPatcherRegisterProgram
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_shader_cache_register(VitasdkGxmShaderCache *cache, SceUInt32 id, SceGxmShaderPatcherId patcher_id)
+{
+	if (id == 0)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	if (cache->program_count == VITASDK_GXM_SHADER_MAX_PROGRAMS)
+		return (int)SCE_KERNEL_ERROR_NO_MEMORY;
+	cache->programs[cache->program_count].id         = id;
+	cache->programs[cache->program_count].patcher_id = patcher_id;
+	cache->program_count++;
+	return 0;
+}
+
+static inline SceGxmShaderPatcherId _vitasdk_gxm_shader_find(const VitasdkGxmShaderCache *cache, SceUInt32 id)
+{
+	SceUInt32 i;
+
+	for (i = 0; i < cache->program_count; i++) {
+		if (cache->programs[i].id == id)
+			return cache->programs[i].patcher_id;
+	}
+	return NULL;
+}
+
+/* FNV-1a of a key, never 0 */
+static inline SceUInt32 _vitasdk_gxm_shader_hash(const VitasdkGxmShaderKey *key)
+{
+	const SceUInt8 *p = (const SceUInt8 *)key;
+	SceUInt32 i, hash = 0x811C9DC5u;
+
+	for (i = 0; i < sizeof(*key); i++)
+		hash = (hash ^ p[i]) * 0x01000193u;
+	return hash ? hash : 1;
+}
+
+/* Patch the program of a key, with the patch lock held */
+static inline int _vitasdk_gxm_shader_patch(VitasdkGxmShaderCache *cache, const VitasdkGxmShaderKey *key, void **program)
+{
+	SceGxmShaderPatcherId id = _vitasdk_gxm_shader_find(cache, key->program), vertex_id = NULL;
+
+	if (!id)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	if (key->type == VITASDK_GXM_SHADER_VERTEX)
+		return sceGxmShaderPatcherCreateVertexProgram(cache->patcher, id, key->attributes, key->attribute_count,
+		                                              key->streams, key->stream_count, (SceGxmVertexProgram **)program);
+
+	if (key->vertex_program != 0) {
+		vertex_id = _vitasdk_gxm_shader_find(cache, key->vertex_program);
+		if (!vertex_id)
+			return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	}
+	return sceGxmShaderPatcherCreateFragmentProgram(cache->patcher, id, (SceGxmOutputRegisterFormat)key->output_format,
+	                                                (SceGxmMultisampleMode)key->multisample, key->blended ? &key->blend : NULL,
+	                                                vertex_id ? sceGxmShaderPatcherGetProgramFromId(vertex_id) : NULL,
+	                                                (SceGxmFragmentProgram **)program);
+}
+
+/*
+ * Find the entry of a key without lock, or else the free entry it goes to.
+ * NULL if the table is full.
+ */
+static inline VitasdkGxmShaderEntry *_vitasdk_gxm_shader_probe(VitasdkGxmShaderCache *cache, const VitasdkGxmShaderKey *key, SceUInt32 hash, SceBool *found)
+{
+	VitasdkGxmShaderEntry *e;
+	SceUInt32 i, h;
+
+	for (i = 0; i <= cache->mask; i++) {
+		e = &cache->entries[(hash + i) & cache->mask];
+		/* The key and program of an entry are written before its hash */
+		h = vitasdk_atomic_load_acquire32(&e->hash);
+		if (h == 0 || (h == hash && __builtin_memcmp(&e->key, key, sizeof(*key)) == 0)) {
+			*found = h != 0;
+			return e;
+		}
+	}
+	*found = SCE_FALSE;
+	return NULL;
+}
+
+/* Find the program of a key, patched if it is not in the cache yet */
+static inline int _vitasdk_gxm_shader_lookup(VitasdkGxmShaderCache *cache, const VitasdkGxmShaderKey *key, SceBool preload, void **program)
+{
+	SceUInt32 hash = _vitasdk_gxm_shader_hash(key);
+	VitasdkGxmShaderEntry *e;
+	SceBool found;
+	void *patched;
+	int res = 0;
+
+	e = _vitasdk_gxm_shader_probe(cache, key, hash, &found);
+	if (e && found)
+		goto hit;
+
+	vitasdk_mutex_lock(&cache->patch_lock);
+	/* Another thread may have patched it meanwhile */
+	e = _vitasdk_gxm_shader_probe(cache, key, hash, &found);
+	if (!e || (!found && preload && cache->count == cache->mask)) {
+		/* Keep a free entry for the lookups of the frames */
+		res = (int)SCE_KERNEL_ERROR_NO_MEMORY;
+	} else if (!found) {
+		res = _vitasdk_gxm_shader_patch(cache, key, &patched);
+		if (res >= 0) {
+			e->key     = *key;
+			e->program = patched;
+			vitasdk_atomic_store_release32(&e->hash, hash);
+			cache->count++;
+			if (preload)
+				cache->preloaded++;
+			else
+				cache->misses++;
+			*program = patched;
+		}
+	}
+	vitasdk_mutex_unlock(&cache->patch_lock);
+	if (res < 0 || !found)
+		return res;
+
+hit:
+	if (!preload)
+		vitasdk_atomic_add32(&cache->hits, 1);
+	*program = e->program;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_gxm_shader_cache_vertex_program - Get a vertex program, patched on the first lookup
+ * @param cache - The cache
+ * @param id - The id of the program
+ * @param attributes - The vertex attributes
+ * @param attribute_count - The number of attributes, at most VITASDK_GXM_SHADER_MAX_ATTRIBUTES
+ * @param streams - The vertex streams
+ * @param stream_count - The number of streams, at most VITASDK_GXM_SHADER_MAX_STREAMS
+ * @param program - Receives the program, owned by the cache
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_shader_cache_vertex_program(VitasdkGxmShaderCache *cache, SceUInt32 id, const SceGxmVertexAttribute *attributes, SceUInt32 attribute_count,
+	const SceGxmVertexStream *streams, SceUInt32 stream_count, SceGxmVertexProgram **program)
+{
+	VitasdkGxmShaderKey key;
+
+	if (attribute_count > VITASDK_GXM_SHADER_MAX_ATTRIBUTES || stream_count > VITASDK_GXM_SHADER_MAX_STREAMS)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+
+	/* The unused fields are part of the hash */
+	__builtin_memset(&key, 0, sizeof(key));
+	key.type            = VITASDK_GXM_SHADER_VERTEX;
+	key.program         = id;
+	key.attribute_count = attribute_count;
+	key.stream_count    = stream_count;
+	__builtin_memcpy(key.attributes, attributes, attribute_count * sizeof(*attributes));
+	__builtin_memcpy(key.streams, streams, stream_count * sizeof(*streams));
+	return _vitasdk_gxm_shader_lookup(cache, &key, SCE_FALSE, (void **)program);
+}
+
+/**
+ * @brief vitasdk_gxm_shader_cache_fragment_program - Get a fragment program, patched on the first lookup
+ * @param cache - The cache
+ * @param id - The id of the program
+ * @param output_format - The output register format
+ * @param multisample - The multisample mode
+ * @param blend - The blending, or NULL
+ * @param vertex_program - The id of the vertex program it is linked with, or 0
+ * @param program - Receives the program, owned by the cache
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_shader_cache_fragment_program(VitasdkGxmShaderCache *cache, SceUInt32 id, SceGxmOutputRegisterFormat output_format,
+	SceGxmMultisampleMode multisample, const SceGxmBlendInfo *blend, SceUInt32 vertex_program, SceGxmFragmentProgram **program)
+{
+	VitasdkGxmShaderKey key;
+
+	__builtin_memset(&key, 0, sizeof(key));
+	key.type           = VITASDK_GXM_SHADER_FRAGMENT;
+	key.program        = id;
+	key.vertex_program = vertex_program;
+	key.output_format  = output_format;
+	key.multisample    = multisample;
+	if (blend) {
+		key.blended = 1;
+		key.blend   = *blend;
+	}
+	return _vitasdk_gxm_shader_lookup(cache, &key, SCE_FALSE, (void **)program);
+}
+
+/**
+ * @brief vitasdk_gxm_shader_cache_save - Write the combinations of the cache to a file
+ * @param cache - The cache
+ * @param path - The file, e.g. under ux0:data
+ * @param version - The version of the shaders
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_shader_cache_save(VitasdkGxmShaderCache *cache, const char *path, SceUInt32 version)
+{
+	VitasdkGxmShaderFileHeader header;
+	SceSSize written;
+	SceUInt32 i;
+	SceUID fd;
+	int res = 0;
+
+	fd = sceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0666);
+	if (fd < 0)
+		return fd;
+
+	vitasdk_mutex_lock(&cache->patch_lock);
+	header.magic    = _VITASDK_GXM_SHADER_MAGIC;
+	header.version  = version;
+	header.key_size = sizeof(VitasdkGxmShaderKey);
+	header.count    = cache->count;
+	written = sceIoWrite(fd, &header, sizeof(header));
+	if (written != sizeof(header))
+		res = written < 0 ? (int)written : (int)SCE_KERNEL_ERROR_ERROR;
+	for (i = 0; res >= 0 && i <= cache->mask; i++) {
+		if (cache->entries[i].hash == 0)
+			continue;
+		written = sceIoWrite(fd, &cache->entries[i].key, sizeof(VitasdkGxmShaderKey));
+		if (written != sizeof(VitasdkGxmShaderKey))
+			res = written < 0 ? (int)written : (int)SCE_KERNEL_ERROR_ERROR;
+	}
+	vitasdk_mutex_unlock(&cache->patch_lock);
+
+	sceIoClose(fd);
+	return res;
+}
+
+static inline int _vitasdk_gxm_shader_preload_entry(SceSize args, void *argp)
+{
+	VitasdkGxmShaderCache *cache = *(VitasdkGxmShaderCache **)argp;
+	VitasdkGxmShaderKey keys[_VITASDK_GXM_SHADER_BATCH];
+	VitasdkGxmShaderFileHeader header;
+	SceSSize bytes;
+	SceUInt32 i, n;
+	void *program;
+	SceUID fd;
+	int res = 0;
+
+	(void)args;
+	fd = sceIoOpen(cache->preload_path, SCE_O_RDONLY, 0);
+	if (fd < 0) {
+		cache->preload_result = fd;
+		return 0;
+	}
+
+	/* A file of other shaders or of another layout is ignored */
+	bytes = sceIoRead(fd, &header, sizeof(header));
+	if (bytes != sizeof(header) || header.magic != _VITASDK_GXM_SHADER_MAGIC ||
+	    header.version != cache->preload_version || header.key_size != sizeof(VitasdkGxmShaderKey))
+		goto out;
+
+	/* A truncated file gives the keys written before its end */
+	while (header.count > 0) {
+		n = header.count < _VITASDK_GXM_SHADER_BATCH ? header.count : _VITASDK_GXM_SHADER_BATCH;
+		bytes = sceIoRead(fd, keys, n * sizeof(VitasdkGxmShaderKey));
+		if (bytes <= 0)
+			break;
+		n = bytes / sizeof(VitasdkGxmShaderKey);
+		for (i = 0; i < n; i++) {
+			/* The keys of programs which are gone are skipped */
+			res = _vitasdk_gxm_shader_lookup(cache, &keys[i], SCE_TRUE, &program);
+			if (res == (int)SCE_KERNEL_ERROR_NO_MEMORY)
+				goto out;
+		}
+		if (n == 0)
+			break;
+		header.count -= n;
+	}
+	res = 0;
+
+out:
+	sceIoClose(fd);
+	cache->preload_result = res;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_gxm_shader_cache_preload - Patch the combinations of a file in a background thread
+ * @param cache - The cache, with all its programs registered
+ * @param path - The file written by vitasdk_gxm_shader_cache_save
+ * @param version - The version of the shaders
+ * @param priority - The priority of the thread, e.g. 0x10000100 + 32, below the threads which render
+ * @param stack_size - The stack of the thread, e.g. 0x4000
+ * @param core_mask - The cores of the thread, e.g. SCE_KERNEL_CPU_MASK_USER_2
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_shader_cache_preload(VitasdkGxmShaderCache *cache, const char *path, SceUInt32 version, int priority, SceSize stack_size,
+	int core_mask)
+{
+	SceUInt32 i;
+	SceUID thid;
+	int res;
+
+	if (cache->preload_thid >= 0)
+		return (int)SCE_KERNEL_ERROR_ERROR;
+	for (i = 0; path[i] != '\0'; i++) {
+		if (i == _VITASDK_GXM_SHADER_PATH_MAX - 1)
+			return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+		cache->preload_path[i] = path[i];
+	}
+	cache->preload_path[i] = '\0';
+	cache->preload_version = version;
+	cache->preload_result  = 0;
+
+	thid = sceKernelCreateThread("VitasdkGxmShaderPreload", _vitasdk_gxm_shader_preload_entry, priority, stack_size, 0, core_mask, NULL);
+	if (thid < 0)
+		return thid;
+	res = sceKernelStartThread(thid, sizeof(cache), &cache);
+	if (res < 0) {
+		sceKernelDeleteThread(thid);
+		return res;
+	}
+	cache->preload_thid = thid;
+	return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_GXMSHADERCACHE_H_ */
@@ -0,0 +1,422 @@
+#ifndef _VITASDK_GXMSTATE_H_
+#define _VITASDK_GXMSTATE_H_
+
+/*
+ * GXM state filtering and sorted draw recording.
+ *
+ * VitasdkGxmState shadows the state of a SceGxmContext and only calls the
+ * sceGxmSet* functions whose value changed, the others cost a compare:
+ *
+ *   vitasdk_gxm_set_fragment_program(&state, program);
+ *   vitasdk_gxm_set_fragment_texture(&state, 0, &texture);
+ *   vitasdk_gxm_draw(&state, SCE_GXM_PRIMITIVE_TRIANGLES, SCE_GXM_INDEX_FORMAT_U16, indices, count);
+ *
+ * VitasdkGxmRecorder records whole draws of a scene instead, sorts them by
+ * a caller key, e.g. VITASDK_GXM_SORT_KEY, and submits them through the
+ * state filter so draws sharing programs and textures follow each other.
+ * The uniforms of recorded draws are in caller memory such as a
+ * vitasdk/gxmring.h ring, since the reserved default uniform buffers of
+ * the context belong to the next draw.
+ *
+ * Call vitasdk_gxm_state_invalidate after anything which changes the
+ * context behind the filter, e.g. a command list or a precomputed state.
+ */
+
+#include <psp2/types.h>
+#include <psp2/gxm.h>
+#include <psp2/kernel/error.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** Fragment textures of a recorded draw */
+#define VITASDK_GXM_DRAW_TEXTURES (4)
+/** Vertex streams of a recorded draw */
+#define VITASDK_GXM_DRAW_STREAMS  (2)
+
+/** Sort key of a recorded draw: layers first, then programs, textures and depth */
+#define VITASDK_GXM_SORT_KEY(layer, program, texture, depth) \
+	((((SceUInt32)(layer) & 0xF) << 28) | (((SceUInt32)(program) & 0x3FF) << 18) | \
+	 (((SceUInt32)(texture) & 0x3FF) << 8) | ((SceUInt32)(depth) & 0xFF))
+
+/* Scalar state shadowed by VitasdkGxmState */
+enum {
+	_VITASDK_GXM_STATE_VERTEX_PROGRAM,
+	_VITASDK_GXM_STATE_FRAGMENT_PROGRAM,
+	_VITASDK_GXM_STATE_VERTEX_UNIFORMS,
+	_VITASDK_GXM_STATE_FRAGMENT_UNIFORMS,
+	_VITASDK_GXM_STATE_FRONT_DEPTH_FUNC,
+	_VITASDK_GXM_STATE_BACK_DEPTH_FUNC,
+	_VITASDK_GXM_STATE_FRONT_DEPTH_WRITE,
+	_VITASDK_GXM_STATE_BACK_DEPTH_WRITE,
+	_VITASDK_GXM_STATE_FRONT_POLYGON_MODE,
+	_VITASDK_GXM_STATE_BACK_POLYGON_MODE,
+	_VITASDK_GXM_STATE_FRONT_STENCIL_REF,
+	_VITASDK_GXM_STATE_BACK_STENCIL_REF,
+	_VITASDK_GXM_STATE_CULL_MODE,
+	_VITASDK_GXM_STATE_TWO_SIDED,
+	_VITASDK_GXM_STATE_COUNT
+};
+
+typedef struct VitasdkGxmStateStats {
+	SceUInt32 submitted;  //!< State changes passed to the context
+	SceUInt32 elided;     //!< State changes dropped as redundant
+	SceUInt32 draws;
+} VitasdkGxmStateStats;
+
+typedef struct VitasdkGxmState {
+	SceGxmContext *context;
+	SceUInt32 valid;                  //!< Scalars whose shadow is known
+	uintptr_t values[_VITASDK_GXM_STATE_COUNT];
+	SceUInt32 fragment_texture_valid;
+	SceUInt32 vertex_texture_valid;
+	SceUInt32 stream_valid;
+	SceGxmTexture fragment_textures[SCE_GXM_MAX_TEXTURE_UNITS];
+	SceGxmTexture vertex_textures[SCE_GXM_MAX_TEXTURE_UNITS];
+	const void *streams[SCE_GXM_MAX_VERTEX_STREAMS];
+	VitasdkGxmStateStats stats;
+} VitasdkGxmState;
+
+/**
+ * @brief vitasdk_gxm_state_init - Start shadowing the state of a context
+ * @param state - The state
+ * @param context - The context
+ */
+static inline void vitasdk_gxm_state_init(VitasdkGxmState *state, SceGxmContext *context)
+{
+	state->context                = context;
+	state->valid                  = 0;
+	state->fragment_texture_valid = 0;
+	state->vertex_texture_valid   = 0;
+	state->stream_valid           = 0;
+	state->stats.submitted        = 0;
+	state->stats.elided           = 0;
+	state->stats.draws            = 0;
+}
+
+/**
+ * @brief vitasdk_gxm_state_invalidate - Forget the shadowed state
+ * @param state - The state, whose next changes all reach the context
+ */
+static inline void vitasdk_gxm_state_invalidate(VitasdkGxmState *state)
+{
+	state->valid                  = 0;
+	state->fragment_texture_valid = 0;
+	state->vertex_texture_valid   = 0;
+	state->stream_valid           = 0;
+}
+
+static inline void vitasdk_gxm_state_reset_stats(VitasdkGxmState *state)
+{
+	state->stats.submitted = 0;
+	state->stats.elided    = 0;
+	state->stats.draws     = 0;
+}
+
+/* Shadow a scalar, return whether the context must be updated */
+static inline SceBool _vitasdk_gxm_state_update(VitasdkGxmState *state, SceUInt32 index, uintptr_t value)
+{
+	if ((state->valid & (1u << index)) && state->values[index] == value) {
+		state->stats.elided++;
+		return SCE_FALSE;
+	}
+	state->valid |= 1u << index;
+	state->values[index] = value;
+	state->stats.submitted++;
+	return SCE_TRUE;
+}
+
+static inline SceBool _vitasdk_gxm_state_update_texture(VitasdkGxmState *state, SceGxmTexture *shadow, SceUInt32 *valid, unsigned int index, const SceGxmTexture *texture)
+{
+	if ((*valid & (1u << index)) && __builtin_memcmp(&shadow[index], texture, sizeof(SceGxmTexture)) == 0) {
+		state->stats.elided++;
+		return SCE_FALSE;
+	}
+	*valid |= 1u << index;
+	shadow[index] = *texture;
+	state->stats.submitted++;
+	return SCE_TRUE;
+}
+
+static inline void vitasdk_gxm_set_vertex_program(VitasdkGxmState *state, const SceGxmVertexProgram *program)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_VERTEX_PROGRAM, (uintptr_t)program))
+		sceGxmSetVertexProgram(state->context, program);
+}
+
+static inline void vitasdk_gxm_set_fragment_program(VitasdkGxmState *state, const SceGxmFragmentProgram *program)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_FRAGMENT_PROGRAM, (uintptr_t)program))
+		sceGxmSetFragmentProgram(state->context, program);
+}
+
+static inline int vitasdk_gxm_set_vertex_default_uniform_buffer(VitasdkGxmState *state, const void *buffer)
+{
+	if (!_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_VERTEX_UNIFORMS, (uintptr_t)buffer))
+		return 0;
+	return sceGxmSetVertexDefaultUniformBuffer(state->context, buffer);
+}
+
+static inline int vitasdk_gxm_set_fragment_default_uniform_buffer(VitasdkGxmState *state, const void *buffer)
+{
+	if (!_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_FRAGMENT_UNIFORMS, (uintptr_t)buffer))
+		return 0;
+	return sceGxmSetFragmentDefaultUniformBuffer(state->context, buffer);
+}
+
+static inline int vitasdk_gxm_set_fragment_texture(VitasdkGxmState *state, unsigned int index, const SceGxmTexture *texture)
+{
+	if (index >= SCE_GXM_MAX_TEXTURE_UNITS)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	if (!_vitasdk_gxm_state_update_texture(state, state->fragment_textures, &state->fragment_texture_valid, index, texture))
+		return 0;
+	return sceGxmSetFragmentTexture(state->context, index, texture);
+}
+
+static inline int vitasdk_gxm_set_vertex_texture(VitasdkGxmState *state, unsigned int index, const SceGxmTexture *texture)
+{
+	if (index >= SCE_GXM_MAX_TEXTURE_UNITS)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	if (!_vitasdk_gxm_state_update_texture(state, state->vertex_textures, &state->vertex_texture_valid, index, texture))
+		return 0;
+	return sceGxmSetVertexTexture(state->context, index, texture);
+}
+
+static inline int vitasdk_gxm_set_vertex_stream(VitasdkGxmState *state, unsigned int index, const void *data)
+{
+	if (index >= SCE_GXM_MAX_VERTEX_STREAMS)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	if ((state->stream_valid & (1u << index)) && state->streams[index] == data) {
+		state->stats.elided++;
+		return 0;
+	}
+	state->stream_valid |= 1u << index;
+	state->streams[index] = data;
+	state->stats.submitted++;
+	return sceGxmSetVertexStream(state->context, index, data);
+}
+
+static inline void vitasdk_gxm_set_front_depth_func(VitasdkGxmState *state, SceGxmDepthFunc func)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_FRONT_DEPTH_FUNC, func))
+		sceGxmSetFrontDepthFunc(state->context, func);
+}
+
+static inline void vitasdk_gxm_set_back_depth_func(VitasdkGxmState *state, SceGxmDepthFunc func)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_BACK_DEPTH_FUNC, func))
+		sceGxmSetBackDepthFunc(state->context, func);
+}
+
+static inline void vitasdk_gxm_set_front_depth_write_enable(VitasdkGxmState *state, SceGxmDepthWriteMode enable)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_FRONT_DEPTH_WRITE, enable))
+		sceGxmSetFrontDepthWriteEnable(state->context, enable);
+}
+
+static inline void vitasdk_gxm_set_back_depth_write_enable(VitasdkGxmState *state, SceGxmDepthWriteMode enable)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_BACK_DEPTH_WRITE, enable))
+		sceGxmSetBackDepthWriteEnable(state->context, enable);
+}
+
+static inline void vitasdk_gxm_set_front_polygon_mode(VitasdkGxmState *state, SceGxmPolygonMode mode)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_FRONT_POLYGON_MODE, mode))
+		sceGxmSetFrontPolygonMode(state->context, mode);
+}
+
+static inline void vitasdk_gxm_set_back_polygon_mode(VitasdkGxmState *state, SceGxmPolygonMode mode)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_BACK_POLYGON_MODE, mode))
+		sceGxmSetBackPolygonMode(state->context, mode);
+}
+
+static inline void vitasdk_gxm_set_front_stencil_ref(VitasdkGxmState *state, unsigned int sref)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_FRONT_STENCIL_REF, sref))
+		sceGxmSetFrontStencilRef(state->context, sref);
+}
+
+static inline void vitasdk_gxm_set_back_stencil_ref(VitasdkGxmState *state, unsigned int sref)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_BACK_STENCIL_REF, sref))
+		sceGxmSetBackStencilRef(state->context, sref);
+}
+
+static inline void vitasdk_gxm_set_cull_mode(VitasdkGxmState *state, SceGxmCullMode mode)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_CULL_MODE, mode))
+		sceGxmSetCullMode(state->context, mode);
+}
+
+static inline void vitasdk_gxm_set_two_sided_enable(VitasdkGxmState *state, SceGxmTwoSidedMode enable)
+{
+	if (_vitasdk_gxm_state_update(state, _VITASDK_GXM_STATE_TWO_SIDED, enable))
+		sceGxmSetTwoSidedEnable(state->context, enable);
+}
+
+static inline int vitasdk_gxm_draw(VitasdkGxmState *state, SceGxmPrimitiveType primitive, SceGxmIndexFormat index_format, const void *indices, unsigned int index_count)
+{
+	state->stats.draws++;
+	return sceGxmDraw(state->context, primitive, index_format, indices, index_count);
+}
+
+/** A draw with all its state, NULL pointers leave the context state as is */
+typedef struct VitasdkGxmDraw {
+	SceUInt32 sort_key;
+	const SceGxmVertexProgram *vertex_program;
+	const SceGxmFragmentProgram *fragment_program;
+	const SceGxmTexture *textures[VITASDK_GXM_DRAW_TEXTURES];
+	const void *streams[VITASDK_GXM_DRAW_STREAMS];
+	const void *vertex_uniforms;
+	const void *fragment_uniforms;
+	SceGxmDepthFunc depth_func;        //!< Front depth function
+	SceGxmDepthWriteMode depth_write;  //!< Front depth write mode
+	SceGxmCullMode cull_mode;
+	SceGxmPrimitiveType primitive;
+	SceGxmIndexFormat index_format;
+	const void *indices;
+	unsigned int index_count;
+} VitasdkGxmDraw;
+
+typedef struct VitasdkGxmRecorder {
+	VitasdkGxmState *state;
+	VitasdkGxmDraw *draws;
+	SceUInt32 *order;       //!< 2 * capacity indices
+	SceUInt32 capacity;
+	SceUInt32 count;
+} VitasdkGxmRecorder;
+
+/**
+ * @brief vitasdk_gxm_recorder_init - Initialize a draw recorder
+ * @param rec - The recorder
+ * @param state - The state filter the draws are submitted through
+ * @param draws - Storage for `capacity` draws
+ * @param order - Storage for 2 * `capacity` indices
+ * @param capacity - The number of draws of a flush
+ */
+static inline void vitasdk_gxm_recorder_init(VitasdkGxmRecorder *rec, VitasdkGxmState *state, VitasdkGxmDraw *draws, SceUInt32 *order, SceUInt32 capacity)
+{
+	rec->state    = state;
+	rec->draws    = draws;
+	rec->order    = order;
+	rec->capacity = capacity;
+	rec->count    = 0;
+}
+
+/**
+ * @brief vitasdk_gxm_recorder_add - Record a draw
+ * @param rec - The recorder
+ * @return The draw to fill, NULL if the recorder must be flushed first.
+ */
+static inline VitasdkGxmDraw *vitasdk_gxm_recorder_add(VitasdkGxmRecorder *rec)
+{
+	VitasdkGxmDraw *d;
+	SceUInt32 i;
+
+	if (rec->count == rec->capacity)
+		return NULL;
+
+	d = &rec->draws[rec->count++];
+	d->sort_key         = 0;
+	d->vertex_program   = NULL;
+	d->fragment_program = NULL;
+	for (i = 0; i < VITASDK_GXM_DRAW_TEXTURES; i++)
+		d->textures[i] = NULL;
+	for (i = 0; i < VITASDK_GXM_DRAW_STREAMS; i++)
+		d->streams[i] = NULL;
+	d->vertex_uniforms   = NULL;
+	d->fragment_uniforms = NULL;
+	d->depth_func        = SCE_GXM_DEPTH_FUNC_LESS_EQUAL;
+	d->depth_write       = SCE_GXM_DEPTH_WRITE_ENABLED;
+	d->cull_mode         = SCE_GXM_CULL_NONE;
+	return d;
+}
+
+/* Stable radix sort of the draw indices by key, returns the sorted array */
+static inline SceUInt32 *_vitasdk_gxm_recorder_sort(VitasdkGxmRecorder *rec)
+{
+	SceUInt32 count[256];
+	SceUInt32 *src = rec->order, *dst = rec->order + rec->capacity, *tmp;
+	SceUInt32 i, shift, digit, sum, n = rec->count;
+
+	for (i = 0; i < n; i++)
+		src[i] = i;
+
+	for (shift = 0; shift < 32; shift += 8) {
+		for (i = 0; i < 256; i++)
+			count[i] = 0;
+		for (i = 0; i < n; i++)
+			count[(rec->draws[i].sort_key >> shift) & 0xFF]++;
+		/* Keys sharing this byte are already in order */
+		if (count[(rec->draws[0].sort_key >> shift) & 0xFF] == n)
+			continue;
+		for (i = 0, sum = 0; i < 256; i++) {
+			digit    = count[i];
+			count[i] = sum;
+			sum     += digit;
+		}
+		for (i = 0; i < n; i++)
+			dst[count[(rec->draws[src[i]].sort_key >> shift) & 0xFF]++] = src[i];
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	return src;
+}
+
+static inline int _vitasdk_gxm_recorder_submit(VitasdkGxmState *state, const VitasdkGxmDraw *d)
+{
+	SceUInt32 i;
+	int res;
+
+	if (d->vertex_program)
+		vitasdk_gxm_set_vertex_program(state, d->vertex_program);
+	if (d->fragment_program)
+		vitasdk_gxm_set_fragment_program(state, d->fragment_program);
+	for (i = 0; i < VITASDK_GXM_DRAW_TEXTURES; i++) {
+		if (d->textures[i] && (res = vitasdk_gxm_set_fragment_texture(state, i, d->textures[i])) < 0)
+			return res;
+	}
+	for (i = 0; i < VITASDK_GXM_DRAW_STREAMS; i++) {
+		if (d->streams[i] && (res = vitasdk_gxm_set_vertex_stream(state, i, d->streams[i])) < 0)
+			return res;
+	}
+	if (d->vertex_uniforms && (res = vitasdk_gxm_set_vertex_default_uniform_buffer(state, d->vertex_uniforms)) < 0)
+		return res;
+	if (d->fragment_uniforms && (res = vitasdk_gxm_set_fragment_default_uniform_buffer(state, d->fragment_uniforms)) < 0)
+		return res;
+	vitasdk_gxm_set_front_depth_func(state, d->depth_func);
+	vitasdk_gxm_set_front_depth_write_enable(state, d->depth_write);
+	vitasdk_gxm_set_cull_mode(state, d->cull_mode);
+	return vitasdk_gxm_draw(state, d->primitive, d->index_format, d->indices, d->index_count);
+}
+
+/**
+ * @brief vitasdk_gxm_recorder_flush - Submit the recorded draws
+ * @param rec - The recorder, in a scene of its context
+ * @param sort - Whether to submit the draws by key instead of in recording order
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_gxm_recorder_flush(VitasdkGxmRecorder *rec, SceBool sort)
+{
+	SceUInt32 i, n = rec->count;
+	SceUInt32 *order = NULL;
+	int res = 0;
+
+	if (n == 0)
+		return 0;
+	if (sort)
+		order = _vitasdk_gxm_recorder_sort(rec);
+	rec->count = 0;
+	for (i = 0; i < n && res >= 0; i++)
+		res = _vitasdk_gxm_recorder_submit(rec->state, &rec->draws[order ? order[i] : i]);
+	return res < 0 ? res : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_GXMSTATE_H_ */
@@ -0,0 +1,16 @@
+#ifndef _VITASDK_INPUT_H_
+#define _VITASDK_INPUT_H_
+
+/* Buttons, touch, camera, motion and location, a lighter alternative to vitasdk.h */
+
+#include <psp2/types.h>
+#include <psp2/camera.h>
+#include <psp2/ctrl.h>
+#include <psp2/gps.h>
+#include <psp2/hid.h>
+#include <psp2/location.h>
+#include <psp2/motion.h>
+#include <psp2/motion_dev.h>
+#include <psp2/touch.h>
+
+#endif /* _VITASDK_INPUT_H_ */
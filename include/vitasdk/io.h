@@ -0,0 +1,14 @@
+#ifndef _VITASDK_IO_H_
+#define _VITASDK_IO_H_
+
+/* File I/O, a lighter alternative to vitasdk.h */
+
+#include <psp2/types.h>
+#include <psp2/fios2kernel.h>
+#include <psp2/fios2kernel02.h>
+#include <psp2/io/devctl.h>
+#include <psp2/io/dirent.h>
+#include <psp2/io/fcntl.h>
+#include <psp2/io/stat.h>
+
+#endif /* _VITASDK_IO_H_ */
@@ -0,0 +1,648 @@
+#ifndef _VITASDK_JOBS_H_
+#define _VITASDK_JOBS_H_
+
+/*
+ * Work-stealing job system running jobs on fibers.
+ *
+ * One worker thread is pinned to each user core. Every worker owns a
+ * Chase-Lev deque: it pushes and pops its own jobs at the bottom while the
+ * other workers steal from the top. Jobs submitted from other threads go
+ * through a shared VitasdkMpmcRing.
+ *
+ * Each job runs on a fiber of a fixed pool. A job waiting on a counter
+ * returns its fiber to the worker, which runs other jobs meanwhile and
+ * resumes the fiber once the counter reached zero, instead of blocking the
+ * thread. A thread other than a worker waiting on a counter runs the queued
+ * jobs itself.
+ *
+ *   static void update(void *arg) { ... }
+ *
+ *   VitasdkJob jobs[64];
+ *   VitasdkJobCounter counter = { 0 };
+ *
+ *   for (i = 0; i < 64; i++) {
+ *       jobs[i].func = update;
+ *       jobs[i].arg  = &entities[i];
+ *   }
+ *   vitasdk_jobs_submit(&js, jobs, 64, &counter);
+ *   vitasdk_jobs_wait(&js, &counter);
+ *
+ * The jobs and the counter must stay valid until the counter reached zero.
+ * The application must load SCE_SYSMODULE_FIBER and link SceFiber_stub.
+ */
+
+#include <psp2/types.h>
+#include <psp2/fiber.h>
+#include <psp2/kernel/cpu.h>
+#include <psp2/kernel/error.h>
+#include <psp2/kernel/sysmem.h>
+#include <psp2/kernel/threadmgr/thread.h>
+#include <psp2/kernel/threadmgr/semaphore.h>
+#include <vitasdk/atomic.h>
+#include <vitasdk/ring.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** One worker per user core */
+#define VITASDK_JOBS_MAX_WORKERS (3)
+
+/** Worker index passed to the hooks for a job run by another thread */
+#define VITASDK_JOBS_NO_WORKER (0xFFFFFFFF)
+
+/** How long an idle worker sleeps before looking for jobs again, in microseconds */
+#define VITASDK_JOBS_IDLE_TIMEOUT (1000)
+
+/* Values returned by a fiber to its worker */
+#define _VITASDK_JOB_FIBER_DONE (0)
+#define _VITASDK_JOB_FIBER_WAIT (1)
+
+/* Spins of vitasdk_jobs_wait without any job to run before sleeping */
+#define _VITASDK_JOBS_WAIT_SPIN (100)
+
+typedef void (*VitasdkJobFunc)(void *arg);
+
+typedef struct VitasdkJobCounter {
+	volatile SceUInt32 value; //!< Jobs not completed yet
+} VitasdkJobCounter;
+
+typedef struct VitasdkJob {
+	VitasdkJobFunc func;
+	void *arg;
+	VitasdkJobCounter *counter; //!< Set by vitasdk_jobs_submit
+} VitasdkJob;
+
+/** Called around every job, e.g. to feed a profiler */
+typedef void (*VitasdkJobHook)(const VitasdkJob *job, SceUInt32 worker, void *user);
+
+typedef struct VitasdkJobSystemParam {
+	SceUInt32 workers;          //!< Number of workers, at most VITASDK_JOBS_MAX_WORKERS
+	int priority;               //!< Priority of the worker threads
+	SceSize thread_stack_size;  //!< Stack of the worker threads
+	SceUInt32 fibers;           //!< Number of fibers, bounds the number of jobs running or waiting at once
+	SceSize fiber_stack_size;   //!< Stack of each fiber
+	SceUInt32 deque_size;       //!< Capacity of each worker deque, a power of two
+	SceUInt32 queue_size;       //!< Capacity of the queue of the other threads, a power of two
+	VitasdkJobHook on_job_begin;
+	VitasdkJobHook on_job_end;
+	void *hook_user;            //!< Passed to the hooks
+} VitasdkJobSystemParam;
+
+typedef struct VitasdkJobDeque {
+	/* Written by the thieves */
+	volatile SceUInt32 top VITASDK_CACHE_ALIGNED;
+	/* Written by the owner */
+	volatile SceUInt32 bottom VITASDK_CACHE_ALIGNED;
+	/* Read-only after init */
+	VitasdkJob **jobs VITASDK_CACHE_ALIGNED;
+	SceUInt32 mask;
+} VitasdkJobDeque;
+
+typedef struct VitasdkJobFiber {
+	SceFiber fiber;
+	struct VitasdkJobSystem *system;
+	VitasdkJob *job;
+	VitasdkJobCounter *wait_counter;
+	SceUInt32 worker;
+} VitasdkJobFiber;
+
+typedef struct VitasdkJobWorker {
+	VitasdkJobDeque deque;
+	struct VitasdkJobSystem *system;
+	VitasdkJobFiber *current; //!< The fiber run by the worker, NULL between jobs
+	SceUID thid;
+	SceUInt32 index;
+	/* Statistics, only written by the worker */
+	volatile SceUInt32 jobs_run;
+	volatile SceUInt32 jobs_stolen;
+} VitasdkJobWorker;
+
+typedef struct VitasdkJobSystem {
+	VitasdkJobWorker workers[VITASDK_JOBS_MAX_WORKERS];
+	VitasdkMpmcRing queue;
+	VitasdkMpmcRing free_fibers;
+	VitasdkMpmcRing waiting_fibers;
+	VitasdkJobSystemParam param;
+	VitasdkJobFiber *fibers;
+	SceUID memblock;
+	SceUID idle_sema;
+	volatile SceUInt32 idle;
+	volatile SceUInt32 quit;
+} VitasdkJobSystem;
+
+static inline void vitasdk_jobs_param_init(VitasdkJobSystemParam *param)
+{
+	param->workers           = VITASDK_JOBS_MAX_WORKERS;
+	param->priority          = 0x10000100;
+	param->thread_stack_size = 0x4000;
+	param->fibers            = 32;
+	param->fiber_stack_size  = 0x4000;
+	param->deque_size        = 256;
+	param->queue_size        = 256;
+	param->on_job_begin      = NULL;
+	param->on_job_end        = NULL;
+	param->hook_user         = NULL;
+}
+
+/* Push a job at the bottom, from the owner only */
+static inline SceBool _vitasdk_job_deque_push(VitasdkJobDeque *deque, VitasdkJob *job)
+{
+	SceUInt32 bottom = deque->bottom;
+
+	if (bottom - vitasdk_atomic_load_acquire32(&deque->top) > deque->mask)
+		return SCE_FALSE;
+	deque->jobs[bottom & deque->mask] = job;
+	vitasdk_atomic_store_release32(&deque->bottom, bottom + 1);
+	return SCE_TRUE;
+}
+
+/* Pop a job from the bottom, from the owner only */
+static inline VitasdkJob *_vitasdk_job_deque_pop(VitasdkJobDeque *deque)
+{
+	SceUInt32 bottom = deque->bottom - 1, top;
+	VitasdkJob *job;
+
+	vitasdk_atomic_store32(&deque->bottom, bottom);
+	vitasdk_atomic_fence();
+	top = vitasdk_atomic_load32(&deque->top);
+	if ((SceInt32)(bottom - top) < 0) {
+		vitasdk_atomic_store32(&deque->bottom, bottom + 1);
+		return NULL;
+	}
+	job = deque->jobs[bottom & deque->mask];
+	if (bottom == top) {
+		/* Last job, race the thieves for it */
+		if (!vitasdk_atomic_cas32(&deque->top, top, top + 1))
+			job = NULL;
+		vitasdk_atomic_fence();
+		vitasdk_atomic_store32(&deque->bottom, bottom + 1);
+	}
+	return job;
+}
+
+/* Steal a job from the top, from any thread */
+static inline VitasdkJob *_vitasdk_job_deque_steal(VitasdkJobDeque *deque)
+{
+	SceUInt32 top = vitasdk_atomic_load_acquire32(&deque->top), bottom;
+	VitasdkJob *job;
+
+	vitasdk_atomic_fence();
+	bottom = vitasdk_atomic_load_acquire32(&deque->bottom);
+	if ((SceInt32)(bottom - top) <= 0)
+		return NULL;
+	job = deque->jobs[top & deque->mask];
+	vitasdk_atomic_fence();
+	if (!vitasdk_atomic_cas32(&deque->top, top, top + 1))
+		return NULL;
+	vitasdk_atomic_fence_acquire();
+	return job;
+}
+
+/* The worker run by the calling thread, NULL for another thread */
+static inline VitasdkJobWorker *_vitasdk_jobs_current_worker(VitasdkJobSystem *js)
+{
+	SceUID thid = sceKernelGetThreadId();
+	SceUInt32 i;
+
+	for (i = 0; i < js->param.workers; i++) {
+		if (js->workers[i].thid == thid)
+			return &js->workers[i];
+	}
+	return NULL;
+}
+
+/* Call the begin hook and run a job on the calling fiber or thread */
+static inline void _vitasdk_jobs_begin(VitasdkJobSystem *js, VitasdkJob *job, SceUInt32 worker)
+{
+	if (js->param.on_job_begin)
+		js->param.on_job_begin(job, worker, js->param.hook_user);
+	job->func(job->arg);
+}
+
+/* Call the end hook and complete a job, `worker` being the one running it now */
+static inline void _vitasdk_jobs_end(VitasdkJobSystem *js, VitasdkJob *job, VitasdkJobCounter *counter, SceUInt32 worker)
+{
+	if (js->param.on_job_end)
+		js->param.on_job_end(job, worker, js->param.hook_user);
+	/* The job may be freed once the counter reached zero */
+	if (counter) {
+		vitasdk_atomic_fence_release();
+		vitasdk_atomic_add32(&counter->value, (SceUInt32)-1);
+	}
+}
+
+/* Run a job on the calling thread and complete it */
+static inline void _vitasdk_jobs_execute(VitasdkJobSystem *js, VitasdkJob *job, SceUInt32 worker)
+{
+	VitasdkJobCounter *counter = job->counter;
+
+	_vitasdk_jobs_begin(js, job, worker);
+	_vitasdk_jobs_end(js, job, counter, worker);
+}
+
+static inline void _vitasdk_job_fiber_entry(SceUInt32 argOnInitialize, SceUInt32 argOnRun)
+{
+	VitasdkJobFiber *fiber = (VitasdkJobFiber *)(uintptr_t)argOnInitialize;
+
+	for (;;) {
+		VitasdkJob *job = fiber->job;
+		VitasdkJobCounter *counter = job->counter;
+
+		_vitasdk_jobs_begin(fiber->system, job, fiber->worker);
+		/* The fiber may have waited and been resumed by another worker */
+		_vitasdk_jobs_end(fiber->system, job, counter, fiber->worker);
+		fiber->job = NULL;
+		sceFiberReturnToThread(_VITASDK_JOB_FIBER_DONE, &argOnRun);
+	}
+}
+
+/* Find a job for a worker, or for another thread if `worker` is NULL */
+static inline VitasdkJob *_vitasdk_jobs_find(VitasdkJobSystem *js, VitasdkJobWorker *worker)
+{
+	VitasdkJob *job = NULL;
+	SceUInt32 first = 0, i;
+
+	if (worker) {
+		job = _vitasdk_job_deque_pop(&worker->deque);
+		if (job)
+			return job;
+		first = worker->index + 1;
+	}
+	if (vitasdk_mpmc_ring_pop(&js->queue, (void **)&job))
+		return job;
+	for (i = 0; i < js->param.workers; i++) {
+		VitasdkJobWorker *victim = &js->workers[(first + i) % js->param.workers];
+		if (victim == worker)
+			continue;
+		job = _vitasdk_job_deque_steal(&victim->deque);
+		if (job) {
+			/* Only the worker writes its statistics */
+			if (worker)
+				vitasdk_atomic_store_release32(&worker->jobs_stolen, worker->jobs_stolen + 1);
+			return job;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Put a fiber back in a ring. The rings have twice as many cells as there
+ * are fibers, but a push may still fail while a consumer has claimed the
+ * cell ahead and not drained it yet: retry until it goes through.
+ */
+static inline void _vitasdk_jobs_put_fiber(VitasdkMpmcRing *ring, VitasdkJobFiber *fiber)
+{
+	SceUInt32 spin = 0;
+
+	while (!vitasdk_mpmc_ring_push(ring, fiber)) {
+		if (++spin < _VITASDK_JOBS_WAIT_SPIN)
+			vitasdk_cpu_relax();
+		else
+			sceKernelDelayThread(100);
+	}
+}
+
+/* Run a fiber until its job completes or waits */
+static inline void _vitasdk_jobs_run_fiber(VitasdkJobWorker *worker, VitasdkJobFiber *fiber)
+{
+	VitasdkJobSystem *js = worker->system;
+	SceUInt32 ret = _VITASDK_JOB_FIBER_DONE;
+
+	fiber->worker   = worker->index;
+	worker->current = fiber;
+	sceFiberRun(&fiber->fiber, 0, &ret);
+	worker->current = NULL;
+	if (ret == _VITASDK_JOB_FIBER_WAIT)
+		_vitasdk_jobs_put_fiber(&js->waiting_fibers, fiber);
+	else
+		_vitasdk_jobs_put_fiber(&js->free_fibers, fiber);
+}
+
+/* Resume the oldest waiting fiber if its counter reached zero */
+static inline SceBool _vitasdk_jobs_resume(VitasdkJobWorker *worker)
+{
+	VitasdkJobSystem *js = worker->system;
+	VitasdkJobFiber *fiber;
+
+	if (!vitasdk_mpmc_ring_pop(&js->waiting_fibers, (void **)&fiber))
+		return SCE_FALSE;
+	if (vitasdk_atomic_load_acquire32(&fiber->wait_counter->value) != 0) {
+		_vitasdk_jobs_put_fiber(&js->waiting_fibers, fiber);
+		return SCE_FALSE;
+	}
+	fiber->wait_counter = NULL;
+	_vitasdk_jobs_run_fiber(worker, fiber);
+	return SCE_TRUE;
+}
+
+static inline void _vitasdk_jobs_run(VitasdkJobWorker *worker, VitasdkJob *job)
+{
+	VitasdkJobSystem *js = worker->system;
+	VitasdkJobFiber *fiber;
+
+	if (vitasdk_mpmc_ring_pop(&js->free_fibers, (void **)&fiber)) {
+		fiber->job = job;
+		_vitasdk_jobs_run_fiber(worker, fiber);
+	} else {
+		/* Every fiber is busy, run the job on the worker thread */
+		_vitasdk_jobs_execute(js, job, worker->index);
+	}
+	vitasdk_atomic_store_release32(&worker->jobs_run, worker->jobs_run + 1);
+}
+
+static inline int _vitasdk_jobs_worker_entry(SceSize args, void *argp)
+{
+	VitasdkJobWorker *worker = *(VitasdkJobWorker **)argp;
+	VitasdkJobSystem *js = worker->system;
+	VitasdkJob *job;
+	SceUInt timeout;
+
+	(void)args;
+	while (!vitasdk_atomic_load_acquire32(&js->quit)) {
+		if (_vitasdk_jobs_resume(worker))
+			continue;
+		job = _vitasdk_jobs_find(js, worker);
+		if (!job) {
+			/* Look again once counted as idle, a submitter may have missed us */
+			vitasdk_atomic_add32(&js->idle, 1);
+			job = _vitasdk_jobs_find(js, worker);
+			if (!job) {
+				timeout = VITASDK_JOBS_IDLE_TIMEOUT;
+				sceKernelWaitSema(js->idle_sema, 1, &timeout);
+			}
+			vitasdk_atomic_add32(&js->idle, (SceUInt32)-1);
+		}
+		if (job)
+			_vitasdk_jobs_run(worker, job);
+	}
+	return 0;
+}
+
+static inline SceSize _vitasdk_jobs_align(SceSize size, SceSize align)
+{
+	return (size + align - 1) & ~(align - 1);
+}
+
+static inline SceUInt32 _vitasdk_jobs_pow2(SceUInt32 n)
+{
+	SceUInt32 pow2 = 2;
+
+	while (pow2 < n)
+		pow2 <<= 1;
+	return pow2;
+}
+
+/**
+ * @brief vitasdk_jobs_destroy - Stop the workers and free a job system
+ * @param js - The job system, with no job queued, running or waiting
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_jobs_destroy(VitasdkJobSystem *js)
+{
+	SceUInt32 i;
+
+	vitasdk_atomic_store_release32(&js->quit, 1);
+	if (js->idle_sema >= 0)
+		sceKernelSignalSema(js->idle_sema, js->param.workers);
+	for (i = 0; i < js->param.workers; i++) {
+		if (js->workers[i].thid < 0)
+			continue;
+		sceKernelWaitThreadEnd(js->workers[i].thid, NULL, NULL);
+		sceKernelDeleteThread(js->workers[i].thid);
+		js->workers[i].thid = -1;
+	}
+	if (js->idle_sema >= 0)
+		sceKernelDeleteSema(js->idle_sema);
+	js->idle_sema = -1;
+	if (js->fibers) {
+		for (i = 0; i < js->param.fibers; i++)
+			sceFiberFinalize(&js->fibers[i].fiber);
+		js->fibers = NULL;
+	}
+	if (js->memblock >= 0)
+		sceKernelFreeMemBlock(js->memblock);
+	js->memblock = -1;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_jobs_create - Create a job system and start its workers
+ *
+ * The fiber stacks, the deques and the rings are allocated from one
+ * SCE_KERNEL_MEMBLOCK_TYPE_USER_RW block.
+ *
+ * @param js - The job system
+ * @param param - The parameters, NULL for the defaults of vitasdk_jobs_param_init
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_jobs_create(VitasdkJobSystem *js, const VitasdkJobSystemParam *param)
+{
+	SceSize stack_size, size, fibers_offset, deques_offset, cells_offset;
+	SceUInt32 fiber_cells, i;
+	VitasdkRingCell *cells;
+	char *base;
+	int res;
+
+	if (param)
+		js->param = *param;
+	else
+		vitasdk_jobs_param_init(&js->param);
+	js->memblock  = -1;
+	js->idle_sema = -1;
+	js->fibers    = NULL;
+	js->idle      = 0;
+	js->quit      = 0;
+	for (i = 0; i < VITASDK_JOBS_MAX_WORKERS; i++)
+		js->workers[i].thid = -1;
+
+	if (js->param.workers == 0 || js->param.workers > VITASDK_JOBS_MAX_WORKERS || js->param.fibers == 0)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	res = _vitasdk_ring_check_capacity(js->param.deque_size);
+	if (res < 0)
+		return res;
+	res = _vitasdk_ring_check_capacity(js->param.queue_size);
+	if (res < 0)
+		return res;
+
+	/* Fiber stacks, fibers, deque slots then ring cells */
+	fiber_cells   = _vitasdk_jobs_pow2(js->param.fibers * 2);
+	stack_size    = _vitasdk_jobs_align(js->param.fiber_stack_size, 8);
+	fibers_offset = stack_size * js->param.fibers;
+	deques_offset = fibers_offset + sizeof(VitasdkJobFiber) * js->param.fibers;
+	cells_offset  = _vitasdk_jobs_align(deques_offset + sizeof(VitasdkJob *) * js->param.deque_size * js->param.workers, 8);
+	size          = cells_offset + sizeof(VitasdkRingCell) * (js->param.queue_size + fiber_cells * 2);
+
+	js->memblock = sceKernelAllocMemBlock("VitasdkJobSystem", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW,
+	                                      _vitasdk_jobs_align(size, 0x1000), NULL);
+	if (js->memblock < 0)
+		return js->memblock;
+	res = sceKernelGetMemBlockBase(js->memblock, (void **)&base);
+	if (res < 0)
+		goto error;
+
+	cells = (VitasdkRingCell *)(base + cells_offset);
+	vitasdk_mpmc_ring_init(&js->queue, cells, js->param.queue_size);
+	cells += js->param.queue_size;
+	vitasdk_mpmc_ring_init(&js->free_fibers, cells, fiber_cells);
+	cells += fiber_cells;
+	vitasdk_mpmc_ring_init(&js->waiting_fibers, cells, fiber_cells);
+
+	js->fibers = (VitasdkJobFiber *)(base + fibers_offset);
+	for (i = 0; i < js->param.fibers; i++) {
+		VitasdkJobFiber *fiber = &js->fibers[i];
+
+		fiber->system       = js;
+		fiber->job          = NULL;
+		fiber->wait_counter = NULL;
+		fiber->worker       = VITASDK_JOBS_NO_WORKER;
+		res = _sceFiberInitializeImpl(&fiber->fiber, (char *)"VitasdkJobFiber", _vitasdk_job_fiber_entry,
+		                              (SceUInt32)(uintptr_t)fiber, base + stack_size * i, stack_size, NULL);
+		if (res < 0) {
+			/* Only finalize the fibers initialized so far */
+			js->param.fibers = i;
+			goto error;
+		}
+		_vitasdk_jobs_put_fiber(&js->free_fibers, fiber);
+	}
+
+	js->idle_sema = sceKernelCreateSema("VitasdkJobIdle", SCE_KERNEL_ATTR_THREAD_FIFO, 0, 0x7FFF, NULL);
+	if (js->idle_sema < 0) {
+		res = js->idle_sema;
+		goto error;
+	}
+
+	for (i = 0; i < js->param.workers; i++) {
+		VitasdkJobWorker *worker = &js->workers[i];
+
+		worker->deque.top    = 0;
+		worker->deque.bottom = 0;
+		worker->deque.jobs   = (VitasdkJob **)(base + deques_offset) + js->param.deque_size * i;
+		worker->deque.mask   = js->param.deque_size - 1;
+		worker->system       = js;
+		worker->current      = NULL;
+		worker->index        = i;
+		worker->jobs_run     = 0;
+		worker->jobs_stolen  = 0;
+	}
+	for (i = 0; i < js->param.workers; i++) {
+		VitasdkJobWorker *worker = &js->workers[i];
+		SceUID thid = sceKernelCreateThread("VitasdkJobWorker", _vitasdk_jobs_worker_entry, js->param.priority,
+		                                    js->param.thread_stack_size, 0, SCE_KERNEL_CPU_MASK_USER_0 << i, NULL);
+		if (thid < 0) {
+			res = thid;
+			goto error;
+		}
+		worker->thid = thid;
+		res = sceKernelStartThread(thid, sizeof(worker), &worker);
+		if (res < 0) {
+			sceKernelDeleteThread(thid);
+			worker->thid = -1;
+			goto error;
+		}
+	}
+	return 0;
+
+error:
+	vitasdk_jobs_destroy(js);
+	return res;
+}
+
+/**
+ * @brief vitasdk_jobs_submit - Queue jobs
+ *
+ * A worker queues the jobs on its own deque, another thread on the shared
+ * queue. A job which does not fit in either is run right away.
+ *
+ * @param js - The job system
+ * @param jobs - The jobs, valid until `counter` reached zero
+ * @param n - The number of jobs
+ * @param counter - Incremented by `n` and decremented as each job completes, may be NULL
+ */
+static inline void vitasdk_jobs_submit(VitasdkJobSystem *js, VitasdkJob *jobs, SceUInt32 n, VitasdkJobCounter *counter)
+{
+	VitasdkJobWorker *worker = _vitasdk_jobs_current_worker(js);
+	SceUInt32 i, idle;
+
+	if (counter)
+		vitasdk_atomic_add32(&counter->value, n);
+	for (i = 0; i < n; i++) {
+		VitasdkJob *job = &jobs[i];
+
+		job->counter = counter;
+		if (worker && _vitasdk_job_deque_push(&worker->deque, job))
+			continue;
+		if (vitasdk_mpmc_ring_push(&js->queue, job))
+			continue;
+		_vitasdk_jobs_execute(js, job, worker ? worker->index : VITASDK_JOBS_NO_WORKER);
+	}
+
+	vitasdk_atomic_fence();
+	idle = vitasdk_atomic_load32(&js->idle);
+	if (idle != 0)
+		sceKernelSignalSema(js->idle_sema, idle < n ? idle : n);
+}
+
+/**
+ * @brief vitasdk_jobs_wait - Wait until every job of a counter completed
+ *
+ * From a job the fiber is suspended and the worker runs other jobs, it may
+ * be resumed by another worker. From a job run without a fiber, every fiber
+ * being busy, the worker keeps running jobs and resuming fibers while
+ * waiting. From another thread the queued jobs are run by the calling thread
+ * while waiting.
+ *
+ * @param js - The job system
+ * @param counter - The counter passed to vitasdk_jobs_submit
+ */
+static inline void vitasdk_jobs_wait(VitasdkJobSystem *js, VitasdkJobCounter *counter)
+{
+	VitasdkJobWorker *worker;
+	SceUInt32 spin = 0;
+
+	if (vitasdk_atomic_load_acquire32(&counter->value) == 0)
+		return;
+
+	worker = _vitasdk_jobs_current_worker(js);
+	if (worker && worker->current) {
+		VitasdkJobFiber *fiber = worker->current;
+		SceUInt32 arg;
+
+		fiber->wait_counter = counter;
+		sceFiberReturnToThread(_VITASDK_JOB_FIBER_WAIT, &arg);
+		vitasdk_atomic_fence_acquire();
+		return;
+	}
+
+	while (vitasdk_atomic_load_acquire32(&counter->value) != 0) {
+		VitasdkJob *job;
+
+		/*
+		 * A worker waits here from a job run without a fiber: it keeps
+		 * resuming the waiting fibers, which may be the ones it waits for
+		 */
+		if (worker && _vitasdk_jobs_resume(worker)) {
+			spin = 0;
+			continue;
+		}
+		job = _vitasdk_jobs_find(js, worker);
+		if (job) {
+			if (worker)
+				_vitasdk_jobs_run(worker, job);
+			else
+				_vitasdk_jobs_execute(js, job, VITASDK_JOBS_NO_WORKER);
+			spin = 0;
+		} else if (++spin < _VITASDK_JOBS_WAIT_SPIN) {
+			vitasdk_cpu_relax();
+		} else {
+			/* The remaining jobs run on the workers */
+			sceKernelDelayThread(100);
+		}
+	}
+	vitasdk_atomic_fence_acquire();
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_JOBS_H_ */
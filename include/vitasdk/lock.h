@@ -0,0 +1,324 @@
+#ifndef _VITASDK_LOCK_H_
+#define _VITASDK_LOCK_H_
+
+/*
+ * Hybrid locks which only enter the kernel on contention.
+ *
+ * The state of each lock is an atomic word updated with the SceLibKernel
+ * atomics, a semaphore is only waited on or signaled when another thread
+ * holds the lock. An uncontended lock/unlock pair costs two atomic
+ * operations and no syscall.
+ *
+ *   VitasdkMutex  - non-recursive mutex, spins briefly before parking
+ *   VitasdkRWLock - reader/writer lock, writers do not starve
+ *   VitasdkCond   - condition variable used with a VitasdkMutex
+ */
+
+#include <psp2/types.h>
+#include <psp2/kernel/threadmgr/semaphore.h>
+#include <vitasdk/atomic.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** Default number of spins of vitasdk_mutex_lock before parking */
+#define VITASDK_MUTEX_DEFAULT_SPIN (100)
+
+/* More than the number of threads which can wait on a lock */
+#define _VITASDK_LOCK_SEMA_MAX (0x7FFF)
+
+typedef struct VitasdkMutex {
+	volatile SceUInt32 count; //!< Threads holding or waiting for the mutex
+	SceUID sema;
+	SceUInt32 spin;
+} VitasdkMutex;
+
+/**
+ * @brief vitasdk_mutex_create - Create a mutex
+ * @param mutex - The mutex
+ * @param name - The name of the semaphore used for parking
+ * @param spin - The number of spins before parking, e.g. VITASDK_MUTEX_DEFAULT_SPIN
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_mutex_create(VitasdkMutex *mutex, const char *name, SceUInt32 spin)
+{
+	SceUID sema = sceKernelCreateSema(name, SCE_KERNEL_ATTR_THREAD_PRIO, 0, _VITASDK_LOCK_SEMA_MAX, NULL);
+	if (sema < 0)
+		return sema;
+	mutex->count = 0;
+	mutex->sema  = sema;
+	mutex->spin  = spin;
+	return 0;
+}
+
+static inline int vitasdk_mutex_delete(VitasdkMutex *mutex)
+{
+	return sceKernelDeleteSema(mutex->sema);
+}
+
+/**
+ * @brief vitasdk_mutex_trylock - Lock a mutex if it is free
+ * @param mutex - The mutex
+ * @return SCE_TRUE if the mutex was locked
+ */
+static inline SceBool vitasdk_mutex_trylock(VitasdkMutex *mutex)
+{
+	if (vitasdk_atomic_load32(&mutex->count) != 0 || !vitasdk_atomic_cas32(&mutex->count, 0, 1))
+		return SCE_FALSE;
+	vitasdk_atomic_fence_acquire();
+	return SCE_TRUE;
+}
+
+/**
+ * @brief vitasdk_mutex_lock - Lock a mutex
+ * @param mutex - The mutex
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_mutex_lock(VitasdkMutex *mutex)
+{
+	SceUInt32 i;
+	int res = 0;
+
+	for (i = 0; i < mutex->spin; i++) {
+		if (vitasdk_mutex_trylock(mutex))
+			return 0;
+		vitasdk_cpu_relax();
+	}
+	/* Count this thread in, the owner wakes one waiter per unlock */
+	if (vitasdk_atomic_add32(&mutex->count, 1) > 1)
+		res = sceKernelWaitSema(mutex->sema, 1, NULL);
+	vitasdk_atomic_fence_acquire();
+	return res < 0 ? res : 0;
+}
+
+/**
+ * @brief vitasdk_mutex_unlock - Unlock a mutex locked by the calling thread
+ * @param mutex - The mutex
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_mutex_unlock(VitasdkMutex *mutex)
+{
+	vitasdk_atomic_fence_release();
+	if (vitasdk_atomic_add32(&mutex->count, (SceUInt32)-1) != 0)
+		return sceKernelSignalSema(mutex->sema, 1);
+	return 0;
+}
+
+/*
+ * The reader/writer lock status packs three 10 bits counters: the readers
+ * holding the lock, the readers waiting for the writers to leave and the
+ * writers holding or waiting for the lock.
+ */
+#define _VITASDK_RWLOCK_READERS(s)      ((s) & 0x3FF)
+#define _VITASDK_RWLOCK_WAIT_TO_READ(s) (((s) >> 10) & 0x3FF)
+#define _VITASDK_RWLOCK_WRITERS(s)      (((s) >> 20) & 0x3FF)
+#define _VITASDK_RWLOCK_ONE_READER      (1 << 0)
+#define _VITASDK_RWLOCK_ONE_WAIT_TO_READ (1 << 10)
+#define _VITASDK_RWLOCK_ONE_WRITER      (1 << 20)
+
+typedef struct VitasdkRWLock {
+	volatile SceUInt32 status;
+	SceUID read_sema;
+	SceUID write_sema;
+} VitasdkRWLock;
+
+/**
+ * @brief vitasdk_rwlock_create - Create a reader/writer lock
+ * @param lock - The lock
+ * @param name - The name of the semaphores used for parking
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_rwlock_create(VitasdkRWLock *lock, const char *name)
+{
+	SceUID read_sema, write_sema;
+
+	read_sema = sceKernelCreateSema(name, SCE_KERNEL_ATTR_THREAD_PRIO, 0, _VITASDK_LOCK_SEMA_MAX, NULL);
+	if (read_sema < 0)
+		return read_sema;
+	write_sema = sceKernelCreateSema(name, SCE_KERNEL_ATTR_THREAD_PRIO, 0, _VITASDK_LOCK_SEMA_MAX, NULL);
+	if (write_sema < 0) {
+		sceKernelDeleteSema(read_sema);
+		return write_sema;
+	}
+	lock->status     = 0;
+	lock->read_sema  = read_sema;
+	lock->write_sema = write_sema;
+	return 0;
+}
+
+static inline int vitasdk_rwlock_delete(VitasdkRWLock *lock)
+{
+	int res = sceKernelDeleteSema(lock->read_sema);
+	int res2 = sceKernelDeleteSema(lock->write_sema);
+	return res < 0 ? res : res2;
+}
+
+/**
+ * @brief vitasdk_rwlock_lock_read - Lock for reading, shared with the other readers
+ * @param lock - The lock
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_rwlock_lock_read(VitasdkRWLock *lock)
+{
+	SceUInt32 old, status;
+	int res = 0;
+
+	do {
+		old = vitasdk_atomic_load32(&lock->status);
+		/* Queue behind the writers, even waiting ones */
+		if (_VITASDK_RWLOCK_WRITERS(old) != 0)
+			status = old + _VITASDK_RWLOCK_ONE_WAIT_TO_READ;
+		else
+			status = old + _VITASDK_RWLOCK_ONE_READER;
+	} while (!vitasdk_atomic_cas32(&lock->status, old, status));
+
+	if (_VITASDK_RWLOCK_WRITERS(old) != 0)
+		res = sceKernelWaitSema(lock->read_sema, 1, NULL);
+	vitasdk_atomic_fence_acquire();
+	return res < 0 ? res : 0;
+}
+
+static inline int vitasdk_rwlock_unlock_read(VitasdkRWLock *lock)
+{
+	SceUInt32 status;
+
+	vitasdk_atomic_fence_release();
+	status = vitasdk_atomic_add32(&lock->status, (SceUInt32)-_VITASDK_RWLOCK_ONE_READER);
+	/* The last reader lets the first waiting writer in */
+	if (_VITASDK_RWLOCK_READERS(status) == 0 && _VITASDK_RWLOCK_WRITERS(status) != 0)
+		return sceKernelSignalSema(lock->write_sema, 1);
+	return 0;
+}
+
+/**
+ * @brief vitasdk_rwlock_lock_write - Lock for writing, exclusively
+ * @param lock - The lock
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_rwlock_lock_write(VitasdkRWLock *lock)
+{
+	SceUInt32 old;
+	int res = 0;
+
+	old = vitasdk_atomic_add32(&lock->status, _VITASDK_RWLOCK_ONE_WRITER) - _VITASDK_RWLOCK_ONE_WRITER;
+	if (_VITASDK_RWLOCK_READERS(old) != 0 || _VITASDK_RWLOCK_WRITERS(old) != 0)
+		res = sceKernelWaitSema(lock->write_sema, 1, NULL);
+	vitasdk_atomic_fence_acquire();
+	return res < 0 ? res : 0;
+}
+
+static inline int vitasdk_rwlock_unlock_write(VitasdkRWLock *lock)
+{
+	SceUInt32 old, status, wait_to_read;
+
+	vitasdk_atomic_fence_release();
+	do {
+		old = vitasdk_atomic_load32(&lock->status);
+		status = old - _VITASDK_RWLOCK_ONE_WRITER;
+		/* The waiting readers go first, then the next writer */
+		wait_to_read = _VITASDK_RWLOCK_WAIT_TO_READ(old);
+		if (wait_to_read != 0)
+			status = (status & ~(0x3FF << 10 | 0x3FF)) | wait_to_read;
+	} while (!vitasdk_atomic_cas32(&lock->status, old, status));
+
+	if (wait_to_read != 0)
+		return sceKernelSignalSema(lock->read_sema, wait_to_read);
+	if (_VITASDK_RWLOCK_WRITERS(old) > 1)
+		return sceKernelSignalSema(lock->write_sema, 1);
+	return 0;
+}
+
+typedef struct VitasdkCond {
+	volatile SceUInt32 waiters;
+	SceUID sema;
+} VitasdkCond;
+
+/**
+ * @brief vitasdk_cond_create - Create a condition variable
+ * @param cond - The condition variable
+ * @param name - The name of the semaphore used for parking
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_cond_create(VitasdkCond *cond, const char *name)
+{
+	SceUID sema = sceKernelCreateSema(name, SCE_KERNEL_ATTR_THREAD_FIFO, 0, _VITASDK_LOCK_SEMA_MAX, NULL);
+	if (sema < 0)
+		return sema;
+	cond->waiters = 0;
+	cond->sema    = sema;
+	return 0;
+}
+
+static inline int vitasdk_cond_delete(VitasdkCond *cond)
+{
+	return sceKernelDeleteSema(cond->sema);
+}
+
+/* Take one waiter off the count, SCE_FALSE if there was none */
+static inline SceBool _vitasdk_cond_take_waiter(VitasdkCond *cond)
+{
+	SceUInt32 waiters;
+
+	do {
+		waiters = vitasdk_atomic_load32(&cond->waiters);
+		if (waiters == 0)
+			return SCE_FALSE;
+	} while (!vitasdk_atomic_cas32(&cond->waiters, waiters, waiters - 1));
+	return SCE_TRUE;
+}
+
+/**
+ * @brief vitasdk_cond_wait - Unlock a mutex and wait for a signal, then lock the mutex again
+ *
+ * Like any condition variable, wake ups may be spurious and the condition
+ * must be checked again.
+ *
+ * @param cond - The condition variable
+ * @param mutex - The mutex, locked by the calling thread
+ * @param timeout - Timeout in microseconds, NULL to wait forever
+ * @return 0 on success, SCE_KERNEL_ERROR_WAIT_TIMEOUT on timeout, < 0 on error.
+ */
+static inline int vitasdk_cond_wait(VitasdkCond *cond, VitasdkMutex *mutex, SceUInt *timeout)
+{
+	int res, res2;
+
+	vitasdk_atomic_add32(&cond->waiters, 1);
+	vitasdk_mutex_unlock(mutex);
+	res = sceKernelWaitSema(cond->sema, 1, timeout);
+	/* On timeout, leave the waiters or consume the signal already sent to this thread */
+	if (res < 0 && !_vitasdk_cond_take_waiter(cond))
+		sceKernelPollSema(cond->sema, 1);
+	res2 = vitasdk_mutex_lock(mutex);
+	return res < 0 ? res : res2;
+}
+
+/**
+ * @brief vitasdk_cond_signal - Wake up one waiting thread
+ * @param cond - The condition variable
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_cond_signal(VitasdkCond *cond)
+{
+	if (!_vitasdk_cond_take_waiter(cond))
+		return 0;
+	return sceKernelSignalSema(cond->sema, 1);
+}
+
+/**
+ * @brief vitasdk_cond_broadcast - Wake up every waiting thread
+ * @param cond - The condition variable
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_cond_broadcast(VitasdkCond *cond)
+{
+	SceUInt32 waiters = vitasdk_atomic_exchange32(&cond->waiters, 0);
+	if (waiters == 0)
+		return 0;
+	return sceKernelSignalSema(cond->sema, (int)waiters);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_LOCK_H_ */
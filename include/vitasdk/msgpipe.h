@@ -0,0 +1,239 @@
+#ifndef _VITASDK_MSGPIPE_H_
+#define _VITASDK_MSGPIPE_H_
+
+/*
+ * Batched message pipe transfers.
+ *
+ * A message pipe is a byte stream, the messages of a batch have a fixed
+ * size so that any batch boundary on the receiving side falls between two
+ * messages. Each batch of up to VITASDK_MSGPIPE_MAX_VECTOR messages costs a
+ * single sceKernel*MsgPipeVector syscall instead of one per message.
+ *
+ * For large payloads the zero-copy helpers send buffer handles, i.e. the
+ * pointers to buffers owned by the process, so only 4 bytes per message go
+ * through the pipe. The receiver owns a buffer once its handle is received.
+ *
+ * A VitasdkMsgPipe may have any number of senders and receivers. A batch of
+ * more than VITASDK_MSGPIPE_MAX_VECTOR messages takes several syscalls, and
+ * the kernel is not known to keep a vectored transfer in one piece when it
+ * does not fit in the free space of the pipe. So the senders hold a
+ * VitasdkMutex across the syscalls of each transfer, and the receivers hold
+ * another one. These mutexes only enter the kernel when two senders, or two
+ * receivers, meet. Every sender must go through these helpers.
+ */
+
+#include <psp2/types.h>
+#include <psp2/kernel/error.h>
+#include <psp2/kernel/threadmgr/msgpipe.h>
+#include <vitasdk/lock.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** Messages sent or received per syscall */
+#define VITASDK_MSGPIPE_MAX_VECTOR (16)
+
+typedef struct VitasdkMsgPipe {
+	SceUID uid;
+	VitasdkMutex send_lock;    //!< Keeps the transfers of each sender in one piece
+	VitasdkMutex receive_lock; //!< Keeps the transfers of each receiver in one piece
+} VitasdkMsgPipe;
+
+/**
+ * @brief vitasdk_msgpipe_delete - Delete a pipe and its locks
+ * @param pipe - The pipe, without any sender or receiver left
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_msgpipe_delete(VitasdkMsgPipe *pipe)
+{
+	int res = 0;
+
+	if (pipe->uid >= 0)
+		res = sceKernelDeleteMsgPipe(pipe->uid);
+	if (pipe->send_lock.sema >= 0)
+		vitasdk_mutex_delete(&pipe->send_lock);
+	if (pipe->receive_lock.sema >= 0)
+		vitasdk_mutex_delete(&pipe->receive_lock);
+	pipe->uid               = -1;
+	pipe->send_lock.sema    = -1;
+	pipe->receive_lock.sema = -1;
+	return res;
+}
+
+/**
+ * @brief vitasdk_msgpipe_create - Create a pipe and its locks
+ * @param pipe - The pipe
+ * @param name - The name of the pipe and of its semaphores
+ * @param type - The memory type of the pipe buffer, see sceKernelCreateMsgPipe
+ * @param attr - The attributes of the pipe, see sceKernelCreateMsgPipe
+ * @param size - The size of the pipe buffer
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_msgpipe_create(VitasdkMsgPipe *pipe, const char *name, int type, int attr, unsigned int size)
+{
+	int res;
+
+	pipe->send_lock.sema    = -1;
+	pipe->receive_lock.sema = -1;
+	pipe->uid = sceKernelCreateMsgPipe(name, type, attr, size, NULL);
+	if (pipe->uid < 0)
+		return pipe->uid;
+	res = vitasdk_mutex_create(&pipe->send_lock, name, VITASDK_MUTEX_DEFAULT_SPIN);
+	if (res < 0)
+		goto error;
+	res = vitasdk_mutex_create(&pipe->receive_lock, name, VITASDK_MUTEX_DEFAULT_SPIN);
+	if (res < 0)
+		goto error;
+	return 0;
+
+error:
+	vitasdk_msgpipe_delete(pipe);
+	return res;
+}
+
+static inline SceUInt32 _vitasdk_msgpipe_vector(SceKernelMsgPipeVector *v, void *const *messages, SceSize size, SceUInt32 n)
+{
+	SceUInt32 i;
+
+	if (n > VITASDK_MSGPIPE_MAX_VECTOR)
+		n = VITASDK_MSGPIPE_MAX_VECTOR;
+	for (i = 0; i < n; i++) {
+		v[i].message = messages[i];
+		v[i].size    = size;
+	}
+	return n;
+}
+
+/**
+ * @brief vitasdk_msgpipe_send_batch - Send messages of the same size
+ *
+ * The batch reaches the receivers in one piece, the other senders wait
+ * until it is sent. On error, the messages before the failing syscall were
+ * sent.
+ *
+ * @param pipe - The pipe
+ * @param messages - The messages
+ * @param size - The size of each message
+ * @param n - The number of messages
+ * @param timeout - Timeout of each syscall in us, NULL to wait indefinitely, the wait for the other senders is not bounded
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_msgpipe_send_batch(VitasdkMsgPipe *pipe, void *const *messages, SceSize size, SceUInt32 n, unsigned int *timeout)
+{
+	SceKernelMsgPipeVector v[VITASDK_MSGPIPE_MAX_VECTOR];
+	SceUInt32 count;
+	int res;
+
+	res = vitasdk_mutex_lock(&pipe->send_lock);
+	if (res < 0)
+		return res;
+	while (n != 0) {
+		count = _vitasdk_msgpipe_vector(v, messages, size, n);
+		res = sceKernelSendMsgPipeVector(pipe->uid, v, count, 0, NULL, timeout);
+		if (res < 0)
+			break;
+		messages += count;
+		n        -= count;
+	}
+	vitasdk_mutex_unlock(&pipe->send_lock);
+	return res < 0 ? res : 0;
+}
+
+/**
+ * @brief vitasdk_msgpipe_receive_batch - Receive messages of the same size
+ *
+ * The other receivers wait until the whole batch is received.
+ *
+ * @param pipe - The pipe
+ * @param messages - The buffers of the messages
+ * @param size - The size of each message
+ * @param n - The number of messages
+ * @param timeout - Timeout of each syscall in us, NULL to wait indefinitely, the wait for the other receivers is not bounded
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_msgpipe_receive_batch(VitasdkMsgPipe *pipe, void *const *messages, SceSize size, SceUInt32 n, unsigned int *timeout)
+{
+	SceKernelMsgPipeVector v[VITASDK_MSGPIPE_MAX_VECTOR];
+	SceUInt32 count;
+	int res;
+
+	res = vitasdk_mutex_lock(&pipe->receive_lock);
+	if (res < 0)
+		return res;
+	while (n != 0) {
+		count = _vitasdk_msgpipe_vector(v, messages, size, n);
+		res = sceKernelReceiveMsgPipeVector(pipe->uid, v, count, 0, NULL, timeout);
+		if (res < 0)
+			break;
+		messages += count;
+		n        -= count;
+	}
+	vitasdk_mutex_unlock(&pipe->receive_lock);
+	return res < 0 ? res : 0;
+}
+
+/**
+ * @brief vitasdk_msgpipe_send_handles - Send buffers without copying them
+ * @param pipe - The pipe
+ * @param buffers - The buffers, owned by the receiver once sent
+ * @param n - The number of buffers
+ * @param timeout - Timeout in us, NULL to wait indefinitely, the wait for the other senders is not bounded
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_msgpipe_send_handles(VitasdkMsgPipe *pipe, void *const *buffers, SceUInt32 n, unsigned int *timeout)
+{
+	int res = vitasdk_mutex_lock(&pipe->send_lock);
+
+	if (res < 0)
+		return res;
+	res = sceKernelSendMsgPipe(pipe->uid, (void *)buffers, sizeof(void *) * n, 0, NULL, timeout);
+	vitasdk_mutex_unlock(&pipe->send_lock);
+	return res;
+}
+
+/**
+ * @brief vitasdk_msgpipe_receive_handles - Receive buffers sent by vitasdk_msgpipe_send_handles
+ * @param pipe - The pipe
+ * @param buffers - Receives the buffers
+ * @param n - The number of buffers
+ * @param timeout - Timeout in us, NULL to wait indefinitely, the wait for the other receivers is not bounded
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_msgpipe_receive_handles(VitasdkMsgPipe *pipe, void **buffers, SceUInt32 n, unsigned int *timeout)
+{
+	int res = vitasdk_mutex_lock(&pipe->receive_lock);
+
+	if (res < 0)
+		return res;
+	res = sceKernelReceiveMsgPipe(pipe->uid, buffers, sizeof(void *) * n, 0, NULL, timeout);
+	vitasdk_mutex_unlock(&pipe->receive_lock);
+	return res;
+}
+
+/**
+ * @brief vitasdk_msgpipe_try_receive_handles - Receive buffers if they were all sent already
+ *
+ * Fails with SCE_KERNEL_ERROR_MSG_PIPE_EMPTY as well while another receiver
+ * holds the pipe.
+ *
+ * @param pipe - The pipe
+ * @param buffers - Receives the buffers
+ * @param n - The number of buffers
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_msgpipe_try_receive_handles(VitasdkMsgPipe *pipe, void **buffers, SceUInt32 n)
+{
+	int res;
+
+	if (!vitasdk_mutex_trylock(&pipe->receive_lock))
+		return (int)SCE_KERNEL_ERROR_MSG_PIPE_EMPTY;
+	res = sceKernelTryReceiveMsgPipe(pipe->uid, buffers, sizeof(void *) * n, 0, NULL);
+	vitasdk_mutex_unlock(&pipe->receive_lock);
+	return res;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_MSGPIPE_H_ */
@@ -0,0 +1,16 @@
+#ifndef _VITASDK_NET_H_
+#define _VITASDK_NET_H_
+
+/* Sockets, HTTP, SSL and adhoc networking, a lighter alternative to vitasdk.h */
+
+#include <psp2/types.h>
+#include <psp2/libssl.h>
+#include <psp2/pspnet_adhoc.h>
+#include <psp2/pspnet_adhocctl.h>
+#include <psp2/net/adhoc_matching.h>
+#include <psp2/net/http.h>
+#include <psp2/net/net.h>
+#include <psp2/net/net_syscalls.h>
+#include <psp2/net/netctl.h>
+
+#endif /* _VITASDK_NET_H_ */
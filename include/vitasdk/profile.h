@@ -0,0 +1,382 @@
+#ifndef _VITASDK_PROFILE_H_
+#define _VITASDK_PROFILE_H_
+
+/*
+ * Instrumentation scopes recorded into per-thread rings.
+ *
+ *   vitasdk_profile_init(&prof, VITASDK_PROFILE_TLS_KEY, NULL, 0);
+ *   vitasdk_profile_thread_init(&prof, &main_ring, main_events, 4096, "main");
+ *
+ *   void update(void)
+ *   {
+ *       VITASDK_PROFILE_SCOPE("update");
+ *       ...
+ *   }
+ *
+ * A scope records its begin and end scePerfGetTimebaseValue timestamps and
+ * the ARM PMU counters selected by vitasdk_profile_init into a ring of the
+ * calling thread, only written by that thread. Any thread drains the rings
+ * into a file with vitasdk_profile_dump, profile_trace.py converts that file
+ * to the Chrome trace event format.
+ *
+ * VITASDK_PROFILE_SCOPE records into the profiler initialized with
+ * VITASDK_PROFILE_TLS_KEY, the slot of sceKernelGetTLSAddr the rings of its
+ * threads are found in. VITASDK_PROFILE_SCOPE_IN records into any other.
+ *
+ * Scopes are only compiled with ENABLE_VITASDK_PROFILE defined, without it
+ * both macros expand to nothing. Without PMU counters a scope costs two
+ * timebase reads and a store into the ring, no syscall. Each PMU counter
+ * adds a syscall to each end of a scope, far above the cost of the rest of
+ * the scope, only select them when needed.
+ * The application must link ScePerf_stub.
+ */
+
+#include <psp2/types.h>
+#include <psp2/perf.h>
+#include <psp2/kernel/error.h>
+#include <psp2/io/fcntl.h>
+#include <psp2/kernel/threadmgr/thread.h>
+#include <vitasdk/atomic.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** TLS slot of the profiler of VITASDK_PROFILE_SCOPE, define it before the include to move it */
+#ifndef VITASDK_PROFILE_TLS_KEY
+#define VITASDK_PROFILE_TLS_KEY (0x40)
+#endif
+
+/** PMU counters which can be recorded by each scope */
+#define VITASDK_PROFILE_PMU_COUNTERS (2)
+
+#define VITASDK_PROFILE_MAX_THREADS (32)
+
+/* Records written by each sceIoWrite of vitasdk_profile_dump */
+#define _VITASDK_PROFILE_DUMP_RECORDS (16)
+
+/* The file written by vitasdk_profile_open and vitasdk_profile_dump */
+#define VITASDK_PROFILE_MAGIC   (0x46525056) /* "VPRF" */
+#define VITASDK_PROFILE_VERSION (1)
+
+typedef enum VitasdkProfileRecordType {
+	VITASDK_PROFILE_RECORD_SCOPE  = 0,
+	VITASDK_PROFILE_RECORD_THREAD = 1  //!< Name of a thread
+} VitasdkProfileRecordType;
+
+typedef struct VitasdkProfileFileHeader {
+	SceUInt32 magic;
+	SceUInt32 version;
+	SceUInt32 timebase_frequency;
+	SceUInt32 pmu_count;
+	SceUInt32 pmu_events[VITASDK_PROFILE_PMU_COUNTERS];
+} VitasdkProfileFileHeader;
+
+typedef struct VitasdkProfileRecord {
+	SceUInt32 type;
+	SceUID thid;
+	SceUInt64 begin;
+	SceUInt64 end;
+	SceUInt32 counters[VITASDK_PROFILE_PMU_COUNTERS]; //!< Counts between the begin and the end
+	char name[32];
+} VitasdkProfileRecord;
+
+typedef struct VitasdkProfileEvent {
+	SceUInt64 begin;
+	SceUInt64 end;
+	const char *name;
+	SceUInt32 counters[VITASDK_PROFILE_PMU_COUNTERS];
+} VitasdkProfileEvent;
+
+typedef struct VitasdkProfileThread {
+	/* Written by the dumping thread */
+	volatile SceUInt32 head VITASDK_CACHE_ALIGNED;
+	/* Written by the owner */
+	volatile SceUInt32 tail VITASDK_CACHE_ALIGNED;
+	volatile SceUInt32 dropped; //!< Scopes lost because the ring was full
+	/* Read-only after init */
+	VitasdkProfileEvent *events VITASDK_CACHE_ALIGNED;
+	SceUInt32 mask;
+	SceUInt32 pmu_count;
+	SceUID thid;
+	char name[32];
+} VitasdkProfileThread;
+
+typedef struct VitasdkProfiler {
+	VitasdkProfileThread *threads[VITASDK_PROFILE_MAX_THREADS];
+	volatile SceUInt32 thread_count;
+	int tls_key;               //!< TLS slot holding the ring of each thread
+	SceUInt32 pmu_count;
+	SceUInt8 pmu_events[VITASDK_PROFILE_PMU_COUNTERS];
+} VitasdkProfiler;
+
+typedef struct VitasdkProfileScope {
+	VitasdkProfileThread *thread;
+	const char *name;
+	SceUInt64 begin;
+	SceUInt32 counters[VITASDK_PROFILE_PMU_COUNTERS];
+} VitasdkProfileScope;
+
+/**
+ * @brief vitasdk_profile_init - Initialize a profiler
+ * @param prof - The profiler
+ * @param tls_key - A TLS slot of sceKernelGetTLSAddr not used by anything else, VITASDK_PROFILE_TLS_KEY for the profiler of VITASDK_PROFILE_SCOPE
+ * @param pmu_events - The PMU events counted by each scope, e.g. SCE_PERF_ARM_PMON_DCACHE_MISS
+ * @param pmu_count - The number of events, at most VITASDK_PROFILE_PMU_COUNTERS
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_profile_init(VitasdkProfiler *prof, int tls_key, const ScePerfArmPmonEventCode *pmu_events, SceUInt32 pmu_count)
+{
+	SceUInt32 i;
+
+	if (pmu_count > VITASDK_PROFILE_PMU_COUNTERS)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	prof->thread_count = 0;
+	prof->tls_key      = tls_key;
+	prof->pmu_count    = pmu_count;
+	for (i = 0; i < VITASDK_PROFILE_MAX_THREADS; i++)
+		prof->threads[i] = NULL;
+	for (i = 0; i < pmu_count; i++)
+		prof->pmu_events[i] = (SceUInt8)pmu_events[i];
+	return 0;
+}
+
+/**
+ * @brief vitasdk_profile_thread_init - Start recording the scopes of the calling thread
+ * @param prof - The profiler
+ * @param thread - The ring of the thread, valid until the profiler is not used anymore
+ * @param events - Storage of the ring
+ * @param capacity - The number of events, a power of two
+ * @param name - The name of the thread in the trace
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_profile_thread_init(VitasdkProfiler *prof, VitasdkProfileThread *thread,
+                                              VitasdkProfileEvent *events, SceUInt32 capacity, const char *name)
+{
+	SceUInt32 index, i;
+	int res;
+
+	if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+		return (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+	thread->head      = 0;
+	thread->tail      = 0;
+	thread->dropped   = 0;
+	thread->events    = events;
+	thread->mask      = capacity - 1;
+	thread->pmu_count = prof->pmu_count;
+	thread->thid      = sceKernelGetThreadId();
+	for (i = 0; i < sizeof(thread->name) - 1 && name[i] != '\0'; i++)
+		thread->name[i] = name[i];
+	thread->name[i] = '\0';
+
+	if (prof->pmu_count != 0) {
+		res = scePerfArmPmonReset(SCE_PERF_ARM_PMON_THREAD_ID_SELF);
+		for (i = 0; res >= 0 && i < prof->pmu_count; i++)
+			res = scePerfArmPmonSelectEvent(SCE_PERF_ARM_PMON_THREAD_ID_SELF, i, prof->pmu_events[i]);
+		if (res >= 0)
+			res = scePerfArmPmonStart(SCE_PERF_ARM_PMON_THREAD_ID_SELF);
+		if (res < 0)
+			return res;
+	}
+
+	index = vitasdk_atomic_add32(&prof->thread_count, 1) - 1;
+	if (index >= VITASDK_PROFILE_MAX_THREADS) {
+		vitasdk_atomic_add32(&prof->thread_count, (SceUInt32)-1);
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	}
+	/* vitasdk_profile_dump may read the slot as soon as the count covers it */
+	vitasdk_atomic_store_release_ptr((void *volatile *)&prof->threads[index], thread);
+	*(VitasdkProfileThread **)sceKernelGetTLSAddr(prof->tls_key) = thread;
+	return 0;
+}
+
+/** Stop recording the scopes of the calling thread, its ring can still be dumped */
+static inline void vitasdk_profile_thread_exit(VitasdkProfiler *prof)
+{
+	*(VitasdkProfileThread **)sceKernelGetTLSAddr(prof->tls_key) = NULL;
+}
+
+/** Begin a scope of the profiler whose threads are found in the TLS slot `tls_key` */
+static inline VitasdkProfileScope vitasdk_profile_scope_begin_key(int tls_key, const char *name)
+{
+	VitasdkProfileScope scope;
+	SceUInt32 i;
+
+	scope.thread = *(VitasdkProfileThread **)sceKernelGetTLSAddr(tls_key);
+	scope.name   = name;
+	if (scope.thread) {
+		for (i = 0; i < scope.thread->pmu_count; i++)
+			scePerfArmPmonGetCounterValue(SCE_PERF_ARM_PMON_THREAD_ID_SELF, i, &scope.counters[i]);
+	}
+	scope.begin = scePerfGetTimebaseValue();
+	return scope;
+}
+
+static inline VitasdkProfileScope vitasdk_profile_scope_begin(VitasdkProfiler *prof, const char *name)
+{
+	return vitasdk_profile_scope_begin_key(prof->tls_key, name);
+}
+
+static inline void vitasdk_profile_scope_end(const VitasdkProfileScope *scope)
+{
+	SceUInt64 end = scePerfGetTimebaseValue();
+	VitasdkProfileThread *thread = scope->thread;
+	VitasdkProfileEvent *event;
+	SceUInt32 tail, i;
+
+	if (!thread)
+		return;
+	tail = thread->tail;
+	if (tail - vitasdk_atomic_load_acquire32(&thread->head) > thread->mask) {
+		vitasdk_atomic_store_release32(&thread->dropped, thread->dropped + 1);
+		return;
+	}
+	event = &thread->events[tail & thread->mask];
+	event->begin = scope->begin;
+	event->end   = end;
+	event->name  = scope->name;
+	for (i = 0; i < thread->pmu_count; i++) {
+		scePerfArmPmonGetCounterValue(SCE_PERF_ARM_PMON_THREAD_ID_SELF, i, &event->counters[i]);
+		event->counters[i] -= scope->counters[i];
+	}
+	vitasdk_atomic_store_release32(&thread->tail, tail + 1);
+}
+
+#define _VITASDK_PROFILE_CONCAT2(a, b) a ## b
+#define _VITASDK_PROFILE_CONCAT(a, b) _VITASDK_PROFILE_CONCAT2(a, b)
+
+#ifdef ENABLE_VITASDK_PROFILE
+/** Record the rest of the enclosing block, `name` must outlive the next dump */
+#define VITASDK_PROFILE_SCOPE(name) \
+	VitasdkProfileScope _VITASDK_PROFILE_CONCAT(_vitasdk_profile_scope_, __COUNTER__) \
+		__attribute__((cleanup(vitasdk_profile_scope_end))) = vitasdk_profile_scope_begin_key(VITASDK_PROFILE_TLS_KEY, name)
+/** Record the rest of the enclosing block into `prof`, `name` must outlive the next dump */
+#define VITASDK_PROFILE_SCOPE_IN(prof, name) \
+	VitasdkProfileScope _VITASDK_PROFILE_CONCAT(_vitasdk_profile_scope_, __COUNTER__) \
+		__attribute__((cleanup(vitasdk_profile_scope_end))) = vitasdk_profile_scope_begin(prof, name)
+#else
+#define VITASDK_PROFILE_SCOPE(name)
+#define VITASDK_PROFILE_SCOPE_IN(prof, name)
+#endif
+
+static inline void _vitasdk_profile_copy_name(char *dst, const char *src)
+{
+	SceUInt32 i;
+
+	for (i = 0; i < 31 && src[i] != '\0'; i++)
+		dst[i] = src[i];
+	for (; i < 32; i++)
+		dst[i] = '\0';
+}
+
+/**
+ * @brief vitasdk_profile_open - Create a profile file
+ * @param prof - The profiler
+ * @param path - The path of the file, e.g. "ux0:data/profile.bin"
+ * @return The file descriptor for vitasdk_profile_dump, < 0 on error.
+ */
+static inline SceUID vitasdk_profile_open(const VitasdkProfiler *prof, const char *path)
+{
+	VitasdkProfileFileHeader header;
+	SceUInt32 i;
+	SceUID fd;
+	SceSSize res;
+
+	fd = sceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0666);
+	if (fd < 0)
+		return fd;
+	header.magic              = VITASDK_PROFILE_MAGIC;
+	header.version            = VITASDK_PROFILE_VERSION;
+	header.timebase_frequency = scePerfGetTimebaseFrequency();
+	header.pmu_count          = prof->pmu_count;
+	for (i = 0; i < VITASDK_PROFILE_PMU_COUNTERS; i++)
+		header.pmu_events[i] = i < prof->pmu_count ? prof->pmu_events[i] : 0xFFFFFFFF;
+	res = sceIoWrite(fd, &header, sizeof(header));
+	if (res < 0) {
+		sceIoClose(fd);
+		return (SceUID)res;
+	}
+	return fd;
+}
+
+/* The next record of the dump buffer, which is written out first when full */
+static inline VitasdkProfileRecord *_vitasdk_profile_record(SceUID fd, VitasdkProfileRecord *records, SceUInt32 *count, int *res)
+{
+	SceSSize written;
+
+	if (*count == _VITASDK_PROFILE_DUMP_RECORDS) {
+		written = sceIoWrite(fd, records, sizeof(records[0]) * *count);
+		if (written < 0) {
+			*res = (int)written;
+			return NULL;
+		}
+		*count = 0;
+	}
+	return &records[(*count)++];
+}
+
+/**
+ * @brief vitasdk_profile_dump - Move the recorded scopes of every thread to a profile file
+ * @param prof - The profiler
+ * @param fd - The file descriptor returned by vitasdk_profile_open
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_profile_dump(VitasdkProfiler *prof, SceUID fd)
+{
+	VitasdkProfileRecord records[_VITASDK_PROFILE_DUMP_RECORDS], *r;
+	SceUInt32 count = 0, n, t, i;
+	SceSSize written;
+	int res = 0;
+
+	n = vitasdk_atomic_load_acquire32(&prof->thread_count);
+	if (n > VITASDK_PROFILE_MAX_THREADS)
+		n = VITASDK_PROFILE_MAX_THREADS;
+	for (t = 0; t < n; t++) {
+		VitasdkProfileThread *thread = (VitasdkProfileThread *)vitasdk_atomic_load_acquire_ptr((void *volatile *)&prof->threads[t]);
+		SceUInt32 head, tail;
+
+		if (!thread)
+			continue;
+		/* Every dump names its threads, so that any file can be converted on its own */
+		r = _vitasdk_profile_record(fd, records, &count, &res);
+		if (!r)
+			return res;
+		r->type  = VITASDK_PROFILE_RECORD_THREAD;
+		r->thid  = thread->thid;
+		r->begin = 0;
+		r->end   = 0;
+		for (i = 0; i < VITASDK_PROFILE_PMU_COUNTERS; i++)
+			r->counters[i] = 0;
+		_vitasdk_profile_copy_name(r->name, thread->name);
+
+		head = thread->head;
+		tail = vitasdk_atomic_load_acquire32(&thread->tail);
+		for (; head != tail; head++) {
+			const VitasdkProfileEvent *e = &thread->events[head & thread->mask];
+
+			r = _vitasdk_profile_record(fd, records, &count, &res);
+			if (!r)
+				return res;
+			r->type  = VITASDK_PROFILE_RECORD_SCOPE;
+			r->thid  = thread->thid;
+			r->begin = e->begin;
+			r->end   = e->end;
+			for (i = 0; i < VITASDK_PROFILE_PMU_COUNTERS; i++)
+				r->counters[i] = i < thread->pmu_count ? e->counters[i] : 0;
+			_vitasdk_profile_copy_name(r->name, e->name);
+		}
+		/* The events are copied, hand their slots back to the thread */
+		vitasdk_atomic_store_release32(&thread->head, head);
+	}
+	if (count != 0) {
+		written = sceIoWrite(fd, records, sizeof(records[0]) * count);
+		if (written < 0)
+			return (int)written;
+	}
+	return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_PROFILE_H_ */
@@ -0,0 +1,235 @@
+#ifndef _VITASDK_RCU_H_
+#define _VITASDK_RCU_H_
+
+/*
+ * Epoch-based read-copy-update for read-mostly data reached through a
+ * pointer, such as a settings or camera block.
+ *
+ * Every reading thread registers once and gets its own reader slot on its
+ * own cache line. A read section only records the current epoch in that
+ * slot, so readers never write a shared cache line. A writer publishes a
+ * new copy, then waits until every reader that may still see the old one
+ * has left its read section before freeing it:
+ *
+ *   vitasdk_rcu_read_lock(&rcu, reader);
+ *   settings = vitasdk_rcu_dereference((void **)&shared_settings);
+ *   ...
+ *   vitasdk_rcu_read_unlock(reader);
+ *
+ *   old = vitasdk_rcu_replace(&rcu, (void **)&shared_settings, copy);
+ *   free(old);
+ *
+ * Read sections nest and must not block on a writer of the same RCU, the
+ * writers of a pointer are serialized by the caller.
+ */
+
+#include <psp2/types.h>
+#include <psp2/kernel/threadmgr/thread.h>
+#include <vitasdk/atomic.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** Threads which can read at the same time */
+#define VITASDK_RCU_MAX_READERS (32)
+
+/* Spins before sleeping while a reader holds an old epoch */
+#define _VITASDK_RCU_SPIN (100)
+
+typedef struct VitasdkRcuReader {
+	volatile SceUInt32 epoch VITASDK_CACHE_ALIGNED; //!< Epoch of the read section, 0 outside
+	SceUInt32 nesting;
+} VitasdkRcuReader;
+
+typedef struct VitasdkRcu {
+	volatile SceUInt32 epoch VITASDK_CACHE_ALIGNED; //!< Odd, advanced by each synchronize
+	volatile SceUInt32 registered;                  //!< Mask of the readers in use
+	VitasdkRcuReader readers[VITASDK_RCU_MAX_READERS];
+} VitasdkRcu;
+
+static inline void vitasdk_rcu_init(VitasdkRcu *rcu)
+{
+	SceUInt32 i;
+
+	rcu->epoch      = 1;
+	rcu->registered = 0;
+	for (i = 0; i < VITASDK_RCU_MAX_READERS; i++) {
+		rcu->readers[i].epoch   = 0;
+		rcu->readers[i].nesting = 0;
+	}
+}
+
+/**
+ * @brief vitasdk_rcu_register - Get the reader slot of a thread
+ * @param rcu - The RCU
+ * @return The reader, NULL if VITASDK_RCU_MAX_READERS threads are registered.
+ */
+static inline VitasdkRcuReader *vitasdk_rcu_register(VitasdkRcu *rcu)
+{
+	SceUInt32 registered, bit;
+
+	registered = vitasdk_atomic_load32(&rcu->registered);
+	while (registered != 0xFFFFFFFF) {
+		bit = 1u << __builtin_ctz(~registered);
+		if (vitasdk_atomic_cas32(&rcu->registered, registered, registered | bit))
+			return &rcu->readers[__builtin_ctz(bit)];
+		registered = vitasdk_atomic_load32(&rcu->registered);
+	}
+	return NULL;
+}
+
+/**
+ * @brief vitasdk_rcu_unregister - Give back the reader slot of a thread
+ * @param rcu - The RCU
+ * @param reader - The reader, outside of any read section
+ */
+static inline void vitasdk_rcu_unregister(VitasdkRcu *rcu, VitasdkRcuReader *reader)
+{
+	vitasdk_atomic_clear32(&rcu->registered, 1u << (reader - rcu->readers));
+}
+
+/**
+ * @brief vitasdk_rcu_read_lock - Enter a read section
+ * @param rcu - The RCU
+ * @param reader - The reader of the calling thread
+ */
+static inline void vitasdk_rcu_read_lock(VitasdkRcu *rcu, VitasdkRcuReader *reader)
+{
+	if (reader->nesting++ != 0)
+		return;
+	vitasdk_atomic_store32(&reader->epoch, vitasdk_atomic_load32(&rcu->epoch));
+	/* Writers see the epoch before this thread loads any pointer */
+	vitasdk_atomic_fence();
+}
+
+/**
+ * @brief vitasdk_rcu_read_unlock - Leave a read section
+ * @param reader - The reader of the calling thread
+ */
+static inline void vitasdk_rcu_read_unlock(VitasdkRcuReader *reader)
+{
+	if (--reader->nesting != 0)
+		return;
+	vitasdk_atomic_store_release32(&reader->epoch, 0);
+}
+
+/**
+ * @brief vitasdk_rcu_dereference - Load a pointer published with vitasdk_rcu_assign
+ * @param p - The pointer, read in a read section
+ * @return The pointed data, valid until the end of the read section.
+ */
+static inline void *vitasdk_rcu_dereference(void *const volatile *p)
+{
+	return vitasdk_atomic_load_acquire_ptr(p);
+}
+
+/**
+ * @brief vitasdk_rcu_assign - Publish a pointer to fully initialized data
+ * @param p - The pointer
+ * @param value - The new data
+ */
+static inline void vitasdk_rcu_assign(void *volatile *p, void *value)
+{
+	vitasdk_atomic_store_release_ptr(p, value);
+}
+
+/**
+ * @brief vitasdk_rcu_synchronize - Wait for the read sections which may see unpublished data
+ * @param rcu - The RCU, not in a read section of the calling thread
+ */
+static inline void vitasdk_rcu_synchronize(VitasdkRcu *rcu)
+{
+	SceUInt32 target, registered, epoch, spin, i;
+
+	vitasdk_atomic_fence();
+	target = vitasdk_atomic_add32(&rcu->epoch, 2);
+	vitasdk_atomic_fence();
+
+	registered = vitasdk_atomic_load32(&rcu->registered);
+	for (; registered != 0; registered &= registered - 1) {
+		i    = __builtin_ctz(registered);
+		spin = 0;
+		/* Sections entered with the new epoch already see the new data */
+		while ((epoch = vitasdk_atomic_load_acquire32(&rcu->readers[i].epoch)) != 0 && (SceInt32)(epoch - target) < 0) {
+			if (++spin < _VITASDK_RCU_SPIN)
+				vitasdk_cpu_relax();
+			else
+				sceKernelDelayThread(100);
+		}
+	}
+	vitasdk_atomic_fence_acquire();
+}
+
+/**
+ * @brief vitasdk_rcu_replace - Publish new data and wait until the old one is unused
+ * @param rcu - The RCU
+ * @param p - The pointer
+ * @param value - The new data
+ * @return The old data, which the caller may free.
+ */
+static inline void *vitasdk_rcu_replace(VitasdkRcu *rcu, void *volatile *p, void *value)
+{
+	void *old = vitasdk_atomic_load_acquire_ptr(p);
+
+	vitasdk_rcu_assign(p, value);
+	vitasdk_rcu_synchronize(rcu);
+	return old;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+namespace vitasdk {
+
+/** Read section for the rest of the scope */
+class RcuReadGuard {
+public:
+	RcuReadGuard(VitasdkRcu &rcu, VitasdkRcuReader *reader) : reader_(reader)
+	{
+		vitasdk_rcu_read_lock(&rcu, reader_);
+	}
+
+	~RcuReadGuard()
+	{
+		vitasdk_rcu_read_unlock(reader_);
+	}
+
+	RcuReadGuard(const RcuReadGuard &) = delete;
+	RcuReadGuard &operator=(const RcuReadGuard &) = delete;
+
+private:
+	VitasdkRcuReader *reader_;
+};
+
+/** Pointer to data shared through an RCU */
+template <typename T>
+class RcuPointer {
+public:
+	explicit RcuPointer(T *value = nullptr) : value_(value) {}
+
+	RcuPointer(const RcuPointer &) = delete;
+	RcuPointer &operator=(const RcuPointer &) = delete;
+
+	/** The data, valid until the end of the read section */
+	T *load() const
+	{
+		return static_cast<T *>(vitasdk_rcu_dereference(&value_));
+	}
+
+	/** Publish `value`, return the old data once no reader uses it */
+	T *replace(VitasdkRcu &rcu, T *value)
+	{
+		return static_cast<T *>(vitasdk_rcu_replace(&rcu, &value_, value));
+	}
+
+private:
+	void *volatile value_;
+};
+
+} // namespace vitasdk
+#endif
+
+#endif /* _VITASDK_RCU_H_ */
@@ -0,0 +1,350 @@
+#ifndef _VITASDK_RING_H_
+#define _VITASDK_RING_H_
+
+/*
+ * Bounded lock-free rings of pointers, to hand work between threads without
+ * a message pipe syscall per item.
+ *
+ *   VitasdkSpscRing - one producer thread, one consumer thread
+ *   VitasdkMpscRing - any producer thread, one consumer thread
+ *   VitasdkMpmcRing - any producer and consumer thread
+ *
+ * The storage is provided by the caller, its capacity must be a power of two.
+ * The rings themselves should be allocated on a VITASDK_CACHE_LINE_SIZE
+ * boundary so that the producer and consumer indices do not share a line.
+ * Push and pop never block, they return how many items were transferred.
+ */
+
+#include <psp2/types.h>
+#include <psp2/kernel/error.h>
+#include <vitasdk/atomic.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct VitasdkSpscRing {
+	/* Written by the consumer */
+	volatile SceUInt32 head VITASDK_CACHE_ALIGNED;
+	SceUInt32 tail_cache;
+	/* Written by the producer */
+	volatile SceUInt32 tail VITASDK_CACHE_ALIGNED;
+	SceUInt32 head_cache;
+	/* Read-only after init */
+	void **slots VITASDK_CACHE_ALIGNED;
+	SceUInt32 mask;
+} VitasdkSpscRing;
+
+/** Slot of the multi-producer rings, the sequence tells which lap may use it */
+typedef struct VitasdkRingCell {
+	volatile SceUInt32 seq;
+	void *data;
+} VitasdkRingCell;
+
+typedef struct VitasdkMpscRing {
+	volatile SceUInt32 tail VITASDK_CACHE_ALIGNED;
+	SceUInt32 head VITASDK_CACHE_ALIGNED;
+	VitasdkRingCell *cells VITASDK_CACHE_ALIGNED;
+	SceUInt32 mask;
+} VitasdkMpscRing;
+
+typedef struct VitasdkMpmcRing {
+	volatile SceUInt32 tail VITASDK_CACHE_ALIGNED;
+	volatile SceUInt32 head VITASDK_CACHE_ALIGNED;
+	VitasdkRingCell *cells VITASDK_CACHE_ALIGNED;
+	SceUInt32 mask;
+} VitasdkMpmcRing;
+
+static inline int _vitasdk_ring_check_capacity(SceUInt32 capacity)
+{
+	if (capacity < 2 || capacity > 0x80000000 || (capacity & (capacity - 1)) != 0)
+		return (int)SCE_KERNEL_ERROR_ILLEGAL_SIZE;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_spsc_ring_init - Initialize a single producer, single consumer ring
+ * @param ring - The ring
+ * @param slots - Storage for `capacity` pointers
+ * @param capacity - The number of slots, a power of two
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_spsc_ring_init(VitasdkSpscRing *ring, void **slots, SceUInt32 capacity)
+{
+	int res = _vitasdk_ring_check_capacity(capacity);
+	if (res < 0)
+		return res;
+	ring->head       = 0;
+	ring->tail_cache = 0;
+	ring->tail       = 0;
+	ring->head_cache = 0;
+	ring->slots      = slots;
+	ring->mask       = capacity - 1;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_spsc_ring_push_n - Push items, from the producer thread only
+ * @param ring - The ring
+ * @param items - The items to push
+ * @param n - The number of items
+ * @return The number of items pushed, less than `n` if the ring is full
+ */
+static inline SceUInt32 vitasdk_spsc_ring_push_n(VitasdkSpscRing *ring, void *const *items, SceUInt32 n)
+{
+	SceUInt32 tail = ring->tail, free, i;
+
+	free = ring->mask + 1 - (tail - ring->head_cache);
+	if (free < n) {
+		ring->head_cache = vitasdk_atomic_load_acquire32(&ring->head);
+		free = ring->mask + 1 - (tail - ring->head_cache);
+	}
+	if (n > free)
+		n = free;
+	for (i = 0; i < n; i++)
+		ring->slots[(tail + i) & ring->mask] = items[i];
+	if (n != 0)
+		vitasdk_atomic_store_release32(&ring->tail, tail + n);
+	return n;
+}
+
+/**
+ * @brief vitasdk_spsc_ring_pop_n - Pop items, from the consumer thread only
+ * @param ring - The ring
+ * @param items - Receives the items
+ * @param n - The maximum number of items
+ * @return The number of items popped, 0 if the ring is empty
+ */
+static inline SceUInt32 vitasdk_spsc_ring_pop_n(VitasdkSpscRing *ring, void **items, SceUInt32 n)
+{
+	SceUInt32 head = ring->head, used, i;
+
+	used = ring->tail_cache - head;
+	if (used < n) {
+		ring->tail_cache = vitasdk_atomic_load_acquire32(&ring->tail);
+		used = ring->tail_cache - head;
+	}
+	if (n > used)
+		n = used;
+	for (i = 0; i < n; i++)
+		items[i] = ring->slots[(head + i) & ring->mask];
+	if (n != 0)
+		vitasdk_atomic_store_release32(&ring->head, head + n);
+	return n;
+}
+
+static inline SceBool vitasdk_spsc_ring_push(VitasdkSpscRing *ring, void *item)
+{
+	return vitasdk_spsc_ring_push_n(ring, &item, 1) == 1;
+}
+
+static inline SceBool vitasdk_spsc_ring_pop(VitasdkSpscRing *ring, void **item)
+{
+	return vitasdk_spsc_ring_pop_n(ring, item, 1) == 1;
+}
+
+/** The number of queued items, only a snapshot when read from another thread */
+static inline SceUInt32 vitasdk_spsc_ring_size(const VitasdkSpscRing *ring)
+{
+	return vitasdk_atomic_load32(&ring->tail) - vitasdk_atomic_load32(&ring->head);
+}
+
+static inline void _vitasdk_ring_cells_init(VitasdkRingCell *cells, SceUInt32 capacity)
+{
+	SceUInt32 i;
+
+	for (i = 0; i < capacity; i++) {
+		cells[i].seq  = i;
+		cells[i].data = NULL;
+	}
+}
+
+/*
+ * Claim up to `n` consecutive cells from `*index`. A cell at position `pos`
+ * is ready when its sequence is `pos + ready`: `pos` for a producer (free on
+ * this lap) and `pos + 1` for a consumer (filled on this lap).
+ */
+static inline SceUInt32 _vitasdk_ring_claim(volatile SceUInt32 *index, const VitasdkRingCell *cells,
+                                            SceUInt32 mask, SceUInt32 n, SceUInt32 ready, SceUInt32 *first)
+{
+	SceUInt32 pos = vitasdk_atomic_load32(index);
+
+	if (n == 0)
+		return 0;
+	for (;;) {
+		SceUInt32 count = 0;
+		SceInt32 diff = 0;
+
+		while (count < n) {
+			diff = (SceInt32)(vitasdk_atomic_load_acquire32(&cells[(pos + count) & mask].seq) - (pos + count + ready));
+			if (diff != 0)
+				break;
+			count++;
+		}
+		/* Full for a producer, empty for a consumer */
+		if (count == 0 && diff < 0)
+			return 0;
+		if (count != 0 && vitasdk_atomic_cas32(index, pos, pos + count)) {
+			*first = pos;
+			return count;
+		}
+		/* Another thread moved the index */
+		vitasdk_cpu_relax();
+		pos = vitasdk_atomic_load32(index);
+	}
+}
+
+static inline void _vitasdk_ring_fill(VitasdkRingCell *cells, SceUInt32 mask, SceUInt32 pos, void *const *items, SceUInt32 n)
+{
+	SceUInt32 i;
+
+	for (i = 0; i < n; i++) {
+		VitasdkRingCell *cell = &cells[(pos + i) & mask];
+		cell->data = items[i];
+		vitasdk_atomic_store_release32(&cell->seq, pos + i + 1);
+	}
+}
+
+static inline void _vitasdk_ring_drain(VitasdkRingCell *cells, SceUInt32 mask, SceUInt32 pos, void **items, SceUInt32 n)
+{
+	SceUInt32 i;
+
+	for (i = 0; i < n; i++) {
+		VitasdkRingCell *cell = &cells[(pos + i) & mask];
+		items[i] = cell->data;
+		/* Free the cell for the next lap */
+		vitasdk_atomic_store_release32(&cell->seq, pos + i + mask + 1);
+	}
+}
+
+/**
+ * @brief vitasdk_mpsc_ring_init - Initialize a multi-producer, single consumer ring
+ * @param ring - The ring
+ * @param cells - Storage for `capacity` cells
+ * @param capacity - The number of cells, a power of two
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_mpsc_ring_init(VitasdkMpscRing *ring, VitasdkRingCell *cells, SceUInt32 capacity)
+{
+	int res = _vitasdk_ring_check_capacity(capacity);
+	if (res < 0)
+		return res;
+	_vitasdk_ring_cells_init(cells, capacity);
+	ring->tail  = 0;
+	ring->head  = 0;
+	ring->cells = cells;
+	ring->mask  = capacity - 1;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_mpsc_ring_push_n - Push consecutive items, from any thread
+ * @param ring - The ring
+ * @param items - The items to push
+ * @param n - The number of items
+ * @return The number of items pushed, less than `n` if the ring is full
+ */
+static inline SceUInt32 vitasdk_mpsc_ring_push_n(VitasdkMpscRing *ring, void *const *items, SceUInt32 n)
+{
+	SceUInt32 pos;
+
+	n = _vitasdk_ring_claim(&ring->tail, ring->cells, ring->mask, n, 0, &pos);
+	_vitasdk_ring_fill(ring->cells, ring->mask, pos, items, n);
+	return n;
+}
+
+/**
+ * @brief vitasdk_mpsc_ring_pop_n - Pop items, from the consumer thread only
+ * @param ring - The ring
+ * @param items - Receives the items
+ * @param n - The maximum number of items
+ * @return The number of items popped, 0 if the ring is empty
+ */
+static inline SceUInt32 vitasdk_mpsc_ring_pop_n(VitasdkMpscRing *ring, void **items, SceUInt32 n)
+{
+	SceUInt32 head = ring->head, count = 0;
+
+	/* Stops at the first cell a producer claimed but has not filled yet */
+	while (count < n && vitasdk_atomic_load_acquire32(&ring->cells[(head + count) & ring->mask].seq) == head + count + 1)
+		count++;
+	_vitasdk_ring_drain(ring->cells, ring->mask, head, items, count);
+	ring->head = head + count;
+	return count;
+}
+
+static inline SceBool vitasdk_mpsc_ring_push(VitasdkMpscRing *ring, void *item)
+{
+	return vitasdk_mpsc_ring_push_n(ring, &item, 1) == 1;
+}
+
+static inline SceBool vitasdk_mpsc_ring_pop(VitasdkMpscRing *ring, void **item)
+{
+	return vitasdk_mpsc_ring_pop_n(ring, item, 1) == 1;
+}
+
+/**
+ * @brief vitasdk_mpmc_ring_init - Initialize a multi-producer, multi-consumer ring
+ * @param ring - The ring
+ * @param cells - Storage for `capacity` cells
+ * @param capacity - The number of cells, a power of two
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_mpmc_ring_init(VitasdkMpmcRing *ring, VitasdkRingCell *cells, SceUInt32 capacity)
+{
+	int res = _vitasdk_ring_check_capacity(capacity);
+	if (res < 0)
+		return res;
+	_vitasdk_ring_cells_init(cells, capacity);
+	ring->tail  = 0;
+	ring->head  = 0;
+	ring->cells = cells;
+	ring->mask  = capacity - 1;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_mpmc_ring_push_n - Push consecutive items, from any thread
+ * @param ring - The ring
+ * @param items - The items to push
+ * @param n - The number of items
+ * @return The number of items pushed, less than `n` if the ring is full
+ */
+static inline SceUInt32 vitasdk_mpmc_ring_push_n(VitasdkMpmcRing *ring, void *const *items, SceUInt32 n)
+{
+	SceUInt32 pos;
+
+	n = _vitasdk_ring_claim(&ring->tail, ring->cells, ring->mask, n, 0, &pos);
+	_vitasdk_ring_fill(ring->cells, ring->mask, pos, items, n);
+	return n;
+}
+
+/**
+ * @brief vitasdk_mpmc_ring_pop_n - Pop consecutive items, from any thread
+ * @param ring - The ring
+ * @param items - Receives the items
+ * @param n - The maximum number of items
+ * @return The number of items popped, 0 if the ring is empty
+ */
+static inline SceUInt32 vitasdk_mpmc_ring_pop_n(VitasdkMpmcRing *ring, void **items, SceUInt32 n)
+{
+	SceUInt32 pos;
+
+	n = _vitasdk_ring_claim(&ring->head, ring->cells, ring->mask, n, 1, &pos);
+	_vitasdk_ring_drain(ring->cells, ring->mask, pos, items, n);
+	return n;
+}
+
+static inline SceBool vitasdk_mpmc_ring_push(VitasdkMpmcRing *ring, void *item)
+{
+	return vitasdk_mpmc_ring_push_n(ring, &item, 1) == 1;
+}
+
+static inline SceBool vitasdk_mpmc_ring_pop(VitasdkMpmcRing *ring, void **item)
+{
+	return vitasdk_mpmc_ring_pop_n(ring, item, 1) == 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_RING_H_ */
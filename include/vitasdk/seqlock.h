@@ -0,0 +1,209 @@
+#ifndef _VITASDK_SEQLOCK_H_
+#define _VITASDK_SEQLOCK_H_
+
+/*
+ * Sequence lock for small, read-mostly data such as settings or input
+ * snapshots.
+ *
+ * Readers do not write anything: they copy the data and retry if the
+ * sequence changed in the meantime. A writer makes the sequence odd,
+ * updates the data and makes it even again, writers exclude each other
+ * on the sequence itself.
+ *
+ *   VitasdkSeqlock lock = VITASDK_SEQLOCK_INIT;
+ *   InputSnapshot shared, mine;
+ *
+ *   vitasdk_seqlock_write(&lock, &shared, &latest, sizeof(shared));
+ *   vitasdk_seqlock_read(&lock, &mine, &shared, sizeof(mine));
+ *
+ * The data must not hold pointers which a writer may free, a reader can
+ * see a torn copy before its retry.
+ */
+
+#include <psp2/types.h>
+#include <psp2/kernel/threadmgr/thread.h>
+#include <vitasdk/atomic.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/* Spins before sleeping while a writer holds the lock */
+#define _VITASDK_SEQLOCK_SPIN (100)
+
+typedef struct VitasdkSeqlock {
+	volatile SceUInt32 sequence; //!< Odd while a writer holds the lock
+} VitasdkSeqlock;
+
+#define VITASDK_SEQLOCK_INIT {0}
+
+static inline void vitasdk_seqlock_init(VitasdkSeqlock *lock)
+{
+	lock->sequence = 0;
+}
+
+/* A writer preempted by a higher priority thread of its core must get to run */
+static inline void _vitasdk_seqlock_backoff(SceUInt32 *spin)
+{
+	if (++*spin < _VITASDK_SEQLOCK_SPIN)
+		vitasdk_cpu_relax();
+	else
+		sceKernelDelayThread(100);
+}
+
+/**
+ * @brief vitasdk_seqlock_read_begin - Start reading
+ * @param lock - The lock
+ * @return The sequence to pass to vitasdk_seqlock_read_retry
+ */
+static inline SceUInt32 vitasdk_seqlock_read_begin(const VitasdkSeqlock *lock)
+{
+	SceUInt32 seq, spin = 0;
+
+	while ((seq = vitasdk_atomic_load_acquire32(&lock->sequence)) & 1)
+		_vitasdk_seqlock_backoff(&spin);
+	return seq;
+}
+
+/**
+ * @brief vitasdk_seqlock_read_retry - Check whether a read saw a consistent state
+ * @param lock - The lock
+ * @param seq - The sequence returned by vitasdk_seqlock_read_begin
+ * @return SCE_TRUE if a writer ran during the read, which must be retried
+ */
+static inline SceBool vitasdk_seqlock_read_retry(const VitasdkSeqlock *lock, SceUInt32 seq)
+{
+	vitasdk_atomic_fence_acquire();
+	return vitasdk_atomic_load32(&lock->sequence) != seq;
+}
+
+/**
+ * @brief vitasdk_seqlock_write_begin - Start writing
+ * @param lock - The lock
+ */
+static inline void vitasdk_seqlock_write_begin(VitasdkSeqlock *lock)
+{
+	SceUInt32 seq, spin = 0;
+
+	for (;;) {
+		seq = vitasdk_atomic_load32(&lock->sequence);
+		if ((seq & 1) == 0 && vitasdk_atomic_cas32(&lock->sequence, seq, seq + 1))
+			break;
+		_vitasdk_seqlock_backoff(&spin);
+	}
+	/* Readers see the odd sequence before any update of the data */
+	vitasdk_atomic_fence_release();
+}
+
+/**
+ * @brief vitasdk_seqlock_write_end - Publish the writes
+ * @param lock - The lock
+ */
+static inline void vitasdk_seqlock_write_end(VitasdkSeqlock *lock)
+{
+	vitasdk_atomic_store_release32(&lock->sequence, lock->sequence + 1);
+}
+
+/**
+ * @brief vitasdk_seqlock_read - Copy consistent data
+ * @param lock - The lock
+ * @param dst - The copy
+ * @param src - The data guarded by the lock
+ * @param size - The size of the data
+ */
+static inline void vitasdk_seqlock_read(const VitasdkSeqlock *lock, void *dst, const void *src, SceSize size)
+{
+	SceUInt32 seq;
+
+	do {
+		seq = vitasdk_seqlock_read_begin(lock);
+		__builtin_memcpy(dst, src, size);
+	} while (vitasdk_seqlock_read_retry(lock, seq));
+}
+
+/**
+ * @brief vitasdk_seqlock_write - Replace the data
+ * @param lock - The lock
+ * @param dst - The data guarded by the lock
+ * @param src - The new data
+ * @param size - The size of the data
+ */
+static inline void vitasdk_seqlock_write(VitasdkSeqlock *lock, void *dst, const void *src, SceSize size)
+{
+	vitasdk_seqlock_write_begin(lock);
+	__builtin_memcpy(dst, src, size);
+	vitasdk_seqlock_write_end(lock);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+namespace vitasdk {
+
+/** Holds a seqlock for writing until the end of the scope */
+class SeqlockWriteGuard {
+public:
+	explicit SeqlockWriteGuard(VitasdkSeqlock &lock) : lock_(lock)
+	{
+		vitasdk_seqlock_write_begin(&lock_);
+	}
+
+	~SeqlockWriteGuard()
+	{
+		vitasdk_seqlock_write_end(&lock_);
+	}
+
+	SeqlockWriteGuard(const SeqlockWriteGuard &) = delete;
+	SeqlockWriteGuard &operator=(const SeqlockWriteGuard &) = delete;
+
+private:
+	VitasdkSeqlock &lock_;
+};
+
+/** A value guarded by its own seqlock, loads return a consistent copy */
+template <typename T>
+class Seqlocked {
+	static_assert(__is_trivially_copyable(T), "Seqlocked values are copied while written");
+
+public:
+	Seqlocked() : value_()
+	{
+		vitasdk_seqlock_init(&lock_);
+	}
+
+	explicit Seqlocked(const T &value) : value_(value)
+	{
+		vitasdk_seqlock_init(&lock_);
+	}
+
+	T load() const
+	{
+		T value;
+		vitasdk_seqlock_read(&lock_, &value, &value_, sizeof(T));
+		return value;
+	}
+
+	void store(const T &value)
+	{
+		vitasdk_seqlock_write(&lock_, &value_, &value, sizeof(T));
+	}
+
+	/** Update the value in place with `func(T &)` */
+	template <typename F>
+	void update(F func)
+	{
+		SeqlockWriteGuard guard(lock_);
+		func(value_);
+	}
+
+private:
+	VitasdkSeqlock lock_;
+	T value_;
+};
+
+} // namespace vitasdk
+#endif
+
+#endif /* _VITASDK_SEQLOCK_H_ */
@@ -0,0 +1,357 @@
+#ifndef _VITASDK_TCACHE_H_
+#define _VITASDK_TCACHE_H_
+
+/*
+ * Thread-cached small-object allocator over a SceClibMspace.
+ *
+ * Every thread keeps a free list per size class in a TLS slot, so most
+ * allocations and frees touch neither the mspace nor its lock. A thread
+ * refills an empty list with a batch of objects and hands a batch back once
+ * its list grows too long. Batches go through a lock-free central ring per
+ * class, the mspace is only used when that ring is empty or full.
+ *
+ * Allocations larger than VITASDK_TCACHE_MAX_SIZE go straight to the
+ * mspace. Objects freed to the caches stay allocated in the mspace, see
+ * vitasdk_tcache_get_stats and vitasdk_tcache_trim.
+ */
+
+#include <psp2/types.h>
+#include <psp2/kernel/clib.h>
+#include <psp2/kernel/threadmgr/thread.h>
+#include <vitasdk/atomic.h>
+#include <vitasdk/ring.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#define VITASDK_TCACHE_CLASS_SIZE (16)
+#define VITASDK_TCACHE_CLASSES    (16)
+/** Largest size served by the caches */
+#define VITASDK_TCACHE_MAX_SIZE   (VITASDK_TCACHE_CLASS_SIZE * VITASDK_TCACHE_CLASSES)
+/** Objects moved at once between a thread and the central rings */
+#define VITASDK_TCACHE_BATCH      (32)
+/** Batches held by the central ring of each class, a power of two */
+#define VITASDK_TCACHE_CENTRAL    (64)
+/** Threads which can have a cache, the others use the mspace directly */
+#define VITASDK_TCACHE_MAX_THREADS (32)
+
+typedef struct VitasdkTcacheBin {
+	void *head;
+	SceUInt32 count;
+} VitasdkTcacheBin;
+
+typedef struct VitasdkTcacheThread {
+	VitasdkTcacheBin bins[VITASDK_TCACHE_CLASSES];
+	volatile SceUInt32 bytes; //!< Held by the bins, only written by the owner
+} VitasdkTcacheThread;
+
+typedef struct VitasdkTcacheStats {
+	SceClibMspaceStats mspace;
+	SceSize thread_cached;  //!< Bytes held by the thread caches
+	SceSize central_cached; //!< Bytes held by the central rings
+	SceSize in_use;         //!< Bytes allocated by the application, mspace.current_in_use less the cached bytes
+} VitasdkTcacheStats;
+
+typedef struct VitasdkTcache {
+	VitasdkMpmcRing central[VITASDK_TCACHE_CLASSES];
+	VitasdkRingCell cells[VITASDK_TCACHE_CLASSES][VITASDK_TCACHE_CENTRAL];
+	VitasdkTcacheThread *threads[VITASDK_TCACHE_MAX_THREADS];
+	volatile SceUInt32 threads_used[VITASDK_TCACHE_MAX_THREADS];
+	volatile SceUInt32 central_bytes;
+	SceClibMspace mspace;
+	int tls_key;
+} VitasdkTcache;
+
+/**
+ * @brief vitasdk_tcache_init - Initialize a thread-cached allocator
+ * @param tc - The allocator
+ * @param mspace - The backing mspace
+ * @param tls_key - A TLS slot of sceKernelGetTLSAddr not used by anything else
+ */
+static inline void vitasdk_tcache_init(VitasdkTcache *tc, SceClibMspace mspace, int tls_key)
+{
+	SceUInt32 i;
+
+	for (i = 0; i < VITASDK_TCACHE_CLASSES; i++)
+		vitasdk_mpmc_ring_init(&tc->central[i], tc->cells[i], VITASDK_TCACHE_CENTRAL);
+	for (i = 0; i < VITASDK_TCACHE_MAX_THREADS; i++) {
+		tc->threads[i]      = NULL;
+		tc->threads_used[i] = 0;
+	}
+	tc->central_bytes = 0;
+	tc->mspace        = mspace;
+	tc->tls_key       = tls_key;
+}
+
+static inline SceSize _vitasdk_tcache_class_size(SceUInt32 cls)
+{
+	return (cls + 1) * VITASDK_TCACHE_CLASS_SIZE;
+}
+
+/* Claim a cache for the calling thread, NULL if every cache is taken */
+static inline VitasdkTcacheThread *_vitasdk_tcache_attach(VitasdkTcache *tc, VitasdkTcacheThread **tls)
+{
+	VitasdkTcacheThread *t;
+	SceUInt32 i, j;
+
+	for (i = 0; i < VITASDK_TCACHE_MAX_THREADS; i++) {
+		if (vitasdk_atomic_load32(&tc->threads_used[i]) == 0 && vitasdk_atomic_cas32(&tc->threads_used[i], 0, 1))
+			break;
+	}
+	if (i == VITASDK_TCACHE_MAX_THREADS)
+		return NULL;
+	vitasdk_atomic_fence_acquire();
+	/* The caches of the exited threads are kept for the next ones */
+	t = tc->threads[i];
+	if (!t) {
+		t = (VitasdkTcacheThread *)sceClibMspaceMalloc(tc->mspace, sizeof(*t));
+		if (!t) {
+			vitasdk_atomic_store_release32(&tc->threads_used[i], 0);
+			return NULL;
+		}
+		for (j = 0; j < VITASDK_TCACHE_CLASSES; j++) {
+			t->bins[j].head  = NULL;
+			t->bins[j].count = 0;
+		}
+		t->bytes = 0;
+		tc->threads[i] = t;
+	}
+	*tls = t;
+	return t;
+}
+
+static inline VitasdkTcacheThread *_vitasdk_tcache_thread(VitasdkTcache *tc)
+{
+	VitasdkTcacheThread **tls = (VitasdkTcacheThread **)sceKernelGetTLSAddr(tc->tls_key);
+
+	if (*tls)
+		return *tls;
+	return _vitasdk_tcache_attach(tc, tls);
+}
+
+/* Only the owner writes `bytes`, the statistics read it from any thread */
+static inline void _vitasdk_tcache_add_bytes(VitasdkTcacheThread *t, SceUInt32 delta)
+{
+	vitasdk_atomic_store_release32(&t->bytes, t->bytes + delta);
+}
+
+/* Refill an empty bin from the central ring, or from the mspace */
+static inline SceBool _vitasdk_tcache_refill(VitasdkTcache *tc, VitasdkTcacheThread *t, SceUInt32 cls)
+{
+	VitasdkTcacheBin *bin = &t->bins[cls];
+	SceSize size = _vitasdk_tcache_class_size(cls);
+	void *batch;
+
+	if (vitasdk_mpmc_ring_pop(&tc->central[cls], &batch)) {
+		vitasdk_atomic_add32(&tc->central_bytes, (SceUInt32)-(SceInt32)(size * VITASDK_TCACHE_BATCH));
+		bin->head  = batch;
+		bin->count = VITASDK_TCACHE_BATCH;
+	} else {
+		while (bin->count < VITASDK_TCACHE_BATCH) {
+			void *p = sceClibMspaceMalloc(tc->mspace, size);
+			if (!p)
+				break;
+			*(void **)p = bin->head;
+			bin->head = p;
+			bin->count++;
+		}
+	}
+	_vitasdk_tcache_add_bytes(t, bin->count * size);
+	return bin->count != 0;
+}
+
+/* Hand the first batch of a bin to the central ring, or back to the mspace */
+static inline void _vitasdk_tcache_release(VitasdkTcache *tc, VitasdkTcacheThread *t, SceUInt32 cls)
+{
+	VitasdkTcacheBin *bin = &t->bins[cls];
+	SceSize size = _vitasdk_tcache_class_size(cls);
+	void *batch = bin->head, *last = batch, *p;
+	SceUInt32 i;
+
+	for (i = 1; i < VITASDK_TCACHE_BATCH; i++)
+		last = *(void **)last;
+	bin->head = *(void **)last;
+	*(void **)last = NULL;
+	bin->count -= VITASDK_TCACHE_BATCH;
+	_vitasdk_tcache_add_bytes(t, (SceUInt32)-(SceInt32)(VITASDK_TCACHE_BATCH * size));
+
+	if (vitasdk_mpmc_ring_push(&tc->central[cls], batch)) {
+		vitasdk_atomic_add32(&tc->central_bytes, size * VITASDK_TCACHE_BATCH);
+		return;
+	}
+	while (batch) {
+		p = *(void **)batch;
+		sceClibMspaceFree(tc->mspace, batch);
+		batch = p;
+	}
+}
+
+/**
+ * @brief vitasdk_tcache_malloc - Allocate memory
+ * @param tc - The allocator
+ * @param size - The size to allocate
+ * @return The allocated memory, NULL if the mspace is full
+ */
+static inline void *vitasdk_tcache_malloc(VitasdkTcache *tc, SceSize size)
+{
+	SceUInt32 cls = size == 0 ? 0 : (size - 1) / VITASDK_TCACHE_CLASS_SIZE;
+	VitasdkTcacheThread *t;
+	VitasdkTcacheBin *bin;
+	void *p;
+
+	if (size > VITASDK_TCACHE_MAX_SIZE)
+		return sceClibMspaceMalloc(tc->mspace, size);
+	t = _vitasdk_tcache_thread(tc);
+	/* Still a whole class, it may be freed to a cache by another thread */
+	if (!t)
+		return sceClibMspaceMalloc(tc->mspace, _vitasdk_tcache_class_size(cls));
+	bin = &t->bins[cls];
+	if (!bin->head && !_vitasdk_tcache_refill(tc, t, cls))
+		return NULL;
+	p = bin->head;
+	bin->head = *(void **)p;
+	bin->count--;
+	_vitasdk_tcache_add_bytes(t, (SceUInt32)-(SceInt32)_vitasdk_tcache_class_size(cls));
+	return p;
+}
+
+static inline void _vitasdk_tcache_free_class(VitasdkTcache *tc, void *ptr, SceUInt32 cls)
+{
+	VitasdkTcacheThread *t = _vitasdk_tcache_thread(tc);
+	VitasdkTcacheBin *bin;
+
+	if (!t) {
+		sceClibMspaceFree(tc->mspace, ptr);
+		return;
+	}
+	bin = &t->bins[cls];
+	*(void **)ptr = bin->head;
+	bin->head = ptr;
+	bin->count++;
+	_vitasdk_tcache_add_bytes(t, _vitasdk_tcache_class_size(cls));
+	if (bin->count >= VITASDK_TCACHE_BATCH * 2)
+		_vitasdk_tcache_release(tc, t, cls);
+}
+
+/**
+ * @brief vitasdk_tcache_free - Free memory from vitasdk_tcache_malloc or the mspace
+ * @param tc - The allocator
+ * @param ptr - The memory, may be NULL
+ */
+static inline void vitasdk_tcache_free(VitasdkTcache *tc, void *ptr)
+{
+	SceSize usable;
+
+	if (!ptr)
+		return;
+	/* Cache the object in the largest class it can hold */
+	usable = sceClibMspaceMallocUsableSize(ptr);
+	if (usable < VITASDK_TCACHE_CLASS_SIZE || usable / VITASDK_TCACHE_CLASS_SIZE > VITASDK_TCACHE_CLASSES)
+		sceClibMspaceFree(tc->mspace, ptr);
+	else
+		_vitasdk_tcache_free_class(tc, ptr, usable / VITASDK_TCACHE_CLASS_SIZE - 1);
+}
+
+/**
+ * @brief vitasdk_tcache_free_sized - Free memory without looking its size up
+ * @param tc - The allocator
+ * @param ptr - The memory, may be NULL
+ * @param size - The size passed to vitasdk_tcache_malloc
+ */
+static inline void vitasdk_tcache_free_sized(VitasdkTcache *tc, void *ptr, SceSize size)
+{
+	if (!ptr)
+		return;
+	if (size > VITASDK_TCACHE_MAX_SIZE)
+		sceClibMspaceFree(tc->mspace, ptr);
+	else
+		_vitasdk_tcache_free_class(tc, ptr, size == 0 ? 0 : (size - 1) / VITASDK_TCACHE_CLASS_SIZE);
+}
+
+/**
+ * @brief vitasdk_tcache_thread_exit - Return the cache of the calling thread
+ *
+ * Must be called by every thread which used the allocator before it exits,
+ * its cache is reused by the next thread.
+ *
+ * @param tc - The allocator
+ */
+static inline void vitasdk_tcache_thread_exit(VitasdkTcache *tc)
+{
+	VitasdkTcacheThread **tls = (VitasdkTcacheThread **)sceKernelGetTLSAddr(tc->tls_key);
+	VitasdkTcacheThread *t = *tls;
+	SceUInt32 i;
+
+	if (!t)
+		return;
+	for (i = 0; i < VITASDK_TCACHE_CLASSES; i++) {
+		VitasdkTcacheBin *bin = &t->bins[i];
+		while (bin->count >= VITASDK_TCACHE_BATCH)
+			_vitasdk_tcache_release(tc, t, i);
+		while (bin->head) {
+			void *p = bin->head;
+			bin->head = *(void **)p;
+			sceClibMspaceFree(tc->mspace, p);
+		}
+		bin->count = 0;
+	}
+	t->bytes = 0;
+	*tls = NULL;
+	for (i = 0; i < VITASDK_TCACHE_MAX_THREADS; i++) {
+		if (tc->threads[i] == t)
+			vitasdk_atomic_store_release32(&tc->threads_used[i], 0);
+	}
+}
+
+/**
+ * @brief vitasdk_tcache_trim - Return the objects of the central rings to the mspace
+ * @param tc - The allocator
+ */
+static inline void vitasdk_tcache_trim(VitasdkTcache *tc)
+{
+	SceUInt32 i;
+	void *batch;
+
+	for (i = 0; i < VITASDK_TCACHE_CLASSES; i++) {
+		while (vitasdk_mpmc_ring_pop(&tc->central[i], &batch)) {
+			vitasdk_atomic_add32(&tc->central_bytes,
+			                     (SceUInt32)-(SceInt32)(_vitasdk_tcache_class_size(i) * VITASDK_TCACHE_BATCH));
+			while (batch) {
+				void *p = *(void **)batch;
+				sceClibMspaceFree(tc->mspace, batch);
+				batch = p;
+			}
+		}
+	}
+}
+
+/**
+ * @brief vitasdk_tcache_get_stats - Get the usage of the mspace and of the caches
+ *
+ * The cached bytes are class sizes, the mspace adds its own overhead to
+ * each object. The values of other threads are snapshots.
+ *
+ * @param tc - The allocator
+ * @param stats - Receives the stats
+ */
+static inline void vitasdk_tcache_get_stats(VitasdkTcache *tc, VitasdkTcacheStats *stats)
+{
+	SceSize cached;
+	SceUInt32 i;
+
+	sceClibMspaceMallocStatsFast(tc->mspace, &stats->mspace);
+	stats->thread_cached = 0;
+	for (i = 0; i < VITASDK_TCACHE_MAX_THREADS; i++) {
+		if (vitasdk_atomic_load_acquire32(&tc->threads_used[i]) && tc->threads[i])
+			stats->thread_cached += vitasdk_atomic_load32(&tc->threads[i]->bytes);
+	}
+	stats->central_cached = vitasdk_atomic_load32(&tc->central_bytes);
+	cached = stats->thread_cached + stats->central_cached;
+	stats->in_use = stats->mspace.current_in_use > cached ? stats->mspace.current_in_use - cached : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_TCACHE_H_ */
@@ -0,0 +1,11 @@
+#ifndef _VITASDK_THREADING_H_
+#define _VITASDK_THREADING_H_
+
+/* Threads, synchronization, atomics and fibers, a lighter alternative to vitasdk.h */
+
+#include <psp2/types.h>
+#include <psp2/fiber.h>
+#include <psp2/kernel/cpu.h>
+#include <psp2/kernel/threadmgr.h>
+
+#endif /* _VITASDK_THREADING_H_ */
@@ -0,0 +1,357 @@
+#ifndef _VITASDK_THREADPOOL_H_
+#define _VITASDK_THREADPOOL_H_
+
+/*
+ * Thread pool with one worker pinned to each usable core.
+ *
+ * The pool tries every core of the requested mask and keeps the ones the
+ * process may run threads on, the calling thread takes part in each
+ * parallel-for as well:
+ *
+ *   static void scale(void *arg, SceUInt32 begin, SceUInt32 end)
+ *   {
+ *       float *v = arg;
+ *       for (; begin < end; begin++)
+ *           v[begin] *= 2.0f;
+ *   }
+ *
+ *   vitasdk_thread_pool_parallel_for(&pool, 0, count, 0, scale, values);
+ *
+ * The workers spend their time between two parallel-fors waiting on a
+ * semaphore. A pool runs one parallel-for at a time and must not be used
+ * from its own workers.
+ */
+
+#include <psp2/types.h>
+#include <psp2/kernel/cpu.h>
+#include <psp2/kernel/error.h>
+#include <psp2/kernel/processmgr.h>
+#include <psp2/kernel/threadmgr/thread.h>
+#include <psp2/kernel/threadmgr/semaphore.h>
+#include <vitasdk/atomic.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * User cores 0-2, and the system core when the mask has
+ * SCE_KERNEL_CPU_MASK_SYSTEM: an application may be granted a share of it,
+ * without that grant the pool skips it like any core the process may not use
+ */
+#define VITASDK_THREAD_POOL_MAX_WORKERS (4)
+
+/* Chunks per worker of a parallel-for without a chunk size */
+#define _VITASDK_THREAD_POOL_CHUNKS_PER_WORKER (4)
+
+/** Priority bands of vitasdk_thread_pool_set_band */
+typedef enum VitasdkThreadPoolBand {
+	VITASDK_THREAD_POOL_BAND_HIGH   = 0,
+	VITASDK_THREAD_POOL_BAND_NORMAL = 1,
+	VITASDK_THREAD_POOL_BAND_LOW    = 2,
+	VITASDK_THREAD_POOL_BANDS       = 3
+} VitasdkThreadPoolBand;
+
+typedef void (*VitasdkParallelForFunc)(void *arg, SceUInt32 begin, SceUInt32 end);
+
+typedef struct VitasdkThreadPoolParam {
+	int core_mask;                                //!< Cores to try, e.g. SCE_KERNEL_CPU_MASK_USER_ALL
+	int priorities[VITASDK_THREAD_POOL_BANDS];    //!< Priority of each band
+	VitasdkThreadPoolBand band;                   //!< Initial band
+	SceSize stack_size;
+} VitasdkThreadPoolParam;
+
+typedef struct VitasdkThreadPoolWorker {
+	SceUID thid;
+	int core_mask;
+	/* Statistics, only written by the worker */
+	volatile SceUInt32 chunks;   //!< Chunks run
+	volatile SceUInt32 busy_ms;  //!< Time spent running chunks, read by any thread
+	SceUInt64 busy_us;           //!< Same in us, private to the worker
+} VitasdkThreadPoolWorker;
+
+typedef struct VitasdkThreadPool {
+	VitasdkThreadPoolWorker workers[VITASDK_THREAD_POOL_MAX_WORKERS];
+	SceUInt32 worker_count;
+	int core_mask;                //!< Cores with a worker
+	VitasdkThreadPoolParam param;
+	SceUID work_sema;
+	SceUID done_sema;
+	volatile SceUInt32 quit;
+	SceUInt64 stats_start;
+	/* The running parallel-for */
+	VitasdkParallelForFunc func;
+	void *arg;
+	SceUInt32 end;
+	SceUInt32 chunk;
+	volatile SceUInt32 next VITASDK_CACHE_ALIGNED;
+} VitasdkThreadPool;
+
+static inline void vitasdk_thread_pool_param_init(VitasdkThreadPoolParam *param)
+{
+	param->core_mask  = SCE_KERNEL_CPU_MASK_USER_ALL;
+	param->priorities[VITASDK_THREAD_POOL_BAND_HIGH]   = 0x10000100 - 32;
+	param->priorities[VITASDK_THREAD_POOL_BAND_NORMAL] = 0x10000100;
+	param->priorities[VITASDK_THREAD_POOL_BAND_LOW]    = 0x10000100 + 32;
+	param->band       = VITASDK_THREAD_POOL_BAND_NORMAL;
+	param->stack_size = 0x4000;
+}
+
+/* Run chunks of the current parallel-for until none is left */
+static inline void _vitasdk_thread_pool_run(VitasdkThreadPool *pool, VitasdkThreadPoolWorker *worker)
+{
+	SceUInt64 start = worker ? sceKernelGetProcessTimeWide() : 0;
+	SceUInt32 begin, chunks = 0;
+
+	for (;;) {
+		begin = vitasdk_atomic_add32(&pool->next, pool->chunk) - pool->chunk;
+		if (begin >= pool->end)
+			break;
+		pool->func(pool->arg, begin, pool->end - begin < pool->chunk ? pool->end : begin + pool->chunk);
+		chunks++;
+	}
+	/* A 64-bit store is not atomic, the other threads read the 32-bit copies */
+	if (worker) {
+		worker->busy_us += sceKernelGetProcessTimeWide() - start;
+		vitasdk_atomic_store_release32(&worker->chunks, worker->chunks + chunks);
+		vitasdk_atomic_store_release32(&worker->busy_ms, (SceUInt32)(worker->busy_us / 1000));
+	}
+}
+
+static inline int _vitasdk_thread_pool_entry(SceSize args, void *argp)
+{
+	VitasdkThreadPool *pool = *(VitasdkThreadPool **)argp;
+	VitasdkThreadPoolWorker *worker = NULL;
+	SceUID thid = sceKernelGetThreadId();
+	SceUInt32 i;
+
+	(void)args;
+	for (;;) {
+		if (sceKernelWaitSema(pool->work_sema, 1, NULL) < 0)
+			break;
+		if (vitasdk_atomic_load_acquire32(&pool->quit))
+			break;
+		/* The workers only exist once the pool is created */
+		if (!worker) {
+			for (i = 0; i < pool->worker_count; i++) {
+				if (pool->workers[i].thid == thid)
+					worker = &pool->workers[i];
+			}
+		}
+		_vitasdk_thread_pool_run(pool, worker);
+		sceKernelSignalSema(pool->done_sema, 1);
+	}
+	return 0;
+}
+
+/**
+ * @brief vitasdk_thread_pool_destroy - Stop the workers and free a pool
+ * @param pool - The pool
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_thread_pool_destroy(VitasdkThreadPool *pool)
+{
+	SceUInt32 i;
+
+	vitasdk_atomic_store_release32(&pool->quit, 1);
+	if (pool->worker_count != 0)
+		sceKernelSignalSema(pool->work_sema, pool->worker_count);
+	for (i = 0; i < pool->worker_count; i++) {
+		sceKernelWaitThreadEnd(pool->workers[i].thid, NULL, NULL);
+		sceKernelDeleteThread(pool->workers[i].thid);
+	}
+	pool->worker_count = 0;
+	if (pool->work_sema >= 0)
+		sceKernelDeleteSema(pool->work_sema);
+	if (pool->done_sema >= 0)
+		sceKernelDeleteSema(pool->done_sema);
+	pool->work_sema = -1;
+	pool->done_sema = -1;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_thread_pool_create - Create a pool with one worker per usable core
+ *
+ * A core of the mask on which the process may not run threads is skipped,
+ * `pool->core_mask` holds the cores which got a worker.
+ *
+ * @param pool - The pool
+ * @param param - The parameters, NULL for the defaults of vitasdk_thread_pool_param_init
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_thread_pool_create(VitasdkThreadPool *pool, const VitasdkThreadPoolParam *param)
+{
+	SceUInt32 i;
+	int res;
+
+	if (param)
+		pool->param = *param;
+	else
+		vitasdk_thread_pool_param_init(&pool->param);
+	pool->worker_count = 0;
+	pool->core_mask    = 0;
+	pool->quit         = 0;
+	pool->end          = 0;
+	pool->chunk        = 1;
+	pool->next         = 0;
+	pool->done_sema    = -1;
+	pool->work_sema    = sceKernelCreateSema("VitasdkPoolWork", SCE_KERNEL_ATTR_THREAD_FIFO, 0, VITASDK_THREAD_POOL_MAX_WORKERS, NULL);
+	if (pool->work_sema < 0)
+		return pool->work_sema;
+	pool->done_sema = sceKernelCreateSema("VitasdkPoolDone", SCE_KERNEL_ATTR_THREAD_FIFO, 0, VITASDK_THREAD_POOL_MAX_WORKERS, NULL);
+	if (pool->done_sema < 0) {
+		res = pool->done_sema;
+		goto error;
+	}
+
+	for (i = 0; i < VITASDK_THREAD_POOL_MAX_WORKERS; i++) {
+		int mask = SCE_KERNEL_CPU_MASK_USER_0 << i;
+		VitasdkThreadPoolWorker *worker = &pool->workers[pool->worker_count];
+		SceUID thid;
+
+		if ((pool->param.core_mask & mask) == 0)
+			continue;
+		thid = sceKernelCreateThread("VitasdkPoolWorker", _vitasdk_thread_pool_entry,
+		                             pool->param.priorities[pool->param.band], pool->param.stack_size, 0, mask, NULL);
+		/* Not a core of this process */
+		if (thid == (SceUID)SCE_KERNEL_ERROR_ILLEGAL_CPU_AFFINITY_MASK || thid == (SceUID)SCE_KERNEL_ERROR_INVALID_CPU_AFFINITY)
+			continue;
+		if (thid < 0) {
+			res = thid;
+			goto error;
+		}
+		res = sceKernelStartThread(thid, sizeof(pool), &pool);
+		if (res < 0) {
+			sceKernelDeleteThread(thid);
+			goto error;
+		}
+		worker->thid      = thid;
+		worker->core_mask = mask;
+		worker->chunks    = 0;
+		worker->busy_ms   = 0;
+		worker->busy_us   = 0;
+		pool->worker_count++;
+		pool->core_mask |= mask;
+	}
+	if (pool->worker_count == 0) {
+		res = (int)SCE_KERNEL_ERROR_ILLEGAL_CPU_AFFINITY_MASK;
+		goto error;
+	}
+	pool->stats_start = sceKernelGetProcessTimeWide();
+	return 0;
+
+error:
+	vitasdk_thread_pool_destroy(pool);
+	return res;
+}
+
+/**
+ * @brief vitasdk_thread_pool_set_band - Move every worker to a priority band
+ * @param pool - The pool
+ * @param band - The band
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_thread_pool_set_band(VitasdkThreadPool *pool, VitasdkThreadPoolBand band)
+{
+	SceUInt32 i;
+	int res;
+
+	if ((SceUInt32)band >= VITASDK_THREAD_POOL_BANDS)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	for (i = 0; i < pool->worker_count; i++) {
+		res = sceKernelChangeThreadPriority(pool->workers[i].thid, pool->param.priorities[band]);
+		if (res < 0)
+			return res;
+	}
+	pool->param.band = band;
+	return 0;
+}
+
+/**
+ * @brief vitasdk_thread_pool_parallel_for - Run a function over a range in chunks
+ *
+ * Returns once every chunk ran, the calling thread runs chunks as well.
+ *
+ * @param pool - The pool
+ * @param begin - The first index
+ * @param end - The index after the last one
+ * @param chunk - The number of indices per call, 0 to split the range evenly
+ * @param func - The function, called with ranges of at most `chunk` indices
+ * @param arg - Passed to `func`
+ * @return 0 on success, < 0 on error.
+ */
+static inline int vitasdk_thread_pool_parallel_for(VitasdkThreadPool *pool, SceUInt32 begin, SceUInt32 end, SceUInt32 chunk,
+                                                   VitasdkParallelForFunc func, void *arg)
+{
+	SceUInt32 workers, chunks;
+	int res;
+
+	if (begin >= end)
+		return 0;
+	if (chunk == 0) {
+		chunk = (end - begin) / ((pool->worker_count + 1) * _VITASDK_THREAD_POOL_CHUNKS_PER_WORKER);
+		if (chunk == 0)
+			chunk = 1;
+	}
+	if (chunk > end - begin)
+		chunk = end - begin;
+	/* Each thread moves `next` at most one chunk past the end */
+	if ((SceUInt64)end + (SceUInt64)chunk * (VITASDK_THREAD_POOL_MAX_WORKERS + 1) > 0xFFFFFFFF)
+		return (int)SCE_KERNEL_ERROR_INVALID_ARGUMENT;
+	pool->func  = func;
+	pool->arg   = arg;
+	pool->end   = end;
+	pool->chunk = chunk;
+	vitasdk_atomic_store_release32(&pool->next, begin);
+
+	/* Only wake the workers which can get a chunk, the caller runs one as well */
+	chunks  = (end - begin + chunk - 1) / chunk;
+	workers = chunks - 1 < pool->worker_count ? chunks - 1 : pool->worker_count;
+	if (workers != 0) {
+		res = sceKernelSignalSema(pool->work_sema, workers);
+		if (res < 0)
+			return res;
+	}
+	_vitasdk_thread_pool_run(pool, NULL);
+	if (workers != 0) {
+		res = sceKernelWaitSema(pool->done_sema, workers, NULL);
+		if (res < 0)
+			return res;
+	}
+	vitasdk_atomic_fence_acquire();
+	return 0;
+}
+
+/**
+ * @brief vitasdk_thread_pool_utilization - Get the share of time a worker spent running chunks
+ * @param pool - The pool
+ * @param worker - The index of the worker
+ * @return The busy time in 1/1000 of the time since the creation or vitasdk_thread_pool_reset_stats
+ */
+static inline SceUInt32 vitasdk_thread_pool_utilization(const VitasdkThreadPool *pool, SceUInt32 worker)
+{
+	SceUInt64 elapsed = sceKernelGetProcessTimeWide() - pool->stats_start;
+
+	if (worker >= pool->worker_count || elapsed == 0)
+		return 0;
+	return (SceUInt32)((SceUInt64)vitasdk_atomic_load32(&pool->workers[worker].busy_ms) * 1000000 / elapsed);
+}
+
+/** Reset the statistics of the workers, between two parallel-fors */
+static inline void vitasdk_thread_pool_reset_stats(VitasdkThreadPool *pool)
+{
+	SceUInt32 i;
+
+	for (i = 0; i < pool->worker_count; i++) {
+		pool->workers[i].chunks  = 0;
+		pool->workers[i].busy_ms = 0;
+		pool->workers[i].busy_us = 0;
+	}
+	pool->stats_start = sceKernelGetProcessTimeWide();
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _VITASDK_THREADPOOL_H_ */
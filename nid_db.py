@@ -0,0 +1,75 @@
+import os
+import glob
+
+
+CURR_DIR = os.path.dirname(os.path.realpath(__file__))
+DB_DIR = os.path.join(CURR_DIR, 'db')
+
+# The db files only use block mappings of scalars, so a small indentation
+# based reader is enough and is much faster than a full yaml parser.
+def _scalar(v):
+    if v == 'true':
+        return True
+    if v == 'false':
+        return False
+    if v.startswith('0x'):
+        return int(v, 16)
+    if v.isdigit():
+        return int(v)
+    return v
+
+def parse_yml(path):
+    root = dict()
+    stack = [(-1, root)]
+    with open(path, 'r') as f:
+        for line_no, line in enumerate(f):
+            stripped = line.strip()
+            if not stripped or stripped[0] == '#':
+                continue
+            indent = len(line) - len(line.lstrip(' '))
+            k, sep, v = stripped.partition(':')
+            if not sep:
+                raise ValueError('%s:%d: expected `key: value`' %
+                                 (path, line_no + 1))
+            v = v.split(' #')[0].strip()
+            while indent <= stack[-1][0]:
+                stack.pop()
+            parent = stack[-1][1]
+            if v:
+                parent[k] = _scalar(v)
+            else:
+                parent[k] = dict()
+                stack.append((indent, parent[k]))
+    return root
+
+def firmware_version(fw):
+    """Convert a `3.60` style firmware string to a PSP2_SDK_VERSION value."""
+    major, _, minor = str(fw).partition('.')
+    return (int(major, 16) << 24) | (int(minor.ljust(3, '0')[:3], 16) << 12)
+
+def db_versions(db_dir=DB_DIR):
+    return sorted(d for d in os.listdir(db_dir)
+                  if os.path.isdir(os.path.join(db_dir, d)))
+
+def load_dir(ver_dir):
+    """Return {yml file name: parsed yml} for one `db/<fw>` directory."""
+    return dict((os.path.basename(fn), parse_yml(fn))
+                for fn in sorted(glob.glob(os.path.join(ver_dir, '*.yml'))))
+
+def iter_libraries(files):
+    """Yield (file, module, module nid, library, library dict) tuples."""
+    for fn, yml in sorted(files.items()):
+        for mod_name, mod in sorted(yml.get('modules', dict()).items()):
+            for lib_name, lib in sorted(mod.get('libraries', dict()).items()):
+                yield fn, mod_name, mod.get('nid'), lib_name, lib
+
+def load_db(db_dir=DB_DIR, versions=None):
+    """Return {fw dir name: {yml file name: parsed yml}}."""
+    return dict((ver, load_dir(os.path.join(db_dir, ver)))
+                for ver in (versions or db_versions(db_dir)))
+
+def dir_firmware(files):
+    """Return the `firmware` string shared by the files of a `db/<fw>` dir."""
+    for yml in files.values():
+        return str(yml.get('firmware'))
+    return None
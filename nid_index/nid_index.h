@@ -0,0 +1,225 @@
+/*
+ * Reader for the binary NID index generated by nid_index.py.
+ *
+ * The index is meant to be mapped read-only as is, every lookup is a binary
+ * search over the sorted tables and nothing is allocated.
+ */
+
+#ifndef _NID_INDEX_H_
+#define _NID_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NID_INDEX_MAGIC   (0x44494E56) /* 'VNID' */
+#define NID_INDEX_VERSION (1)
+
+#define NID_INDEX_NONE    (0xFFFFFFFF)
+
+#define NID_INDEX_LIB_FLAG_KERNEL      (1 << 0)
+#define NID_INDEX_ENTRY_FLAG_VARIABLE  (1 << 0)
+
+typedef struct NidIndexHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t n_firmwares;
+	uint32_t n_libraries;
+	uint32_t n_entries;
+	uint32_t off_firmwares;
+	uint32_t off_libraries;
+	uint32_t off_entries;
+	uint32_t off_by_nid;    //!< Entry indices sorted by NID
+	uint32_t off_by_name;   //!< Entry indices sorted by name
+	uint32_t off_strings;
+	uint32_t strings_size;
+} NidIndexHeader;
+
+typedef struct NidIndexFirmware {
+	uint32_t version;       //!< Same encoding as PSP2_SDK_VERSION
+	uint32_t name;          //!< String offset, e.g. "3.60"
+} NidIndexFirmware;
+
+typedef struct NidIndexLibrary {
+	uint32_t name;          //!< String offset
+	uint32_t module_name;   //!< String offset
+	uint32_t nid;
+	uint32_t module_nid;
+	uint32_t stubname;      //!< String offset or NID_INDEX_NONE
+	uint32_t first_entry;   //!< The library entries are contiguous
+	uint32_t n_entries;
+	uint16_t firmware;      //!< Index into the firmware table
+	uint16_t flags;         //!< NID_INDEX_LIB_FLAG_*
+} NidIndexLibrary;
+
+typedef struct NidIndexEntry {
+	uint32_t nid;
+	uint32_t name;          //!< String offset
+	uint32_t library;       //!< Index into the library table
+	uint16_t flags;         //!< NID_INDEX_ENTRY_FLAG_*
+	uint16_t firmware;      //!< Index into the firmware table
+} NidIndexEntry;
+
+typedef struct NidIndex {
+	const NidIndexHeader   *header;
+	const NidIndexFirmware *firmwares;
+	const NidIndexLibrary  *libraries;
+	const NidIndexEntry    *entries;
+	const uint32_t         *by_nid;
+	const uint32_t         *by_name;
+	const char             *strings;
+} NidIndex;
+
+/**
+ * Attach a reader to an index image
+ *
+ * @param[out] index - The reader to initialize
+ * @param[in]  data  - The index image, 4 bytes aligned (e.g. mmap-ed)
+ * @param[in]  size  - The size of the image
+ *
+ * @return 0 on success, < 0 if the image is not a valid index
+ */
+static inline int nid_index_open(NidIndex *index, const void *data, size_t size)
+{
+	const NidIndexHeader *h = (const NidIndexHeader *)data;
+	const char *base = (const char *)data;
+
+	if (size < sizeof(*h) || h->magic != NID_INDEX_MAGIC || h->version != NID_INDEX_VERSION)
+		return -1;
+	if ((size_t)h->off_strings + h->strings_size > size
+	 || (size_t)h->off_by_name + h->n_entries * sizeof(uint32_t) > size
+	 || (size_t)h->off_by_nid + h->n_entries * sizeof(uint32_t) > size
+	 || (size_t)h->off_entries + h->n_entries * sizeof(NidIndexEntry) > size
+	 || (size_t)h->off_libraries + h->n_libraries * sizeof(NidIndexLibrary) > size
+	 || (size_t)h->off_firmwares + h->n_firmwares * sizeof(NidIndexFirmware) > size)
+		return -2;
+
+	index->header    = h;
+	index->firmwares = (const NidIndexFirmware *)(base + h->off_firmwares);
+	index->libraries = (const NidIndexLibrary *)(base + h->off_libraries);
+	index->entries   = (const NidIndexEntry *)(base + h->off_entries);
+	index->by_nid    = (const uint32_t *)(base + h->off_by_nid);
+	index->by_name   = (const uint32_t *)(base + h->off_by_name);
+	index->strings   = base + h->off_strings;
+	return 0;
+}
+
+static inline const char *nid_index_string(const NidIndex *index, uint32_t offset)
+{
+	if (offset == NID_INDEX_NONE)
+		return NULL;
+	return index->strings + offset;
+}
+
+static inline const NidIndexEntry *nid_index_entry(const NidIndex *index, uint32_t i)
+{
+	return &index->entries[i];
+}
+
+static inline const NidIndexLibrary *nid_index_entry_library(const NidIndex *index, const NidIndexEntry *entry)
+{
+	return &index->libraries[entry->library];
+}
+
+static inline const NidIndexFirmware *nid_index_entry_firmware(const NidIndex *index, const NidIndexEntry *entry)
+{
+	return &index->firmwares[entry->firmware];
+}
+
+/**
+ * Find every entry exporting a NID
+ *
+ * The same NID is commonly exported by several libraries (e.g. ForDriver and
+ * ForKernel variants) and firmwares, so a range is returned.
+ *
+ * @param[in]  index - The index
+ * @param[in]  nid   - The NID to look up
+ * @param[out] first - Position of the first match in the by_nid table
+ *
+ * @return The number of matching entries
+ */
+static inline uint32_t nid_index_find_nid(const NidIndex *index, uint32_t nid, uint32_t *first)
+{
+	uint32_t lo = 0, hi = index->header->n_entries, end;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (index->entries[index->by_nid[mid]].nid < nid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	end = lo;
+	while (end < index->header->n_entries && index->entries[index->by_nid[end]].nid == nid)
+		end++;
+
+	*first = lo;
+	return end - lo;
+}
+
+/**
+ * Find every entry with a name
+ *
+ * @param[in]  index - The index
+ * @param[in]  name  - The function or variable name
+ * @param[out] first - Position of the first match in the by_name table
+ *
+ * @return The number of matching entries
+ */
+static inline uint32_t nid_index_find_name(const NidIndex *index, const char *name, uint32_t *first)
+{
+	uint32_t lo = 0, hi = index->header->n_entries, end;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (strcmp(index->strings + index->entries[index->by_name[mid]].name, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	end = lo;
+	while (end < index->header->n_entries
+	    && strcmp(index->strings + index->entries[index->by_name[end]].name, name) == 0)
+		end++;
+
+	*first = lo;
+	return end - lo;
+}
+
+/**
+ * Resolve a NID imported from a given library
+ *
+ * @param[in] index       - The index
+ * @param[in] library_nid - The NID of the library the function is imported from
+ * @param[in] nid         - The function or variable NID
+ * @param[in] firmware    - PSP2_SDK_VERSION style firmware, 0 for any
+ *
+ * @return The entry, NULL if not found
+ */
+static inline const NidIndexEntry *nid_index_resolve(const NidIndex *index, uint32_t library_nid, uint32_t nid, uint32_t firmware)
+{
+	uint32_t first, count, i;
+	const NidIndexEntry *found = NULL;
+
+	count = nid_index_find_nid(index, nid, &first);
+	for (i = first; i < first + count; i++) {
+		const NidIndexEntry *entry = &index->entries[index->by_nid[i]];
+		if (index->libraries[entry->library].nid != library_nid)
+			continue;
+		/* Entries of the same NID are sorted by firmware, keep the newest one not after `firmware` */
+		if (firmware != 0 && index->firmwares[entry->firmware].version > firmware)
+			break;
+		found = entry;
+	}
+	return found;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NID_INDEX_H_ */
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+import os
+import sys
+import struct
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.realpath(__file__)), '..'))
+import nid_db
+
+# Keep in sync with nid_index.h
+MAGIC = 0x44494E56 # 'VNID'
+VERSION = 1
+HEADER = struct.Struct('<12I')
+FIRMWARE = struct.Struct('<II')
+LIBRARY = struct.Struct('<7IHH')
+ENTRY = struct.Struct('<3IHH')
+
+LIB_FLAG_KERNEL = 1 << 0
+ENTRY_FLAG_VARIABLE = 1 << 0
+
+class StringTable(object):
+    def __init__(self):
+        self.offsets = dict()
+        self.data = bytearray()
+
+    def add(self, s):
+        if s is None:
+            return 0xFFFFFFFF
+        off = self.offsets.get(s)
+        if off is None:
+            off = self.offsets[s] = len(self.data)
+            self.data += s.encode() + b'\0'
+        return off
+
+def align(data, n=4):
+    data += b'\0' * (-len(data) % n)
+
+def build_index(db):
+    strings = StringTable()
+    firmwares = []
+    libraries = []
+    entries = []
+    fws = dict((ver, nid_db.dir_firmware(files)) for ver, files in db.items())
+    for fw_idx, ver in enumerate(sorted(db, key=lambda v: nid_db.firmware_version(fws[v]))):
+        firmwares.append((nid_db.firmware_version(fws[ver]), strings.add(fws[ver])))
+        for fn, mod_name, mod_nid, lib_name, lib in nid_db.iter_libraries(db[ver]):
+            first = len(entries)
+            for section, flags in (('functions', 0), ('variables', ENTRY_FLAG_VARIABLE)):
+                for name, nid in sorted(lib.get(section, dict()).items()):
+                    entries.append((nid, name, len(libraries), flags, fw_idx))
+            libraries.append((strings.add(lib_name), strings.add(mod_name),
+                              lib.get('nid', 0), mod_nid or 0,
+                              strings.add(lib.get('stubname')),
+                              first, len(entries) - first, fw_idx,
+                              LIB_FLAG_KERNEL if lib.get('kernel') else 0))
+
+    by_nid = sorted(range(len(entries)),
+                    key=lambda i: (entries[i][0], entries[i][4], entries[i][2]))
+    by_name = sorted(range(len(entries)),
+                     key=lambda i: (entries[i][1].encode(), entries[i][4], entries[i][2]))
+
+    body = bytearray()
+    def section(items):
+        align(body)
+        off = HEADER.size + len(body)
+        for item in items:
+            body.extend(item)
+        return off
+
+    off_fw = section(FIRMWARE.pack(*fw) for fw in firmwares)
+    off_libs = section(LIBRARY.pack(*lib) for lib in libraries)
+    off_entries = section(ENTRY.pack(nid, strings.add(name), lib, flags, fw)
+                          for nid, name, lib, flags, fw in entries)
+    off_by_nid = section(struct.pack('<I', i) for i in by_nid)
+    off_by_name = section(struct.pack('<I', i) for i in by_name)
+    off_strings = section([strings.data])
+
+    header = HEADER.pack(MAGIC, VERSION, len(firmwares), len(libraries),
+                         len(entries), off_fw, off_libs, off_entries,
+                         off_by_nid, off_by_name, off_strings, len(strings.data))
+    return header + bytes(body)
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        sys.stderr.write('usage: %s <output> [db dir]\n' % sys.argv[0])
+        sys.exit(1)
+
+    db_dir = sys.argv[2] if len(sys.argv) >= 3 else nid_db.DB_DIR
+    data = build_index(nid_db.load_db(db_dir))
+    with open(sys.argv[1] + '.tmp', 'wb') as f:
+        f.write(data)
+    os.replace(sys.argv[1] + '.tmp', sys.argv[1])
@@ -0,0 +1,78 @@
+/*
+ * Resolve NIDs or names with the binary NID index.
+ *
+ * usage: nid_lookup <nids.bin> <0xNID | name>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nid_index.h"
+
+static void print_entry(const NidIndex *index, const NidIndexEntry *entry)
+{
+	const NidIndexLibrary *lib = nid_index_entry_library(index, entry);
+
+	printf("0x%08X %s %s/%s (0x%08X) %s%s\n",
+		entry->nid,
+		index->strings + entry->name,
+		index->strings + lib->module_name,
+		index->strings + lib->name,
+		lib->nid,
+		index->strings + nid_index_entry_firmware(index, entry)->name,
+		(lib->flags & NID_INDEX_LIB_FLAG_KERNEL) ? " kernel" : "");
+}
+
+int main(int argc, char *argv[])
+{
+	NidIndex index;
+	struct stat st;
+	void *data;
+	int fd, i, missing = 0;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <nids.bin> <0xNID | name>...\n", argv[0]);
+		return 1;
+	}
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED || nid_index_open(&index, data, st.st_size) < 0) {
+		fprintf(stderr, "%s: not a valid NID index\n", argv[1]);
+		return 1;
+	}
+
+	for (i = 2; i < argc; i++) {
+		uint32_t first, count, j;
+		const uint32_t *table;
+		char *end;
+		unsigned long nid = strtoul(argv[i], &end, 16);
+
+		if (argv[i][0] == '0' && (argv[i][1] == 'x' || argv[i][1] == 'X') && *end == '\0') {
+			count = nid_index_find_nid(&index, (uint32_t)nid, &first);
+			table = index.by_nid;
+		} else {
+			count = nid_index_find_name(&index, argv[i], &first);
+			table = index.by_name;
+		}
+
+		if (count == 0) {
+			printf("%s: not found\n", argv[i]);
+			missing++;
+		}
+		for (j = first; j < first + count; j++)
+			print_entry(&index, nid_index_entry(&index, table[j]));
+	}
+
+	munmap(data, st.st_size);
+	return missing ? 2 : 0;
+}
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Convert a vitasdk/profile.h dump to the Chrome trace event format.
+
+The output can be loaded in chrome://tracing or https://ui.perfetto.dev.
+Every scope becomes a complete ("X") event of its thread, with the PMU
+counts of the scope as arguments.
+"""
+import os
+import re
+import sys
+import json
+import struct
+
+INCLUDE_DIR = os.path.join(os.path.dirname(os.path.realpath(__file__)), 'include')
+
+# Layouts of vitasdk/profile.h, little-endian
+MAGIC = 0x46525056
+VERSION = 1
+PMU_COUNTERS = 2
+HEADER = struct.Struct('<4I%dI' % PMU_COUNTERS)
+RECORD = struct.Struct('<Ii2Q%dI32s' % PMU_COUNTERS)
+RECORD_SCOPE = 0
+RECORD_THREAD = 1
+
+PMU_EVENT_RULE = re.compile(r'^\s*SCE_PERF_ARM_PMON_(\w+)\s*=\s*(0x[0-9A-Fa-f]+)')
+
+def pmu_event_names(include_dir):
+    """Return {event code: name} from the ScePerfArmPmonEventCode of psp2/perf.h."""
+    names = dict()
+    try:
+        with open(os.path.join(include_dir, 'psp2', 'perf.h')) as f:
+            for line in f:
+                m = PMU_EVENT_RULE.match(line)
+                if m:
+                    names.setdefault(int(m.group(2), 16), m.group(1).lower())
+    except IOError:
+        pass
+    return names
+
+def read_dump(data):
+    """Return (header dict, [record dict]) of a dump."""
+    if len(data) < HEADER.size:
+        raise ValueError('truncated header')
+    fields = HEADER.unpack_from(data)
+    magic, version, frequency, pmu_count = fields[:4]
+    if magic != MAGIC:
+        raise ValueError('not a vitasdk profile dump')
+    if version != VERSION:
+        raise ValueError('unsupported version %d' % version)
+    header = {'frequency': frequency, 'pmu_events': list(fields[4:4 + pmu_count])}
+
+    records = []
+    offset = HEADER.size
+    while offset + RECORD.size <= len(data):
+        fields = RECORD.unpack_from(data, offset)
+        rtype, thid, begin, end = fields[:4]
+        counters = fields[4:4 + PMU_COUNTERS]
+        name = fields[-1].split(b'\0', 1)[0].decode('utf-8', 'replace')
+        records.append({'type': rtype, 'thid': thid, 'begin': begin, 'end': end,
+                        'counters': counters[:pmu_count], 'name': name})
+        offset += RECORD.size
+    if offset != len(data):
+        sys.stderr.write('warning: ignoring %d trailing bytes\n' % (len(data) - offset))
+    return header, records
+
+def to_trace(header, records, event_names, pid=0):
+    """Return the Chrome trace object of a dump."""
+    us = 1000000.0 / header['frequency']
+    counter_names = [event_names.get(code, '0x%02X' % code) for code in header['pmu_events']]
+    scopes = [r for r in records if r['type'] == RECORD_SCOPE]
+    origin = min(r['begin'] for r in scopes) if scopes else 0
+
+    events = []
+    named = set()
+    for r in records:
+        if r['type'] == RECORD_THREAD:
+            if r['thid'] not in named:
+                named.add(r['thid'])
+                events.append({'ph': 'M', 'name': 'thread_name', 'pid': pid, 'tid': r['thid'],
+                               'args': {'name': r['name']}})
+            continue
+        event = {'ph': 'X', 'name': r['name'], 'pid': pid, 'tid': r['thid'],
+                 'ts': (r['begin'] - origin) * us, 'dur': (r['end'] - r['begin']) * us}
+        if counter_names:
+            event['args'] = dict(zip(counter_names, r['counters']))
+        events.append(event)
+    return {'traceEvents': events, 'displayTimeUnit': 'ns'}
+
+if __name__ == '__main__':
+    import argparse
+
+    parser = argparse.ArgumentParser(description='Convert a vitasdk profile dump to Chrome trace JSON.')
+    parser.add_argument('dump', help='file written by vitasdk_profile_open/vitasdk_profile_dump')
+    parser.add_argument('-o', '--output', default='-', help='trace file, - for stdout')
+    parser.add_argument('--include', default=INCLUDE_DIR, help='headers to read the PMU event names from')
+    args = parser.parse_args()
+
+    with open(args.dump, 'rb') as f:
+        data = f.read()
+    try:
+        header, records = read_dump(data)
+    except ValueError as e:
+        sys.exit('%s: %s' % (args.dump, e))
+    trace = to_trace(header, records, pmu_event_names(args.include))
+
+    if args.output == '-':
+        json.dump(trace, sys.stdout)
+        sys.stdout.write('\n')
+    else:
+        with open(args.output, 'w') as f:
+            json.dump(trace, f)
@@ -0,0 +1,152 @@
+# Precompiled headers and header units for the vitasdk umbrella headers.
+#
+# Parsing vitasdk.h is a large share of the compile time of most sources,
+# these helpers let a target parse it once instead of once per source:
+#
+#   include("${VITASDK}/share/vita.header_pch.cmake")
+#
+#   vita_precompile_headers(game)                              # <vitasdk.h>
+#   vita_precompile_headers(driver KERNEL)                     # <vitasdkkern.h>
+#   vita_precompile_headers(renderer HEADERS psp2/gxm.h)       # leaf headers only
+#   vita_precompile_headers(tools REUSE_FROM game)             # share one pch
+#
+#   vita_header_units(game)                                    # C++20 / clang modules
+
+if(NOT __VITA_HEADER_PCH_INCLUDED)
+set(__VITA_HEADER_PCH_INCLUDED On)
+
+set(VITA_PCH_USER_HEADERS   vitasdk.h)
+set(VITA_PCH_KERNEL_HEADERS vitasdkkern.h)
+
+# The heaviest leaf headers, for targets which do not want the umbrellas
+set(VITA_PCH_USER_LEAF_HEADERS   psp2/gxm.h psp2/json.h)
+set(VITA_PCH_KERNEL_LEAF_HEADERS psp2kern/vfs.h)
+
+if(DEFINED VITASDK)
+  set(VITA_HEADERS_INCLUDE_DIR "${VITASDK}/arm-vita-eabi/include")
+elseif(DEFINED ENV{VITASDK})
+  set(VITA_HEADERS_INCLUDE_DIR "$ENV{VITASDK}/arm-vita-eabi/include")
+else()
+  # Used from a vita-headers checkout
+  set(VITA_HEADERS_INCLUDE_DIR "${CMAKE_CURRENT_LIST_DIR}/include")
+endif()
+
+##
+## vita_precompile_headers(<target> [KERNEL] [HEADERS <header>...] [REUSE_FROM <other target>])
+##
+## Precompile the vitasdk headers used by every source of <target>.
+##   KERNEL     - Use vitasdkkern.h instead of vitasdk.h
+##   HEADERS    - Precompile these headers instead of the umbrella one
+##   REUSE_FROM - Reuse the precompiled header of another target
+##                (it must be built with the same flags)
+##
+function(vita_precompile_headers target)
+  cmake_parse_arguments(ARG "KERNEL" "REUSE_FROM" "HEADERS" ${ARGN})
+
+  if(CMAKE_VERSION VERSION_LESS 3.16)
+    message(WARNING "vita_precompile_headers needs CMake 3.16 or later, ${target} is built without precompiled headers")
+    return()
+  endif()
+
+  if(ARG_REUSE_FROM)
+    target_precompile_headers(${target} REUSE_FROM ${ARG_REUSE_FROM})
+    return()
+  endif()
+
+  if(ARG_HEADERS)
+    set(headers ${ARG_HEADERS})
+  elseif(ARG_KERNEL)
+    set(headers ${VITA_PCH_KERNEL_HEADERS})
+  else()
+    set(headers ${VITA_PCH_USER_HEADERS})
+  endif()
+
+  set(pch_headers)
+  foreach(header ${headers})
+    list(APPEND pch_headers "<${header}>")
+  endforeach()
+  target_precompile_headers(${target} PRIVATE ${pch_headers})
+endfunction()
+
+##
+## vita_header_units(<target> [KERNEL] [HEADERS <header>...])
+##
+## Compile the vitasdk headers as modules instead of textually including them.
+##   clang - Experimental, it has not been built with the Vita toolchain.
+##           Uses the include/module.modulemap shipped with the headers,
+##           `#include <vitasdk.h>` is transparently turned into an import.
+##   g++   - Builds C++20 header units (g++ 11 or later), the C++ sources of
+##           <target> can then `import <vitasdk.h>;`.
+## Other compilers fall back to vita_precompile_headers.
+##
+function(vita_header_units target)
+  cmake_parse_arguments(ARG "KERNEL" "" "HEADERS" ${ARGN})
+
+  if(ARG_HEADERS)
+    set(headers ${ARG_HEADERS})
+  elseif(ARG_KERNEL)
+    set(headers ${VITA_PCH_KERNEL_HEADERS})
+  else()
+    set(headers ${VITA_PCH_USER_HEADERS})
+  endif()
+
+  if(CMAKE_C_COMPILER_ID MATCHES "Clang" OR CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+    message(STATUS "vita_header_units: clang modules are experimental for ${target}")
+    target_compile_options(${target} PRIVATE
+      -fmodules
+      "-fmodule-map-file=${VITA_HEADERS_INCLUDE_DIR}/module.modulemap"
+      "-fmodules-cache-path=${CMAKE_BINARY_DIR}/vita-module-cache"
+    )
+    return()
+  endif()
+
+  if(NOT CMAKE_CXX_COMPILER_ID STREQUAL "GNU" OR CMAKE_CXX_COMPILER_VERSION VERSION_LESS 11)
+    message(WARNING "${CMAKE_CXX_COMPILER_ID} ${CMAKE_CXX_COMPILER_VERSION} can not build header units, using precompiled headers for ${target}")
+    vita_precompile_headers(${target} HEADERS ${headers})
+    return()
+  endif()
+
+  # g++ looks the header units up in gcm.cache/ of the working directory,
+  # which is the binary directory of the target for the compile commands.
+  get_target_property(binary_dir ${target} BINARY_DIR)
+  get_target_property(compile_defs ${target} COMPILE_DEFINITIONS)
+  set(defs)
+  if(compile_defs)
+    foreach(def ${compile_defs})
+      list(APPEND defs "-D${def}")
+    endforeach()
+  endif()
+  separate_arguments(cxx_flags UNIX_COMMAND "${CMAKE_CXX_FLAGS}")
+
+  # The units must be built with the same dialect as the sources importing them
+  set_target_properties(${target} PROPERTIES CXX_STANDARD 20 CXX_STANDARD_REQUIRED On)
+  get_target_property(cxx_extensions ${target} CXX_EXTENSIONS)
+  if(cxx_extensions OR cxx_extensions STREQUAL "cxx_extensions-NOTFOUND")
+    set(cxx_std ${CMAKE_CXX20_EXTENSION_COMPILE_OPTION})
+  else()
+    set(cxx_std ${CMAKE_CXX20_STANDARD_COMPILE_OPTION})
+  endif()
+
+  set(units)
+  foreach(header ${headers})
+    string(MAKE_C_IDENTIFIER "${header}" unit_name)
+    set(stamp "${binary_dir}/vita-header-units/${unit_name}.stamp")
+    add_custom_command(
+      OUTPUT ${stamp}
+      COMMAND ${CMAKE_CXX_COMPILER} ${cxx_flags} ${defs} ${cxx_std} -fmodules-ts
+              "-I${VITA_HEADERS_INCLUDE_DIR}" -x c++-system-header ${header}
+      COMMAND ${CMAKE_COMMAND} -E make_directory ${binary_dir}/vita-header-units
+      COMMAND ${CMAKE_COMMAND} -E touch ${stamp}
+      WORKING_DIRECTORY ${binary_dir}
+      COMMENT "Building header unit <${header}>"
+      VERBATIM
+    )
+    list(APPEND units ${stamp})
+  endforeach()
+
+  add_custom_target(${target}_vita_header_units DEPENDS ${units})
+  add_dependencies(${target} ${target}_vita_header_units)
+  target_compile_options(${target} PRIVATE $<$<COMPILE_LANGUAGE:CXX>:-fmodules-ts>)
+endfunction()
+
+endif()